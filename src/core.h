@@ -85,12 +85,17 @@ namespace JSON {
             static const std::string dsp_both_unblocks("dsp_both_unblocks");
             static const std::string dsp_prod_timer("dsp_prod_timer");
             static const std::string dsp_prod_timer_unblocks("dsp_prod_timer_unblocks");
+            static const std::string dsp_timer_unblocks("dsp_timer_unblocks");
             static const std::string dsp_monitor("dsp_monitor");
             static const std::string dsp_never("dsp_never");
         }
 
         namespace Extras {
             static const std::string step("step");
+            // One of the names in WaitPolicy (promises/wait_policy.h)
+            static const std::string wait("wait");
+            // Consumer latency bound of the DSP step controller, in ns
+            static const std::string max_wait("max_wait");
         }
     }
 }
@@ -103,6 +108,7 @@ namespace JSON {
                 Synchronizers::dsp_both_unblocks, \
                 Synchronizers::dsp_prod_timer, \
                 Synchronizers::dsp_prod_timer_unblocks, \
+                Synchronizers::dsp_timer_unblocks, \
                 Synchronizers::dsp_monitor, \
                 Synchronizers::dsp_never
 
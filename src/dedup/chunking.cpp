@@ -0,0 +1,95 @@
+#include <limits.h>
+#include <stdint.h>
+
+#include "chunking.h"
+#include "rabin.h"
+
+//Levels of normalization: bits of the mask added before avg_size, and removed after it
+#define GEAR_NORMALIZATION 2
+
+//Random values of the bytes, from a fixed seed: the same data gives the same
+//chunks from one run to the next
+static uint64_t gear[256];
+
+static chunking_t current = { CHUNKING_RABIN, 0, 0, 0 };
+
+//splitmix64, to fill the table from a fixed seed
+static uint64_t next_random(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static uint64_t high_bits(int n) {
+  return n <= 0 ? 0 : ~0ULL << (64 - n);
+}
+
+const char *chunking_engine_name(chunking_engine_t engine) {
+  switch(engine) {
+    case CHUNKING_RABIN:
+      return "rabin";
+    case CHUNKING_GEAR:
+      return "gear";
+    default:
+      return "unknown";
+  }
+}
+
+int chunking_init(const chunking_t *chunking) {
+  uint64_t state = 0x6765617263646300ULL;
+  int i;
+
+  if(chunking->engine == CHUNKING_GEAR) {
+    const u32int avg = chunking->avg_size;
+    if(chunking->min_size < 64 || chunking->min_size >= avg || avg >= chunking->max_size ||
+       (avg & (avg - 1)) != 0 || chunking->max_size > INT_MAX) {
+      return -1;
+    }
+  } else if(chunking->engine != CHUNKING_RABIN) {
+    return -1;
+  }
+
+  for(i=0; i<256; i++) gear[i] = next_random(&state);
+
+  current = *chunking;
+  return 0;
+}
+
+const chunking_t *chunking_current() {
+  return &current;
+}
+
+int gearseg(const uchar *p, int n, const chunking_t *c) {
+  int normal = MIN((int)c->avg_size, n);
+  int end = MIN((int)c->max_size, n);
+  //Masks of the high bits of the hash before and after avg_size
+  int bits = __builtin_ctz(c->avg_size);
+  uint64_t mask_small = high_bits(bits + GEAR_NORMALIZATION);
+  uint64_t mask_large = high_bits(bits - GEAR_NORMALIZATION);
+  uint64_t h = 0;
+  int i;
+
+  //Skip the bytes no boundary can be found in
+  if(n <= (int)c->min_size)
+    return n;
+
+  for(i=c->min_size; i<normal; i++){
+    h = (h << 1) + gear[p[i]];
+    if((h & mask_small) == 0)
+      return i + 1;
+  }
+  for(; i<end; i++){
+    h = (h << 1) + gear[p[i]];
+    if((h & mask_large) == 0)
+      return i + 1;
+  }
+  return end;
+}
+
+int chunking_cut(uchar *p, int n, int winlen, u32int *rabintab, u32int *rabinwintab) {
+  if(current.engine == CHUNKING_GEAR)
+    return gearseg(p, n, &current);
+  return rabinseg_lanes(p, n, winlen, rabintab, rabinwintab);
+}
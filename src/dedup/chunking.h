@@ -0,0 +1,55 @@
+/* Content-defined chunking of the Refine stage.
+ *
+ * The Rabin engine is rabinseg_lanes, with the window and tables the caller
+ * gives it. The gear engine follows FastCDC: a 64 bits hash shifted by one bit
+ * and added a random value per byte, so that its high bits depend on the last
+ * 64 bytes. A boundary is where the high bits of the hash selected by a mask
+ * are all 0. No boundary is searched in the first min_size bytes of a chunk,
+ * and the chunk sizes are normalized around avg_size: the mask has two bits
+ * more than log2(avg_size) before avg_size, two bits less after it. A chunk is
+ * cut at max_size if no boundary was found.
+ *
+ * Archives cut with the gear engine record it and its sizes in their header,
+ * see write_header.
+ */
+
+#ifndef _CHUNKING_H_
+#define _CHUNKING_H_
+
+#include "dedupdef.h"
+
+typedef enum {
+  CHUNKING_RABIN = 0,  //rabinseg_lanes
+  CHUNKING_GEAR,       //gear hash with normalized chunk sizes
+} chunking_engine_t;
+
+typedef struct {
+  chunking_engine_t engine;
+  //Sizes of the chunks of the gear engine, unused by the Rabin one
+  u32int min_size;
+  u32int avg_size;     //a power of 2
+  u32int max_size;
+} chunking_t;
+
+const char *chunking_engine_name(chunking_engine_t engine);
+
+//Select the engine of chunking_cut. Returns 0 on success, -1 if the sizes of
+//the gear engine are not 64 <= min_size < avg_size < max_size < 2^31 with
+//avg_size a power of 2.
+int chunking_init(const chunking_t *chunking);
+
+//Engine and sizes selected by chunking_init
+const chunking_t *chunking_current();
+
+/*
+ * Offset of the first boundary of the n bytes at p with the gear engine, n if
+ * there is none and n < c->max_size. Same contract as rabinseg otherwise.
+ * chunking_init must have been called once, whatever the engine.
+ */
+int gearseg(const uchar *p, int n, const chunking_t *c);
+
+//Offset of the first boundary with the current engine, same arguments as
+//rabinseg_lanes, which is called with the Rabin engine
+int chunking_cut(uchar *p, int n, int winlen, u32int *rabintab, u32int *rabinwintab);
+
+#endif //_CHUNKING_H_
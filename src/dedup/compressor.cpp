@@ -0,0 +1,418 @@
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dedupdef.h"
+#include "compressor.h"
+
+#ifdef ENABLE_GZIP_COMPRESSION
+#include <zlib.h>
+#endif //ENABLE_GZIP_COMPRESSION
+
+#ifdef ENABLE_BZIP2_COMPRESSION
+#include <bzlib.h>
+#endif //ENABLE_BZIP2_COMPRESSION
+
+#ifdef ENABLE_ZSTD_COMPRESSION
+#include <zstd.h>
+#endif //ENABLE_ZSTD_COMPRESSION
+
+#ifdef ENABLE_LZ4_COMPRESSION
+#include <lz4.h>
+#include <lz4hc.h>
+#endif //ENABLE_LZ4_COMPRESSION
+
+//Size of the uncompressed data stored in front of the lz4 blocks
+#define LZ4_HEADER 4
+
+struct compressor {
+  int type;
+  int level;
+  //Output of the last call, grown on demand and never shrunk
+  unsigned char *buffer;
+  size_t size;
+#ifdef ENABLE_GZIP_COMPRESSION
+  z_stream deflate;
+  int deflate_ready;
+  z_stream inflate;
+  int inflate_ready;
+#endif //ENABLE_GZIP_COMPRESSION
+#ifdef ENABLE_ZSTD_COMPRESSION
+  ZSTD_CCtx *cctx;
+  ZSTD_DCtx *dctx;
+#endif //ENABLE_ZSTD_COMPRESSION
+#ifdef ENABLE_LZ4_COMPRESSION
+  void *lz4_state;
+#endif //ENABLE_LZ4_COMPRESSION
+};
+
+static int reserve(compressor_t *c, size_t size) {
+  unsigned char *buffer;
+
+  if(size <= c->size) return 0;
+  buffer = (unsigned char *)realloc(c->buffer, size);
+  if(buffer == NULL) return -1;
+  c->buffer = buffer;
+  c->size = size;
+  return 0;
+}
+
+/*****************************************************************************/
+int compressor_supported(int type) {
+  switch(type) {
+    case COMPRESS_NONE:
+      return TRUE;
+#ifdef ENABLE_GZIP_COMPRESSION
+    case COMPRESS_GZIP:
+      return TRUE;
+#endif //ENABLE_GZIP_COMPRESSION
+#ifdef ENABLE_BZIP2_COMPRESSION
+    case COMPRESS_BZIP2:
+      return TRUE;
+#endif //ENABLE_BZIP2_COMPRESSION
+#ifdef ENABLE_ZSTD_COMPRESSION
+    case COMPRESS_ZSTD:
+      return TRUE;
+#endif //ENABLE_ZSTD_COMPRESSION
+#ifdef ENABLE_LZ4_COMPRESSION
+    case COMPRESS_LZ4:
+      return TRUE;
+#endif //ENABLE_LZ4_COMPRESSION
+    default:
+      return FALSE;
+  }
+}
+
+const char *compressor_name(int type) {
+  switch(type) {
+    case COMPRESS_GZIP:
+      return "gzip";
+    case COMPRESS_BZIP2:
+      return "bzip2";
+    case COMPRESS_NONE:
+      return "none";
+    case COMPRESS_ZSTD:
+      return "zstd";
+    case COMPRESS_LZ4:
+      return "lz4";
+    default:
+      return "unknown";
+  }
+}
+
+int compressor_default_level(int type) {
+  switch(type) {
+    case COMPRESS_GZIP:
+      return 6;
+    case COMPRESS_BZIP2:
+      return 9;
+    case COMPRESS_ZSTD:
+      return 3;
+    case COMPRESS_LZ4:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static int level_valid(int type, int level) {
+  switch(type) {
+    case COMPRESS_GZIP:
+    case COMPRESS_BZIP2:
+      return level >= 1 && level <= 9;
+#ifdef ENABLE_ZSTD_COMPRESSION
+    case COMPRESS_ZSTD:
+      return level >= ZSTD_minCLevel() && level <= ZSTD_maxCLevel();
+#endif //ENABLE_ZSTD_COMPRESSION
+#ifdef ENABLE_LZ4_COMPRESSION
+    case COMPRESS_LZ4:
+      return level <= LZ4HC_CLEVEL_MAX;
+#endif //ENABLE_LZ4_COMPRESSION
+    default:
+      return TRUE;
+  }
+}
+
+/*****************************************************************************/
+compressor_t *compressor_create(int type, int level) {
+  compressor_t *c;
+
+  if(!compressor_supported(type)) return NULL;
+  if(level == 0) level = compressor_default_level(type);
+  if(!level_valid(type, level)) return NULL;
+
+  c = (compressor_t *)calloc(1, sizeof(compressor_t));
+  if(c == NULL) return NULL;
+  c->type = type;
+  c->level = level;
+
+#ifdef ENABLE_ZSTD_COMPRESSION
+  if(type == COMPRESS_ZSTD) {
+    c->cctx = ZSTD_createCCtx();
+    c->dctx = ZSTD_createDCtx();
+    if(c->cctx == NULL || c->dctx == NULL) { compressor_destroy(c); return NULL; }
+  }
+#endif //ENABLE_ZSTD_COMPRESSION
+#ifdef ENABLE_LZ4_COMPRESSION
+  if(type == COMPRESS_LZ4) {
+    c->lz4_state = malloc(level > 1 ? LZ4_sizeofStateHC() : LZ4_sizeofState());
+    if(c->lz4_state == NULL) { compressor_destroy(c); return NULL; }
+  }
+#endif //ENABLE_LZ4_COMPRESSION
+
+  return c;
+}
+
+void compressor_destroy(compressor_t *c) {
+#ifdef ENABLE_GZIP_COMPRESSION
+  if(c->deflate_ready) deflateEnd(&c->deflate);
+  if(c->inflate_ready) inflateEnd(&c->inflate);
+#endif //ENABLE_GZIP_COMPRESSION
+#ifdef ENABLE_ZSTD_COMPRESSION
+  ZSTD_freeCCtx(c->cctx);
+  ZSTD_freeDCtx(c->dctx);
+#endif //ENABLE_ZSTD_COMPRESSION
+#ifdef ENABLE_LZ4_COMPRESSION
+  free(c->lz4_state);
+#endif //ENABLE_LZ4_COMPRESSION
+  free(c->buffer);
+  free(c);
+}
+
+/*****************************************************************************/
+#ifdef ENABLE_GZIP_COMPRESSION
+static const void *gzip_compress(compressor_t *c, const void *src, size_t n, size_t *out_n) {
+  z_stream *s = &c->deflate;
+
+  if(n > UINT_MAX) return NULL;
+  //Same zlib stream as compress(), without setting up the deflate state for every chunk
+  if(!c->deflate_ready) {
+    if(deflateInit(s, c->level) != Z_OK) return NULL;
+    c->deflate_ready = TRUE;
+  } else if(deflateReset(s) != Z_OK) {
+    return NULL;
+  }
+
+  size_t bound = deflateBound(s, n);
+  if(reserve(c, bound)) return NULL;
+
+  s->next_in = (Bytef *)src;
+  s->avail_in = n;
+  s->next_out = c->buffer;
+  s->avail_out = c->size > UINT_MAX ? UINT_MAX : c->size;
+  if(deflate(s, Z_FINISH) != Z_STREAM_END) return NULL;
+
+  *out_n = s->total_out;
+  return c->buffer;
+}
+
+static const void *gzip_decompress(compressor_t *c, const void *src, size_t n, size_t *out_n) {
+  z_stream *s = &c->inflate;
+  int r;
+
+  if(n > UINT_MAX) return NULL;
+  if(!c->inflate_ready) {
+    if(inflateInit(s) != Z_OK) return NULL;
+    c->inflate_ready = TRUE;
+  } else if(inflateReset(s) != Z_OK) {
+    return NULL;
+  }
+
+  //The uncompressed size is not stored, grow the buffer until it fits
+  if(reserve(c, 4 * n + 4096)) return NULL;
+  s->next_in = (Bytef *)src;
+  s->avail_in = n;
+  for(;;) {
+    s->next_out = c->buffer + s->total_out;
+    s->avail_out = c->size - s->total_out > UINT_MAX ? UINT_MAX : c->size - s->total_out;
+    r = inflate(s, Z_FINISH);
+    if(r == Z_STREAM_END) break;
+    if((r != Z_OK && r != Z_BUF_ERROR) || s->avail_out != 0) return NULL;
+    if(reserve(c, 2 * c->size)) return NULL;
+  }
+
+  *out_n = s->total_out;
+  return c->buffer;
+}
+#endif //ENABLE_GZIP_COMPRESSION
+
+#ifdef ENABLE_BZIP2_COMPRESSION
+static const void *bzip2_compress(compressor_t *c, const void *src, size_t n, size_t *out_n) {
+  unsigned int len;
+
+  if(n > UINT_MAX) return NULL;
+  //Bzip compression buffer must be at least 1% larger than source buffer plus 600 bytes
+  if(reserve(c, n + (n >> 6) + 600)) return NULL;
+  len = c->size > UINT_MAX ? UINT_MAX : c->size;
+  if(BZ2_bzBuffToBuffCompress((char *)c->buffer, &len, (char *)src, n, c->level, 0, 30) != BZ_OK) return NULL;
+
+  *out_n = len;
+  return c->buffer;
+}
+
+static const void *bzip2_decompress(compressor_t *c, const void *src, size_t n, size_t *out_n) {
+  unsigned int len;
+  int r;
+
+  if(n > UINT_MAX) return NULL;
+  //The uncompressed size is not stored, grow the buffer until it fits
+  if(reserve(c, 4 * n + 4096)) return NULL;
+  for(;;) {
+    len = c->size > UINT_MAX ? UINT_MAX : c->size;
+    r = BZ2_bzBuffToBuffDecompress((char *)c->buffer, &len, (char *)src, n, 0, 0);
+    if(r == BZ_OK) break;
+    if(r != BZ_OUTBUFF_FULL || c->size >= UINT_MAX) return NULL;
+    if(reserve(c, 2 * c->size)) return NULL;
+  }
+
+  *out_n = len;
+  return c->buffer;
+}
+#endif //ENABLE_BZIP2_COMPRESSION
+
+#ifdef ENABLE_ZSTD_COMPRESSION
+static const void *zstd_compress(compressor_t *c, const void *src, size_t n, size_t *out_n) {
+  size_t r;
+
+  if(reserve(c, ZSTD_compressBound(n))) return NULL;
+  r = ZSTD_compressCCtx(c->cctx, c->buffer, c->size, src, n, c->level);
+  if(ZSTD_isError(r)) return NULL;
+
+  *out_n = r;
+  return c->buffer;
+}
+
+static const void *zstd_decompress(compressor_t *c, const void *src, size_t n, size_t *out_n) {
+  unsigned long long len = ZSTD_getFrameContentSize(src, n);
+  size_t r;
+
+  if(len == ZSTD_CONTENTSIZE_UNKNOWN || len == ZSTD_CONTENTSIZE_ERROR) return NULL;
+  //Reserve at least one byte, the buffer of an empty chunk may still be NULL
+  if(reserve(c, len > 0 ? len : 1)) return NULL;
+  r = ZSTD_decompressDCtx(c->dctx, c->buffer, len, src, n);
+  if(ZSTD_isError(r) || r != len) return NULL;
+
+  *out_n = r;
+  return c->buffer;
+}
+#endif //ENABLE_ZSTD_COMPRESSION
+
+#ifdef ENABLE_LZ4_COMPRESSION
+static const void *lz4_compress(compressor_t *c, const void *src, size_t n, size_t *out_n) {
+  int bound, r;
+
+  if(n > LZ4_MAX_INPUT_SIZE) return NULL;
+  bound = LZ4_compressBound(n);
+  if(reserve(c, LZ4_HEADER + bound)) return NULL;
+
+  c->buffer[0] = n;
+  c->buffer[1] = n >> 8;
+  c->buffer[2] = n >> 16;
+  c->buffer[3] = n >> 24;
+  if(c->level > 1)
+    r = LZ4_compress_HC_extStateHC(c->lz4_state, (const char *)src, (char *)c->buffer + LZ4_HEADER, n, bound, c->level);
+  else
+    r = LZ4_compress_fast_extState(c->lz4_state, (const char *)src, (char *)c->buffer + LZ4_HEADER, n, bound, c->level < 0 ? -c->level : 1);
+  if(r <= 0 && n > 0) return NULL;
+
+  *out_n = LZ4_HEADER + r;
+  return c->buffer;
+}
+
+static const void *lz4_decompress(compressor_t *c, const void *src, size_t n, size_t *out_n) {
+  const unsigned char *in = (const unsigned char *)src;
+  size_t len;
+  int r;
+
+  if(n < LZ4_HEADER || n - LZ4_HEADER > INT_MAX) return NULL;
+  len = (size_t)in[0] | (size_t)in[1] << 8 | (size_t)in[2] << 16 | (size_t)in[3] << 24;
+  if(len > LZ4_MAX_INPUT_SIZE) return NULL;
+  if(reserve(c, len > 0 ? len : 1)) return NULL;
+  r = LZ4_decompress_safe((const char *)in + LZ4_HEADER, (char *)c->buffer, n - LZ4_HEADER, len);
+  if(r < 0 || (size_t)r != len) return NULL;
+
+  *out_n = len;
+  return c->buffer;
+}
+#endif //ENABLE_LZ4_COMPRESSION
+
+/*****************************************************************************/
+const void *compressor_compress(compressor_t *c, const void *src, size_t n, size_t *out_n) {
+  switch(c->type) {
+    case COMPRESS_NONE:
+      *out_n = n;
+      return src;
+#ifdef ENABLE_GZIP_COMPRESSION
+    case COMPRESS_GZIP:
+      return gzip_compress(c, src, n, out_n);
+#endif //ENABLE_GZIP_COMPRESSION
+#ifdef ENABLE_BZIP2_COMPRESSION
+    case COMPRESS_BZIP2:
+      return bzip2_compress(c, src, n, out_n);
+#endif //ENABLE_BZIP2_COMPRESSION
+#ifdef ENABLE_ZSTD_COMPRESSION
+    case COMPRESS_ZSTD:
+      return zstd_compress(c, src, n, out_n);
+#endif //ENABLE_ZSTD_COMPRESSION
+#ifdef ENABLE_LZ4_COMPRESSION
+    case COMPRESS_LZ4:
+      return lz4_compress(c, src, n, out_n);
+#endif //ENABLE_LZ4_COMPRESSION
+    default:
+      return NULL;
+  }
+}
+
+const void *compressor_decompress(compressor_t *c, const void *src, size_t n, size_t *out_n) {
+  switch(c->type) {
+    case COMPRESS_NONE:
+      *out_n = n;
+      return src;
+#ifdef ENABLE_GZIP_COMPRESSION
+    case COMPRESS_GZIP:
+      return gzip_decompress(c, src, n, out_n);
+#endif //ENABLE_GZIP_COMPRESSION
+#ifdef ENABLE_BZIP2_COMPRESSION
+    case COMPRESS_BZIP2:
+      return bzip2_decompress(c, src, n, out_n);
+#endif //ENABLE_BZIP2_COMPRESSION
+#ifdef ENABLE_ZSTD_COMPRESSION
+    case COMPRESS_ZSTD:
+      return zstd_decompress(c, src, n, out_n);
+#endif //ENABLE_ZSTD_COMPRESSION
+#ifdef ENABLE_LZ4_COMPRESSION
+    case COMPRESS_LZ4:
+      return lz4_decompress(c, src, n, out_n);
+#endif //ENABLE_LZ4_COMPRESSION
+    default:
+      return NULL;
+  }
+}
+
+double compressor_entropy(const void *src, size_t n) {
+  const u_char *p = (const u_char *)src;
+  unsigned int histogram[256] = { 0 };
+  size_t sampled, i, j;
+  double bits = 0;
+
+  if(n <= COMPRESSOR_SAMPLE_SPANS * COMPRESSOR_SAMPLE_SPAN) {
+    for(i=0; i<n; i++) histogram[p[i]]++;
+    sampled = n;
+  } else {
+    //The first span at the start of src, the last one at its end
+    size_t stride = (n - COMPRESSOR_SAMPLE_SPAN) / (COMPRESSOR_SAMPLE_SPANS - 1);
+    for(i=0; i<COMPRESSOR_SAMPLE_SPANS; i++) {
+      const u_char *span = p + i * stride;
+      for(j=0; j<COMPRESSOR_SAMPLE_SPAN; j++) histogram[span[j]]++;
+    }
+    sampled = COMPRESSOR_SAMPLE_SPANS * COMPRESSOR_SAMPLE_SPAN;
+  }
+  if(sampled == 0) return 0;
+
+  for(i=0; i<256; i++) {
+    if(histogram[i] != 0) bits -= histogram[i] * log2((double)histogram[i] / sampled);
+  }
+  return bits / sampled;
+}
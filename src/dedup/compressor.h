@@ -0,0 +1,74 @@
+/* Compression backends of the Compress stage and of the decoder.
+ *
+ * A compressor_t holds the state of one backend (zlib streams, zstd contexts,
+ * lz4 state) and an output buffer, both reused from one chunk to the next. It
+ * is not thread-safe: every thread uses its own.
+ *
+ * The backends are the COMPRESS_* values of the file header. Gzip and bzip2
+ * keep the format of the original dedup, zstd writes frames with their content
+ * size and lz4 raw blocks after the size of the uncompressed data, as a 32 bits
+ * little endian integer.
+ */
+
+#ifndef _COMPRESSOR_H_
+#define _COMPRESSOR_H_
+
+#include <stddef.h>
+
+typedef struct compressor compressor_t;
+
+//Returns TRUE if the backend was enabled at build time
+int compressor_supported(int type);
+
+const char *compressor_name(int type);
+
+//Level used when 0 is requested
+int compressor_default_level(int type);
+
+/*
+ * compressor_create
+ *
+ * @param   type    one of the COMPRESS_* values
+ * @param   level   backend specific level, 0 for its default:
+ *                   - gzip 1 (fast) to 9 (small), default 6
+ *                   - bzip2 1 to 9, default 9
+ *                   - zstd negative (fast) to 22 (small), default 3
+ *                   - lz4 negative values accelerate, 1 is the default fast
+ *                     mode, 2 to 12 are the high compression levels
+ * @return          newly created compressor, or NULL if the backend is not
+ *                  supported or out of memory
+ */
+compressor_t *compressor_create(int type, int level);
+
+void compressor_destroy(compressor_t *c);
+
+/*
+ * Compress n bytes of src. The result is in a buffer of c, valid until the
+ * next call on c.
+ *
+ * @return   the compressed data, its size in *out_n, or NULL on failure
+ */
+const void *compressor_compress(compressor_t *c, const void *src, size_t n, size_t *out_n);
+
+/*
+ * Decompress n bytes of src. The result is in a buffer of c, valid until the
+ * next call on c.
+ *
+ * @return   the uncompressed data, its size in *out_n, or NULL on failure
+ */
+const void *compressor_decompress(compressor_t *c, const void *src, size_t n, size_t *out_n);
+
+/*
+ * Estimate how well n bytes of src compress, at a small fraction of the cost of
+ * compressing them: the order-0 entropy of a sample of COMPRESSOR_SAMPLE_SPANS
+ * spans of COMPRESSOR_SAMPLE_SPAN bytes spread over src, all of src if it is
+ * smaller. Already compressed or encrypted data is close to 8 bits per byte.
+ *
+ * @return   the entropy of the sample in bits per byte, 0 for no data
+ */
+double compressor_entropy(const void *src, size_t n);
+
+#define COMPRESSOR_SAMPLE_SPANS 16
+#define COMPRESSOR_SAMPLE_SPAN 256
+
+#endif //_COMPRESSOR_H_
@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "ddpindex.h"
+#include "util.h"
+
+//Size of a record in the archive: type, length and content
+static inline u_long record_size(u_long len) {
+  return sizeof(u_char) + sizeof(u_long) + len;
+}
+
+/*****************************************************************************/
+ddp_index_t *ddp_index_create(u_long offset) {
+  ddp_index_t *idx = new ddp_index_t;
+
+  idx->offset = offset;
+  idx->uncompressed_size = 0;
+  return idx;
+}
+
+/*****************************************************************************/
+void ddp_index_destroy(ddp_index_t *idx) {
+  delete idx;
+}
+
+/*****************************************************************************/
+u_long ddp_index_add(ddp_index_t *idx, u_char type, u_long len, u_long uncompressed_len, u_long unique) {
+  u_long record = idx->entries.size();
+
+  //TYPE_ORIGINAL and TYPE_REFERENCE records have the data of their chunk, like a TYPE_COMPRESS one
+  int has_data = type == TYPE_COMPRESS || type == TYPE_ORIGINAL || type == TYPE_REFERENCE;
+  assert(has_data || unique < record);
+  idx->entries.push_back({ idx->offset, idx->uncompressed_size, has_data ? record : unique });
+  idx->offset += record_size(len);
+  idx->uncompressed_size += uncompressed_len;
+  return record;
+}
+
+/*****************************************************************************/
+int ddp_index_write(ddp_index_t *idx, int fd) {
+  ddp_index_footer_t footer;
+  u_char type = TYPE_INDEX;
+  u_long len = idx->entries.size() * sizeof(ddp_index_entry_t) + sizeof(footer);
+
+  footer.n_records = idx->entries.size();
+  footer.uncompressed_size = idx->uncompressed_size;
+  footer.index_offset = idx->offset;
+  memcpy(footer.magic, DDP_INDEX_MAGIC, sizeof(footer.magic));
+
+  if(xwrite(fd, &type, sizeof(type)) < 0) return -1;
+  if(xwrite(fd, &len, sizeof(len)) < 0) return -1;
+  if(xwrite(fd, idx->entries.data(), idx->entries.size() * sizeof(ddp_index_entry_t)) < 0) return -1;
+  if(xwrite(fd, &footer, sizeof(footer)) < 0) return -1;
+  return 0;
+}
+
+/*****************************************************************************/
+ddp_index_t *ddp_index_read(int fd) {
+  ddp_index_footer_t footer;
+  struct stat st;
+
+  if(fstat(fd, &st) < 0 || (u_long)st.st_size < sizeof(footer)) return NULL;
+  if(xpread(fd, &footer, sizeof(footer), st.st_size - sizeof(footer)) <= 0) return NULL;
+  if(memcmp(footer.magic, DDP_INDEX_MAGIC, sizeof(footer.magic)) != 0) return NULL;
+
+  //The index record must end exactly where the file ends
+  u_long entries_size = footer.n_records * sizeof(ddp_index_entry_t);
+  if(footer.index_offset + record_size(entries_size + sizeof(footer)) != (u_long)st.st_size) return NULL;
+
+  ddp_index_t *idx = ddp_index_create(footer.index_offset);
+  idx->uncompressed_size = footer.uncompressed_size;
+  idx->entries.resize(footer.n_records);
+  if(entries_size > 0 && xpread(fd, idx->entries.data(), entries_size, footer.index_offset + record_size(0)) <= 0) {
+    ddp_index_destroy(idx);
+    return NULL;
+  }
+  return idx;
+}
+
+/*****************************************************************************/
+u_long ddp_index_find(ddp_index_t *idx, u_long uncompressed_offset) {
+  assert(uncompressed_offset < idx->uncompressed_size);
+
+  //First record starting after the offset, the one before has the byte
+  auto it = std::upper_bound(idx->entries.begin(), idx->entries.end(), uncompressed_offset,
+                             [](u_long offset, ddp_index_entry_t const& entry) { return offset < entry.uncompressed_offset; });
+  return (it - idx->entries.begin()) - 1;
+}
+
+/*****************************************************************************/
+u_long ddp_index_uncompressed_len(ddp_index_t *idx, u_long record) {
+  u_long end = record + 1 < idx->entries.size() ? idx->entries[record + 1].uncompressed_offset : idx->uncompressed_size;
+
+  return end - idx->entries[record].uncompressed_offset;
+}
@@ -0,0 +1,77 @@
+/* Index of the records of a .ddp archive.
+ *
+ * The encoder can append the index to the archive as a TYPE_INDEX record after
+ * the TYPE_COMPRESS / TYPE_FINGERPRINT records. Decoders read the records up to
+ * the end of the file and fail on a type they do not know, so an archive with
+ * an index can only be decoded by a decoder which knows TYPE_INDEX: the ones
+ * from before the index exit on it. The index has an entry per record and
+ * ends with a footer, which is at the very end of the file so that it can be
+ * found without reading the records:
+ *
+ *   entries[n_records] | footer
+ *
+ * With the index, a duplicate record is resolved by the number of its unique
+ * record instead of its SHA1 sum, any byte range of the original file can be
+ * decoded by reading only the records it needs, and the decoder knows when a
+ * unique chunk is referenced for the last time.
+ */
+
+#ifndef _DDPINDEX_H_
+#define _DDPINDEX_H_
+
+#include <vector>
+
+#include "dedupdef.h"
+
+#define DDP_INDEX_MAGIC "DDPINDEX"
+
+typedef struct {
+  u_long offset;               //offset of the record in the archive
+  u_long uncompressed_offset;  //offset of the data of the record in the original file
+  u_long unique;               //number of the record with the data, itself for a TYPE_COMPRESS, TYPE_ORIGINAL or TYPE_REFERENCE one
+} ddp_index_entry_t;
+
+typedef struct {
+  u_long n_records;
+  u_long uncompressed_size;    //size of the original file
+  u_long index_offset;         //offset of the TYPE_INDEX record in the archive
+  char magic[8];               //DDP_INDEX_MAGIC, without the terminating null byte
+} ddp_index_footer_t;
+
+typedef struct ddp_index {
+  std::vector<ddp_index_entry_t> entries;
+  u_long offset;               //offset of the next record in the archive
+  u_long uncompressed_size;
+} ddp_index_t;
+
+//Index of an archive whose first record is at offset
+ddp_index_t *ddp_index_create(u_long offset);
+
+void ddp_index_destroy(ddp_index_t *idx);
+
+/*
+ * Add the record written after the previous one to the index.
+ *
+ * @param   len                 length of the content of the record
+ * @param   uncompressed_len    size of the data of the record in the original file
+ * @param   unique              number of the unique record of a TYPE_FINGERPRINT
+ *                              record, ignored for the records with data
+ * @return                      number of the record
+ */
+u_long ddp_index_add(ddp_index_t *idx, u_char type, u_long len, u_long uncompressed_len, u_long unique);
+
+//Append the index to the archive, after the last record
+//Returns 0 on success, -1 on failure
+int ddp_index_write(ddp_index_t *idx, int fd);
+
+//Read the index of an archive, without moving the file offset
+//Returns NULL if the archive has no index
+ddp_index_t *ddp_index_read(int fd);
+
+//Number of the record with the byte at uncompressed_offset of the original file
+u_long ddp_index_find(ddp_index_t *idx, u_long uncompressed_offset);
+
+//Size of the data of a record in the original file
+u_long ddp_index_uncompressed_len(ddp_index_t *idx, u_long record);
+
+#endif //_DDPINDEX_H_
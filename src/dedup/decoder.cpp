@@ -13,21 +13,29 @@
 #include <unistd.h>
 #include <string.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
 #include "decoder.h"
 #include "dedupdef.h"
 #include "config.h"
 #include "util.h"
-#include "hashtable.h"
+#include "compressor.h"
+#include "ddpindex.h"
+#include "fingerprint.h"
+#include "fpstore.h"
+#include "hashtable_private.h"
 #include "mbuffer.h"
 #include "debug.h"
-
-#ifdef ENABLE_GZIP_COMPRESSION
-#include <zlib.h>
-#endif //ENABLE_GZIP_COMPRESSION
-
-#ifdef ENABLE_BZIP2_COMPRESSION
-#include <bzlib.h>
-#endif //ENABLE_BZIP2_COMPRESSION
+#ifdef ENABLE_PTHREADS
+#include "binheap.h"
+#include "naive_queue.hpp"
+#endif //ENABLE_PTHREADS
 
 #ifdef ENABLE_PARSEC_HOOKS
 #include <hooks.h>
@@ -52,6 +60,71 @@ static int keys_equal_fn ( void *key1, void *key2 ) {
 
 
 
+//Archives of the fingerprint store the TYPE_REFERENCE records refer to, opened
+//when first used. Records are read by the calling thread, and read again by
+//the writer with a memory budget.
+static std::mutex store_mutex;
+static std::vector<fpstore_archive_t> store_archives;
+static std::vector<int> store_fds;
+
+//Helper function which returns the file of archive number archive of the store
+static int store_archive_fd(u32int archive) {
+  std::unique_lock<std::mutex> lck(store_mutex);
+
+  if(store_archives.empty()) {
+    if(conf->store[0] == '\0') EXIT_TRACE("The archive refers to a fingerprint store, which is not given.\n");
+    if(fpstore_read_archives(conf->store, &store_archives) != 0) {
+      EXIT_TRACE("Cannot read the archives of the fingerprint store %s\n", conf->store);
+    }
+    store_fds.assign(store_archives.size(), -1);
+  }
+  if(archive >= store_archives.size()) {
+    EXIT_TRACE("The archive refers to archive %u of the fingerprint store %s, which has %zu.\n", archive, conf->store, store_archives.size());
+  }
+  if(store_archives[archive].compress_type != conf->compress_type) {
+    EXIT_TRACE("Archive %s of the fingerprint store is not compressed like the archive.\n", store_archives[archive].path.c_str());
+  }
+  if(store_fds[archive] < 0) {
+    store_fds[archive] = open(store_archives[archive].path.c_str(), O_RDONLY|O_LARGEFILE);
+    if(store_fds[archive] < 0) EXIT_TRACE("Cannot open %s of the fingerprint store\n", store_archives[archive].path.c_str());
+  }
+  return store_fds[archive];
+}
+
+static void store_close() {
+  std::unique_lock<std::mutex> lck(store_mutex);
+
+  for(int fd: store_fds) {
+    if(fd >= 0) close(fd);
+  }
+  store_fds.clear();
+  store_archives.clear();
+}
+
+//Helper function which reads the TYPE_COMPRESS or TYPE_ORIGINAL record at
+//offset of fd into the compressed data of the chunk
+static void pread_compressed(int fd, u_long offset, chunk_t *chunk) {
+  u_char type;
+  u_long len;
+  int r;
+
+  if(xpread(fd, &type, sizeof(type), offset) <= 0 ||
+     xpread(fd, &len, sizeof(len), offset + sizeof(type)) <= 0 || (type != TYPE_COMPRESS && type != TYPE_ORIGINAL)) {
+    EXIT_TRACE("Record at offset %lu cannot be read.\n", offset);
+  }
+  chunk->header.isRaw = type == TYPE_ORIGINAL;
+  r = mbuffer_create(&chunk->compressed_data, len);
+  if(r != 0) EXIT_TRACE("Creation of input buffer failed.\n");
+  if(xpread(fd, chunk->compressed_data.ptr, len, offset + sizeof(type) + sizeof(len)) <= 0) {
+    EXIT_TRACE("Record at offset %lu cannot be read.\n", offset);
+  }
+}
+
+//Helper function which reads the data a TYPE_REFERENCE record refers to
+static void read_reference(const fpstore_entry_t *ref, chunk_t *chunk) {
+  pread_compressed(store_archive_fd(ref->archive), ref->offset, chunk);
+}
+
 /*
  * Helper function which reads the next chunk from the input file
  *
@@ -63,10 +136,15 @@ static int read_chunk(int fd, chunk_t *chunk) {
   assert(chunk!=NULL);
   assert(fd>=0);
 
+  //Where the record can be read again
+  chunk->offset = lseek(fd, 0, SEEK_CUR);
+
   u_char type;
   r=xread(fd, &type, sizeof(type));
   if(r < 0) EXIT_TRACE("xread type fails\n")
   else if(r == 0) return 0;
+  //The index follows the last record with data
+  if(type == TYPE_INDEX) return 0;
 
   u_long len;
   r=xread(fd, &len, sizeof(len));
@@ -82,6 +160,7 @@ static int read_chunk(int fd, chunk_t *chunk) {
     chunk->header.isDuplicate = TRUE;
     break;
   case TYPE_COMPRESS:
+  case TYPE_ORIGINAL:
     if(len<=0) EXIT_TRACE("illegal size of data chunk\n");
     r = mbuffer_create(&chunk->compressed_data, len);
     if(r != 0) EXIT_TRACE("Creation of input buffer failed.\n");
@@ -89,7 +168,19 @@ static int read_chunk(int fd, chunk_t *chunk) {
     if(r < 0) EXIT_TRACE("xread data chunk fails\n")
     else if(r == 0) EXIT_TRACE("incomplete chunk\n");
     chunk->header.isDuplicate = FALSE;
+    chunk->header.isRaw = type == TYPE_ORIGINAL;
     break;
+  case TYPE_REFERENCE: {
+    fpstore_entry_t ref;
+    if(len!=sizeof(ref)) EXIT_TRACE("incorrect size of reference\n");
+    r=xread(fd, &ref, sizeof(ref));
+    if(r < 0) EXIT_TRACE("xread reference fails\n")
+    else if(r == 0) EXIT_TRACE("incomplete chunk\n");
+    //The data is read now, so that the chunk is uncompressed like the others
+    read_reference(&ref, chunk);
+    chunk->header.isDuplicate = FALSE;
+    break;
+  }
   default:
     EXIT_TRACE("unknown chunk type\n");
   }
@@ -101,165 +192,621 @@ static int read_chunk(int fd, chunk_t *chunk) {
  *
  * Returns the size of the uncompressed data
  */
-static int uncompress_chunk(chunk_t *chunk) {
+static int uncompress_chunk(compressor_t *decompressor, chunk_t *chunk) {
+  const void *data;
+  size_t n;
   int r;
 
   assert(chunk!=NULL);
   assert(!chunk->header.isDuplicate);
 
+  //The data of a TYPE_ORIGINAL record is not compressed
+  if(chunk->header.isRaw) {
+    chunk->uncompressed_data = chunk->compressed_data;
+    chunk->header.state = CHUNK_STATE_UNCOMPRESSED;
+    return chunk->uncompressed_data.n;
+  }
+
   //uncompress the item
-  switch (conf->compress_type) {
-  case COMPRESS_NONE: {
-    //Simply duplicate the data
-    r = mbuffer_create(&chunk->uncompressed_data, chunk->compressed_data.n);
-    if(r != 0) EXIT_TRACE("Creation of decompression buffer failed.\n");
-    //copy the block
-    memcpy(chunk->uncompressed_data.ptr, chunk->compressed_data.ptr, chunk->compressed_data.n);
-    break;
+  data = compressor_decompress(decompressor, chunk->compressed_data.ptr, chunk->compressed_data.n, &n);
+  if(data == NULL) EXIT_TRACE("error uncompressing chunk data\n");
+  r = mbuffer_create(&chunk->uncompressed_data, n);
+  if(r != 0) EXIT_TRACE("Creation of decompression buffer failed.\n");
+  memcpy(chunk->uncompressed_data.ptr, data, n);
+  chunk->header.state = CHUNK_STATE_UNCOMPRESSED;
+
+  mbuffer_free(&chunk->compressed_data);
+  return chunk->uncompressed_data.n;
+}
+
+//Index of the archive being decoded, NULL if it has none
+static ddp_index_t *archive_index;
+
+//Records left to write that use the data of each unique record, with an index
+static std::vector<u_int> references;
+
+//Unique chunks that records left to write still use, by record number
+static std::unordered_map<u_long, chunk_t *> uniques;
+
+//Count the records first to last that use the data of each unique record
+static void count_references(u_long first, u_long last) {
+  references.assign(archive_index->entries.size(), 0);
+  for(u_long record=first; record<=last; record++) {
+    references[archive_index->entries[record].unique]++;
   }
-#ifdef ENABLE_GZIP_COMPRESSION
-  case COMPRESS_GZIP: {
-    unsigned long len_64 = UNCOMPRESS_BOUND;
-    r = mbuffer_create(&chunk->uncompressed_data, len_64);
-    if(r != 0) EXIT_TRACE("Creation of decompression buffer failed.\n");
-    r = uncompress((Bytef*)chunk->uncompressed_data.ptr, &len_64, (const Bytef*)chunk->compressed_data.ptr, chunk->compressed_data.n);
-    //TODO: Automatically enlarge buffer if return value is Z_BUF_ERROR
-    if(r!=Z_OK) EXIT_TRACE("error uncompressing chunk data\n");
-    //Shrink buffer to actual size
-    if(len_64 < chunk->uncompressed_data.n) {
-      r = mbuffer_realloc(&chunk->uncompressed_data, len_64);
-      assert(r == 0);
+}
+
+//Returns TRUE if the SHA1 sums of the unique chunks are needed
+static inline int needs_sha1() {
+  //Without an index, duplicate records can only be resolved by their SHA1 sum
+  return archive_index == NULL || conf->verify;
+}
+
+/*
+ * Helper function which finds the chunk with the uncompressed data of a record.
+ * Unique chunks must have been uncompressed, and fingerprinted if needs_sha1().
+ * Duplicate chunks are freed.
+ */
+static chunk_t *resolve_chunk(chunk_t *chunk, u_long record) {
+  chunk_t *entry;
+
+  if(archive_index == NULL) {
+    if(!chunk->header.isDuplicate) {
+      //Add new chunk with uncompressed data to cache
+      if(hashtable_insert(cache, (void *)(chunk->sha1), (void *)chunk) == 0) {
+        EXIT_TRACE("hashtable_insert failed");
+      }
+      return chunk;
     }
-    break;
+    //We got a SHA1 key, use it to retrieve unique counterpart with uncompressed data
+    entry=(chunk_t *)hashtable_search(cache, (void *)(chunk->sha1));
+    if(entry==NULL) {
+      EXIT_TRACE("Encountered a duplicate chunk in input file but not its unique counterpart. Maybe data is out of order?");
+    }
+    free(chunk);
+    return entry;
   }
-#else
-  case COMPRESS_GZIP: {
-    EXIT_TRACE("Gzip compression used by input file not supported.\n");
-    break;
+
+  //The index gives the record with the data
+  u_long unique = archive_index->entries[record].unique;
+  if(chunk->header.isDuplicate != (unique != record)) {
+    EXIT_TRACE("Record %lu does not match the index of the archive.\n", record);
+  }
+  if(!chunk->header.isDuplicate) {
+    uniques[record] = chunk;
+    return chunk;
+  }
+  auto it = uniques.find(unique);
+  if(it == uniques.end()) {
+    EXIT_TRACE("Record %lu refers to record %lu, which was not read.\n", record, unique);
+  }
+  entry = it->second;
+  if(conf->verify && memcmp(chunk->sha1, entry->sha1, SHA1_LEN) != 0) {
+    EXIT_TRACE("SHA1 sum of record %lu does not match the data of record %lu.\n", record, unique);
   }
-#endif //ENABLE_GZIP_COMPRESSION
-#ifdef ENABLE_BZIP2_COMPRESSION
-  case COMPRESS_BZIP2: {
-    unsigned int len_32 = UNCOMPRESS_BOUND;
-    r = mbuffer_create(&chunk->uncompressed_data, len_32);
-    if(r != 0) EXIT_TRACE("Creation of decompression buffer failed.\n");
-    r = BZ2_bzBuffToBuffDecompress((char*)chunk->uncompressed_data.ptr, &len_32, (char*)chunk->compressed_data.ptr, chunk->compressed_data.n, 0, 0);
-    //TODO: Automatically enlarge buffer if return value is BZ_OUTBUFF_FULL
-    if(r!=BZ_OK) EXIT_TRACE("error uncompressing chunk data\n");
-    //Shrink buffer to actual size
-    if(len_32 < chunk->uncompressed_data.n) {
-      r = mbuffer_realloc(&chunk->uncompressed_data, len_32);
-      assert(r == 0);
+  free(chunk);
+  return entry;
+}
+
+/*
+ * With a memory budget, the writer keeps the uncompressed data of the unique
+ * chunks it used last, up to conf->memory_budget bytes. The data of the others
+ * is freed, their state becomes CHUNK_STATE_FLUSHED, and their record is read
+ * again from the archive the next time a duplicate record uses them. The chunk
+ * itself stays, with its SHA1 sum and the offset of its record.
+ */
+
+//Unique chunks with their uncompressed data, most recently used first
+static std::list<chunk_t *> lru;
+static std::unordered_map<chunk_t *, std::list<chunk_t *>::iterator> lru_position;
+//Bytes of uncompressed data of the chunks in lru
+static size_t lru_size;
+//Archive and decompression context to read evicted chunks again
+static int reload_fd;
+static compressor_t *reload_decompressor;
+static u_long n_reloads;
+
+//Helper function which reads the record of an evicted chunk again
+static void reload_chunk(chunk_t *chunk) {
+  u_char type;
+
+  assert(chunk->header.state == CHUNK_STATE_FLUSHED);
+  if(xpread(reload_fd, &type, sizeof(type), chunk->offset) <= 0) {
+    EXIT_TRACE("Record at offset %lu cannot be read again.\n", chunk->offset);
+  }
+  if(type == TYPE_REFERENCE) {
+    fpstore_entry_t ref;
+    if(xpread(reload_fd, &ref, sizeof(ref), chunk->offset + sizeof(type) + sizeof(u_long)) <= 0) {
+      EXIT_TRACE("Record at offset %lu cannot be read again.\n", chunk->offset);
     }
-    break;
+    read_reference(&ref, chunk);
+  } else {
+    pread_compressed(reload_fd, chunk->offset, chunk);
   }
-#else
-  case COMPRESS_BZIP2: {
-    EXIT_TRACE("Bzip2 compression used by input file not supported.\n");
-    break;
+  if(uncompress_chunk(reload_decompressor, chunk) <= 0) EXIT_TRACE("error uncompressing data")
+  n_reloads++;
+}
+
+//Helper function which makes sure a unique chunk has its uncompressed data, and
+//frees the data of the least recently used ones beyond the memory budget
+static void use_chunk(chunk_t *chunk) {
+  auto it = lru_position.find(chunk);
+  if(it != lru_position.end()) {
+    lru.splice(lru.begin(), lru, it->second);
+    return;
   }
-#endif //ENABLE_BZIP2_COMPRESSION
-  default: {
-    EXIT_TRACE("unknown compression type\n");
-    break;
+
+  if(chunk->header.state == CHUNK_STATE_FLUSHED) reload_chunk(chunk);
+  lru.push_front(chunk);
+  lru_position[chunk] = lru.begin();
+  lru_size += chunk->uncompressed_data.n;
+
+  //The chunk being written always stays
+  while(lru_size > conf->memory_budget && lru.size() > 1) {
+    chunk_t *victim = lru.back();
+    lru.pop_back();
+    lru_position.erase(victim);
+    lru_size -= victim->uncompressed_data.n;
+    mbuffer_free(&victim->uncompressed_data);
+    victim->header.state = CHUNK_STATE_FLUSHED;
+  }
+}
+
+//Helper function which frees a unique chunk that no record left to write uses
+static void free_chunk(chunk_t *chunk) {
+  auto it = lru_position.find(chunk);
+  if(it != lru_position.end()) {
+    lru_size -= chunk->uncompressed_data.n;
+    lru.erase(it->second);
+    lru_position.erase(it);
+  }
+  if(chunk->header.state != CHUNK_STATE_FLUSHED) mbuffer_free(&chunk->uncompressed_data);
+  free(chunk);
+}
+
+//Helper function which frees the unique chunks of the cache, then the cache
+static void cache_destroy() {
+  for(unsigned int i=0; i<cache->tablelength; i++) {
+    for(struct hash_entry *e=cache->table[i]; e!=NULL; e=e->next) {
+      free_chunk((chunk_t *)e->v);
+    }
   }
+  //The keys are the SHA1 sums of the chunks, freed with them
+  hashtable_destroy(cache, FALSE);
+  cache = NULL;
+}
+
+//Set up the memory budget of the writer for the archive opened as fd
+static void lru_init(int fd) {
+  lru.clear();
+  lru_position.clear();
+  lru_size = 0;
+  n_reloads = 0;
+  reload_fd = fd;
+  if(conf->memory_budget != 0) {
+    reload_decompressor = compressor_create(conf->compress_type, 0);
+    if(reload_decompressor == NULL) EXIT_TRACE("Creation of decompression context failed.\n");
   }
+}
 
-  mbuffer_free(&chunk->compressed_data);
-  return chunk->uncompressed_data.n;
+static void lru_destroy() {
+  if(conf->memory_budget != 0) {
+    if(conf->verbose) {
+      printf("Memory budget of %zu bytes: %lu chunks read again from the archive\n", conf->memory_budget, n_reloads);
+    }
+    compressor_destroy(reload_decompressor);
+    reload_decompressor = NULL;
+  }
 }
 
+/*
+ * Helper function which frees the unique chunk used by a record once it is
+ * written, if no record left to write uses it. Without an index, unique chunks
+ * stay in the cache.
+ */
+static void release_chunk(u_long record) {
+  if(archive_index == NULL) return;
+
+  u_long unique = archive_index->entries[record].unique;
+  if(--references[unique] == 0) {
+    auto it = uniques.find(unique);
+    free_chunk(it->second);
+    uniques.erase(it);
+  }
+}
 
-void Decode(config_t * _conf) {
-  int fd_in;
-  int fd_out;
-  chunk_t *chunk=NULL;
+//Helper function which writes the uncompressed data of a record to the output file
+static void write_chunk(int fd_out, chunk_t *chunk, u_long record) {
+  //We now have the uncompressed data in 'entry', write uncompressed data to output file
+  chunk_t *entry = resolve_chunk(chunk, record);
+  if(conf->memory_budget != 0) use_chunk(entry);
+  if(xwrite(fd_out, entry->uncompressed_data.ptr, entry->uncompressed_data.n)<entry->uncompressed_data.n) {
+    EXIT_TRACE("error writing to output file");
+  }
+  release_chunk(record);
+}
+
+#ifdef ENABLE_PTHREADS
+/*
+ * The parallel decoder is a pipeline of three stages:
+ *  - the calling thread reads the records of the input file in order and
+ *    numbers them
+ *  - conf->nthreads workers uncompress the unique chunks and compute their SHA1
+ *    sum if needed, the key duplicate records refer to
+ *  - a writer puts the records back in order and writes them, resolving the
+ *    duplicates with the cache or the index. It is the only thread using them.
+ * Records are numbered with the L2 part of their sequence number, which is what
+ * the binary heap of the writer sorts on.
+ */
+
+//Records in flight between two stages
+#define DECODE_QUEUE_SIZE 4096
+//Records the reader may be ahead of the writer. The records the workers finish
+//out of order wait in the binary heap of the writer, so this bounds the memory
+//used by the decoder whatever the size of the input file.
+#define DECODE_WINDOW (4 * DECODE_QUEUE_SIZE)
+
+static NaiveQueue<chunk_t*> uncompress_que, write_que;
+
+//Records written so far, the reader waits on it once it is DECODE_WINDOW ahead
+static std::atomic<sequence_number_t> n_written;
+static std::mutex window_mutex;
+static std::condition_variable window_cond;
+
+static void Uncompress() {
+  Ringbuffer<chunk_t*> recv_buf(ITEM_PER_FETCH), send_buf(ITEM_PER_INSERT);
+  chunk_t *chunk;
   int r;
 
-  conf = _conf;
+  //Every worker has its own decompression context
+  compressor_t *decompressor = compressor_create(conf->compress_type, 0);
+  if(decompressor == NULL) EXIT_TRACE("Creation of decompression context failed.\n");
 
-  //Create chunk cache
-  cache = hashtable_create(65536, hash_from_key_fn, keys_equal_fn, FALSE);
-  if(cache == NULL) {
-    printf("ERROR: Out of memory\n");
-    exit(1);
+  while(TRUE) {
+    if(recv_buf.empty()) {
+      //The reader may be waiting for the writer, which may need these records
+      while(!send_buf.empty()) {
+        r = write_que.enqueue(&send_buf, ITEM_PER_INSERT);
+        assert(r>=1);
+      }
+      r = uncompress_que.dequeue(&recv_buf, ITEM_PER_FETCH);
+      if(r < 0) break;
+    }
+    chunk = recv_buf.pop().value_or(nullptr);
+    assert(chunk!=NULL);
+
+    if(!chunk->header.isDuplicate) {
+      r=uncompress_chunk(decompressor, chunk);
+      if(r<=0) EXIT_TRACE("error uncompressing data")
+      if(needs_sha1()) {
+        fingerprint(chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, (unsigned char *)(chunk->sha1));
+      }
+    }
+
+    send_buf.push(chunk);
+    if(send_buf.full()) {
+      r = write_que.enqueue(&send_buf, ITEM_PER_INSERT);
+      assert(r>=1);
+    }
   }
 
-  mbuffer_system_init();
+  //drain buffer
+  while(!send_buf.empty()) {
+    r = write_que.enqueue(&send_buf, ITEM_PER_INSERT);
+    assert(r>=1);
+  }
+  write_que.terminate();
+  compressor_destroy(decompressor);
+}
+
+static void Write(int fd_out) {
+  Ringbuffer<chunk_t*> recv_buf(ITEM_PER_FETCH);
+  PriorityQueue pending = Initialize(DECODE_QUEUE_SIZE);
+  sequence_number_t next = 0;
+  chunk_t *chunk;
+  int r;
+
+  while(TRUE) {
+    if(recv_buf.empty()) {
+      r = write_que.dequeue(&recv_buf, ITEM_PER_FETCH);
+      if(r < 0) break;
+    }
+    chunk = recv_buf.pop().value_or(nullptr);
+    assert(chunk!=NULL);
+
+    //Keep the chunk until the records before it are written
+    if(chunk->sequence.l2num != next) {
+      Insert(chunk, pending);
+      continue;
+    }
+
+    //write as many chunks as possible, current chunk is next in sequence
+    do {
+      write_chunk(fd_out, chunk, next);
+      next++;
+      chunk = NULL;
+      if(!IsEmpty(pending) && FindMin(pending)->sequence.l2num == next) {
+        chunk = DeleteMin(pending);
+      }
+    } while(chunk != NULL);
+
+    {
+      std::lock_guard<std::mutex> lck(window_mutex);
+      n_written.store(next);
+    }
+    window_cond.notify_one();
+  }
 
+  if(!IsEmpty(pending)) EXIT_TRACE("Record %u never reached the writer.\n", next);
+  Destroy(pending);
+}
+#endif //ENABLE_PTHREADS
+
+
+/*
+ * Helper function which opens the input archive, reads its header and creates
+ * the output file
+ */
+static void open_files(int *fd_in, int *fd_out) {
   //Open input & output files
-  fd_in = open(conf->infile, O_RDONLY|O_LARGEFILE);
-  if (fd_in < 0) {
+  *fd_in = open(conf->infile, O_RDONLY|O_LARGEFILE);
+  if (*fd_in < 0) {
     perror("infile open");
     exit(1);
   }
   byte compress_type;
-  if (read_header(fd_in, &compress_type)) {
+  if (read_header(*fd_in, &compress_type)) {
     EXIT_TRACE("Cannot read input file header.\n");
   }
   //Ignore any compression settings given at the command line, use type used during encoding
   conf->compress_type = compress_type;
-  fd_out = open(conf->outfile, O_CREAT|O_WRONLY|O_TRUNC, ~(S_ISUID | S_ISGID |S_IXGRP | S_IXUSR | S_IXOTH));
-  if (fd_out < 0) {
+  if(!compressor_supported(compress_type)) {
+    EXIT_TRACE("Compression type %d (%s) used by input file not supported.\n", compress_type, compressor_name(compress_type));
+  }
+  *fd_out = open(conf->outfile, O_CREAT|O_WRONLY|O_TRUNC, ~(S_ISUID | S_ISGID |S_IXGRP | S_IXUSR | S_IXOTH));
+  if (*fd_out < 0) {
     perror("outfile open");
-    close(fd_in);
+    close(*fd_in);
     exit(1);
   }
+}
+
+unsigned long long Decode(config_t * _conf) {
+  int fd_in;
+  int fd_out;
+  chunk_t *chunk=NULL;
+  int r;
+
+  conf = _conf;
+
+  mbuffer_system_init();
+
+  open_files(&fd_in, &fd_out);
+
+  //With an index, unique chunks are freed after the last record that uses them
+  archive_index = ddp_index_read(fd_in);
+  if(archive_index != NULL && !archive_index->entries.empty()) {
+    count_references(0, archive_index->entries.size() - 1);
+  }
+  //Without one, they stay in the chunk cache, found by their SHA1 sum
+  if(archive_index == NULL) {
+    cache = hashtable_create(65536, hash_from_key_fn, keys_equal_fn, FALSE);
+    if(cache == NULL) {
+      printf("ERROR: Out of memory\n");
+      exit(1);
+    }
+  }
+  lru_init(fd_in);
+
+  auto begin = steady_clock::now();
 
 #ifdef ENABLE_PARSEC_HOOKS
     __parsec_roi_begin();
 #endif
 
+#ifdef ENABLE_PTHREADS
+  int nthreads = conf->nthreads > 0 ? conf->nthreads : 1;
+  n_written.store(0);
+  uncompress_que.delayed_init(DECODE_QUEUE_SIZE, 1);
+  write_que.delayed_init(DECODE_QUEUE_SIZE, nthreads);
+
+  std::vector<std::thread> workers;
+  for(int i=0; i<nthreads; i++) {
+    workers.emplace_back(Uncompress);
+  }
+  std::thread writer(Write, fd_out);
+
+  Ringbuffer<chunk_t*> send_buf(ITEM_PER_INSERT);
+  sequence_number_t count = 0;
   while(TRUE) {
-    //chunks are 'consumed' if they are added to the hash table
-    //only duplicate chunks can get reused, malloc a new one otherwise
-    if(chunk==NULL) {
-      chunk = (chunk_t *)malloc(sizeof(chunk_t));
-      if(chunk==NULL) EXIT_TRACE("Memory allocation failed.\n");
+    //Hold back until the writer catches up, with the records read so far sent
+    if(count >= n_written.load() + DECODE_WINDOW) {
+      while(!send_buf.empty()) {
+        r = uncompress_que.enqueue(&send_buf, ITEM_PER_INSERT);
+        assert(r>=1);
+      }
+      std::unique_lock<std::mutex> lck(window_mutex);
+      window_cond.wait(lck, [count] { return count < n_written.load() + DECODE_WINDOW; });
     }
 
+    chunk = (chunk_t *)malloc(sizeof(chunk_t));
+    if(chunk==NULL) EXIT_TRACE("Memory allocation failed.\n");
+
+    //get input data
+    r=read_chunk(fd_in, chunk);
+    if(r<0) EXIT_TRACE("error reading from input file")
+    else if(r==0) break;
+
+    chunk->sequence.l1num = 0;
+    chunk->sequence.l2num = count++;
+    send_buf.push(chunk);
+    if(send_buf.full()) {
+      r = uncompress_que.enqueue(&send_buf, ITEM_PER_INSERT);
+      assert(r>=1);
+    }
+  }
+
+  //drain buffer
+  while(!send_buf.empty()) {
+    r = uncompress_que.enqueue(&send_buf, ITEM_PER_INSERT);
+    assert(r>=1);
+  }
+  uncompress_que.terminate();
+
+  for(std::thread& worker: workers) {
+    worker.join();
+  }
+  writer.join();
+#else
+  compressor_t *decompressor = compressor_create(conf->compress_type, 0);
+  if(decompressor == NULL) EXIT_TRACE("Creation of decompression context failed.\n");
+
+  for(u_long record=0; ; record++) {
+    //chunks are 'consumed' if they are added to the hash table
+    //duplicate chunks are freed once written
+    chunk = (chunk_t *)malloc(sizeof(chunk_t));
+    if(chunk==NULL) EXIT_TRACE("Memory allocation failed.\n");
+
     //get input data
     r=read_chunk(fd_in, chunk);
     if(r<0) EXIT_TRACE("error reading from input file")
     else if(r==0) break;
 
-    //process input data & assing chunk with corresponding uncompresse data to 'entry' variable
-    chunk_t *entry;
     if(!chunk->header.isDuplicate) {
       //We got the compressed data, use it to get original data back
-      r=uncompress_chunk(chunk);
+      r=uncompress_chunk(decompressor, chunk);
       if(r<=0) EXIT_TRACE("error uncompressing data")
-      //Compute SHA1 sum and add new chunk with uncompressed data to cache
-      SHA1_Digest(chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, (unsigned char *)(chunk->sha1));
-      if(hashtable_insert(cache, (void *)(chunk->sha1), (void *)chunk) == 0) {
-        EXIT_TRACE("hashtable_insert failed");
+      //Compute SHA1 sum, the key of the chunk in the cache
+      if(needs_sha1()) {
+        fingerprint(chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, (unsigned char *)(chunk->sha1));
       }
-      entry=chunk;
-      chunk=NULL;
-    } else {
-      //We got a SHA1 key, use it to retrieve unique counterpart with uncompressed data
-      entry=(chunk_t *)hashtable_search(cache, (void *)(chunk->sha1));
-      if(entry==NULL) {
-        EXIT_TRACE("Encountered a duplicate chunk in input file but not its unique counterpart. Maybe data is out of order?");
-      }
-    }
-    //We now have the uncompressed data in 'entry', write uncompressed data to output file
-    if(xwrite(fd_out, entry->uncompressed_data.ptr, entry->uncompressed_data.n)<entry->uncompressed_data.n) {
-      EXIT_TRACE("error writing to output file");
     }
+    write_chunk(fd_out, chunk, record);
   }
 
+  compressor_destroy(decompressor);
+#endif //ENABLE_PTHREADS
+
 #ifdef ENABLE_PARSEC_HOOKS
     __parsec_roi_end();
 #endif
 
+  auto end = steady_clock::now();
+
+  lru_destroy();
+  store_close();
   close(fd_in);
   close(fd_out);
 
+  //The last read found the end of the file, its chunk is unused
   free(chunk);
+  if(archive_index != NULL) {
+    ddp_index_destroy(archive_index);
+    archive_index = NULL;
+  } else {
+    cache_destroy();
+  }
   mbuffer_system_destroy();
-  //NOTE: Would have to iterate through hashtable and manually free all buffers. Calling
-  //      hashtable_destroy will cause those buffers to be reported as leaked memory.
-  //hashtable_destroy(cache, TRUE);
+
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
 }
 
+//Helper function which reads a record of the archive, found with the index
+static void read_record(int fd, u_long record, chunk_t *chunk) {
+  if(lseek(fd, archive_index->entries[record].offset, SEEK_SET) < 0) EXIT_TRACE("lseek to record %lu fails\n", record);
+  if(read_chunk(fd, chunk) <= 0) EXIT_TRACE("Record %lu of the index is not in the archive.\n", record);
+}
+
+//Helper function which reads and uncompresses the data of a unique record
+static chunk_t *read_unique(int fd, compressor_t *decompressor, u_long record) {
+  chunk_t *chunk = (chunk_t *)malloc(sizeof(chunk_t));
+  if(chunk==NULL) EXIT_TRACE("Memory allocation failed.\n");
+
+  read_record(fd, record, chunk);
+  if(chunk->header.isDuplicate) EXIT_TRACE("Record %lu does not match the index of the archive.\n", record);
+  if(uncompress_chunk(decompressor, chunk) <= 0) EXIT_TRACE("error uncompressing data")
+  if(needs_sha1()) {
+    fingerprint(chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, (unsigned char *)(chunk->sha1));
+  }
+  return chunk;
+}
+
+unsigned long long DecodeRange(config_t * _conf, u_long begin, u_long end) {
+  int fd_in;
+  int fd_out;
+
+  conf = _conf;
+
+  mbuffer_system_init();
+
+  open_files(&fd_in, &fd_out);
+  archive_index = ddp_index_read(fd_in);
+  if(archive_index == NULL) {
+    EXIT_TRACE("%s has no index, byte ranges cannot be decoded.\n", conf->infile);
+  }
+  end = MIN(end, archive_index->uncompressed_size);
+  lru_init(fd_in);
+
+  compressor_t *decompressor = compressor_create(conf->compress_type, 0);
+  if(decompressor == NULL) EXIT_TRACE("Creation of decompression context failed.\n");
+
+  auto time_begin = steady_clock::now();
+
+  if(begin < end) {
+    u_long first = ddp_index_find(archive_index, begin);
+    u_long last = ddp_index_find(archive_index, end - 1);
+    count_references(first, last);
+
+    for(u_long record=first; record<=last; record++) {
+      u_long unique = archive_index->entries[record].unique;
+      chunk_t *chunk;
+
+      if(unique == record) {
+        chunk = read_unique(fd_in, decompressor, record);
+      } else {
+        //The unique record may be before the range
+        if(uniques.count(unique) == 0) {
+          uniques[unique] = read_unique(fd_in, decompressor, unique);
+        }
+
+        chunk = (chunk_t *)malloc(sizeof(chunk_t));
+        if(chunk==NULL) EXIT_TRACE("Memory allocation failed.\n");
+        //The SHA1 sum of a duplicate record is only read to verify it
+        if(conf->verify) {
+          read_record(fd_in, record, chunk);
+        } else {
+          chunk->header.isDuplicate = TRUE;
+        }
+      }
+
+      chunk_t *entry = resolve_chunk(chunk, record);
+      if(conf->memory_budget != 0) use_chunk(entry);
+      u_long offset = archive_index->entries[record].uncompressed_offset;
+      if(entry->uncompressed_data.n != ddp_index_uncompressed_len(archive_index, record)) {
+        EXIT_TRACE("Size of record %lu does not match the index of the archive.\n", record);
+      }
+
+      //Only the part of the first and last records in the range is written
+      u_long from = MAX(begin, offset) - offset;
+      u_long to = MIN(end, offset + entry->uncompressed_data.n) - offset;
+      if(xwrite(fd_out, (u_char *)entry->uncompressed_data.ptr + from, to - from) < to - from) {
+        EXIT_TRACE("error writing to output file");
+      }
+      release_chunk(record);
+    }
+  }
+
+  auto time_end = steady_clock::now();
+
+  lru_destroy();
+  store_close();
+  close(fd_in);
+  close(fd_out);
+
+  compressor_destroy(decompressor);
+  ddp_index_destroy(archive_index);
+  archive_index = NULL;
+  mbuffer_system_destroy();
+
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(time_end - time_begin).count();
+}
@@ -3,6 +3,11 @@
 
 #include "dedupdef.h"
 
-void Decode(config_t * _conf);
+//Returns the time spent decoding, in nanoseconds
+unsigned long long Decode(config_t * _conf);
+
+//Decode the bytes begin to end (excluded) of the original file of an archive
+//with an index. Returns the time spent decoding, in nanoseconds
+unsigned long long DecodeRange(config_t * _conf, u_long begin, u_long end);
 
 #endif /* !_DECODER_H_ */
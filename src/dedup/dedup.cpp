@@ -45,6 +45,8 @@ using json = nlohmann::json;
 config_t * conf;
 
 struct hashtable* cache;
+struct fpindex* fingerprint_index;
+struct fpstore* fingerprint_store;
 
 std::map<void*, std::tuple<std::string, std::array<size_t, 2>>> _semaphore_data;
 
@@ -193,8 +195,27 @@ void start_sol(CLIArgs const& args) {
     compressions["GZIP"] = Compressions::GZIP;
     compressions["BZIP2"] = Compressions::BZIP;
     compressions["NONE"] = Compressions::NONE;
+    compressions["ZSTD"] = Compressions::ZSTD;
+    compressions["LZ4"] = Compressions::LZ4;
     lua["Compressions"] = compressions;
 
+    sol::table fingerprints = lua.create_table_with();
+    fingerprints["AUTO"] = FINGERPRINT_AUTO;
+    fingerprints["OPENSSL"] = FINGERPRINT_OPENSSL;
+    fingerprints["SHANI"] = FINGERPRINT_SHANI;
+    fingerprints["AVX2"] = FINGERPRINT_AVX2;
+    lua["Fingerprints"] = fingerprints;
+
+    sol::table indexes = lua.create_table_with();
+    indexes["LOCKFREE"] = INDEX_LOCKFREE;
+    indexes["LOCKED"] = INDEX_LOCKED;
+    lua["Indexes"] = indexes;
+
+    sol::table chunkings = lua.create_table_with();
+    chunkings["RABIN"] = CHUNKING_RABIN;
+    chunkings["GEAR"] = CHUNKING_GEAR;
+    lua["Chunkings"] = chunkings;
+
     /* sol::table roles = lua.create_table_with();
     roles["PRODUCER"] = FIFORole::PRODUCER;
     roles["CONSUMER"] = FIFORole::CONSUMER;
@@ -221,15 +242,39 @@ void start_sol(CLIArgs const& args) {
     dedup_data_type["input_filename"] = &DedupData::_input_filename;
     dedup_data_type["output_filename"] = &DedupData::_output_filename; 
     dedup_data_type["preloading"] = &DedupData::_preloading;
+    dedup_data_type["mmap"] = &DedupData::_mmap;
     dedup_data_type["new_fifo"] = &DedupData::new_fifo;
     dedup_data_type["debug_timestamps"] = &DedupData::_debug_timestamps;
+    dedup_data_type["archive_index"] = &DedupData::_archive_index;
+    dedup_data_type["output_buffer"] = &DedupData::_output_buffer;
+    dedup_data_type["output_flusher"] = &DedupData::_output_flusher;
+    dedup_data_type["output_direct"] = &DedupData::_output_direct;
+    dedup_data_type["read_block"] = &DedupData::_read_block;
+    dedup_data_type["read_ahead"] = &DedupData::_read_ahead;
+    dedup_data_type["task_threads"] = &DedupData::_task_threads;
+    dedup_data_type["decode_threads"] = &DedupData::_decode_threads;
+    dedup_data_type["verify"] = &DedupData::_verify;
+    dedup_data_type["decode_memory"] = &DedupData::_decode_memory;
     dedup_data_type["algorithm"] = &DedupData::_algorithm;
     dedup_data_type["compression"] = &DedupData::_compression;
+    dedup_data_type["compression_level"] = &DedupData::_compression_level;
+    dedup_data_type["compress_skip"] = &DedupData::_compress_skip;
+    dedup_data_type["fingerprint"] = &DedupData::_fingerprint;
+    dedup_data_type["index"] = &DedupData::_index;
+    dedup_data_type["fingerprint_store"] = &DedupData::_fingerprint_store;
+    dedup_data_type["chunking"] = &DedupData::_chunking;
+    dedup_data_type["rabin_window"] = &DedupData::_rabin_window;
+    dedup_data_type["chunk_min"] = &DedupData::_chunk_min;
+    dedup_data_type["chunk_avg"] = &DedupData::_chunk_avg;
+    dedup_data_type["chunk_max"] = &DedupData::_chunk_max;
     dedup_data_type["dump"] = &DedupData::dump;
     dedup_data_type["run_orig"] = &DedupData::run_orig;
     // dedup_data_type["run_mutex"] = &DedupData::run_mutex;
     // dedup_data_type["run_smart"] = &DedupData::run_smart;
     dedup_data_type["run_auto"] = &DedupData::run_auto;
+    dedup_data_type["run_tasks"] = &DedupData::run_tasks;
+    dedup_data_type["run_decode"] = &DedupData::run_decode;
+    dedup_data_type["run_decode_range"] = &DedupData::run_decode_range;
     dedup_data_type["push_layer"] = &DedupData::push_layer_data;
     dedup_data_type["set_observers"] = &DedupData::set_observers;
     dedup_data_type["run_numbers"] = &DedupData::run_numbers;
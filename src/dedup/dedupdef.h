@@ -7,6 +7,7 @@
 
 #include <cstring>
 
+#include <atomic>
 #include <chrono>
 #include <vector>
 
@@ -22,6 +23,8 @@
 using std::chrono::steady_clock;
 
 #define CHECKBIT 123456
+//Header of the archives whose chunks were not cut by the Rabin engine, see write_header
+#define CHECKBIT_CHUNKING 123457
 
 #define MAX_THREADS 1024
 
@@ -167,13 +170,14 @@ static inline void sequence_reset(sequence_t *s) {
 typedef struct _chunk_t {
   struct {
     int isDuplicate;        //whether this is an original chunk or a duplicate
-    chunk_state_t state;    //which type of data this chunk contains
-#ifdef ENABLE_PTHREADS
-    //once a chunk has been added to the global database accesses
-    //to the state require synchronization b/c the chunk is globally viewable
-    pthread_mutex_t lock;
-    pthread_cond_t update;
-#endif //ENABLE_PTHREADS
+    //whether the compressed data is the uncompressed data, stored as it is in
+    //a TYPE_ORIGINAL record because it does not compress (only if !isDuplicate)
+    int isRaw;
+    //which type of data this chunk contains
+    //once a chunk has been added to the global database accesses to the
+    //state require synchronization b/c the chunk is globally viewable, they
+    //go through the chunk_state_* functions below
+    chunk_state_t state;
   } header;
   //The SHA1 sum of the chunk, computed by SHA1/Routing stage from the uncompressed chunk data
   unsigned int sha1[SHA1_LEN/sizeof(unsigned int)]; //NOTE:: Force integer-alignment for hashtable, SHA1_LEN must be multiple of unsigned int
@@ -185,6 +189,15 @@ typedef struct _chunk_t {
   mbuffer_t compressed_data;
   //reference to original chunk with compressed data (only if isDuplicate)
   struct _chunk_t *compressed_data_ref;
+  //number of the record with the compressed data once written, for the index
+  //of the archive (only if !isDuplicate)
+  u_long record;
+  //offset of the record with the compressed data in the archive, for the
+  //decoder to read it again (only if !isDuplicate)
+  u_long offset;
+  //record of an archive of the fingerprint store with the data of the chunk,
+  //which is then not compressed (only if !isDuplicate)
+  const struct fpstore_entry *stored;
 #ifdef ENABLE_PTHREADS
   //Original location of the chunk in input stream (for reordering)
   sequence_t sequence;
@@ -192,6 +205,32 @@ typedef struct _chunk_t {
   int isLastL2Chunk;
 #endif //ENABLE_PTHREADS
 } chunk_t;
+
+#ifdef ENABLE_PTHREADS
+//The thread which changes the state of a globally viewable chunk publishes the
+//data of the new state with a release store, the thread which reads the state
+//sees that data with an acquire load. A thread only sleeps, on a futex, when
+//it waits for a state which is not published yet.
+static inline chunk_state_t chunk_state_load(chunk_t *chunk) {
+  return std::atomic_ref<chunk_state_t>(chunk->header.state).load(std::memory_order_acquire);
+}
+
+static inline void chunk_state_publish(chunk_t *chunk, chunk_state_t state) {
+  std::atomic_ref<chunk_state_t> ref(chunk->header.state);
+
+  ref.store(state, std::memory_order_release);
+  //No system call unless a thread is waiting
+  ref.notify_all();
+}
+
+//Wait until the state of the chunk is no longer old, and return the new one
+static inline chunk_state_t chunk_state_wait(chunk_t *chunk, chunk_state_t old) {
+  std::atomic_ref<chunk_state_t> ref(chunk->header.state);
+
+  ref.wait(old, std::memory_order_acquire);
+  return ref.load(std::memory_order_acquire);
+}
+#endif //ENABLE_PTHREADS
  
 static std::mutex _hashmutex;
 static std::map<chunk_t*, void*> _chunks_dumps;
@@ -227,7 +266,12 @@ static inline void check_chunk(chunk_t* chunk) {
 
 #define TYPE_FINGERPRINT 0
 #define TYPE_COMPRESS 1
+//Data of a chunk which does not compress, as it is
 #define TYPE_ORIGINAL 2
+//Index of the records, last record of the archive (see ddpindex.h)
+#define TYPE_INDEX 3
+//Data of a record of an archive of the fingerprint store (see fpstore.h)
+#define TYPE_REFERENCE 4
 
 #define QUEUE_SIZE 1024UL*1024
 
@@ -255,16 +299,23 @@ typedef struct {
   int preloading;
   int nthreads;
   int verbose;
+  int verify;  //decoder: check the SHA1 sums of the duplicate records
+  size_t memory_budget;  //decoder: bytes of uncompressed unique chunks kept, 0 for no limit
+  char store[LEN_FILENAME];  //decoder: fingerprint store of the TYPE_REFERENCE records, empty for none
 } config_t;
 
 #define COMPRESS_GZIP 0
 #define COMPRESS_BZIP2 1
 #define COMPRESS_NONE 2
+#define COMPRESS_ZSTD 3
+#define COMPRESS_LZ4 4
 
 #define UNCOMPRESS_BOUND 10000000
 
 extern config_t* conf;
 extern struct hashtable* cache;
+extern struct fpindex* fingerprint_index;
+extern struct fpstore* fingerprint_store;
 
 struct ReorderData {
     unsigned long long time;
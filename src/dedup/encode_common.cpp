@@ -14,6 +14,10 @@ int keys_equal_fn ( void *key1, void *key2 ) {
     return (memcmp(key1, key2, SHA1_LEN) == 0);
 }
 
+const void *chunk_key_fn( void *v ) {
+    return ((chunk_t *)v)->sha1;
+}
+
 #ifdef ENABLE_STATISTICS
 
 //Initialize a statistics record
@@ -128,19 +132,47 @@ int create_output_file(const char *outfile) {
     int fd;
 
     //Create output file
-    fd = open(outfile, O_CREAT|O_TRUNC|O_WRONLY|O_TRUNC, S_IRGRP | S_IWUSR | S_IRUSR | S_IROTH);
+    //Readable too, an O_DIRECT output_writer_t reads the header back
+    fd = open(outfile, O_CREAT|O_TRUNC|O_RDWR, S_IRGRP | S_IWUSR | S_IRUSR | S_IROTH);
     if (fd < 0) {
         EXIT_TRACE("Cannot open output file.");
     }
 
     //Write header
-    if (write_header(fd, _g_data->_compression)) {
+    if (write_header(fd, _g_data->_compression, chunking_current())) {
         EXIT_TRACE("Cannot write output file header.\n");
     }
 
     return fd;
 }
 
+/*
+ * Helper function that writes the record with the data of a unique chunk: a
+ * reference to the record of a previous archive if the chunk is in the
+ * fingerprint store, its compressed data otherwise, or its data as it is if it
+ * does not compress.
+ */
+static void write_unique_record(output_writer_t *out, chunk_t *chunk, ddp_index_t *index) {
+    if(chunk->stored != NULL) {
+        //The data is in an archive of the fingerprint store already
+        output_writer_record(out, TYPE_REFERENCE, sizeof(fpstore_entry_t), chunk->stored);
+        if(index != NULL) {
+            chunk->record = ddp_index_add(index, TYPE_REFERENCE, sizeof(fpstore_entry_t), chunk->uncompressed_data.n, 0);
+        }
+        return;
+    }
+
+    if(fingerprint_store != NULL) {
+        fpstore_add(fingerprint_store, chunk->sha1, output_writer_offset(out));
+    }
+    u_char type = chunk->header.isRaw ? TYPE_ORIGINAL : TYPE_COMPRESS;
+    output_writer_record(out, type, chunk->compressed_data.n, chunk->compressed_data.ptr);
+    if(index != NULL) {
+        chunk->record = ddp_index_add(index, type, chunk->compressed_data.n, chunk->uncompressed_data.n, 0);
+    }
+    mbuffer_free(&chunk->compressed_data);
+}
+
 /*
  * Helper function that writes a chunk to an output file depending on
  * its state. The function will write the SHA1 sum if the chunk has
@@ -153,127 +185,124 @@ int create_output_file(const char *outfile) {
 #ifdef ENABLE_PTHREADS
 //NOTE: The parallel version checks the state of each chunk to make sure the
 //        relevant data is available. If it is not then the function waits.
-void write_chunk_to_file(int fd, chunk_t *chunk) {
+void write_chunk_to_file(output_writer_t *out, chunk_t *chunk, ddp_index_t *index) {
     assert(chunk!=NULL);
 
     //Find original chunk
     if(chunk->header.isDuplicate) chunk = chunk->compressed_data_ref;
 
-    pthread_mutex_lock(&chunk->header.lock);
-    while(chunk->header.state == CHUNK_STATE_UNCOMPRESSED) {
-        pthread_cond_wait(&chunk->header.update, &chunk->header.lock);
+    //Only waits if the Compress stage is not done with the chunk yet
+    chunk_state_t state = chunk_state_load(chunk);
+    if(state == CHUNK_STATE_UNCOMPRESSED) {
+        state = chunk_state_wait(chunk, CHUNK_STATE_UNCOMPRESSED);
     }
 
     //state is now guaranteed to be either COMPRESSED or FLUSHED
-    if(chunk->header.state == CHUNK_STATE_COMPRESSED) {
+    //NOTE: The uncompressed data has been freed, but its size is still in uncompressed_data.n
+    if(state == CHUNK_STATE_COMPRESSED) {
         //Chunk data has not been written yet, do so now
-        write_file(fd, TYPE_COMPRESS, chunk->compressed_data.n, (u_char*)chunk->compressed_data.ptr);
-        mbuffer_free(&chunk->compressed_data);
+        write_unique_record(out, chunk, index);
+        //Only the Reorder stage uses the chunk from now on
         chunk->header.state = CHUNK_STATE_FLUSHED;
     } else {
         //Chunk data has been written to file before, just write SHA1
-        write_file(fd, TYPE_FINGERPRINT, SHA1_LEN, (unsigned char *)(chunk->sha1));
+        output_writer_record(out, TYPE_FINGERPRINT, SHA1_LEN, chunk->sha1);
+        if(index != NULL) {
+            ddp_index_add(index, TYPE_FINGERPRINT, SHA1_LEN, chunk->uncompressed_data.n, chunk->record);
+        }
     }
-    pthread_mutex_unlock(&chunk->header.lock);
 }
 #else
 //NOTE: The serial version relies on the fact that chunks are processed in-order,
 //        which means if it reaches the function it is guaranteed all data is ready.
-void write_chunk_to_file(int fd, chunk_t *chunk) {
+void write_chunk_to_file(output_writer_t *out, chunk_t *chunk, ddp_index_t *index) {
     assert(chunk!=NULL);
 
     if(!chunk->header.isDuplicate) {
         //Unique chunk, data has not been written yet, do so now
-        write_file(fd, TYPE_COMPRESS, chunk->compressed_data.n, chunk->compressed_data.ptr);
-        mbuffer_free(&chunk->compressed_data);
+        write_unique_record(out, chunk, index);
     } else {
         //Duplicate chunk, data has been written to file before, just write SHA1
-        write_file(fd, TYPE_FINGERPRINT, SHA1_LEN, (unsigned char *)(chunk->sha1));
+        output_writer_record(out, TYPE_FINGERPRINT, SHA1_LEN, chunk->sha1);
+        if(index != NULL) {
+            ddp_index_add(index, TYPE_FINGERPRINT, SHA1_LEN, chunk->compressed_data_ref->uncompressed_data.n, chunk->compressed_data_ref->record);
+        }
     }
 }
 #endif //ENABLE_PTHREADS
 
+/*
+ * Compression context of the calling thread, created on first use with the
+ * backend and level of the run
+ */
+static compressor_t *thread_compressor() {
+    static thread_local std::unique_ptr<compressor_t, decltype(&compressor_destroy)> compressor(nullptr, compressor_destroy);
+
+    if(!compressor) {
+        compressor.reset(compressor_create(_g_data->_compression, _g_data->_compression_level));
+        if(!compressor) {
+            EXIT_TRACE("Creation of %s compressor failed.\n", compressor_name(_g_data->_compression));
+        }
+    }
+    return compressor.get();
+}
+
+//Chunks of the Compress stage, those the estimator found incompressible, and
+//those which did not get smaller when compressed
+static std::atomic<u_long> compress_chunks, compress_skipped, compress_expanded;
+
 /*
  * Computational kernel of compression stage
  *
  * Actions performed:
- *    - Compress a data chunk
+ *    - Estimate whether a data chunk compresses, with compress_skip
+ *    - Compress it if it does, keep it as it is otherwise
  */
 void sub_Compress(chunk_t *chunk) {
+    const void *compressed;
     size_t n;
     int r;
 
     assert(chunk!=NULL);
     //compress the item and add it to the database
 #ifdef ENABLE_PTHREADS
-    pthread_mutex_lock(&chunk->header.lock);
-    assert(chunk->header.state == CHUNK_STATE_UNCOMPRESSED);
+    assert(chunk_state_load(chunk) == CHUNK_STATE_UNCOMPRESSED);
 #endif //ENABLE_PTHREADS
-    switch (_g_data->_compression) {
-        case COMPRESS_NONE:
-            //Simply duplicate the data
-            n = chunk->uncompressed_data.n;
-            r = mbuffer_create(&chunk->compressed_data, n);
-            if(r != 0) {
-                EXIT_TRACE("Creation of compression buffer failed.\n");
-            }
-            //copy the block
-            memcpy(chunk->compressed_data.ptr, chunk->uncompressed_data.ptr, chunk->uncompressed_data.n);
-            break;
-#ifdef ENABLE_GZIP_COMPRESSION
-        case COMPRESS_GZIP:
-            //Gzip compression buffer must be at least 0.1% larger than source buffer plus 12 bytes
-            n = chunk->uncompressed_data.n + (chunk->uncompressed_data.n >> 9) + 12;
-            r = mbuffer_create(&chunk->compressed_data, n);
-            if(r != 0) {
-                EXIT_TRACE("Creation of compression buffer failed.\n");
-            }
-            //compress the block
-            r = compress((Bytef*)chunk->compressed_data.ptr, &n, (const Bytef*)chunk->uncompressed_data.ptr, chunk->uncompressed_data.n);
-            if (r != Z_OK) {
-                EXIT_TRACE("Compression failed\n");
-            }
-            //Shrink buffer to actual size
-            if(n < chunk->compressed_data.n) {
-                r = mbuffer_realloc(&chunk->compressed_data, n);
-                assert(r == 0);
-            }
-            break;
-#endif //ENABLE_GZIP_COMPRESSION
-#ifdef ENABLE_BZIP2_COMPRESSION
-        case COMPRESS_BZIP2:
-            //Bzip compression buffer must be at least 1% larger than source buffer plus 600 bytes
-            n = chunk->uncompressed_data.n + (chunk->uncompressed_data.n >> 6) + 600;
-            r = mbuffer_create(&chunk->compressed_data, n);
-            if(r != 0) {
-                EXIT_TRACE("Creation of compression buffer failed.\n");
-            }
-            //compress the block
-            {
-                unsigned int int_n = n;
-                r = BZ2_bzBuffToBuffCompress((char*)chunk->compressed_data.ptr, &int_n, (char*)chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, 9, 0, 30);
-                n = int_n;
-            }
-            if (r != BZ_OK) {
-                EXIT_TRACE("Compression failed\n");
-            }
-            //Shrink buffer to actual size
-            if(n < chunk->compressed_data.n) {
-                r = mbuffer_realloc(&chunk->compressed_data, n);
-                assert(r == 0);
-            }
-            break;
-#endif //ENABLE_BZIP2_COMPRESSION
-        default:
-            EXIT_TRACE("Compression type not implemented.\n");
-            break;
+    //Without compress_skip every chunk is compressed, as older decoders expect
+    int skip = _g_data->_compress_skip > 0 && _g_data->_compression != COMPRESS_NONE;
+    chunk->header.isRaw = FALSE;
+    if(skip) {
+        compress_chunks.fetch_add(1, std::memory_order_relaxed);
+    }
+    if(skip && compressor_entropy(chunk->uncompressed_data.ptr, chunk->uncompressed_data.n) >= _g_data->_compress_skip) {
+        //Already compressed data, not worth running the compressor on it
+        compress_skipped.fetch_add(1, std::memory_order_relaxed);
+        chunk->header.isRaw = TRUE;
+    } else {
+        //The compressor works in its own buffer, so the chunk gets a buffer of the exact size
+        compressed = compressor_compress(thread_compressor(), chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, &n);
+        if(compressed == NULL) {
+            EXIT_TRACE("Compression failed\n");
+        }
+        if(skip && n >= chunk->uncompressed_data.n) {
+            compress_expanded.fetch_add(1, std::memory_order_relaxed);
+            chunk->header.isRaw = TRUE;
+        }
     }
+    if(chunk->header.isRaw) {
+        compressed = chunk->uncompressed_data.ptr;
+        n = chunk->uncompressed_data.n;
+    }
+    r = mbuffer_create(&chunk->compressed_data, n);
+    if(r != 0) {
+        EXIT_TRACE("Creation of compression buffer failed.\n");
+    }
+    memcpy(chunk->compressed_data.ptr, compressed, n);
     mbuffer_free(&chunk->uncompressed_data);
 
 #ifdef ENABLE_PTHREADS
-    chunk->header.state = CHUNK_STATE_COMPRESSED;
-    pthread_cond_broadcast(&chunk->header.update);
-    pthread_mutex_unlock(&chunk->header.lock);
+    //Publishes the compressed data, and wakes up the Reorder stage if it waits
+    chunk_state_publish(chunk, CHUNK_STATE_COMPRESSED);
 #endif //ENABLE_PTHREADS
 
     return;
@@ -289,37 +318,129 @@ void sub_Compress(chunk_t *chunk) {
  *    - Returns chunk redundancy status
  */
 std::tuple<int, unsigned int> sub_Deduplicate(chunk_t *chunk) {
-    int isDuplicate;
-    chunk_t *entry;
-
     assert(chunk!=NULL);
     assert(chunk->uncompressed_data.ptr!=NULL);
 
-    SHA1_Digest(chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, (unsigned char *)(chunk->sha1));
+    fingerprint(chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, (unsigned char *)(chunk->sha1));
 
-    //Query database to determine whether we've seen the data chunk before
+    return sub_Deduplicate_fingerprinted(chunk);
+}
+
+/*
+ * Compute the SHA1 signatures of a batch of chunks, letting multi-buffer
+ * backends hash them side by side.
+ */
+void sub_Fingerprint(chunk_t **chunks, int n) {
+    const void *data[FINGERPRINT_MAX_BATCH];
+    size_t len[FINGERPRINT_MAX_BATCH];
+    unsigned char *digest[FINGERPRINT_MAX_BATCH];
+
+    for (int begin = 0; begin < n; begin += FINGERPRINT_MAX_BATCH) {
+        int count = MIN(n - begin, FINGERPRINT_MAX_BATCH);
+        for (int i = 0; i < count; ++i) {
+            chunk_t *chunk = chunks[begin + i];
+            assert(chunk->uncompressed_data.ptr!=NULL);
+            data[i] = chunk->uncompressed_data.ptr;
+            len[i] = chunk->uncompressed_data.n;
+            digest[i] = (unsigned char *)(chunk->sha1);
+        }
+
+        fingerprint_batch(data, len, digest, count);
+    }
+}
+
+/*
+ * After a miss in the index of the run, look the chunk up in the fingerprint
+ * store. A chunk of a previous archive is written as a reference to its
+ * record, so it skips the Compress stage like a duplicate.
+ * Returns TRUE if the chunk was found.
+ */
+static int sub_Deduplicate_stored(chunk_t *chunk) {
+    if (fingerprint_store == NULL)
+        return FALSE;
+
+    chunk->stored = fpstore_search(fingerprint_store, chunk->sha1);
+    if (chunk->stored == NULL)
+        return FALSE;
+
+    mbuffer_free(&chunk->uncompressed_data);
 #ifdef ENABLE_PTHREADS
-    auto [ht_lock, idx] = hashtable_getlock(cache, (void *)(chunk->sha1));
-    pthread_mutex_lock(ht_lock);
-#endif
+    //Its duplicates may already wait for it in the Reorder stage
+    chunk_state_publish(chunk, CHUNK_STATE_COMPRESSED);
+#endif //ENABLE_PTHREADS
+    return TRUE;
+}
+
+/*
+ * sub_Deduplicate_fingerprinted on the lock-free index: a single
+ * insert-if-absent replaces the search and insert under the bucket lock.
+ */
+static std::tuple<int, unsigned int> sub_Deduplicate_lockfree(chunk_t *chunk) {
+    int isDuplicate;
+    chunk_t *entry;
+
+    //The chunk can be seen by the other threads as soon as it is inserted
+    chunk->header.isDuplicate = FALSE;
+    chunk->stored = NULL;
+    entry = (chunk_t *)fpindex_insert(fingerprint_index, chunk);
+    isDuplicate = (entry != chunk);
+    if (isDuplicate) {
+        // Cache hit: Skipping compression stage
+        chunk->header.isDuplicate = TRUE;
+        chunk->compressed_data_ref = entry;
+        mbuffer_free(&chunk->uncompressed_data);
+    }
+
+    //No lock, hence no lock index
+    return { isDuplicate || sub_Deduplicate_stored(chunk), 0 };
+}
+
+/*
+ * sub_Deduplicate_fingerprinted on the PARSEC hashtable, the lock of the
+ * bucket of chunk must be held.
+ */
+static int sub_Deduplicate_locked(chunk_t *chunk) {
+    int isDuplicate;
+    chunk_t *entry;
+
     entry = (chunk_t *)hashtable_search(cache, (void *)(chunk->sha1));
     isDuplicate = (entry != NULL);
     chunk->header.isDuplicate = isDuplicate;
     if (!isDuplicate) {
         // Cache miss: Create entry in hash table and forward data to compression stage
-#ifdef ENABLE_PTHREADS
-        pthread_mutex_init(&chunk->header.lock, NULL);
-        pthread_cond_init(&chunk->header.update, NULL);
-#endif
         //NOTE: chunk->compressed_data.buffer will be computed in compression stage
+        chunk->stored = NULL;
         if (hashtable_insert(cache, (void *)(chunk->sha1), (void *)chunk) == 0) {
             EXIT_TRACE("hashtable_insert failed");
         }
+        return sub_Deduplicate_stored(chunk);
     } else {
         // Cache hit: Skipping compression stage
         chunk->compressed_data_ref = entry;
         mbuffer_free(&chunk->uncompressed_data);
     }
+
+    return isDuplicate;
+}
+
+/*
+ * Database part of sub_Deduplicate, chunk->sha1 must already be computed.
+ */
+std::tuple<int, unsigned int> sub_Deduplicate_fingerprinted(chunk_t *chunk) {
+    int isDuplicate;
+
+    assert(chunk!=NULL);
+    assert(chunk->uncompressed_data.ptr!=NULL);
+
+    if (_g_data->_index == INDEX_LOCKFREE)
+        return sub_Deduplicate_lockfree(chunk);
+
+    //Query database to determine whether we've seen the data chunk before
+#ifdef ENABLE_PTHREADS
+    auto [ht_lock, idx] = hashtable_getlock(cache, (void *)(chunk->sha1));
+    pthread_mutex_lock(ht_lock);
+#endif
+    isDuplicate = sub_Deduplicate_locked(chunk);
 #ifdef ENABLE_PTHREADS
     pthread_mutex_unlock(ht_lock);
 #endif
@@ -327,6 +448,104 @@ std::tuple<int, unsigned int> sub_Deduplicate(chunk_t *chunk) {
     return { isDuplicate, idx };
 }
 
+/*
+ * Batched sub_Deduplicate_fingerprinted: the buckets of all the chunks are
+ * prefetched before the first one is looked up, so that their cache misses
+ * overlap. With the PARSEC hashtable, the chunks are then grouped by lock so
+ * that each lock is taken once per batch. Within a group the chunks keep
+ * their order, so the first of two identical chunks stays the original.
+ */
+void sub_Deduplicate_batch(chunk_t **chunks, int n, int *isDuplicate) {
+    for (int begin = 0; begin < n; begin += FINGERPRINT_MAX_BATCH) {
+        int count = MIN(n - begin, FINGERPRINT_MAX_BATCH);
+        chunk_t **batch = chunks + begin;
+
+        if (_g_data->_index == INDEX_LOCKFREE) {
+            for (int i = 0; i < count; ++i)
+                fpindex_prefetch(fingerprint_index, batch[i]->sha1);
+
+            for (int i = 0; i < count; ++i)
+                isDuplicate[begin + i] = std::get<0>(sub_Deduplicate_lockfree(batch[i]));
+            continue;
+        }
+
+#ifdef ENABLE_PTHREADS
+        pthread_mutex_t *locks[FINGERPRINT_MAX_BATCH];
+        std::pair<unsigned int, int> order[FINGERPRINT_MAX_BATCH];
+
+        for (int i = 0; i < count; ++i) {
+            auto [ht_lock, idx] = hashtable_getlock(cache, (void *)(batch[i]->sha1));
+            hashtable_prefetch(cache, idx);
+            locks[i] = ht_lock;
+            order[i] = { idx, i };
+        }
+
+        std::sort(order, order + count);
+
+        for (int j = 0; j < count; ) {
+            unsigned int idx = order[j].first;
+            pthread_mutex_t *ht_lock = locks[order[j].second];
+
+            pthread_mutex_lock(ht_lock);
+            for (; j < count && order[j].first == idx; ++j) {
+                int i = order[j].second;
+                isDuplicate[begin + i] = sub_Deduplicate_locked(batch[i]);
+            }
+            pthread_mutex_unlock(ht_lock);
+        }
+#else
+        for (int i = 0; i < count; ++i)
+            isDuplicate[begin + i] = sub_Deduplicate_locked(batch[i]);
+#endif
+    }
+}
+
+//Chunks of the run, allocated by the threads from their own slabs
+static slab_cache_t *chunk_slabs = NULL;
+
+chunk_t *chunk_alloc() {
+    chunk_t *chunk = (chunk_t *)slab_alloc(chunk_slabs);
+    if(chunk==NULL) EXIT_TRACE("Memory allocation failed.\n");
+    return chunk;
+}
+
+void chunk_free(chunk_t *chunk) {
+    slab_free(chunk);
+}
+
+void release_mapped_input(void* ptr, size_t n) {
+    // Only drop the pages that lie entirely in the region, the first and last
+    // ones may still be used by the neighbouring chunks
+    static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = ((uintptr_t)ptr + page_size - 1) & ~(page_size - 1);
+    uintptr_t end = ((uintptr_t)ptr + n) & ~(page_size - 1);
+    if (begin < end) {
+        madvise((void*)begin, end - begin, MADV_DONTNEED);
+    }
+}
+
+sequence_number_t fragment_stream(int fd, u32int *rabintab, u32int *rabinwintab, std::function<void(chunk_t*)> const& push) {
+    //Blocks of MAXBUF bytes for the callers which stream without a block size
+    size_t block_size = _g_data->_read_block > 0 ? _g_data->_read_block : MAXBUF;
+    input_stream_t *in = input_stream_create(fd, block_size, std::max(_g_data->_read_ahead, 2U), FRAGMENT_HEAD_ROOM);
+    sequence_number_t anchorcount = 0;
+
+    input_stream_split(in, rf_win_dataprocess, rabintab, rabinwintab, [&](const u_char *p, size_t n) {
+        // A copy of its own, so that the block goes back to the reader at once
+        // instead of when the last chunk cut from it is gone
+        chunk_t *chunk = chunk_alloc();
+        if(mbuffer_create(&chunk->uncompressed_data, n) != 0) {
+            EXIT_TRACE("Unable to initialize memory buffer.\n");
+        }
+        memcpy(chunk->uncompressed_data.ptr, p, n);
+        chunk->header.state = CHUNK_STATE_UNCOMPRESSED;
+        chunk->sequence.l1num = anchorcount++;
+        push(chunk);
+    });
+
+    input_stream_destroy(in);
+    return anchorcount;
+}
 
 unsigned long long EncodeBase(DedupData& data, std::function<void(DedupData&, int, size_t, void*, tp&, tp&)>&& fn) {
     _g_data = &data;
@@ -335,14 +554,60 @@ unsigned long long EncodeBase(DedupData& data, std::function<void(DedupData&, in
     int32 fd;
 
     //Create chunk cache
-    cache = hashtable_create(65536, hash_from_key_fn, keys_equal_fn, FALSE);
-    if(cache == NULL) {
-        printf("ERROR: Out of memory\n");
-        exit(1);
+    if(data._index == INDEX_LOCKFREE) {
+        fingerprint_index = fpindex_create(65536, chunk_key_fn);
+        if(fingerprint_index == NULL) {
+            printf("ERROR: Out of memory\n");
+            exit(1);
+        }
+    } else {
+        cache = hashtable_create(65536, hash_from_key_fn, keys_equal_fn, FALSE);
+        if(cache == NULL) {
+            printf("ERROR: Out of memory\n");
+            exit(1);
+        }
     }
+    printf("Fingerprint index: %s\n", dedup_index_name(data._index));
     
     /* int init_res = */ mbuffer_system_init();
     // assert(!init_res);
+    chunk_slabs = slab_cache_create(sizeof(chunk_t));
+
+    //Also checks the level, so that a typo fails before the pipeline starts
+    compressor_t *compressor = compressor_create(data._compression, data._compression_level);
+    if(compressor == NULL)
+        EXIT_TRACE("Compression %s at level %d is not supported\n", compressor_name(data._compression), data._compression_level);
+    compressor_destroy(compressor);
+    printf("Compression: %s, level %d\n", compressor_name(data._compression),
+           data._compression_level != 0 ? data._compression_level : compressor_default_level(data._compression));
+    if(data._compress_skip > 0)
+        printf("Compression skipped above %.2f bits per byte\n", data._compress_skip);
+
+    if(fingerprint_init(data._fingerprint) != 0)
+        EXIT_TRACE("Fingerprint backend %s is not supported by this CPU\n", fingerprint_backend_name(data._fingerprint));
+    printf("Fingerprint backend: %s\n", fingerprint_backend_name(fingerprint_backend()));
+
+    if(!data._fingerprint_store.empty()) {
+        fingerprint_store = fpstore_open(data._fingerprint_store.c_str());
+        u32int archive = fpstore_begin(fingerprint_store, data._output_filename.c_str(), data._compression);
+        printf("Fingerprint store: %s, %lu chunks of %u archives\n", data._fingerprint_store.c_str(),
+               fpstore_count(fingerprint_store), archive);
+    }
+
+    //Window of the Rabin tables of Fragment and Refine
+    rf_win = rf_win_dataprocess = data._rabin_window ? NWINDOW : 0;
+    if(data._rabin_window)
+        printf("Rabin window: %d bytes\n", NWINDOW);
+
+    chunking_t chunking = { data._chunking, data._chunk_min, data._chunk_avg, data._chunk_max };
+    if(chunking_init(&chunking) != 0)
+        EXIT_TRACE("Chunking %s with sizes %u/%u/%u is not supported\n", chunking_engine_name(data._chunking),
+                   data._chunk_min, data._chunk_avg, data._chunk_max);
+    if(data._chunking == CHUNKING_RABIN)
+        printf("Chunking: %s\n", chunking_engine_name(data._chunking));
+    else
+        printf("Chunking: %s, %u/%u/%u bytes\n", chunking_engine_name(data._chunking),
+               data._chunk_min, data._chunk_avg, data._chunk_max);
 
     /* src file stat */
     if (stat(data._input_filename.c_str(), &filestat) < 0)
@@ -355,9 +620,17 @@ unsigned long long EncodeBase(DedupData& data, std::function<void(DedupData&, in
     if((fd = open(data._input_filename.c_str(), O_RDONLY | O_LARGEFILE)) < 0)
         EXIT_TRACE("%s file open error %s\n", data._input_filename.c_str(), strerror(errno));
 
-    //Load entire file into memory if requested by user
+    //Map or load entire file into memory if requested by user
     void *preloading_buffer = NULL;
-    if(data._preloading) {
+    if(data._mmap) {
+        if(filestat.st_size > 0) {
+            preloading_buffer = mmap(NULL, filestat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(preloading_buffer == MAP_FAILED)
+                EXIT_TRACE("Unable to map input file: %s\n", strerror(errno));
+            //Input is read front to back, have the kernel read ahead aggressively
+            madvise(preloading_buffer, filestat.st_size, MADV_SEQUENTIAL);
+        }
+    } else if(data._preloading) {
         size_t bytes_read=0;
         int r;
 
@@ -393,11 +666,28 @@ unsigned long long EncodeBase(DedupData& data, std::function<void(DedupData&, in
 
     /// Algorithm specific part
     tp begin, end;
+    compress_chunks = 0;
+    compress_skipped = 0;
+    compress_expanded = 0;
     fn(data, fd, filestat.st_size, preloading_buffer, begin, end);
     unsigned long long diff = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+    if(data._compress_skip > 0) {
+        printf("Compress: %lu chunks, %lu stored as they are: %lu skipped as incompressible, %lu not smaller once compressed\n",
+               compress_chunks.load(), compress_skipped.load() + compress_expanded.load(), compress_skipped.load(), compress_expanded.load());
+    }
+
+    //The archive is complete, its unique chunks can be referred to by the next runs
+    if(fingerprint_store != NULL) {
+        fpstore_commit(fingerprint_store);
+        fpstore_close(fingerprint_store);
+        fingerprint_store = NULL;
+    }
 
-    //clean up after preloading
-    if(data._preloading) {
+    //clean up after mapping / preloading
+    if(data._mmap) {
+        if(preloading_buffer != NULL)
+            munmap(preloading_buffer, filestat.st_size);
+    } else if(data._preloading) {
         free(preloading_buffer);
     }
 
@@ -408,7 +698,14 @@ unsigned long long EncodeBase(DedupData& data, std::function<void(DedupData&, in
     /* int des_res = */ mbuffer_system_destroy();
     // assert(!des_res);
 
-    hashtable_destroy(cache, TRUE);
+    //The unique chunks in the index are freed along with their slabs
+    if(data._index == INDEX_LOCKFREE)
+        fpindex_destroy(fingerprint_index, FALSE);
+    else
+        hashtable_destroy(cache, FALSE);
+    printf("Chunks: %zu slabs of %d KB\n", slab_cache_slabs(chunk_slabs), SLAB_SIZE / 1024);
+    slab_cache_destroy(chunk_slabs);
+    chunk_slabs = NULL;
 
     return diff;
 }
@@ -11,19 +11,31 @@
 #include <unistd.h>
 #include <cstring>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <set>
 #include <vector>
 
 #include "sha.h"
+#include "compressor.h"
+#include "fingerprint.h"
 #include "util.h"
 #include "dedupdef.h"
 #include "encoder.h"
 #include "debug.h"
+#include "ddpindex.h"
+#include "output_writer.h"
+#include "input_stream.h"
+#include "slab.h"
 #include "hashtable.h"
+#include "fpindex.h"
+#include "fpstore.h"
 #include "config.h"
 #include "rabin.h"
+#include "chunking.h"
 #include "mbuffer.h"
 #include "step.h"
 #include "script_mgr.h"
@@ -33,6 +45,7 @@
 #include "queue.h"
 #include "binheap.h"
 #include "tree.h"
+#include "reorder_window.h"
 #include "lua_core.h"
 #endif //ENABLE_PTHREADS
 
@@ -54,6 +67,7 @@
 
 unsigned int hash_from_key_fn(void* k);
 int keys_equal_fn(void* key1, void* key2);
+const void* chunk_key_fn(void* v);
 
 #ifdef ENABLE_STATISTICS
 
@@ -89,16 +103,37 @@ extern stats_t stats;
 
 int write_file(int fd, u_char type, u_long len, u_char * content);
 int create_output_file(const char *outfile); 
-void write_chunk_to_file(int fd, chunk_t *chunk);
+//Adds the record to index if it is not NULL
+void write_chunk_to_file(output_writer_t *out, chunk_t *chunk, ddp_index_t *index = NULL);
 
 void sub_Compress(chunk_t *chunk);
 std::tuple<int, unsigned int> sub_Deduplicate(chunk_t *chunk);
+// Split version of sub_Deduplicate: compute the SHA1 signatures of n chunks
+// together, then query the database for each of them.
+void sub_Fingerprint(chunk_t **chunks, int n);
+std::tuple<int, unsigned int> sub_Deduplicate_fingerprinted(chunk_t *chunk);
+// Query the database for n fingerprinted chunks, isDuplicate receives the
+// status of each of them.
+void sub_Deduplicate_batch(chunk_t **chunks, int n, int *isDuplicate);
 
 using sc = std::chrono::steady_clock;
 using tp = std::chrono::time_point<sc>;
 
 unsigned long long EncodeBase(DedupData& data, std::function<void(DedupData&, int, size_t, void*, tp&, tp&)>&& fn);
 
+// Release function of the mbuffer views into the mapped input: give the pages
+// back once the last chunk using them is gone.
+void release_mapped_input(void* ptr, size_t n);
+
+// Fragment stage reading the input with an input_stream_t, from fd to the end
+// of the file: push receives the anchors in sequence. Returns their number.
+sequence_number_t fragment_stream(int fd, u32int *rabintab, u32int *rabinwintab, std::function<void(chunk_t*)> const& push);
+
+// Allocate and free the chunks of the pipeline, from any thread. The chunks that
+// are still allocated at the end of Encode, the unique ones, are freed with it.
+chunk_t *chunk_alloc();
+void chunk_free(chunk_t *chunk);
+
 void compute_fifo_ids_for_layer(std::set<int>& fifo_ids, LayerData const& data);
 void compute_fifo_ids_for_reorder(std::set<int>& fifo_ids, LayerData const& deduplicate, LayerData const& compress);
 
@@ -112,4 +147,13 @@ extern DedupData* _g_data;
 
 #define INITIAL_SEARCH_TREE_SIZE 4096
 
+//Expected number of chunks the Refine stage cuts an anchor into: an anchor is
+//about ANCHOR_JUMP bytes, a refined chunk about MinSegment + RabinMask bytes
+#define REORDER_SLOTS_PER_ANCHOR (ANCHOR_JUMP / (MinSegment + RabinMask + 1))
+
+//Bytes before every block of the input_stream_t of the Fragment stage, where
+//the start of the anchor spanning two blocks is copied. An anchor is seldom
+//more than ANCHOR_JUMP bytes plus a few times RabinMask.
+#define FRAGMENT_HEAD_ROOM (2 * ANCHOR_JUMP)
+
 #endif /* ENCODE_COMMON_H */
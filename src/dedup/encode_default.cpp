@@ -61,7 +61,6 @@ void *FragmentDefault(void * targs){
     send_buf.delayed_init(args->_output_step);
     assert(r==0);
 
-    rf_win_dataprocess = 0;
     rabininit(rf_win_dataprocess, rabintab, rabinwintab);
 
     //Sanity check
@@ -70,8 +69,25 @@ void *FragmentDefault(void * targs){
         fflush(NULL);
     }
 
+    //Stream the file in blocks of bounded memory instead of MAXBUF buffers
+    int stream = _g_data->_read_block > 0 && !_g_data->_preloading && !_g_data->_mmap;
+    if(stream) {
+        fragment_stream(fd, rabintab, rabinwintab, [&](chunk_t *chunk) {
+            r = send_buf.push(chunk);
+            ++count;
+            assert(r==0);
+
+            //send a group of items into the next queue in round-robin fashion
+            if (send_buf.full()) {
+                r = refine_que[args->output_queues_ids[queue_pos]].enqueue(&send_buf, args->_output_step);
+                assert(r>=1);
+                queue_pos = (queue_pos + 1) % args->output_nqueues;
+            }
+        });
+    }
+
     //read from input file / buffer
-    while (1) {
+    while (!stream) {
         size_t bytes_left; //amount of data left over in last_mbuffer from previous iteration
 
         //Check how much data left over from previous iteration resp. create an initial chunk
@@ -86,8 +102,7 @@ void *FragmentDefault(void * targs){
             EXIT_TRACE("Input buffer size exceeds system maximum.\n");
         }
         //Allocate a new chunk and create a new memory buffer
-        chunk = (chunk_t *)malloc(sizeof(chunk_t));
-        if(chunk==NULL) EXIT_TRACE("Memory allocation failed.\n");
+        chunk = chunk_alloc();
         r = mbuffer_create(&chunk->uncompressed_data, MAXBUF+bytes_left);
         if(r!=0) {
             EXIT_TRACE("Unable to initialize memory buffer.\n");
@@ -102,7 +117,7 @@ void *FragmentDefault(void * targs){
             //NOTE: We cannot safely extend the current memory region because it has already been given to another thread
             memcpy(chunk->uncompressed_data.ptr, temp->uncompressed_data.ptr, temp->uncompressed_data.n);
             mbuffer_free(&temp->uncompressed_data);
-            free(temp);
+            chunk_free(temp);
             temp = NULL;
         } else {
             //brand new mbuffer, increment sequence number
@@ -112,9 +127,13 @@ void *FragmentDefault(void * targs){
         }
         //Read data until buffer full
         size_t bytes_read=0;
-        if(_g_data->_preloading) {
+        if(_g_data->_preloading || _g_data->_mmap) {
             size_t max_read = MIN(MAXBUF, args->input_file.size-preloading_buffer_seek);
             memcpy((uchar*)chunk->uncompressed_data.ptr+bytes_left, (uchar*)args->input_file.buffer+preloading_buffer_seek, max_read);
+            //The mapping is only read once, drop what was copied
+            if(_g_data->_mmap) {
+                release_mapped_input((uchar*)args->input_file.buffer+preloading_buffer_seek, max_read);
+            }
             bytes_read = max_read;
             preloading_buffer_seek += max_read;
         } else {
@@ -145,7 +164,7 @@ void *FragmentDefault(void * targs){
         //No data left over from last iteration and also nothing new read in, simply clean up and quit
         if(bytes_left + bytes_read == 0) {
             mbuffer_free(&chunk->uncompressed_data);
-            free(chunk);
+            chunk_free(chunk);
             chunk = NULL;
             break;
         }
@@ -169,7 +188,7 @@ void *FragmentDefault(void * targs){
             split = 0;
             //Try to split the buffer at least ANCHOR_JUMP bytes away from its beginning
             if(ANCHOR_JUMP < chunk->uncompressed_data.n) {
-                int offset = rabinseg((uchar*)chunk->uncompressed_data.ptr + ANCHOR_JUMP, chunk->uncompressed_data.n - ANCHOR_JUMP, rf_win_dataprocess, rabintab, rabinwintab);
+                int offset = rabinseg_lanes((uchar*)chunk->uncompressed_data.ptr + ANCHOR_JUMP, chunk->uncompressed_data.n - ANCHOR_JUMP, rf_win_dataprocess, rabintab, rabinwintab);
                 //Did we find a split location?
                 if(offset == 0) {
                     //Split found at the very beginning of the buffer (should never happen due to technical limitations)
@@ -178,8 +197,7 @@ void *FragmentDefault(void * targs){
                 } else if(offset + ANCHOR_JUMP < chunk->uncompressed_data.n) {
                     //Split found somewhere in the middle of the buffer
                     //Allocate a new chunk and create a new memory buffer
-                    temp = (chunk_t *)malloc(sizeof(chunk_t));
-                    if(temp==NULL) EXIT_TRACE("Memory allocation failed.\n");
+                    temp = chunk_alloc();
 
                     //split it into two pieces
                     r = mbuffer_split(&chunk->uncompressed_data, &temp->uncompressed_data, offset + ANCHOR_JUMP);
@@ -292,7 +310,7 @@ void *FragmentRefineDefault(void * targs) {
         }
 
         //get one item
-        chunk = *recv_buf.pop();
+        chunk = recv_buf.pop().value_or(nullptr);
         assert(chunk!=NULL);
 
         rabininit(rf_win, rabintab, rabinwintab);
@@ -300,13 +318,12 @@ void *FragmentRefineDefault(void * targs) {
         int split;
         sequence_number_t chcount = 0;
         do {
-            //Find next anchor with Rabin fingerprint
-            int offset = rabinseg((uchar*)chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, rf_win, rabintab, rabinwintab);
+            //Find next anchor with the chunking engine
+            int offset = chunking_cut((uchar*)chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, rf_win, rabintab, rabinwintab);
             //Can we split the buffer?
             if(offset < chunk->uncompressed_data.n) {
                 //Allocate a new chunk and create a new memory buffer
-                temp = (chunk_t *)malloc(sizeof(chunk_t));
-                if(temp==NULL) EXIT_TRACE("Memory allocation failed.\n");
+                temp = chunk_alloc();
                 temp->header.state = chunk->header.state;
                 temp->sequence.l1num = chunk->sequence.l1num;
 
@@ -428,7 +445,7 @@ void * DeduplicateDefault(void * targs) {
         }
 
         //get one chunk
-        chunk = *recv_buf.pop();
+        chunk = recv_buf.pop().value_or(nullptr);
         assert(chunk!=NULL);
 
         //Do the processing
@@ -533,7 +550,7 @@ void *CompressDefault(void * targs) {
         }
 
         //fetch one item
-        chunk = *recv_buf.pop();
+        chunk = recv_buf.pop().value_or(nullptr);
         assert(chunk!=NULL);
 
         sub_Compress(chunk);
@@ -577,13 +594,6 @@ void *CompressDefault(void * targs) {
 #endif //ENABLE_STATISTICS
 }
 
-struct ReorderComputeData {
-    SearchTree T;
-    sequence_number_t* chunks_per_anchor;
-};
-
-// static ReorderComputeData c_data;
-
 void *ReorderDefault(void * targs) {
     struct thread_args *args = (struct thread_args *)targs;
     int queue_id = 0;
@@ -594,23 +604,8 @@ void *ReorderDefault(void * targs) {
 
     pthread_barrier_wait(args->_barrier);
 
-    SearchTree T = TreeMakeEmpty(NULL);
-    sequence_number_t* chunks_per_anchor;
-    // c_data.T = TreeMakeEmpty(NULL);
-    Position pos = NULL;
-    struct tree_element tele;
-
-    sequence_t next;
-    sequence_reset(&next);
-
-    //We perform global anchoring in the first stage and refine the anchoring
-    //in the second stage. This array keeps track of the number of chunks in
-    //a coarse chunk.
-    // sequence_number_t *chunks_per_anchor;
-    unsigned int chunks_per_anchor_max = 1024;
-    chunks_per_anchor = (sequence_number_t*)malloc(chunks_per_anchor_max * sizeof(sequence_number_t));
-    if(chunks_per_anchor == NULL) EXIT_TRACE("Error allocating memory\n");
-    memset(chunks_per_anchor, 0, chunks_per_anchor_max * sizeof(sequence_number_t));
+    //Chunks which arrive out of order wait in the window until they are next
+    reorder_window_t *window = reorder_window_create(REORDER_SLOTS_PER_ANCHOR);
     int r;
     int i;
 
@@ -618,6 +613,12 @@ void *ReorderDefault(void * targs) {
     assert(r==0);
 
     fd = create_output_file(_g_data->_output_filename.c_str());
+    ddp_index_t *index = NULL;
+    if(_g_data->_archive_index) {
+        index = ddp_index_create(lseek(fd, 0, SEEK_CUR));
+    }
+    output_writer_t *out = output_writer_create(fd, _g_data->_output_buffer,
+        (_g_data->_output_flusher ? OUTPUT_FLUSHER : 0) | (_g_data->_output_direct ? OUTPUT_DIRECT : 0));
 
     while(1) {
         //get a group of items
@@ -638,103 +639,34 @@ void *ReorderDefault(void * targs) {
         chunk = *opt;
         if (chunk == NULL) break;
 
-        //Double size of sequence number array if necessary
-        if(chunk->sequence.l1num >= chunks_per_anchor_max) {
-            chunks_per_anchor = (sequence_number_t*)realloc(chunks_per_anchor, 2 * chunks_per_anchor_max * sizeof(sequence_number_t));
-            if(chunks_per_anchor == NULL) EXIT_TRACE("Error allocating memory\n");
-            memset(&chunks_per_anchor[chunks_per_anchor_max], 0, chunks_per_anchor_max * sizeof(sequence_number_t));
-            chunks_per_anchor_max *= 2;
-        }
-        //Update expected L2 sequence number
-        if(chunk->isLastL2Chunk) {
-            assert(chunks_per_anchor[chunk->sequence.l1num] == 0);
-            chunks_per_anchor[chunk->sequence.l1num] = chunk->sequence.l2num+1;
-        }
-
-        //Put chunk into local cache if it's not next in the sequence 
-        if(!sequence_eq(chunk->sequence, next)) {
-            pos = TreeFind(chunk->sequence.l1num, T);
-            if (pos == NULL) {
-                //FIXME: Can we remove at least one of the two mallocs in this if-clause?
-                //FIXME: Rename "INITIAL_SEARCH_TREE_SIZE" to something more accurate
-                tele.l1num = chunk->sequence.l1num;
-                tele.queue = Initialize(INITIAL_SEARCH_TREE_SIZE);
-                Insert(chunk, tele.queue);
-                T = TreeInsert(tele, T);
-            } else {
-                Insert(chunk, pos->Element.queue);
-            }
-            continue;
-        }
-
-        //write as many chunks as possible, current chunk is next in sequence
-        pos = TreeFindMin(T);
-        do {
-            write_chunk_to_file(fd, chunk);
+        //Write as many chunks as possible, the received one may be next in sequence
+        reorder_window_insert(window, chunk);
+        while((chunk = reorder_window_next(window)) != NULL) {
+            write_chunk_to_file(out, chunk, index);
             if(chunk->header.isDuplicate) {
-                free(chunk);
+                chunk_free(chunk);
                 chunk=NULL;
             }
-            sequence_inc_l2(&next);
-            if(chunks_per_anchor[next.l1num]!=0 && next.l2num==chunks_per_anchor[next.l1num]) sequence_inc_l1(&next);
-
-            //Check whether we can write more chunks from cache
-            if(pos != NULL && (pos->Element.l1num == next.l1num)) {
-                chunk = FindMin(pos->Element.queue);
-                if(sequence_eq(chunk->sequence, next)) {
-                    //Remove chunk from cache, update position for next iteration
-                    DeleteMin(pos->Element.queue);
-                    if(IsEmpty(pos->Element.queue)) {
-                        Destroy(pos->Element.queue);
-                        T = TreeDelete(pos->Element, T);
-                        pos = TreeFindMin(T);
-                    }
-                } else {
-                    //level 2 sequence number does not match
-                    chunk = NULL;
-                }
-            } else {
-                //level 1 sequence number does not match or no chunks left in cache
-                chunk = NULL;
-            }
-        } while(chunk != NULL);
+        }
     }
 
-    //flush the blocks left in the cache to file
-    pos = TreeFindMin(T);
-    while(pos !=NULL) {
-        if(pos->Element.l1num == next.l1num) {
-            chunk = FindMin(pos->Element.queue);
-            if(sequence_eq(chunk->sequence, next)) {
-                //Remove chunk from cache, update position for next iteration
-                DeleteMin(pos->Element.queue);
-                if(IsEmpty(pos->Element.queue)) {
-                    Destroy(pos->Element.queue);
-                    T = TreeDelete(pos->Element, T);
-                    pos = TreeFindMin(T);
-                }
-            } else {
-                //level 2 sequence number does not match
-                EXIT_TRACE("L2 sequence number mismatch.\n");
-            }
-        } else {
-            //level 1 sequence number does not match
-            EXIT_TRACE("L1 sequence number mismatch.\n");
-        }
-        write_chunk_to_file(fd, chunk);
-        if(chunk->header.isDuplicate) {
-            free(chunk);
-            chunk=NULL;
+    //all chunks were received, a chunk left in the window misses a predecessor
+    if(reorder_window_pending(window) != 0) {
+        EXIT_TRACE("%lu chunks out of sequence left in the reorder window.\n", reorder_window_pending(window));
+    }
+    printf("Reorder: at most %lu chunks waited in the reorder window\n", reorder_window_max_pending(window));
+    reorder_window_destroy(window);
+
+    printf("Reorder: %lu write system calls\n", output_writer_syscalls(out));
+    output_writer_destroy(out);
+    if(index != NULL) {
+        if(ddp_index_write(index, fd) != 0) {
+            EXIT_TRACE("Writing the index of the archive failed.\n");
         }
-        sequence_inc_l2(&next);
-        if(chunks_per_anchor[next.l1num]!=0 && next.l2num==chunks_per_anchor[next.l1num]) sequence_inc_l1(&next);
-
+        ddp_index_destroy(index);
     }
-
     close(fd);
 
-    free(chunks_per_anchor);
-
     return NULL;
 }
 
@@ -835,7 +767,7 @@ static void _Encode(DedupData& data, int fd, size_t filesize, void* buffer, tp&
 
     thread_args* fragment_args = alloc_thread_args(fragment);
     for (int i = 0; i < fragment.get_total_threads(); ++i) {
-        if (data._preloading) {
+        if (data._preloading || data._mmap) {
             fragment_args[i].input_file.size = filesize;
             fragment_args[i].input_file.buffer = buffer;
         }
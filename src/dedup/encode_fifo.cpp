@@ -93,7 +93,6 @@ void *Fragment(void * targs){
        r = ringbuffer_init(&send_buf, step);
        assert(r==0); */
 
-    rf_win_dataprocess = 0;
     rabininit(rf_win_dataprocess, rabintab, rabinwintab);
 
     //Sanity check
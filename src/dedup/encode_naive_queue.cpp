@@ -16,8 +16,19 @@
 
 #include "encode_naive_queue_conf.h"
 
+/* Handoff between the regions of the parallel Fragment: first anchor at or
+ * after the start of a region and sequence number of the chunk starting there.
+ */
+struct fragment_seam {
+    size_t anchor;
+    sequence_number_t l1num;
+};
+
 struct thread_args_naive {
     int fd;
+    // Rank of the thread in its layer and size of the layer
+    int tid;
+    int nb_threads;
     struct {
         void* buffer;
         size_t size;
@@ -29,13 +40,37 @@ struct thread_args_naive {
     std::vector<NaiveQueueImpl<chunk_t*>*> _input_fifos, _output_fifos, _extra_output_fifos;
     std::vector<Observer<chunk_t*>*> _input_observers, _output_observers, _extra_output_observers;
     pthread_barrier_t* _barrier;
+    // Fragment only, one seam per fragment thread
+    std::vector<std::promise<fragment_seam>>* _fragment_seams;
 };
 
 // ============================================================================
 // Smart FIFO version
 // ============================================================================
 
+void ParallelFragmentNaiveQueue(thread_args_naive const& args);
+
 void FragmentNaiveQueue(thread_args_naive const& args) {
+    if (_g_data->_mmap || (args.nb_threads > 1 && _g_data->_preloading)) {
+        ParallelFragmentNaiveQueue(args);
+        return;
+    }
+
+    if (args.nb_threads > 1) {
+        // Regions need random access to the input
+        if (args.tid != 0) {
+            if (args.tid == 1) {
+                fprintf(stderr, "WARNING: parallel Fragment requires preloading or mmap, falling back to a single thread.\n");
+            }
+
+            pthread_barrier_wait(args._barrier);
+            for (NaiveQueueImpl<chunk_t*>* fifo: args._output_fifos) {
+                fifo->terminate();
+            }
+            return;
+        }
+    }
+
     pthread_barrier_wait(args._barrier);
     size_t preloading_buffer_seek = 0;
     int qid = 0;
@@ -52,7 +87,6 @@ void FragmentNaiveQueue(thread_args_naive const& args) {
         EXIT_TRACE("Memory allocation failed.\n");
     }
 
-    rf_win_dataprocess = 0;
     rabininit(rf_win_dataprocess, rabintab, rabinwintab);
 
     //Sanity check
@@ -63,8 +97,22 @@ void FragmentNaiveQueue(thread_args_naive const& args) {
 
     int count = 0;
 
+    //Stream the file in blocks of bounded memory instead of MAXBUF buffers
+    bool stream = _g_data->_read_block > 0 && !_g_data->_preloading;
+    if (stream) {
+        fragment_stream(fd, rabintab, rabinwintab, [&](chunk_t *chunk) {
+            args._output_fifos[qid]->push(chunk);
+            ++count;
+
+            //send a group of items into the next queue in round-robin fashion
+            if (count % args._output_fifos[qid]->get_step() == 0) {
+                qid = (qid + 1) % args._output_fifos.size();
+            }
+        });
+    }
+
     //read from input file / buffer
-    while (1) {
+    while (!stream) {
         size_t bytes_left; //amount of data left over in last_mbuffer from previous iteration
 
         //Check how much data left over from previous iteration resp. create an initial chunk
@@ -80,9 +128,7 @@ void FragmentNaiveQueue(thread_args_naive const& args) {
         }
 
         //Allocate a new chunk and create a new memory buffer
-        chunk = (chunk_t *)malloc(sizeof(chunk_t));
-        if(chunk==NULL)
-            EXIT_TRACE("Memory allocation failed.\n");
+        chunk = chunk_alloc();
 
         r = mbuffer_create(&chunk->uncompressed_data, MAXBUF+bytes_left);
         if(r!=0) {
@@ -99,7 +145,7 @@ void FragmentNaiveQueue(thread_args_naive const& args) {
             //NOTE: We cannot safely extend the current memory region because it has already been given to another thread
             memcpy(chunk->uncompressed_data.ptr, temp->uncompressed_data.ptr, temp->uncompressed_data.n);
             mbuffer_free(&temp->uncompressed_data);
-            free(temp);
+            chunk_free(temp);
             temp = NULL;
         } else {
             //brand new mbuffer, increment sequence number
@@ -144,7 +190,7 @@ void FragmentNaiveQueue(thread_args_naive const& args) {
         //No data left over from last iteration and also nothing new read in, simply clean up and quit
         if(bytes_left + bytes_read == 0) {
             mbuffer_free(&chunk->uncompressed_data);
-            free(chunk);
+            chunk_free(chunk);
             chunk = NULL;
             break;
         }
@@ -170,7 +216,7 @@ void FragmentNaiveQueue(thread_args_naive const& args) {
             split = 0;
             //Try to split the buffer at least ANCHOR_JUMP bytes away from its beginning
             if(ANCHOR_JUMP < chunk->uncompressed_data.n) {
-                int offset = rabinseg((uchar*)chunk->uncompressed_data.ptr + ANCHOR_JUMP, chunk->uncompressed_data.n - ANCHOR_JUMP, rf_win_dataprocess, rabintab, rabinwintab);
+                int offset = rabinseg_lanes((uchar*)chunk->uncompressed_data.ptr + ANCHOR_JUMP, chunk->uncompressed_data.n - ANCHOR_JUMP, rf_win_dataprocess, rabintab, rabinwintab);
                 //Did we find a split location?
                 if(offset == 0) {
                     //Split found at the very beginning of the buffer (should never happen due to technical limitations)
@@ -179,8 +225,7 @@ void FragmentNaiveQueue(thread_args_naive const& args) {
                 } else if(offset + ANCHOR_JUMP < chunk->uncompressed_data.n) {
                     //Split found somewhere in the middle of the buffer
                     //Allocate a new chunk and create a new memory buffer
-                    temp = (chunk_t *)malloc(sizeof(chunk_t));
-                    if(temp==NULL) EXIT_TRACE("Memory allocation failed.\n");
+                    temp = chunk_alloc();
 
                     //split it into two pieces
                     r = mbuffer_split(&chunk->uncompressed_data, &temp->uncompressed_data, offset + ANCHOR_JUMP);
@@ -230,6 +275,102 @@ void FragmentNaiveQueue(thread_args_naive const& args) {
     // printf("Fragment: %d\n", count);
 }
 
+// ============================================================================
+// Parallel Fragment
+// ============================================================================
+
+/* Fragment over a preloaded or mapped input, split in as many regions as there
+ * are fragment threads.
+ *
+ * The serial version only hashes a few KB after each ANCHOR_JUMP, the bulk of
+ * its time goes into copying the input into coarse chunks. Each thread waits
+ * for the seam of the previous region (the first anchor at or after the start
+ * of its region and its sequence number), follows the anchor chain through its
+ * region, hands the seam of the next region over, then copies and pushes its
+ * chunks in parallel with the others. Boundaries and l1num are the ones of the
+ * serial version.
+ *
+ * With a mapped input, chunks are views into the mapping instead of copies.
+ * Their pages are dropped once the last fine chunk of a coarse chunk is freed.
+ *
+ * The anchor chain is followed rather than guessed from the region start: every
+ * scan starts ANCHOR_JUMP bytes after the previous anchor, so the anchors found
+ * depend on where the chain started, whatever the window of the tables.
+ */
+void ParallelFragmentNaiveQueue(thread_args_naive const& args) {
+    pthread_barrier_wait(args._barrier);
+
+    uchar* buffer = (uchar*)args.input_file.buffer;
+    size_t size = args.input_file.size;
+    size_t end = args.tid == args.nb_threads - 1 ? size : size / args.nb_threads * (args.tid + 1);
+    std::vector<std::promise<fragment_seam>>& seams = *args._fragment_seams;
+
+    // Same tables as the serial version, without touching the global
+    const int winlen = rf_win_dataprocess;
+    u32int * rabintab = (u32int*) malloc(256*sizeof rabintab[0]);
+    u32int * rabinwintab = (u32int*) malloc(256*sizeof rabintab[0]);
+    if(rabintab == NULL || rabinwintab == NULL) {
+        EXIT_TRACE("Memory allocation failed.\n");
+    }
+
+    rabininit(winlen, rabintab, rabinwintab);
+
+    if (args.tid == 0) {
+        seams[0].set_value({ 0, 0 });
+    }
+    fragment_seam seam = seams[args.tid].get_future().get();
+
+    // Anchors of the chunks starting in the region
+    std::vector<size_t> anchors;
+    size_t anchor = seam.anchor;
+    while (anchor < end) {
+        anchors.push_back(anchor);
+        anchor = input_stream_next_anchor(buffer, size, anchor, winlen, rabintab, rabinwintab);
+    }
+
+    if (args.tid + 1 < args.nb_threads) {
+        seams[args.tid + 1].set_value({ anchor, sequence_number_t(seam.l1num + anchors.size()) });
+    }
+
+    free(rabintab);
+    free(rabinwintab);
+
+    int qid = 0;
+    int count = 0;
+    for (size_t i = 0; i < anchors.size(); ++i) {
+        size_t chunk_end = i + 1 < anchors.size() ? anchors[i + 1] : anchor;
+
+        chunk_t* chunk = chunk_alloc();
+
+        if (_g_data->_mmap) {
+            int r = mbuffer_create_view(&chunk->uncompressed_data, buffer + anchors[i], chunk_end - anchors[i], release_mapped_input);
+            if(r!=0) {
+                EXIT_TRACE("Unable to initialize memory buffer.\n");
+            }
+        } else {
+            int r = mbuffer_create(&chunk->uncompressed_data, chunk_end - anchors[i]);
+            if(r!=0) {
+                EXIT_TRACE("Unable to initialize memory buffer.\n");
+            }
+
+            memcpy(chunk->uncompressed_data.ptr, buffer + anchors[i], chunk_end - anchors[i]);
+        }
+        chunk->header.state = CHUNK_STATE_UNCOMPRESSED;
+        chunk->sequence.l1num = seam.l1num + i;
+
+        args._output_fifos[qid]->push(chunk);
+        ++count;
+
+        if (count % args._output_fifos[qid]->get_step() == 0) {
+            qid = (qid + 1) % args._output_fifos.size();
+        }
+    }
+
+    for (NaiveQueueImpl<chunk_t*>* fifo: args._output_fifos) {
+        fifo->terminate();
+    }
+}
+
 std::mutex _split_mutex;
 std::map<NaiveQueueImpl<chunk_t*>*, std::vector<uint64_t>> _split_data;
 
@@ -276,15 +417,14 @@ void RefineNaiveQueue(thread_args_naive const& args) {
         int split;
         sequence_number_t chcount = 0;
         do {
-            //Find next anchor with Rabin fingerprint
+            //Find next anchor with the chunking engine
             //TP offset_begin = SteadyClock::now();
-            int offset = rabinseg((uchar*)chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, rf_win, rabintab, rabinwintab);
+            int offset = chunking_cut((uchar*)chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, rf_win, rabintab, rabinwintab);
             //auto offset_diff = diff(offset_begin, SteadyClock::now());
             //Can we split the buffer?
             if(offset < chunk->uncompressed_data.n) {
                 //Allocate a new chunk and create a new memory buffer
-                temp = (chunk_t *)malloc(sizeof(chunk_t));
-                if(temp==NULL) EXIT_TRACE("Memory allocation failed.\n");
+                temp = chunk_alloc();
                 temp->header.state = chunk->header.state;
                 temp->sequence.l1num = chunk->sequence.l1num;
 
@@ -366,6 +506,8 @@ void RefineNaiveQueue(thread_args_naive const& args) {
 void DeduplicateNaiveQueue(thread_args_naive const& args) {
     pthread_barrier_wait(args._barrier);
     chunk_t *chunk;
+    chunk_t *batch[FINGERPRINT_MAX_BATCH];
+    int duplicates[FINGERPRINT_MAX_BATCH];
 
     int in_a_row = 0;
     bool last_was_compressed = false;
@@ -387,73 +529,87 @@ void DeduplicateNaiveQueue(thread_args_naive const& args) {
             break;
         }
 
-        //get one chunk
-        chunk = *value;
+        //get the chunks already popped along with this one, hash and look them up together
+        batch[0] = *value;
+        int n_batch = 1;
+        while (n_batch < FINGERPRINT_MAX_BATCH && args._input_fifos[0]->n_elements() > 0) {
+            auto next = args._input_fifos[0]->pop();
+            if (!next) {
+                break;
+            }
+            batch[n_batch++] = *next;
+        }
 
-        TP begin = SteadyClock::now();
         //Do the processing
-        auto [isDuplicate, lock_idx] = sub_Deduplicate(chunk);
+        TP begin = SteadyClock::now();
+        sub_Fingerprint(batch, n_batch);
+        sub_Deduplicate_batch(batch, n_batch, duplicates);
+        auto d = diff(begin, SteadyClock::now()) / n_batch;
 
-        auto d = diff(begin, SteadyClock::now());
-        //Enqueue chunk either into compression queue or into send queue
-        if(!isDuplicate) {
+        for (int i = 0; i < n_batch; ++i) {
+            chunk = batch[i];
+            int isDuplicate = duplicates[i];
+
+            //Enqueue chunk either into compression queue or into send queue
+            if(!isDuplicate) {
 #if DEDUP_TO_REORDER == 1
-            if (last_was_compressed) {
-                ++in_a_row;
+                if (last_was_compressed) {
+                    ++in_a_row;
 
-                if (in_a_row == row_limit) {
-                    // printf("%p: %d compress in a row\n", args._output_fifos[0], row_limit);
-                    args._extra_output_fifos[0]->force_push();
-                    in_a_row = 0;
+                    if (in_a_row == row_limit) {
+                        // printf("%p: %d compress in a row\n", args._output_fifos[0], row_limit);
+                        args._extra_output_fifos[0]->force_push();
+                        in_a_row = 0;
+                    }
+                } else {
+                    // printf("%p: reset to compress\n", args._extra_output_fifos[0]);
+                    last_was_compressed = true;
+                    in_a_row = 1;
                 }
-            } else {
-                // printf("%p: reset to compress\n", args._extra_output_fifos[0]);
-                last_was_compressed = true;
-                in_a_row = 1;
-            }
 #endif
-            last_was_compressed = true;
+                last_was_compressed = true;
 #if TIMED_PUSH == 1
-            bool push_res = args._output_fifos[0]->generic_push(args._output_observers[0], chunk);
-            if (push_res && push_work_output) {
-                push_work_output = args._output_observers[0]->add_work_time(args._output_fifos[0], d);
-            }
+                bool push_res = args._output_fifos[0]->generic_push(args._output_observers[0], chunk);
+                if (push_res && push_work_output) {
+                    push_work_output = args._output_observers[0]->add_work_time(args._output_fifos[0], d);
+                }
 #else
-            args._output_fifos[0]->push(chunk);
+                args._output_fifos[0]->push(chunk);
 #endif
-        } else {
+            } else {
 #if DEDUP_TO_COMPRESS == 1
-            if (!last_was_compressed) {
-                ++in_a_row;
+                if (!last_was_compressed) {
+                    ++in_a_row;
 
-                if (in_a_row == row_limit) {
-                    // printf("%p: %d deduplicate in a row\n", args._extra_output_fifos[0], row_limit);
-                    args._output_fifos[0]->force_push();
-                    in_a_row = 0;
+                    if (in_a_row == row_limit) {
+                        // printf("%p: %d deduplicate in a row\n", args._extra_output_fifos[0], row_limit);
+                        args._output_fifos[0]->force_push();
+                        in_a_row = 0;
+                    }
+                } else {
+                    // printf("%p: reset to deduplicate\n", args._output_fifos[0]);
+                    last_was_compressed = false;
+                    in_a_row = 1;
                 }
-            } else {
-                // printf("%p: reset to deduplicate\n", args._output_fifos[0]);
-                last_was_compressed = false;
-                in_a_row = 1;
-            }
 #endif
-            last_was_compressed = false;
+                last_was_compressed = false;
 
 #if TIMED_PUSH == 1
-            bool push_res = args._extra_output_fifos[0]->generic_push(args._extra_output_observers[0], chunk);
-            if (push_res && push_work_extra) {
-                push_work_extra = args._extra_output_observers[0]->add_work_time(args._extra_output_fifos[0], diff(begin, SteadyClock::now()));
-            }
+                bool push_res = args._extra_output_fifos[0]->generic_push(args._extra_output_observers[0], chunk);
+                if (push_res && push_work_extra) {
+                    push_work_extra = args._extra_output_observers[0]->add_work_time(args._extra_output_fifos[0], d);
+                }
 #else
-            args._extra_output_fifos[0]->push(chunk);
+                args._extra_output_fifos[0]->push(chunk);
 #endif
-        }
+            }
 
 #if TIMED_PUSH == 1
-        if (push_work_input) {
-            push_work_input = args._input_observers[0]->add_work_time(args._input_fifos[0], d);
-        }
+            if (push_work_input) {
+                push_work_input = args._input_observers[0]->add_work_time(args._input_fifos[0], d);
+            }
 #endif
+        }
     }
 
     args._output_fifos[0]->terminate();
@@ -523,39 +679,22 @@ void CompressNaiveQueue(thread_args_naive const& args) {
     args._output_fifos[0]->terminate();
 }
 
-struct ReorderComputeData {
-    SearchTree T;
-    sequence_number_t* chunks_per_anchor;
-};
-
-// static ReorderComputeData c_data;
-
 void ReorderNaiveQueue(thread_args_naive const& args) {
     pthread_barrier_wait(args._barrier);
     int fd = 0;
 
     chunk_t *chunk;
 
-    SearchTree T;
-    T = TreeMakeEmpty(NULL);
-    Position pos = NULL;
-    struct tree_element tele;
-
-    sequence_t next;
-    sequence_reset(&next); 
-
-    //We perform global anchoring in the first stage and refine the anchoring
-    //in the second stage. This array keeps track of the number of chunks in
-    //a coarse chunk.
-    sequence_number_t *chunks_per_anchor;
-    unsigned int chunks_per_anchor_max = 1024;
-    chunks_per_anchor = (sequence_number_t*)malloc(chunks_per_anchor_max * sizeof(sequence_number_t));
-    if(chunks_per_anchor == NULL) 
-        EXIT_TRACE("Error allocating memory\n");
-
-    memset(chunks_per_anchor, 0, chunks_per_anchor_max * sizeof(sequence_number_t));
+    //Chunks which arrive out of order wait in the window until they are next
+    reorder_window_t *window = reorder_window_create(REORDER_SLOTS_PER_ANCHOR);
 
     fd = create_output_file(_g_data->_output_filename.c_str());
+    ddp_index_t *index = NULL;
+    if(_g_data->_archive_index) {
+        index = ddp_index_create(lseek(fd, 0, SEEK_CUR));
+    }
+    output_writer_t *out = output_writer_create(fd, _g_data->_output_buffer,
+        (_g_data->_output_flusher ? OUTPUT_FLUSHER : 0) | (_g_data->_output_direct ? OUTPUT_DIRECT : 0));
     int qid = 0;
 
     std::map<NaiveQueueImpl<chunk_t*>*, bool> push_work_inputs;
@@ -591,118 +730,37 @@ void ReorderNaiveQueue(thread_args_naive const& args) {
             break;
 
         TP now = SteadyClock::now();
-        //Double size of sequence number array if necessary
-        if(chunk->sequence.l1num >= chunks_per_anchor_max) {
-            chunks_per_anchor = (sequence_number_t*)realloc(chunks_per_anchor, 2 * chunks_per_anchor_max * sizeof(sequence_number_t));
-            if(chunks_per_anchor == NULL) 
-                EXIT_TRACE("Error allocating memory\n");
-            memset(&chunks_per_anchor[chunks_per_anchor_max], 0, chunks_per_anchor_max * sizeof(sequence_number_t));
-            chunks_per_anchor_max *= 2;
-        }
-
-        //Update expected L2 sequence number
-        if(chunk->isLastL2Chunk) {
-            assert(chunks_per_anchor[chunk->sequence.l1num] == 0);
-            chunks_per_anchor[chunk->sequence.l1num] = chunk->sequence.l2num+1;
-        }
-
-        //Put chunk into local cache if it's not next in the sequence 
-        if(!sequence_eq(chunk->sequence, next)) {
-            pos = TreeFind(chunk->sequence.l1num, T);
-            if (pos == NULL) {
-                //FIXME: Can we remove at least one of the two mallocs in this if-clause?
-                //FIXME: Rename "INITIAL_SEARCH_TREE_SIZE" to something more accurate
-                tele.l1num = chunk->sequence.l1num;
-                tele.queue = Initialize(INITIAL_SEARCH_TREE_SIZE);
-                Insert(chunk, tele.queue);
-                T = TreeInsert(tele, T);
-            } else {
-                Insert(chunk, pos->Element.queue);
-            }
-
-#if TIMED_PUSH == 1
-            if (push_work_inputs[current_fifo]) {
-                auto d = diff(now, SteadyClock::now());
-                push_work_inputs[current_fifo] = current_observer->add_work_time(current_fifo, d);
-            }
-#endif
-            continue;
-        }
-
-        //write as many chunks as possible, current chunk is next in sequence
-        pos = TreeFindMin(T);
-        do {
-            write_chunk_to_file(fd, chunk);
+        //Write as many chunks as possible, the received one may be next in sequence
+        reorder_window_insert(window, chunk);
+        while((chunk = reorder_window_next(window)) != NULL) {
+            write_chunk_to_file(out, chunk, index);
             if(chunk->header.isDuplicate) {
-                free(chunk);
+                chunk_free(chunk);
                 chunk=NULL;
             }
-            sequence_inc_l2(&next);
-            if(chunks_per_anchor[next.l1num] != 0 && next.l2num == chunks_per_anchor[next.l1num]) 
-                sequence_inc_l1(&next);
-
-            //Check whether we can write more chunks from cache
-            if(pos != NULL && (pos->Element.l1num == next.l1num)) {
-                chunk = FindMin(pos->Element.queue);
-                if(sequence_eq(chunk->sequence, next)) {
-                    //Remove chunk from cache, update position for next iteration
-                    DeleteMin(pos->Element.queue);
-                    if(IsEmpty(pos->Element.queue)) {
-                        Destroy(pos->Element.queue);
-                        T = TreeDelete(pos->Element, T);
-                        pos = TreeFindMin(T);
-                    }
-                } else {
-                    //level 2 sequence number does not match
-                    chunk = NULL;
-                }
-            } else {
-                //level 1 sequence number does not match or no chunks left in cache
-                chunk = NULL;
-            }
-        } while(chunk != NULL);
+        }
 
         if (push_work_inputs[current_fifo]) {
             push_work_inputs[current_fifo] = current_observer->add_work_time(current_fifo, diff(now, SteadyClock::now()));
         }
     }
 
-    //flush the blocks left in the cache to file
-    pos = TreeFindMin(T);
-    while(pos !=NULL) {
-        if(pos->Element.l1num == next.l1num) {
-            chunk = FindMin(pos->Element.queue);
-            if(sequence_eq(chunk->sequence, next)) {
-                //Remove chunk from cache, update position for next iteration
-                DeleteMin(pos->Element.queue);
-                if(IsEmpty(pos->Element.queue)) {
-                    Destroy(pos->Element.queue);
-                    T = TreeDelete(pos->Element, T);
-                    pos = TreeFindMin(T);
-                }
-            } else {
-                //level 2 sequence number does not match
-                throw std::runtime_error("L2 sequence number mismatch");
-                EXIT_TRACE("L2 sequence number mismatch.\n");
-            }
-        } else {
-            //level 1 sequence number does not match
-            throw std::runtime_error("L1 sequence number mismatch");
-            EXIT_TRACE("L1 sequence number mismatch.\n");
-        }
-        write_chunk_to_file(fd, chunk);
-        if(chunk->header.isDuplicate) {
-            free(chunk);
-            chunk=NULL;
+    //all chunks were received, a chunk left in the window misses a predecessor
+    if(reorder_window_pending(window) != 0) {
+        throw std::runtime_error(std::to_string(reorder_window_pending(window)) + " chunks out of sequence left in the reorder window");
+    }
+    printf("Reorder: at most %lu chunks waited in the reorder window\n", reorder_window_max_pending(window));
+    reorder_window_destroy(window);
+
+    printf("Reorder: %lu write system calls\n", output_writer_syscalls(out));
+    output_writer_destroy(out);
+    if(index != NULL) {
+        if(ddp_index_write(index, fd) != 0) {
+            EXIT_TRACE("Writing the index of the archive failed.\n");
         }
-        sequence_inc_l2(&next);
-        if(chunks_per_anchor[next.l1num] != 0 && next.l2num == chunks_per_anchor[next.l1num]) 
-            sequence_inc_l1(&next);
+        ddp_index_destroy(index);
     }
-
     close(fd);
-
-    free(chunks_per_anchor);
 }
 
 std::vector<std::unique_ptr<thread_args_naive>> _thread_args_naive_vector;
@@ -919,8 +977,11 @@ static void _Encode(/* std::vector<Globals::SmartFIFOTSV>& timestamp_datas, */ D
 
             args[i]._barrier = &barrier;
             args[i].fd = fd;
+            args[i].tid = i;
+            args[i].nb_threads = layer_data.get_total_threads();
+            args[i]._fragment_seams = nullptr;
 
-            if (data._preloading) {
+            if (data._preloading || data._mmap) {
                 args[i].input_file.size = filesize;
                 args[i].input_file.buffer = buffer;
             }
@@ -986,6 +1047,11 @@ static void _Encode(/* std::vector<Globals::SmartFIFOTSV>& timestamp_datas, */ D
     };
 
     auto fragment_stage = launch_stage(_FragmentNaiveQueue, fragment, false, "fragment");
+    std::vector<std::promise<fragment_seam>> fragment_seams(fragment.get_total_threads());
+    for (int i = 0; i < fragment.get_total_threads(); ++i) {
+        std::get<1>(fragment_stage)[i]._fragment_seams = &fragment_seams;
+    }
+
     auto refine_stage = launch_stage(_RefineNaiveQueue, refine, false, "refine");
     auto deduplicate_stage = launch_stage(_DeduplicateNaiveQueue, deduplicate, true, "deduplicate");
     auto compress_stage = launch_stage(_CompressNaiveQueue, compress, false, "compress");
@@ -1124,7 +1190,6 @@ void FragmentNumbers(std::queue<chunk_t*>& out, int fd, size_t filesize, void* b
         EXIT_TRACE("Memory allocation failed.\n");
     }
 
-    rf_win_dataprocess = 0;
     rabininit(rf_win_dataprocess, rabintab, rabinwintab);
 
     //Sanity check
@@ -1150,9 +1215,7 @@ void FragmentNumbers(std::queue<chunk_t*>& out, int fd, size_t filesize, void* b
         }
 
         //Allocate a new chunk and create a new memory buffer
-        chunk = (chunk_t *)malloc(sizeof(chunk_t));
-        if(chunk==NULL)
-            EXIT_TRACE("Memory allocation failed.\n");
+        chunk = chunk_alloc();
 
         r = mbuffer_create(&chunk->uncompressed_data, MAXBUF+bytes_left);
         if(r!=0) {
@@ -1169,7 +1232,7 @@ void FragmentNumbers(std::queue<chunk_t*>& out, int fd, size_t filesize, void* b
             //NOTE: We cannot safely extend the current memory region because it has already been given to another thread
             memcpy(chunk->uncompressed_data.ptr, temp->uncompressed_data.ptr, temp->uncompressed_data.n);
             mbuffer_free(&temp->uncompressed_data);
-            free(temp);
+            chunk_free(temp);
             temp = NULL;
         } else {
             //brand new mbuffer, increment sequence number
@@ -1214,7 +1277,7 @@ void FragmentNumbers(std::queue<chunk_t*>& out, int fd, size_t filesize, void* b
         //No data left over from last iteration and also nothing new read in, simply clean up and quit
         if(bytes_left + bytes_read == 0) {
             mbuffer_free(&chunk->uncompressed_data);
-            free(chunk);
+            chunk_free(chunk);
             chunk = NULL;
             break;
         }
@@ -1238,7 +1301,7 @@ void FragmentNumbers(std::queue<chunk_t*>& out, int fd, size_t filesize, void* b
             split = 0;
             //Try to split the buffer at least ANCHOR_JUMP bytes away from its beginning
             if(ANCHOR_JUMP < chunk->uncompressed_data.n) {
-                int offset = rabinseg((uchar*)chunk->uncompressed_data.ptr + ANCHOR_JUMP, chunk->uncompressed_data.n - ANCHOR_JUMP, rf_win_dataprocess, rabintab, rabinwintab);
+                int offset = rabinseg_lanes((uchar*)chunk->uncompressed_data.ptr + ANCHOR_JUMP, chunk->uncompressed_data.n - ANCHOR_JUMP, rf_win_dataprocess, rabintab, rabinwintab);
                 //Did we find a split location?
                 if(offset == 0) {
                     //Split found at the very beginning of the buffer (should never happen due to technical limitations)
@@ -1247,8 +1310,7 @@ void FragmentNumbers(std::queue<chunk_t*>& out, int fd, size_t filesize, void* b
                 } else if(offset + ANCHOR_JUMP < chunk->uncompressed_data.n) {
                     //Split found somewhere in the middle of the buffer
                     //Allocate a new chunk and create a new memory buffer
-                    temp = (chunk_t *)malloc(sizeof(chunk_t));
-                    if(temp==NULL) EXIT_TRACE("Memory allocation failed.\n");
+                    temp = chunk_alloc();
 
                     //split it into two pieces
                     r = mbuffer_split(&chunk->uncompressed_data, &temp->uncompressed_data, offset + ANCHOR_JUMP);
@@ -1317,15 +1379,14 @@ unsigned int RefineNumbers(std::queue<chunk_t*>& in, std::queue<chunk_t*>& out)
         sequence_number_t chcount = 0;
         do {
             // std::cerr << "DO" << std::endl;
-            //Find next anchor with Rabin fingerprint
+            //Find next anchor with the chunking engine
             //TP offset_begin = SteadyClock::now();
-            int offset = rabinseg((uchar*)chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, rf_win, rabintab, rabinwintab);
+            int offset = chunking_cut((uchar*)chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, rf_win, rabintab, rabinwintab);
             //auto offset_diff = diff(offset_begin, SteadyClock::now());
             //Can we split the buffer?
             if(offset < chunk->uncompressed_data.n) {
                 //Allocate a new chunk and create a new memory buffer
-                temp = (chunk_t *)malloc(sizeof(chunk_t));
-                if(temp==NULL) { EXIT_TRACE("Memory allocation failed.\n"); }
+                temp = chunk_alloc();
                 temp->header.state = chunk->header.state;
                 temp->sequence.l1num = chunk->sequence.l1num;
 
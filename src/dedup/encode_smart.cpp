@@ -49,7 +49,6 @@ void FragmentSmart(thread_args_smart const& args) {
         EXIT_TRACE("Memory allocation failed.\n");
     }
 
-    rf_win_dataprocess = 0;
     rabininit(rf_win_dataprocess, rabintab, rabinwintab);
 
     //Sanity check
@@ -0,0 +1,292 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "encode_common.h"
+#include "task_pool.h"
+
+// ===========================================================================
+// Task-based version
+// ===========================================================================
+
+/*
+ * The stages are tasks of a work-stealing pool instead of threads, see
+ * task_pool.h: every worker runs whichever stage has work, so that a stage
+ * slower than the others on some input does not leave the threads of the
+ * other stages idle.
+ *  - Fragment runs in the calling thread and submits a Refine task per anchor.
+ *    It waits while TASK_ANCHORS_PER_WORKER anchors per worker are not written
+ *    yet, which bounds the memory like the queues of the other versions.
+ *  - Refine cuts its anchor into chunks, and submits a Deduplicate task per
+ *    batch of FINGERPRINT_MAX_BATCH chunks.
+ *  - Deduplicate fingerprints and looks up its batch, submits a Compress task
+ *    with the unique chunks and gives the others to Reorder.
+ *  - Compress compresses its chunks and gives them to Reorder.
+ *  - Reorder writes the chunks in sequence, as ReorderDefault. A single Reorder
+ *    task runs at a time: chunks given to Reorder while it runs are written by
+ *    the running task. It stops at a duplicate whose original is not
+ *    compressed yet instead of waiting for it, so that no worker ever waits
+ *    for a task; the Compress task of the original starts Reorder again.
+ */
+
+#ifdef ENABLE_PTHREADS
+
+#define TASK_ANCHORS_PER_WORKER 2
+
+struct task_encoder {
+    task_pool_t *pool;
+
+    //Reorder stage
+    std::mutex reorder_mutex;
+    std::vector<chunk_t*> received;     //chunks given to Reorder, not in the window yet
+    int reorder_running;
+    reorder_window_t *window;
+    output_writer_t *out;
+    ddp_index_t *index;
+
+    //Anchors given to Refine and not written yet
+    std::mutex anchors_mutex;
+    std::condition_variable anchors_written;
+    sequence_number_t anchors_pending;
+    sequence_number_t max_anchors;
+
+    std::atomic<u_long> compress_count;
+    std::atomic<u_long> reorder_count;
+};
+
+static void ReorderTask(task_encoder *e);
+
+//Give chunks to the Reorder stage, and start a Reorder task if none runs
+static void reorder_chunks(task_encoder *e, chunk_t **chunks, int n) {
+    {
+        std::unique_lock<std::mutex> lck(e->reorder_mutex);
+        e->received.insert(e->received.end(), chunks, chunks + n);
+        if(e->reorder_running) return;
+        e->reorder_running = TRUE;
+    }
+    task_pool_submit(e->pool, [e]() { ReorderTask(e); });
+}
+
+//A chunk can be written once its data, or the data of its original, is compressed
+static int chunk_writable(chunk_t *chunk) {
+    if(chunk->header.isDuplicate) chunk = chunk->compressed_data_ref;
+    return chunk_state_load(chunk) != CHUNK_STATE_UNCOMPRESSED;
+}
+
+//An anchor is written: Fragment may give Refine another one
+static void anchor_written(task_encoder *e) {
+    std::unique_lock<std::mutex> lck(e->anchors_mutex);
+    e->anchors_pending--;
+    e->anchors_written.notify_one();
+}
+
+static void ReorderTask(task_encoder *e) {
+    std::vector<chunk_t*> received;
+    chunk_t *chunk;
+
+    while(TRUE) {
+        {
+            std::unique_lock<std::mutex> lck(e->reorder_mutex);
+            if(e->received.empty()) {
+                e->reorder_running = FALSE;
+                break;
+            }
+            received.swap(e->received);
+        }
+
+        for(chunk_t *c: received) {
+            reorder_window_insert(e->window, c);
+        }
+        received.clear();
+
+        //Write as many chunks as possible
+        while((chunk = reorder_window_peek(e->window)) != NULL && chunk_writable(chunk)) {
+            reorder_window_next(e->window);
+            write_chunk_to_file(e->out, chunk, e->index);
+            if(chunk->isLastL2Chunk) {
+                anchor_written(e);
+            }
+            if(chunk->header.isDuplicate) {
+                chunk_free(chunk);
+            }
+        }
+    }
+}
+
+static void CompressTask(task_encoder *e, std::vector<chunk_t*>& chunks) {
+    for(chunk_t *chunk: chunks) {
+        sub_Compress(chunk);
+    }
+    e->compress_count += chunks.size();
+    reorder_chunks(e, chunks.data(), chunks.size());
+}
+
+static void DeduplicateTask(task_encoder *e, std::vector<chunk_t*>& batch) {
+    int duplicates[FINGERPRINT_MAX_BATCH];
+    chunk_t *others[FINGERPRINT_MAX_BATCH];
+    int n_others = 0;
+    std::vector<chunk_t*> unique;
+
+    sub_Fingerprint(batch.data(), batch.size());
+    sub_Deduplicate_batch(batch.data(), batch.size(), duplicates);
+
+    for(size_t i = 0; i < batch.size(); ++i) {
+        if(duplicates[i]) {
+            others[n_others++] = batch[i];
+        } else {
+            unique.push_back(batch[i]);
+        }
+    }
+
+    if(!unique.empty()) {
+        task_pool_submit(e->pool, [e, unique = std::move(unique)]() mutable { CompressTask(e, unique); });
+    }
+    if(n_others > 0) {
+        e->reorder_count += n_others;
+        reorder_chunks(e, others, n_others);
+    }
+}
+
+static void RefineTask(task_encoder *e, chunk_t *chunk) {
+    u32int rabintab[256], rabinwintab[256];
+    std::vector<chunk_t*> batch;
+    sequence_number_t chcount = 0;
+    chunk_t *temp;
+    int r;
+
+    rabininit(rf_win, rabintab, rabinwintab);
+    batch.reserve(FINGERPRINT_MAX_BATCH);
+
+    do {
+        //Find next anchor with the chunking engine
+        int offset = chunking_cut((uchar*)chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, rf_win, rabintab, rabinwintab);
+        if(offset < chunk->uncompressed_data.n) {
+            //Split the buffer into two pieces
+            temp = chunk_alloc();
+            temp->header.state = chunk->header.state;
+            temp->sequence.l1num = chunk->sequence.l1num;
+
+            r = mbuffer_split(&chunk->uncompressed_data, &temp->uncompressed_data, offset);
+            if(r!=0) EXIT_TRACE("Unable to split memory buffer.\n");
+        } else {
+            //End of buffer reached
+            temp = NULL;
+        }
+
+        chunk->sequence.l2num = chcount++;
+        chunk->isLastL2Chunk = temp == NULL;
+        batch.push_back(chunk);
+
+        if(batch.size() == FINGERPRINT_MAX_BATCH || temp == NULL) {
+            task_pool_submit(e->pool, [e, batch]() mutable { DeduplicateTask(e, batch); });
+            batch.clear();
+        }
+        chunk = temp;
+    } while(chunk != NULL);
+}
+
+/*
+ * Fragment stage on the preloaded or mapped input: anchors end at the first
+ * Rabin boundary ANCHOR_JUMP bytes or more after their start, and are at most
+ * ANCHOR_JUMP + MAXBUF bytes, as with the buffers of FragmentDefault.
+ */
+static sequence_number_t fragment_buffer(uchar *buffer, size_t size, u32int *rabintab, u32int *rabinwintab, std::function<void(chunk_t*)> const& push) {
+    sequence_number_t anchorcount = 0;
+    size_t start = 0;
+
+    while(start < size) {
+        size_t n = size - start;
+        if(n > ANCHOR_JUMP) {
+            int offset = rabinseg_lanes(buffer + start + ANCHOR_JUMP, MIN(n - ANCHOR_JUMP, MAXBUF), rf_win_dataprocess, rabintab, rabinwintab);
+            n = ANCHOR_JUMP + offset;
+        }
+
+        chunk_t *chunk = chunk_alloc();
+        if(mbuffer_create(&chunk->uncompressed_data, n) != 0) {
+            EXIT_TRACE("Unable to initialize memory buffer.\n");
+        }
+        memcpy(chunk->uncompressed_data.ptr, buffer + start, n);
+        //The mapping is only read once, drop what was copied
+        if(_g_data->_mmap) {
+            release_mapped_input(buffer + start, n);
+        }
+        chunk->header.state = CHUNK_STATE_UNCOMPRESSED;
+        chunk->sequence.l1num = anchorcount++;
+        push(chunk);
+        start += n;
+    }
+    return anchorcount;
+}
+
+static void _EncodeTasks(DedupData& data, int fd, size_t filesize, void* buffer, tp& begin, tp& end) {
+    unsigned int n_workers = data._task_threads != 0 ? data._task_threads : std::max(1U, std::thread::hardware_concurrency());
+    task_encoder e;
+    u32int rabintab[256], rabinwintab[256];
+
+    e.pool = task_pool_create(n_workers);
+    e.reorder_running = FALSE;
+    e.window = reorder_window_create(REORDER_SLOTS_PER_ANCHOR);
+    int fd_out = create_output_file(data._output_filename.c_str());
+    e.index = NULL;
+    if(data._archive_index) {
+        e.index = ddp_index_create(lseek(fd_out, 0, SEEK_CUR));
+    }
+    e.out = output_writer_create(fd_out, data._output_buffer,
+        (data._output_flusher ? OUTPUT_FLUSHER : 0) | (data._output_direct ? OUTPUT_DIRECT : 0));
+    e.anchors_pending = 0;
+    e.max_anchors = TASK_ANCHORS_PER_WORKER * n_workers;
+    e.compress_count = 0;
+    e.reorder_count = 0;
+    printf("Tasks: %u workers, at most %lu anchors in flight\n", n_workers, (u_long)e.max_anchors);
+
+    rabininit(rf_win_dataprocess, rabintab, rabinwintab);
+
+    auto push = [&e](chunk_t *anchor) {
+        {
+            std::unique_lock<std::mutex> lck(e.anchors_mutex);
+            e.anchors_written.wait(lck, [&e]() { return e.anchors_pending < e.max_anchors; });
+            e.anchors_pending++;
+        }
+        task_pool_submit(e.pool, [&e, anchor]() { RefineTask(&e, anchor); });
+    };
+
+    begin = sc::now();
+    sequence_number_t anchors;
+    if(data._preloading || data._mmap) {
+        anchors = fragment_buffer((uchar*)buffer, filesize, rabintab, rabinwintab, push);
+    } else {
+        anchors = fragment_stream(fd, rabintab, rabinwintab, push);
+    }
+    task_pool_wait(e.pool);
+    end = sc::now();
+
+    printf("Fragment finished. Inserted %lu values\n", (u_long)anchors);
+    printf("Deduplicate finished, produced %lu compress values, %lu reorder values\n",
+           e.compress_count.load(), e.reorder_count.load());
+    printf("Tasks: %lu run, %lu stolen, %lu sleeps\n", task_pool_tasks(e.pool), task_pool_steals(e.pool), task_pool_sleeps(e.pool));
+    task_pool_destroy(e.pool);
+
+    //every task has run, a chunk left in the window misses a predecessor
+    if(reorder_window_pending(e.window) != 0) {
+        EXIT_TRACE("%lu chunks out of sequence left in the reorder window.\n", reorder_window_pending(e.window));
+    }
+    printf("Reorder: at most %lu chunks waited in the reorder window\n", reorder_window_max_pending(e.window));
+    reorder_window_destroy(e.window);
+
+    printf("Reorder: %lu write system calls\n", output_writer_syscalls(e.out));
+    output_writer_destroy(e.out);
+    if(e.index != NULL) {
+        if(ddp_index_write(e.index, fd_out) != 0) {
+            EXIT_TRACE("Writing the index of the archive failed.\n");
+        }
+        ddp_index_destroy(e.index);
+    }
+    close(fd_out);
+}
+
+unsigned long long EncodeTasks(DedupData& data) {
+    return EncodeBase(data, _EncodeTasks);
+}
+
+#endif //ENABLE_PTHREADS
@@ -13,6 +13,7 @@ struct DedupData;
 unsigned long long EncodeSmart(DedupData&);
 unsigned long long EncodeDefault(DedupData&);
 unsigned long long EncodeNaiveQueue(DedupData&);
+unsigned long long EncodeTasks(DedupData&);
 void EncodeForNumbers(DedupData&);
 
 #endif /* !_ENCODER_H_ */
@@ -0,0 +1,124 @@
+#include <string.h>
+
+#include "dedupdef.h"
+#include "fingerprint.h"
+
+const uint32_t sha1_initial_state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+static void fingerprint_openssl_batch(const void * const *data, const size_t *len, unsigned char * const *digest, int n) {
+  int i;
+
+  for(i=0; i<n; i++)
+    SHA1_Digest(data[i], len[i], digest[i]);
+}
+
+static void fingerprint_shani_batch(const void * const *data, const size_t *len, unsigned char * const *digest, int n) {
+  int i;
+
+  for(i=0; i<n; i++)
+    sha1_shani(data[i], len[i], digest[i]);
+}
+
+static fingerprint_backend_t backend = FINGERPRINT_OPENSSL;
+static void (*fingerprint_fn)(const void *, size_t, unsigned char *) = SHA1_Digest;
+static void (*fingerprint_batch_fn)(const void * const *, const size_t *, unsigned char * const *, int) = fingerprint_openssl_batch;
+
+int fingerprint_supported(fingerprint_backend_t b) {
+  switch(b) {
+    case FINGERPRINT_AUTO:
+    case FINGERPRINT_OPENSSL:
+      return TRUE;
+#if defined(__x86_64__) || defined(__i386__)
+    case FINGERPRINT_SHANI:
+      return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+    case FINGERPRINT_AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return FALSE;
+  }
+}
+
+int fingerprint_init(fingerprint_backend_t b) {
+  if(!fingerprint_supported(b))
+    return -1;
+
+  if(b == FINGERPRINT_AUTO) {
+    //SHA-NI beats eight AVX2 lanes, and unlike them does not need batches
+    if(fingerprint_supported(FINGERPRINT_SHANI))
+      b = FINGERPRINT_SHANI;
+    else if(fingerprint_supported(FINGERPRINT_AVX2))
+      b = FINGERPRINT_AVX2;
+    else
+      b = FINGERPRINT_OPENSSL;
+  }
+
+  switch(b) {
+    case FINGERPRINT_SHANI:
+      fingerprint_fn = sha1_shani;
+      fingerprint_batch_fn = fingerprint_shani_batch;
+      break;
+    case FINGERPRINT_AVX2:
+      //A single buffer gains nothing from the lanes
+      fingerprint_fn = SHA1_Digest;
+      fingerprint_batch_fn = sha1_avx2_batch;
+      break;
+    default:
+      fingerprint_fn = SHA1_Digest;
+      fingerprint_batch_fn = fingerprint_openssl_batch;
+      break;
+  }
+
+  backend = b;
+  return 0;
+}
+
+fingerprint_backend_t fingerprint_backend() {
+  return backend;
+}
+
+const char *fingerprint_backend_name(fingerprint_backend_t b) {
+  switch(b) {
+    case FINGERPRINT_AUTO:
+      return "auto";
+    case FINGERPRINT_OPENSSL:
+      return "openssl";
+    case FINGERPRINT_SHANI:
+      return "sha-ni";
+    case FINGERPRINT_AVX2:
+      return "avx2";
+  }
+  return "unknown";
+}
+
+void fingerprint(const void *data, size_t len, unsigned char *digest) {
+  fingerprint_fn(data, len, digest);
+}
+
+void fingerprint_batch(const void * const *data, const size_t *len, unsigned char * const *digest, int n) {
+  fingerprint_batch_fn(data, len, digest, n);
+}
+
+void sha1_make_tail(const void *data, size_t len, sha1_tail_t *tail) {
+  size_t rem = len % SHA1_BLOCK;
+  uint64_t bits = (uint64_t)len * 8;
+  int i;
+
+  tail->n_blocks = rem + 9 <= SHA1_BLOCK ? 1 : 2;
+  memset(tail->data, 0, sizeof(tail->data));
+  memcpy(tail->data, (const uint8_t *)data + len - rem, rem);
+  tail->data[rem] = 0x80;
+  for(i=0; i<8; i++)
+    tail->data[tail->n_blocks * SHA1_BLOCK - 1 - i] = (uint8_t)(bits >> (8 * i));
+}
+
+void sha1_store_digest(const uint32_t *state, unsigned char *digest) {
+  int i;
+
+  for(i=0; i<5; i++) {
+    digest[4*i]   = (unsigned char)(state[i] >> 24);
+    digest[4*i+1] = (unsigned char)(state[i] >> 16);
+    digest[4*i+2] = (unsigned char)(state[i] >> 8);
+    digest[4*i+3] = (unsigned char)(state[i]);
+  }
+}
@@ -0,0 +1,66 @@
+/* Pluggable SHA-1 fingerprinting of data chunks.
+ *
+ * Every backend produces the exact SHA-1 digest of SHA1_Digest, only the way it
+ * is computed changes, so the TYPE_FINGERPRINT records of the output file are
+ * the same whatever the backend.
+ */
+
+#ifndef _FINGERPRINT_H_
+#define _FINGERPRINT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sha.h"
+
+typedef enum {
+  FINGERPRINT_AUTO = 0,  //best backend supported by the CPU
+  FINGERPRINT_OPENSSL,   //bundled portable OpenSSL code
+  FINGERPRINT_SHANI,     //x86 SHA extensions, one chunk at a time
+  FINGERPRINT_AVX2,      //x86 AVX2, eight chunks hashed side by side
+} fingerprint_backend_t;
+
+//Number of chunks hashed together by the multi-buffer backends
+#define FINGERPRINT_LANES 8
+
+//Maximum number of chunks worth gathering before a call to fingerprint_batch
+#define FINGERPRINT_MAX_BATCH (4 * FINGERPRINT_LANES)
+
+//Select the backend used by fingerprint and fingerprint_batch
+//Returns 0 on success, -1 if the CPU does not support the requested backend
+int fingerprint_init(fingerprint_backend_t backend);
+
+//Backend actually in use (FINGERPRINT_AUTO is resolved by fingerprint_init)
+fingerprint_backend_t fingerprint_backend();
+
+const char *fingerprint_backend_name(fingerprint_backend_t backend);
+
+//Returns TRUE if the CPU can run the backend
+int fingerprint_supported(fingerprint_backend_t backend);
+
+//Compute the SHA-1 digest of len bytes at data
+void fingerprint(const void *data, size_t len, unsigned char *digest);
+
+//Compute the SHA-1 digests of n independent buffers
+void fingerprint_batch(const void * const *data, const size_t *len, unsigned char * const *digest, int n);
+
+/* Backends, use the functions above instead */
+void sha1_shani(const void *data, size_t len, unsigned char *digest);
+void sha1_avx2_batch(const void * const *data, const size_t *len, unsigned char * const *digest, int n);
+
+//Helpers shared by the backends
+#define SHA1_BLOCK 64
+
+//Padded end of a message: the bytes after the last full block, the 0x80 marker
+//and the length in bits
+typedef struct {
+  uint8_t data[2 * SHA1_BLOCK];
+  size_t n_blocks;
+} sha1_tail_t;
+
+void sha1_make_tail(const void *data, size_t len, sha1_tail_t *tail);
+void sha1_store_digest(const uint32_t *state, unsigned char *digest);
+
+extern const uint32_t sha1_initial_state[5];
+
+#endif //_FINGERPRINT_H_
@@ -0,0 +1,309 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include <atomic>
+
+#include "sha.h"
+#include "fpindex.h"
+
+//Content of an empty slot that was copied to the next table, nothing can be
+//inserted in it anymore
+#define SLOT_MOVED ((uintptr_t)1)
+
+//Number of slots a thread copies at once when the table grows
+#define COPY_BLOCK 4096
+
+//Independent counters of inserted values, so that inserting threads do not all
+//write the same cache line
+#define COUNTER_STRIPES 16
+
+typedef struct {
+  std::atomic<uintptr_t> value;
+  std::atomic<uint32_t> tag;    //bits of the key to skip most comparisons, 0 until written
+} fpindex_slot_t;
+
+typedef struct fpindex_table {
+  size_t mask;                               //number of slots - 1, a power of two - 1
+  fpindex_slot_t *slots;
+  std::atomic<struct fpindex_table *> next;  //table being filled with the content of this one
+  std::atomic<size_t> claimed;               //slots given to the copying threads
+  std::atomic<size_t> copied;                //slots copied to next
+  struct fpindex_table *previous;            //table this one replaced
+} fpindex_table_t;
+
+typedef struct {
+  alignas(64) std::atomic<size_t> n;
+} fpindex_counter_t;
+
+struct fpindex {
+  std::atomic<fpindex_table_t *> table;
+  const void *(*key_fn)(void *v);
+  fpindex_counter_t counters[COUNTER_STRIPES];
+};
+
+/*
+ * The key is a SHA1 sum, so its bytes are already uniformly distributed:
+ *  - bytes 4 to 11 give the first slot
+ *  - bytes 8 to 11 give the tag
+ *  - byte 0 gives the counter
+ */
+static inline uint64_t key_hash(const void *k) {
+  uint64_t hv;
+
+  memcpy(&hv, (const uint8_t *)k + 4, sizeof(hv));
+  return hv;
+}
+
+static inline uint32_t key_tag(uint64_t hv) {
+  return (uint32_t)(hv >> 32) | 1;
+}
+
+static inline int key_stripe(const void *k) {
+  return ((const uint8_t *)k)[0] % COUNTER_STRIPES;
+}
+
+static fpindex_table_t *table_create(size_t size, fpindex_table_t *previous) {
+  fpindex_table_t *t;
+
+  t = (fpindex_table_t *)malloc(sizeof(fpindex_table_t));
+  if(t == NULL) return NULL;
+  //Zeroed memory is a valid array of empty slots, and calloc gets it for free from the kernel
+  t->slots = (fpindex_slot_t *)calloc(size, sizeof(fpindex_slot_t));
+  if(t->slots == NULL) { free(t); return NULL; }
+  t->mask = size - 1;
+  t->next.store(NULL, std::memory_order_relaxed);
+  t->claimed.store(0, std::memory_order_relaxed);
+  t->copied.store(0, std::memory_order_relaxed);
+  t->previous = previous;
+  return t;
+}
+
+static void table_destroy(fpindex_table_t *t) {
+  free(t->slots);
+  free(t);
+}
+
+static inline int slot_matches(struct fpindex *h, fpindex_slot_t *s, uintptr_t value, const void *k, uint32_t tag) {
+  uint32_t slot_tag = s->tag.load(std::memory_order_acquire);
+
+  //The tag of a value that has just been inserted may not be written yet
+  if(slot_tag != 0 && slot_tag != tag) return 0;
+  return memcmp(h->key_fn((void *)value), k, SHA1_LEN) == 0;
+}
+
+/*****************************************************************************/
+const char *dedup_index_name(dedup_index_t index) {
+  switch(index) {
+    case INDEX_LOCKFREE:
+      return "lock-free";
+    case INDEX_LOCKED:
+      return "locked";
+  }
+  return "unknown";
+}
+
+/*****************************************************************************/
+struct fpindex *fpindex_create(size_t minsize, const void *(*key_fn)(void *v)) {
+  struct fpindex *h;
+  fpindex_table_t *t;
+  size_t size = COPY_BLOCK;
+  int i;
+
+  //Keep the load factor under 1/2 from the start
+  while(size < 2 * minsize) size *= 2;
+
+  h = (struct fpindex *)malloc(sizeof(struct fpindex));
+  if(h == NULL) return NULL;
+  t = table_create(size, NULL);
+  if(t == NULL) { free(h); return NULL; }
+
+  h->table.store(t, std::memory_order_relaxed);
+  h->key_fn = key_fn;
+  for(i=0; i<COUNTER_STRIPES; i++)
+    h->counters[i].n.store(0, std::memory_order_relaxed);
+  return h;
+}
+
+/*****************************************************************************/
+//Put a value coming from the previous table in t, which nobody else inserts into yet
+static void copy_value(struct fpindex *h, fpindex_table_t *t, uintptr_t value, uint32_t tag) {
+  size_t i = key_hash(h->key_fn((void *)value)) & t->mask;
+
+  for(;;) {
+    fpindex_slot_t *s = &t->slots[i];
+    uintptr_t empty = 0;
+    if(s->value.compare_exchange_strong(empty, value, std::memory_order_release, std::memory_order_relaxed)) {
+      s->tag.store(tag, std::memory_order_release);
+      return;
+    }
+    i = (i + 1) & t->mask;
+  }
+}
+
+//Copy a slot of t to its next table, empty slots are sealed
+static void copy_slot(struct fpindex *h, fpindex_table_t *t, fpindex_table_t *next, size_t i) {
+  fpindex_slot_t *s = &t->slots[i];
+  uintptr_t value = s->value.load(std::memory_order_acquire);
+
+  //Race against a late insertion, whatever ends in the slot is what gets copied
+  while(value == 0) {
+    if(s->value.compare_exchange_weak(value, SLOT_MOVED, std::memory_order_acq_rel, std::memory_order_acquire))
+      return;
+  }
+
+  uint32_t tag = s->tag.load(std::memory_order_acquire);
+  if(tag == 0)
+    tag = key_tag(key_hash(h->key_fn((void *)value)));
+  copy_value(h, next, value, tag);
+}
+
+//Make sure t has a next table, doubling its size
+static fpindex_table_t *start_growing(fpindex_table_t *t) {
+  fpindex_table_t *next = t->next.load(std::memory_order_acquire);
+
+  if(next != NULL) return next;
+
+  fpindex_table_t *bigger = table_create(2 * (t->mask + 1), t);
+  if(bigger == NULL) {
+    fprintf(stderr, "fpindex: out of memory, unable to grow to %zu slots\n", 2 * (t->mask + 1));
+    abort();
+  }
+  if(!t->next.compare_exchange_strong(next, bigger, std::memory_order_acq_rel, std::memory_order_acquire)) {
+    //Another thread was faster
+    table_destroy(bigger);
+    return next;
+  }
+  return bigger;
+}
+
+/*
+ * Help copying t to its next table, and return once the next table is the
+ * one in use. Values are only inserted in the next table after every slot of
+ * t has been copied, so the keys of t are never inserted twice.
+ */
+static void grow(struct fpindex *h, fpindex_table_t *t) {
+  fpindex_table_t *next = start_growing(t);
+  size_t size = t->mask + 1;
+
+  for(;;) {
+    size_t begin = t->claimed.fetch_add(COPY_BLOCK, std::memory_order_relaxed);
+    if(begin >= size) break;
+
+    size_t end = begin + COPY_BLOCK < size ? begin + COPY_BLOCK : size;
+    for(size_t i=begin; i<end; i++)
+      copy_slot(h, t, next, i);
+
+    if(t->copied.fetch_add(end - begin, std::memory_order_acq_rel) + (end - begin) == size)
+      h->table.store(next, std::memory_order_release);
+  }
+
+  while(h->table.load(std::memory_order_acquire) == t)
+    sched_yield();
+}
+
+/*****************************************************************************/
+void *fpindex_insert(struct fpindex *h, void *v) {
+  const void *k = h->key_fn(v);
+  uint64_t hv = key_hash(k);
+  uint32_t tag = key_tag(hv);
+
+  for(;;) {
+    fpindex_table_t *t = h->table.load(std::memory_order_acquire);
+    size_t i = hv & t->mask;
+    size_t probes;
+
+    for(probes=0; probes<=t->mask; probes++, i=(i+1)&t->mask) {
+      fpindex_slot_t *s = &t->slots[i];
+      uintptr_t value = s->value.load(std::memory_order_acquire);
+
+      if(value == 0) {
+        //The key is not in t. While t is being copied, insert in the next table instead
+        if(t->next.load(std::memory_order_acquire) != NULL) break;
+
+        if(s->value.compare_exchange_strong(value, (uintptr_t)v, std::memory_order_acq_rel, std::memory_order_acquire)) {
+          s->tag.store(tag, std::memory_order_release);
+
+          size_t n = h->counters[key_stripe(k)].n.fetch_add(1, std::memory_order_relaxed) + 1;
+          if(n > (t->mask + 1) / 2 / COUNTER_STRIPES)
+            start_growing(t);
+          return v;
+        }
+        //Lost the slot, value is now what the other thread put there
+      }
+
+      if(value == SLOT_MOVED) break;
+      if(slot_matches(h, s, value, k, tag)) return (void *)value;
+    }
+
+    //Either t is being copied, or it is full
+    grow(h, t);
+  }
+}
+
+/*****************************************************************************/
+void *fpindex_search(struct fpindex *h, const void *k) {
+  fpindex_table_t *t = h->table.load(std::memory_order_acquire);
+  uint64_t hv = key_hash(k);
+  uint32_t tag = key_tag(hv);
+  size_t i = hv & t->mask;
+  size_t probes;
+
+  //Keys are not inserted in the next table before t is entirely copied, so t
+  //has all of them even while it is being copied
+  for(probes=0; probes<=t->mask; probes++, i=(i+1)&t->mask) {
+    fpindex_slot_t *s = &t->slots[i];
+    uintptr_t value = s->value.load(std::memory_order_acquire);
+
+    if(value == 0 || value == SLOT_MOVED) return NULL;
+    if(slot_matches(h, s, value, k, tag)) return (void *)value;
+  }
+
+  return NULL;
+}
+
+/*****************************************************************************/
+void fpindex_prefetch(struct fpindex *h, const void *k) {
+  fpindex_table_t *t = h->table.load(std::memory_order_acquire);
+
+  //Prefetched for writing, most of the searched keys are new and get inserted
+  __builtin_prefetch(&t->slots[key_hash(k) & t->mask], 1);
+}
+
+/*****************************************************************************/
+size_t fpindex_count(struct fpindex *h) {
+  size_t n = 0;
+  int i;
+
+  for(i=0; i<COUNTER_STRIPES; i++)
+    n += h->counters[i].n.load(std::memory_order_relaxed);
+  return n;
+}
+
+/*****************************************************************************/
+void fpindex_destroy(struct fpindex *h, int free_values) {
+  fpindex_table_t *t = h->table.load(std::memory_order_acquire);
+  fpindex_table_t *next = t->next.load(std::memory_order_acquire);
+  size_t i;
+
+  if(free_values) {
+    for(i=0; i<=t->mask; i++) {
+      uintptr_t value = t->slots[i].value.load(std::memory_order_relaxed);
+      if(value != 0 && value != SLOT_MOVED)
+        free((void *)value);
+    }
+  }
+
+  //A copy may have been started and never finished
+  if(next != NULL)
+    table_destroy(next);
+
+  while(t != NULL) {
+    fpindex_table_t *previous = t->previous;
+    table_destroy(t);
+    t = previous;
+  }
+  free(h);
+}
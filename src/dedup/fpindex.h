@@ -0,0 +1,63 @@
+/* Concurrent fingerprint index.
+ *
+ * Open-addressing table of values that embed their own SHA1_LEN bytes key
+ * (a chunk_t and its sha1). Unlike the PARSEC hashtable, it needs no lock:
+ * a value is published with a single compare-and-swap on an empty slot,
+ * keys are compared on all their bytes, and the table grows while in use.
+ *
+ * Growing is cooperative: once the load limit is crossed, the threads
+ * that would insert copy blocks of slots to a table twice as large before
+ * they go on. Searches of keys that are already present never wait.
+ * The arrays that were replaced are freed with the index.
+ */
+
+#ifndef _FPINDEX_H_
+#define _FPINDEX_H_
+
+#include <stddef.h>
+
+//Which structure holds the fingerprints of the chunks seen so far
+typedef enum {
+  INDEX_LOCKFREE = 0,  //fpindex
+  INDEX_LOCKED,        //PARSEC hashtable with one lock per bucket
+} dedup_index_t;
+
+const char *dedup_index_name(dedup_index_t index);
+
+struct fpindex;
+
+/*
+ * fpindex_create
+ *
+ * @param   minsize   minimum initial number of slots
+ * @param   key_fn    returns the address of the SHA1_LEN bytes key of a value
+ * @return            newly created index or NULL on failure
+ */
+struct fpindex *fpindex_create(size_t minsize, const void *(*key_fn)(void *v));
+
+/*
+ * fpindex_insert
+ *
+ * Insert v unless a value with the same key is already present.
+ *
+ * @return   the value already present, or v if it was inserted
+ */
+void *fpindex_insert(struct fpindex *h, void *v);
+
+/*
+ * fpindex_search
+ *
+ * @return   the value whose key is k, or NULL if none found
+ */
+void *fpindex_search(struct fpindex *h, const void *k);
+
+//Bring the slot where a search of k starts into the cache
+void fpindex_prefetch(struct fpindex *h, const void *k);
+
+//Number of values inserted so far
+size_t fpindex_count(struct fpindex *h);
+
+//Must not run concurrently with any other function of the index
+void fpindex_destroy(struct fpindex *h, int free_values);
+
+#endif //_FPINDEX_H_
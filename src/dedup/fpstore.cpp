@@ -0,0 +1,321 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fpstore.h"
+#include "util.h"
+#include "debug.h"
+
+static_assert(sizeof(fpstore_entry_t) == 32, "The log and the TYPE_REFERENCE records depend on the layout of fpstore_entry_t");
+
+//Slots of the index per entry of the log, at least
+#define INDEX_LOAD 2
+
+struct fpstore {
+  std::string dir;
+  std::vector<fpstore_archive_t> archives;
+
+  //Log of the previous runs, mapped
+  int log_fd;
+  const fpstore_entry_t *log;
+  u_long n_entries;
+  size_t log_size;                //bytes mapped
+
+  //Index of the log, mapped
+  int index_fd;
+  fpstore_index_header_t *index;
+  u_long *slots;
+  size_t index_size;
+
+  //Run
+  u32int archive;
+  std::string archive_path;
+  byte compress_type;
+  std::vector<fpstore_entry_t> pending;
+};
+
+static std::string store_file(fpstore_t *s, const char *name) {
+  return s->dir + "/" + name;
+}
+
+static u_long slot_of(const void *sha1, u_long n_slots) {
+  u_long h;
+
+  //The SHA1 sum is already uniformly distributed
+  memcpy(&h, sha1, sizeof(h));
+  return h & (n_slots - 1);
+}
+
+static void insert_slot(u_long *slots, u_long n_slots, const fpstore_entry_t *log, u_long entry) {
+  u_long i = slot_of(log[entry].sha1, n_slots);
+
+  while(slots[i] != 0) i = (i + 1) & (n_slots - 1);
+  slots[i] = entry + 1;
+}
+
+static void unmap_log(fpstore_t *s) {
+  if(s->log != NULL) munmap((void *)s->log, s->log_size);
+  s->log = NULL;
+}
+
+static void map_log(fpstore_t *s) {
+  unmap_log(s);
+  if(s->n_entries == 0) return;
+  s->log_size = s->n_entries * sizeof(fpstore_entry_t);
+  void *p = mmap(NULL, s->log_size, PROT_READ, MAP_SHARED, s->log_fd, 0);
+  if(p == MAP_FAILED) EXIT_TRACE("Cannot map the log of the fingerprint store: %s\n", strerror(errno));
+  s->log = (const fpstore_entry_t *)p;
+}
+
+static void unmap_index(fpstore_t *s) {
+  if(s->index != NULL) munmap(s->index, s->index_size);
+  if(s->index_fd >= 0) close(s->index_fd);
+  s->index = NULL;
+  s->slots = NULL;
+  s->index_fd = -1;
+}
+
+//Map the index file, returns -1 if it does not match the log
+static int map_index(fpstore_t *s) {
+  std::string path = store_file(s, "index");
+  fpstore_index_header_t header;
+  struct stat st;
+
+  s->index_fd = open(path.c_str(), O_RDWR);
+  if(s->index_fd < 0) return -1;
+  if(fstat(s->index_fd, &st) < 0 || xread(s->index_fd, &header, sizeof(header)) <= 0 ||
+     memcmp(header.magic, FPSTORE_INDEX_MAGIC, sizeof(header.magic)) != 0 || header.n_entries != s->n_entries ||
+     header.n_slots == 0 || (header.n_slots & (header.n_slots - 1)) != 0 ||
+     (u_long)st.st_size != sizeof(header) + header.n_slots * sizeof(u_long)) {
+    unmap_index(s);
+    return -1;
+  }
+
+  s->index_size = st.st_size;
+  void *p = mmap(NULL, s->index_size, PROT_READ | PROT_WRITE, MAP_SHARED, s->index_fd, 0);
+  if(p == MAP_FAILED) EXIT_TRACE("Cannot map the index of the fingerprint store: %s\n", strerror(errno));
+  s->index = (fpstore_index_header_t *)p;
+  s->slots = (u_long *)(s->index + 1);
+  return 0;
+}
+
+//Build the index of the log in a new file, which replaces the index file
+static void build_index(fpstore_t *s) {
+  std::string path = store_file(s, "index"), tmp = store_file(s, "index.tmp");
+  u_long n_slots = 1024;
+  u_long i;
+
+  unmap_index(s);
+  while(n_slots < INDEX_LOAD * 2 * s->n_entries) n_slots *= 2;
+  size_t size = sizeof(fpstore_index_header_t) + n_slots * sizeof(u_long);
+
+  int fd = open(tmp.c_str(), O_CREAT | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if(fd < 0 || ftruncate(fd, size) < 0) EXIT_TRACE("Cannot create %s: %s\n", tmp.c_str(), strerror(errno));
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED) EXIT_TRACE("Cannot map %s: %s\n", tmp.c_str(), strerror(errno));
+
+  //The file is zeroed, so all the slots are empty
+  fpstore_index_header_t *header = (fpstore_index_header_t *)p;
+  u_long *slots = (u_long *)(header + 1);
+  for(i=0; i<s->n_entries; i++) insert_slot(slots, n_slots, s->log, i);
+  memcpy(header->magic, FPSTORE_INDEX_MAGIC, sizeof(header->magic));
+  header->n_entries = s->n_entries;
+  header->n_slots = n_slots;
+
+  if(msync(p, size, MS_SYNC) < 0 || munmap(p, size) < 0 || close(fd) < 0 || rename(tmp.c_str(), path.c_str()) < 0) {
+    EXIT_TRACE("Cannot write the index of the fingerprint store: %s\n", strerror(errno));
+  }
+  if(map_index(s) != 0) EXIT_TRACE("The index of the fingerprint store just built does not match its log.\n");
+}
+
+/*****************************************************************************/
+int fpstore_read_archives(const char *dir, std::vector<fpstore_archive_t> *archives) {
+  std::string path = std::string(dir) + "/archives";
+  char line[PATH_MAX + 16];
+  FILE *f;
+
+  archives->clear();
+  f = fopen(path.c_str(), "r");
+  if(f == NULL) return errno == ENOENT ? 0 : -1;
+  while(fgets(line, sizeof(line), f) != NULL) {
+    int compress_type, n;
+    size_t len = strlen(line);
+    //A line cut short was not synced, the archive is not in the store
+    if(len == 0 || line[len - 1] != '\n') break;
+    line[len - 1] = '\0';
+    if(sscanf(line, "%d %n", &compress_type, &n) != 1) {
+      fclose(f);
+      return -1;
+    }
+    archives->push_back({ line + n, (byte)compress_type });
+  }
+  fclose(f);
+  return 0;
+}
+
+/*****************************************************************************/
+fpstore_t *fpstore_open(const char *dir) {
+  fpstore_t *s = new fpstore_t;
+  struct stat st;
+
+  s->dir = dir;
+  s->log = NULL;
+  s->log_size = 0;
+  s->index = NULL;
+  s->slots = NULL;
+  s->index_fd = -1;
+  s->archive = 0;
+  s->compress_type = 0;
+
+  if(mkdir(dir, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) < 0 && errno != EEXIST) {
+    EXIT_TRACE("Cannot create the fingerprint store %s: %s\n", dir, strerror(errno));
+  }
+
+  //Held until fpstore_close, the archives and the log are read once it is
+  std::string log = store_file(s, "log");
+  s->log_fd = open(log.c_str(), O_CREAT | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if(s->log_fd < 0) EXIT_TRACE("Cannot open %s: %s\n", log.c_str(), strerror(errno));
+  if(flock(s->log_fd, LOCK_EX | LOCK_NB) < 0) {
+    if(errno != EWOULDBLOCK) EXIT_TRACE("Cannot lock %s: %s\n", log.c_str(), strerror(errno));
+    printf("Fingerprint store %s is used by another run, waiting for it\n", dir);
+    if(flock(s->log_fd, LOCK_EX) < 0) EXIT_TRACE("Cannot lock %s: %s\n", log.c_str(), strerror(errno));
+  }
+
+  if(fpstore_read_archives(dir, &s->archives) != 0) {
+    EXIT_TRACE("Cannot read the archives of the fingerprint store %s\n", dir);
+  }
+  if(fstat(s->log_fd, &st) < 0) EXIT_TRACE("Cannot open %s: %s\n", log.c_str(), strerror(errno));
+
+  //Cut off the entries of an archive that was never added
+  s->n_entries = st.st_size / sizeof(fpstore_entry_t);
+  map_log(s);
+  u_long n = s->n_entries;
+  while(n > 0 && s->log[n - 1].archive >= s->archives.size()) n--;
+  if(n != s->n_entries || (u_long)st.st_size != n * sizeof(fpstore_entry_t)) {
+    s->n_entries = n;
+    if(ftruncate(s->log_fd, n * sizeof(fpstore_entry_t)) < 0) EXIT_TRACE("Cannot truncate %s: %s\n", log.c_str(), strerror(errno));
+    map_log(s);
+  }
+
+  if(map_index(s) != 0 || INDEX_LOAD * s->n_entries > s->index->n_slots) build_index(s);
+  return s;
+}
+
+/*****************************************************************************/
+void fpstore_close(fpstore_t *s) {
+  unmap_log(s);
+  unmap_index(s);
+  //Also releases the lock
+  close(s->log_fd);
+  delete s;
+}
+
+/*****************************************************************************/
+u32int fpstore_begin(fpstore_t *s, const char *archive, byte compress_type) {
+  char resolved[PATH_MAX];
+  u32int i;
+
+  //The path of the archive once it exists, its directory must exist already
+  if(realpath(archive, resolved) == NULL) {
+    char dir[PATH_MAX], base[PATH_MAX], *dir_resolved;
+    snprintf(dir, sizeof(dir), "%s", archive);
+    snprintf(base, sizeof(base), "%s", archive);
+    dir_resolved = realpath(dirname(dir), resolved);
+    if(dir_resolved == NULL) EXIT_TRACE("Cannot resolve the path of %s: %s\n", archive, strerror(errno));
+    s->archive_path = std::string(dir_resolved) + "/" + basename(base);
+  } else {
+    s->archive_path = resolved;
+  }
+
+  for(i=0; i<s->archives.size(); i++) {
+    if(s->archives[i].path == s->archive_path) {
+      EXIT_TRACE("%s is archive %u of the fingerprint store %s, later archives may refer to its records.\n",
+                 s->archive_path.c_str(), i, s->dir.c_str());
+    }
+  }
+
+  s->archive = s->archives.size();
+  s->compress_type = compress_type;
+  s->pending.clear();
+  return s->archive;
+}
+
+/*****************************************************************************/
+const fpstore_entry_t *fpstore_search(fpstore_t *s, const void *sha1) {
+  u_long n_slots = s->index->n_slots;
+  u_long i = slot_of(sha1, n_slots);
+
+  for(; s->slots[i] != 0; i = (i + 1) & (n_slots - 1)) {
+    const fpstore_entry_t *entry = &s->log[s->slots[i] - 1];
+    //The same chunk may be in archives with different compressions
+    if(memcmp(entry->sha1, sha1, SHA1_LEN) == 0 && s->archives[entry->archive].compress_type == s->compress_type) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+/*****************************************************************************/
+void fpstore_add(fpstore_t *s, const void *sha1, u_long offset) {
+  fpstore_entry_t entry;
+
+  memcpy(entry.sha1, sha1, SHA1_LEN);
+  entry.archive = s->archive;
+  entry.offset = offset;
+  s->pending.push_back(entry);
+}
+
+/*****************************************************************************/
+void fpstore_commit(fpstore_t *s) {
+  std::string archives = store_file(s, "archives");
+  u_long i;
+  int fd;
+
+  if(s->pending.empty()) return;
+
+  //The records the entries refer to must be on disk before the entries
+  fd = open(s->archive_path.c_str(), O_RDONLY);
+  if(fd < 0 || fsync(fd) < 0) EXIT_TRACE("Cannot sync %s: %s\n", s->archive_path.c_str(), strerror(errno));
+  close(fd);
+
+  if(lseek(s->log_fd, s->n_entries * sizeof(fpstore_entry_t), SEEK_SET) < 0 ||
+     xwrite(s->log_fd, s->pending.data(), s->pending.size() * sizeof(fpstore_entry_t)) < 0 || fsync(s->log_fd) < 0) {
+    EXIT_TRACE("Cannot write the log of the fingerprint store: %s\n", strerror(errno));
+  }
+
+  //The entries count from the moment the archive is in the archives file
+  fd = open(archives.c_str(), O_CREAT | O_WRONLY | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  std::string line = std::to_string(s->compress_type) + " " + s->archive_path + "\n";
+  if(fd < 0 || xwrite(fd, line.c_str(), line.size()) < 0 || fsync(fd) < 0) {
+    EXIT_TRACE("Cannot add %s to the fingerprint store: %s\n", s->archive_path.c_str(), strerror(errno));
+  }
+  close(fd);
+  s->archives.push_back({ s->archive_path, s->compress_type });
+
+  u_long first = s->n_entries;
+  s->n_entries += s->pending.size();
+  s->pending.clear();
+  map_log(s);
+
+  //An index which does not match the log any more is built again when opened
+  if(INDEX_LOAD * s->n_entries > s->index->n_slots) {
+    build_index(s);
+  } else {
+    for(i=first; i<s->n_entries; i++) insert_slot(s->slots, s->index->n_slots, s->log, i);
+    s->index->n_entries = s->n_entries;
+    if(msync(s->index, s->index_size, MS_SYNC) < 0) EXIT_TRACE("Cannot write the index of the fingerprint store: %s\n", strerror(errno));
+  }
+}
+
+/*****************************************************************************/
+u_long fpstore_count(fpstore_t *s) {
+  return s->n_entries;
+}
@@ -0,0 +1,106 @@
+/* Fingerprint store: the unique chunks of the archives of previous runs.
+ *
+ * An encoder run with a store looks a chunk up in it after a miss in the
+ * index of the run. If an archive written before has the chunk, the chunk is
+ * not compressed and the archive gets a TYPE_REFERENCE record instead, whose
+ * content is the fpstore_entry_t of the chunk: the decoder reads the data from
+ * the archive it refers to. The records of the archives a store knows must
+ * stay where they are, which is why an archive of the store cannot be written
+ * again.
+ *
+ * The store is a directory with three files:
+ *  - archives: one line "<compression> <path>" per archive, numbered from 0
+ *  - log: the fpstore_entry_t of the TYPE_COMPRESS and TYPE_ORIGINAL records
+ *    of the archives, in the order they were written
+ *  - index: open-addressing table of the log entries by SHA1 sum, behind an
+ *    fpstore_index_header_t. A slot is the number of its entry plus one, 0
+ *    for an empty slot.
+ * The log and the index are mapped. They are not changed during the run, so
+ * that any number of threads can search them without a lock: the entries of
+ * the run are kept in memory, then added by fpstore_commit once the archive is
+ * complete. The log is synced before the archive is added to the archives
+ * file, and the index is updated last. Entries of an archive missing from
+ * the archives file are cut off the log when the store is opened, and an
+ * index which does not match the log is built again.
+ *
+ * A run holds an exclusive lock (flock) on the log from fpstore_open to
+ * fpstore_close: runs of several processes with the same store take their
+ * turns, so that two of them never get the same archive number or write their
+ * entries at the same place of the log. The decoder does not take the lock,
+ * it only reads the archives file, whose lines are complete once synced.
+ */
+
+#ifndef _FPSTORE_H_
+#define _FPSTORE_H_
+
+#include <string>
+#include <vector>
+
+#include "dedupdef.h"
+
+#define FPSTORE_INDEX_MAGIC "DDPSTIDX"
+
+//Location of the data of a unique chunk, also the content of a TYPE_REFERENCE record
+typedef struct fpstore_entry {
+  u_char sha1[SHA1_LEN];
+  u32int archive;              //number of the archive in the store
+  u_long offset;               //offset of the TYPE_COMPRESS or TYPE_ORIGINAL record in the archive
+} fpstore_entry_t;
+
+typedef struct {
+  char magic[8];               //FPSTORE_INDEX_MAGIC, without the terminating null byte
+  u_long n_entries;            //entries of the log in the table
+  u_long n_slots;              //a power of 2
+} fpstore_index_header_t;
+
+typedef struct {
+  std::string path;
+  byte compress_type;
+} fpstore_archive_t;
+
+typedef struct fpstore fpstore_t;
+
+//Open the store in dir, created if it does not exist. Waits for the runs of
+//other processes which have it open.
+fpstore_t *fpstore_open(const char *dir);
+
+//Free the store and release it to the other processes, the entries of a run
+//not committed are lost
+void fpstore_close(fpstore_t *s);
+
+/*
+ * fpstore_begin
+ *
+ * Start the run writing archive with compress_type, which must not be an
+ * archive of the store already. Only the chunks of the archives with the same
+ * compression are found from now on.
+ *
+ * @return   number of the archive in the store
+ */
+u32int fpstore_begin(fpstore_t *s, const char *archive, byte compress_type);
+
+/*
+ * fpstore_search
+ *
+ * Thread-safe. The entries added during the run are not searched.
+ *
+ * @return   the entry of the chunk whose SHA1 sum is sha1, or NULL if none found
+ */
+const fpstore_entry_t *fpstore_search(fpstore_t *s, const void *sha1);
+
+//Add the TYPE_COMPRESS or TYPE_ORIGINAL record at offset of the archive of the
+//run. Only one thread may add entries.
+void fpstore_add(fpstore_t *s, const void *sha1, u_long offset);
+
+//Add the archive of the run and its entries to the store, once the archive is
+//complete. Nothing is written if the run added no entry.
+void fpstore_commit(fpstore_t *s);
+
+//Number of entries of the previous runs
+u_long fpstore_count(fpstore_t *s);
+
+//Read the archives of the store in dir, for the decoder
+//Returns 0 on success, -1 on failure
+int fpstore_read_archives(const char *dir, std::vector<fpstore_archive_t> *archives);
+
+#endif //_FPSTORE_H_
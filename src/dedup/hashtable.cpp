@@ -128,6 +128,12 @@ std::tuple<pthread_mutex_t *, unsigned int> hashtable_getlock(struct hashtable *
   index = indexFor(h->tablelength,hashvalue);
   return { &(h->locks[index]), index };
 }
+
+/*****************************************************************************/
+void hashtable_prefetch(struct hashtable *h, unsigned int index) {
+  __builtin_prefetch(&(h->table[index]), 1);
+  __builtin_prefetch(&(h->locks[index]), 1);
+}
 #endif
 
 #ifdef ENABLE_DYNAMIC_EXPANSION
@@ -146,6 +146,20 @@ struct hashtable * hashtable_create(
 std::tuple<pthread_mutex_t *, unsigned int> hashtable_getlock(struct hashtable *h, void *k);
 #endif
 
+/*
+ * hashtable_prefetch
+
+ * @name        hashtable_prefetch
+ * @param   h       the hashtable
+ * @param   index   the index returned by hashtable_getlock
+ *
+ * Bring the head of the bucket and its lock into the cache ahead of their use,
+ * so that a batch of lookups can overlap their cache misses.
+ */
+#ifdef ENABLE_PTHREADS
+void hashtable_prefetch(struct hashtable *h, unsigned int index);
+#endif
+
 /*****************************************************************************
  * hashtable_insert
    
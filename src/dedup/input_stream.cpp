@@ -0,0 +1,235 @@
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "input_stream.h"
+#include "rabin.h"
+#include "debug.h"
+
+//Alignment of the blocks, so that they are read a page at a time
+#define BLOCK_ALIGN 4096
+
+struct input_stream {
+  int fd;
+  size_t block_size;
+  size_t head_room;
+  int n_buffers;
+  u_char **buffers;               //head room then block, the block of the k-th read is in buffers[k % n_buffers]
+  size_t *lengths;
+
+  std::thread reader;
+  std::mutex mutex;
+  std::condition_variable cond;
+  u_long filled;                  //blocks read
+  u_long taken;                   //blocks given to the caller
+  u_long released;                //blocks given back by the caller
+  int eof;
+  int stop;
+  u_long caller_waits;
+  u_long reader_waits;
+};
+
+//Read until the block is full or the file ends
+static size_t read_block(input_stream_t *s, u_char *block) {
+  size_t n = 0;
+
+  while(n < s->block_size) {
+    ssize_t rv = read(s->fd, block + n, s->block_size - n);
+    if(rv < 0 && errno == EINTR) continue;
+    if(rv < 0) EXIT_TRACE("Reading the input file fails: %s\n", strerror(errno));
+    if(rv == 0) break;
+    n += rv;
+  }
+  return n;
+}
+
+static void read_loop(input_stream_t *s) {
+  std::unique_lock<std::mutex> lck(s->mutex);
+
+  while(TRUE) {
+    if(s->filled - s->released == (u_long)s->n_buffers && !s->stop) {
+      s->reader_waits++;
+      s->cond.wait(lck, [s]() { return s->filled - s->released < (u_long)s->n_buffers || s->stop; });
+    }
+    if(s->stop) return;
+
+    int slot = s->filled % s->n_buffers;
+    lck.unlock();
+    size_t n = read_block(s, s->buffers[slot] + s->head_room);
+    lck.lock();
+
+    if(n > 0) {
+      s->lengths[slot] = n;
+      s->filled++;
+    }
+    //A short block is the last one
+    if(n < s->block_size) s->eof = TRUE;
+    s->cond.notify_all();
+    if(s->eof) return;
+  }
+}
+
+/*****************************************************************************/
+input_stream_t *input_stream_create(int fd, size_t block_size, int n_buffers, size_t head_room) {
+  input_stream_t *s = new input_stream_t;
+  int i;
+
+  assert(block_size > 0);
+  //The caller holds a block while it waits for the next one
+  assert(n_buffers >= 2);
+
+  s->fd = fd;
+  s->block_size = block_size;
+  s->head_room = (head_room + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN;
+  s->n_buffers = n_buffers;
+  s->buffers = (u_char **)malloc(n_buffers * sizeof(u_char *));
+  s->lengths = (size_t *)malloc(n_buffers * sizeof(size_t));
+  if(s->buffers == NULL || s->lengths == NULL) EXIT_TRACE("Memory allocation failed.\n");
+  for(i=0; i<n_buffers; i++) {
+    if(posix_memalign((void **)&s->buffers[i], BLOCK_ALIGN, s->head_room + block_size) != 0) {
+      EXIT_TRACE("Memory allocation failed.\n");
+    }
+  }
+
+  s->filled = s->taken = s->released = 0;
+  s->eof = FALSE;
+  s->stop = FALSE;
+  s->caller_waits = s->reader_waits = 0;
+  s->reader = std::thread(read_loop, s);
+  return s;
+}
+
+/*****************************************************************************/
+void input_stream_destroy(input_stream_t *s) {
+  int i;
+
+  {
+    std::unique_lock<std::mutex> lck(s->mutex);
+    s->stop = TRUE;
+    s->cond.notify_all();
+  }
+  s->reader.join();
+
+  for(i=0; i<s->n_buffers; i++) free(s->buffers[i]);
+  free(s->buffers);
+  free(s->lengths);
+  delete s;
+}
+
+/*****************************************************************************/
+u_char *input_stream_next(input_stream_t *s, size_t *n) {
+  std::unique_lock<std::mutex> lck(s->mutex);
+
+  if(s->filled == s->taken && !s->eof) {
+    s->caller_waits++;
+    s->cond.wait(lck, [s]() { return s->filled > s->taken || s->eof; });
+  }
+  if(s->filled == s->taken) return NULL;
+
+  int slot = s->taken % s->n_buffers;
+  s->taken++;
+  *n = s->lengths[slot];
+  return s->buffers[slot] + s->head_room;
+}
+
+/*****************************************************************************/
+void input_stream_release(input_stream_t *s) {
+  std::unique_lock<std::mutex> lck(s->mutex);
+
+  assert(s->released < s->taken);
+  s->released++;
+  s->cond.notify_all();
+}
+
+/*****************************************************************************/
+u_long input_stream_caller_waits(input_stream_t *s) {
+  std::unique_lock<std::mutex> lck(s->mutex);
+  return s->caller_waits;
+}
+
+/*****************************************************************************/
+u_long input_stream_reader_waits(input_stream_t *s) {
+  std::unique_lock<std::mutex> lck(s->mutex);
+  return s->reader_waits;
+}
+
+/*****************************************************************************/
+u_long input_stream_split(input_stream_t *s, int winlen, u32int *rabintab, u32int *rabinwintab,
+                          std::function<void(const u_char *, size_t)> const& emit) {
+  u_char *carry = NULL;           //anchor longer than the head room
+  size_t carry_size = 0;
+  const u_char *left = NULL;      //bytes after the last anchor, in the previous block or in carry
+  size_t left_n = 0;
+  int held = FALSE;               //TRUE until the previous block is given back
+  u_char *block;
+  size_t n;
+  u_long count = 0;
+
+  while((block = input_stream_next(s, &n)) != NULL) {
+    u_char *base;
+    size_t len = left_n + n;
+
+    if(left_n <= s->head_room) {
+      base = block - left_n;
+      if(left_n > 0) memcpy(base, left, left_n);
+    } else {
+      //Append the block to the bytes left instead
+      if(len > carry_size) {
+        u_char *p = (u_char *)malloc(2 * len);
+        if(p == NULL) EXIT_TRACE("Memory allocation failed.\n");
+        memcpy(p, left, left_n);
+        free(carry);
+        carry = p;
+        carry_size = 2 * len;
+      } else {
+        memmove(carry, left, left_n);
+      }
+      memcpy(carry + left_n, block, n);
+      base = carry;
+    }
+    if(held) input_stream_release(s);
+    held = TRUE;
+
+    //partition the bytes into large, coarse-granular chunks
+    size_t start = 0;
+    while(len - start > ANCHOR_JUMP) {
+      int offset = rabinseg_lanes(base + start + ANCHOR_JUMP, len - start - ANCHOR_JUMP, winlen, rabintab, rabinwintab);
+      //Split at the very beginning of the buffer should never happen due to technical limitations
+      assert(offset != 0);
+      //Due to technical limitations we can't distinguish the cases "no split" and "split at end of buffer",
+      //the search starts again at the same place once the next block is there
+      if((size_t)offset + ANCHOR_JUMP >= len - start) break;
+      emit(base + start, offset + ANCHOR_JUMP);
+      count++;
+      start += offset + ANCHOR_JUMP;
+    }
+    left = base + start;
+    left_n = len - start;
+  }
+
+  //Last anchor, shorter than ANCHOR_JUMP or without a boundary
+  if(left_n > 0) {
+    emit(left, left_n);
+    count++;
+  }
+  if(held) input_stream_release(s);
+  free(carry);
+  return count;
+}
+
+/*****************************************************************************/
+size_t input_stream_next_anchor(uchar *buffer, size_t size, size_t start, int winlen, u32int *rabintab, u32int *rabinwintab) {
+  if(size - start <= ANCHOR_JUMP) return size;
+
+  //rabinseg_lanes takes an int
+  size_t n = MIN(size - start - ANCHOR_JUMP, (size_t)INT_MAX);
+  int offset = rabinseg_lanes(buffer + start + ANCHOR_JUMP, n, winlen, rabintab, rabinwintab);
+  return MIN(start + ANCHOR_JUMP + offset, size);
+}
@@ -0,0 +1,73 @@
+/* Streaming reader of the input of the Fragment stage.
+ *
+ * A background thread reads the file in blocks of a fixed size into a fixed
+ * pool of buffers, while the caller cuts the blocks it already has into
+ * anchors. The reader is at most n_buffers blocks ahead of the caller, so the
+ * memory used to read the input is bounded whatever its size.
+ *
+ * Every buffer has head_room bytes before its block, where the caller copies
+ * what is left of the previous block so that an anchor spanning both blocks
+ * is contiguous.
+ */
+
+#ifndef _INPUT_STREAM_H_
+#define _INPUT_STREAM_H_
+
+#include <stddef.h>
+
+#include <functional>
+
+#include "dedupdef.h"
+
+typedef struct input_stream input_stream_t;
+
+/*
+ * input_stream_create
+ *
+ * @param   fd            file to read, from its current offset to its end
+ * @param   block_size    bytes read in a block
+ * @param   n_buffers     blocks in the pool, at least 2
+ * @param   head_room     bytes before every block the caller may write
+ */
+input_stream_t *input_stream_create(int fd, size_t block_size, int n_buffers, size_t head_room);
+
+//Stop the reader and free the buffers
+void input_stream_destroy(input_stream_t *s);
+
+//Next block of the file, NULL once the whole file was read. n receives the
+//size of the block, the block_size given to input_stream_create but for the
+//last one. The blocks are given in the order of the file.
+u_char *input_stream_next(input_stream_t *s, size_t *n);
+
+//Give the oldest block got with input_stream_next back to the reader
+void input_stream_release(input_stream_t *s);
+
+//Number of times the caller waited for a block, and the reader for a buffer
+u_long input_stream_caller_waits(input_stream_t *s);
+u_long input_stream_reader_waits(input_stream_t *s);
+
+/*
+ * input_stream_split
+ *
+ * Cut the whole file into anchors, the way the Fragment stage cuts its
+ * buffers: an anchor ends at the first Rabin boundary ANCHOR_JUMP bytes or
+ * more after its start, the last one at the end of the file. emit is called
+ * for every anchor in order, with bytes which are only valid during the call.
+ *
+ * @return  the number of anchors
+ */
+u_long input_stream_split(input_stream_t *s, int winlen, u32int *rabintab, u32int *rabinwintab,
+                          std::function<void(const u_char *, size_t)> const& emit);
+
+/*
+ * input_stream_next_anchor
+ *
+ * The same rule over an input already in memory, preloaded or mapped: end of
+ * the anchor starting at start in the size bytes at buffer, the first Rabin
+ * boundary found by a scan starting ANCHOR_JUMP bytes after start, strictly
+ * before size, or size if there is none. Following the anchors from 0 gives
+ * those of input_stream_split with the same window and tables.
+ */
+size_t input_stream_next_anchor(uchar *buffer, size_t size, size_t start, int winlen, u32int *rabintab, u32int *rabinwintab);
+
+#endif //_INPUT_STREAM_H_
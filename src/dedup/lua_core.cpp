@@ -1,9 +1,11 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <thread>
 
 #include "nlohmann/json.hpp"
 
+#include "decoder.h"
 #include "encoder.h"
 #include "lua_core.h"
 
@@ -71,9 +73,30 @@ void DedupData::dump() {
                 "\t_output_filename = " << _output_filename << std::endl << 
                 "\t_nb_threads = " << get_total_threads() << std::endl <<
                 "\t_compression = " << (int)_compression << std::endl <<
+                "\t_compression_level = " << _compression_level << std::endl <<
+                "\t_compress_skip = " << _compress_skip << std::endl <<
+                "\t_fingerprint = " << fingerprint_backend_name(_fingerprint) << std::endl <<
+                "\t_index = " << dedup_index_name(_index) << std::endl <<
+                "\t_fingerprint_store = " << _fingerprint_store << std::endl <<
+                "\t_chunking = " << chunking_engine_name(_chunking) << std::endl <<
+                "\t_rabin_window = " << _rabin_window << std::endl <<
+                "\t_chunk_min = " << _chunk_min << std::endl <<
+                "\t_chunk_avg = " << _chunk_avg << std::endl <<
+                "\t_chunk_max = " << _chunk_max << std::endl <<
                 "\t_preloading = " << _preloading << std::endl <<
+                "\t_mmap = " << _mmap << std::endl <<
                 "\t_algorithm = " << (int)_algorithm << std::endl << 
                 "\t_debug_timestamps = " << _debug_timestamps << std::endl <<
+                "\t_archive_index = " << _archive_index << std::endl <<
+                "\t_output_buffer = " << _output_buffer << std::endl <<
+                "\t_output_flusher = " << _output_flusher << std::endl <<
+                "\t_output_direct = " << _output_direct << std::endl <<
+                "\t_read_block = " << _read_block << std::endl <<
+                "\t_read_ahead = " << _read_ahead << std::endl <<
+                "\t_task_threads = " << _task_threads << std::endl <<
+                "\t_decode_threads = " << _decode_threads << std::endl <<
+                "\t_verify = " << _verify << std::endl <<
+                "\t_decode_memory = " << _decode_memory << std::endl <<
                 "\t_fifos = " << std::endl;
 
     /* for (auto& p1: _fifo_data) {
@@ -116,6 +139,59 @@ unsigned long long DedupData::run_auto() {
     return duration;
 }
 
+unsigned long long DedupData::run_tasks() {
+    validate();
+    return EncodeTasks(*this);
+}
+
+// Fills the configuration of the decoder
+static void decode_config(DedupData const& data, config_t& decode_conf) {
+    if (data._input_filename.size() >= LEN_FILENAME || data._output_filename.size() >= LEN_FILENAME ||
+        data._fingerprint_store.size() >= LEN_FILENAME) {
+        std::ostringstream error;
+        error << "[FATAL] File names of run_decode must be shorter than " << LEN_FILENAME << " characters" << std::endl;
+        throw std::runtime_error(error.str());
+    }
+
+    if (fingerprint_init(data._fingerprint) != 0) {
+        std::ostringstream error;
+        error << "[FATAL] Fingerprint backend " << fingerprint_backend_name(data._fingerprint) << " is not supported by this CPU" << std::endl;
+        throw std::runtime_error(error.str());
+    }
+
+    strcpy(decode_conf.infile, data._input_filename.c_str());
+    strcpy(decode_conf.outfile, data._output_filename.c_str());
+    strcpy(decode_conf.store, data._fingerprint_store.c_str());
+    // Replaced by the compression of the file
+    decode_conf.compress_type = data._compression;
+    decode_conf.preloading = data._preloading;
+    decode_conf.nthreads = data._decode_threads != 0 ? data._decode_threads : std::max(1U, std::thread::hardware_concurrency());
+    decode_conf.verbose = 0;
+    decode_conf.verify = data._verify;
+    decode_conf.memory_budget = data._decode_memory;
+}
+
+unsigned long long DedupData::run_decode() {
+    config_t decode_conf;
+    decode_config(*this, decode_conf);
+
+    std::cout << "Running decode with " << decode_conf.nthreads << " workers" << std::endl;
+    auto duration = Decode(&decode_conf);
+    // Decode makes conf point to decode_conf, which main must not free
+    conf = nullptr;
+    return duration;
+}
+
+unsigned long long DedupData::run_decode_range(unsigned long long begin, unsigned long long end) {
+    config_t decode_conf;
+    decode_config(*this, decode_conf);
+
+    auto duration = DecodeRange(&decode_conf, begin, end);
+    // Same as run_decode
+    conf = nullptr;
+    return duration;
+}
+
 /* void DedupData::process_timestamp_data(std::vector<Globals::SmartFIFOTSV> const& data) {
     std::map<SmartFIFOImpl<chunk_t*>*, std::map<Globals::SteadyTP, std::tuple<SmartFIFO<chunk_t*>*, Globals::Action, size_t>>> processed_data;
     for (Globals::SmartFIFOTSV const& vec: data) {
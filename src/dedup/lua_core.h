@@ -6,6 +6,9 @@
 #include <string>
 
 #include "dedupdef.h"
+#include "chunking.h"
+#include "fingerprint.h"
+#include "fpindex.h"
 
 enum Layers {
     FRAGMENT,
@@ -18,7 +21,9 @@ enum Layers {
 enum Compressions {
     GZIP = COMPRESS_GZIP,
     BZIP = COMPRESS_BZIP2,
-    NONE = COMPRESS_NONE
+    NONE = COMPRESS_NONE,
+    ZSTD = COMPRESS_ZSTD,
+    LZ4 = COMPRESS_LZ4
 };
 
 enum class FIFORole;
@@ -80,14 +85,77 @@ public:
     std::optional<std::string> _observers;
     std::string _output_filename;
     Compressions _compression = GZIP;
+    // Level of the compression backend, 0 for its default
+    int _compression_level = 0;
+    // Chunks whose sampled bytes have this entropy or more, in bits per byte,
+    // are stored as they are instead of compressed, see compressor_entropy, as
+    // are chunks which do not get smaller once compressed. 0 to compress every
+    // chunk: archives with chunks stored as they are (TYPE_ORIGINAL records)
+    // cannot be decoded by decoders from before this setting. 7.8 skips
+    // compressed media and random data only.
+    double _compress_skip = 0;
+    fingerprint_backend_t _fingerprint = FINGERPRINT_AUTO;
+    dedup_index_t _index = INDEX_LOCKFREE;
+    // Directory of the fingerprint store of the archives of previous runs,
+    // see fpstore.h. The encoder refers to their records instead of
+    // compressing the chunks again, the decoder reads them. Empty for none.
+    std::string _fingerprint_store;
+    // Engine cutting the anchors into chunks in the Refine stage
+    chunking_engine_t _chunking = CHUNKING_RABIN;
+    // Build the Rabin tables for a rolling window of NWINDOW bytes instead of
+    // the window of 0 byte dedup always used. The anchors and chunks are cut at
+    // other places, so archives differ from the ones made without it, but the
+    // Rabin scans of Fragment and Refine run on interleaved lanes (see
+    // rabinseg_lanes), which need a true rolling window.
+    bool _rabin_window = false;
+    // Minimum, average (a power of 2) and maximum bytes of the chunks of the
+    // gear engine
+    unsigned int _chunk_min = 2048;
+    unsigned int _chunk_avg = 8192;
+    unsigned int _chunk_max = 65536;
     bool _preloading = false;
+    // Map the input instead of reading it, chunks are views into the mapping
+    bool _mmap = false;
     FIFOReconfigure _algorithm;
     bool _debug_timestamps = false;
+    // Append an index of the records to the archive, see ddpindex.h. Decoders
+    // from before the index cannot decode such an archive.
+    bool _archive_index = false;
+    // Bytes of the buffer of the archive, 0 to write the records one by one
+    size_t _output_buffer = 1 << 20;
+    // Write the buffer from a background thread while a second one is filled
+    bool _output_flusher = false;
+    // Write the archive with O_DIRECT
+    bool _output_direct = false;
+    // Bytes of the blocks the Fragment stage reads the input in, from a
+    // background thread. 0 to read it in buffers of MAXBUF bytes instead.
+    // Ignored with _preloading and _mmap.
+    size_t _read_block = 4 << 20;
+    // Blocks the reader may be ahead of the Fragment stage, at least 2
+    unsigned int _read_ahead = 4;
+    // Workers of the pool of run_tasks, 0 for one per hardware thread
+    unsigned int _task_threads = 0;
+    // Workers of run_decode uncompressing the chunks, 0 for one per hardware thread
+    unsigned int _decode_threads = 0;
+    // Check the SHA1 sums of the duplicate records when decoding. Archives
+    // without an index need the sums anyway.
+    bool _verify = false;
+    // Bytes of uncompressed unique chunks run_decode keeps, the others are read
+    // again from the archive when needed. 0 for no limit.
+    size_t _decode_memory = 0;
 
     unsigned long long run_orig();
     // unsigned long long run_mutex();
     // unsigned long long run_smart();
     unsigned long long run_auto();
+    // Stages as tasks of a work-stealing pool instead of the threads of the
+    // layers, see encode_tasks.cpp
+    unsigned long long run_tasks();
+    // Decode _input_filename, a .ddp file, into _output_filename
+    unsigned long long run_decode();
+    // Decode the bytes begin to end (excluded) of the original file, the
+    // archive must have an index
+    unsigned long long run_decode_range(unsigned long long begin, unsigned long long end);
     void run_numbers();
     void push_layer_data(Layers layer, LayerData const& data);
     void dump(); 
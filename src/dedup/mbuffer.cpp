@@ -6,7 +6,7 @@
 #include <assert.h>
 
 #ifdef ENABLE_PTHREADS
-#include <pthread.h>
+#include <atomic>
 #endif //ENABLE_PTHREADS
 
 #ifdef ENABLE_DMALLOC
@@ -15,42 +15,46 @@
 
 
 #include "mbuffer.h"
+#include "slab.h"
 
 
 
+//The buffers created by mbuffer_create are allocated along with their MCB, right
+//after it. Only the MCBs of views are allocated on their own, from a slab cache.
+#define MCB_SIZE ((sizeof(mcb_t) + 15) & ~(size_t)15)
+
+static inline void *mcb_data(mcb_t *mcb) {
+  return (char *)mcb + MCB_SIZE;
+}
+
+static slab_cache_t *view_mcbs = NULL;
+
 #ifdef ENABLE_PTHREADS
+//The reference counter is updated atomically: the thread which drops the last
+//reference must see all the accesses of the others to the buffer before it
+//frees it, hence the release/acquire ordering of the decrement.
+static inline void mcb_ref(mcb_t *mcb) {
+  std::atomic_ref<unsigned int>(mcb->i).fetch_add(1, std::memory_order_relaxed);
+}
 
-//Use spin locks instead of mutexes (this file only)
-#define ENABLE_SPIN_LOCKS
+static inline unsigned int mcb_unref(mcb_t *mcb) {
+  return std::atomic_ref<unsigned int>(mcb->i).fetch_sub(1, std::memory_order_acq_rel) - 1;
+}
 
-#ifdef ENABLE_SPIN_LOCKS
-typedef pthread_spinlock_t pthread_lock_t;
-#define PTHREAD_LOCK_INIT(l) pthread_spin_init(l, PTHREAD_PROCESS_PRIVATE)
-#define PTHREAD_LOCK_DESTROY(l) pthread_spin_destroy(l)
-#define PTHREAD_LOCK(l) pthread_spin_lock(l)
-#define PTHREAD_UNLOCK(l) pthread_spin_unlock(l)
+static inline unsigned int mcb_refs(mcb_t *mcb) {
+  return std::atomic_ref<unsigned int>(mcb->i).load(std::memory_order_acquire);
+}
 #else
-typedef pthread_mutex_t pthread_lock_t;
-#define PTHREAD_LOCK_INIT(l) pthread_mutex_init(l, NULL)
-#define PTHREAD_LOCK_DESTROY(l) pthread_mutex_destroy(l)
-#define PTHREAD_LOCK(l) pthread_mutex_lock(l)
-#define PTHREAD_UNLOCK(l) pthread_mutex_unlock(l)
-#endif //ENABLE_SPIN_LOCKS
-
-//Array with global locks to use. We use many mutexes to achieve some concurrency.
-//FIXME: Merge into mbuffer mcb
-//FIXME: Update documentation with latest changes
-//Unfortunately mutexes cannot be stored inside the memory buffers because of
-//concurrent free operations
-pthread_lock_t *locks = NULL;
-
-//Number of locks to use. More locks means higher potential concurrency, assuming lock usage is reasonably balanced.
-//We use a prime number for that value to get a simple but effective hash function
-#define NUMBER_OF_LOCKS 1021
-
-//A very simple hash function to map memory addresses to a lock id for the locks array
-static inline int lock_hash(void *p) {
-  return (int)(((unsigned long long int)p) % NUMBER_OF_LOCKS);
+static inline void mcb_ref(mcb_t *mcb) {
+  mcb->i++;
+}
+
+static inline unsigned int mcb_unref(mcb_t *mcb) {
+  return --mcb->i;
+}
+
+static inline unsigned int mcb_refs(mcb_t *mcb) {
+  return mcb->i;
 }
 #endif //ENABLE_PTHREADS
 
@@ -58,64 +62,63 @@ static inline int lock_hash(void *p) {
 
 //Initialize memory buffer subsystem
 int mbuffer_system_init() {
-#ifdef ENABLE_PTHREADS
-  int i;
-
-  assert(locks==NULL);
-  locks = (pthread_lock_t*)malloc(NUMBER_OF_LOCKS * sizeof(pthread_lock_t));
-  if(locks==NULL) return -1;
-  for(i=0; i<NUMBER_OF_LOCKS; i++) {
-    if(PTHREAD_LOCK_INIT(&locks[i]) != 0) {
-      int j;
-      for(j=0; j<i; j++) {
-        PTHREAD_LOCK_DESTROY(&locks[i]);
-      }
-      free((void *)locks);
-      locks=NULL;
-      return -1;
-    }
-  }
-#endif
-  return 0;
+  assert(view_mcbs==NULL);
+  view_mcbs = slab_cache_create(sizeof(mcb_t));
+  return view_mcbs == NULL ? -1 : 0;
 }
 
 //Shutdown memory buffer subsystem
 int mbuffer_system_destroy() {
-#ifdef ENABLE_PTHREADS
-  int i, rv;
-  rv=0;
-  for(i=0; i<NUMBER_OF_LOCKS; i++) {
-    rv+=PTHREAD_LOCK_DESTROY(&locks[i]);
-  }
-  free((void *)locks);
-  locks=NULL;
-  return rv ? -1 : 0;
-#else
+  slab_cache_destroy(view_mcbs);
+  view_mcbs = NULL;
   return 0;
-#endif
 }
 
 //Initialize a memory buffer
 int mbuffer_create(mbuffer_t *m, size_t size) {
-  void *ptr;
+  mcb_t *mcb;
 
   assert(m!=NULL);
   assert(size > 0);
 
-  //FIXME: Merge both mallocs to one
-  ptr = malloc(size);
-  if(ptr==NULL) return -1;
-  m->mcb = (mcb_t *)malloc(sizeof(mcb_t));
-  if(m->mcb==NULL) {
-    free(ptr);
-    ptr=NULL;
-    return -1;
-  }
+  mcb = (mcb_t *)malloc(MCB_SIZE + size);
+  if(mcb==NULL) return -1;
+
+  m->ptr = mcb_data(mcb);
+  m->n = size;
+  m->mcb = mcb;
+  m->mcb->i = 1;
+  m->mcb->ptr = m->ptr;
+  m->mcb->n = size;
+  m->mcb->release = NULL;
+#ifdef ENABLE_MBUFFER_CHECK
+  m->check_flag=MBUFFER_CHECK_MAGIC;
+#endif
+
+  return 0;
+}
+
+//Release function of views whose owner does not need to be told
+static void mbuffer_release_nothing(void *ptr, size_t size) {
+  (void)ptr;
+  (void)size;
+}
+
+//Initialize a memory buffer pointing to memory owned by someone else
+int mbuffer_create_view(mbuffer_t *m, void *ptr, size_t size, void (*release)(void *, size_t)) {
+  assert(m!=NULL);
+  assert(ptr!=NULL);
+  assert(size > 0);
+
+  m->mcb = (mcb_t *)slab_alloc(view_mcbs);
+  if(m->mcb==NULL) return -1;
 
   m->ptr = ptr;
   m->n = size;
   m->mcb->i = 1;
   m->mcb->ptr = ptr;
+  m->mcb->n = size;
+  m->mcb->release = release != NULL ? release : mbuffer_release_nothing;
 #ifdef ENABLE_MBUFFER_CHECK
   m->check_flag=MBUFFER_CHECK_MAGIC;
 #endif
@@ -136,15 +139,8 @@ mbuffer_t *mbuffer_clone(mbuffer_t *m) {
   if(temp==NULL) return NULL;
 
   //Update reference counter
-#ifdef ENABLE_PTHREADS
-  PTHREAD_LOCK(&locks[lock_hash(m->mcb)]);
-  assert(m->mcb->i>=1);
-  m->mcb->i++;
-  PTHREAD_UNLOCK(&locks[lock_hash(m->mcb)]);
-#else
-  assert(m->mcb->i>=1);
-  m->mcb->i++;
-#endif //ENABLE_PTHREADS
+  assert(mcb_refs(m->mcb)>=1);
+  mcb_ref(m->mcb);
 
   //copy state, use joint mcb
   temp->ptr = m->ptr;
@@ -193,21 +189,17 @@ void mbuffer_free(mbuffer_t *m) {
 #endif
 
   //Update meta state first to avoid races
-#ifdef ENABLE_PTHREADS
-  PTHREAD_LOCK(&locks[lock_hash(m->mcb)]);
-  m->mcb->i--;
-  ref = m->mcb->i;
-  PTHREAD_UNLOCK(&locks[lock_hash(m->mcb)]);
-#else
-  m->mcb->i--;
-  ref = m->mcb->i;
-#endif //ENABLE_PTHREADS
+  ref = mcb_unref(m->mcb);
 
   //NOTE: No need to synchronize access to ref counter value again because if it has hit 0 the buffer is dead
   if(ref==0) {
-    free(m->mcb->ptr);
-    m->mcb->ptr=NULL;
-    free(m->mcb);
+    if(m->mcb->release != NULL) {
+      m->mcb->release(m->mcb->ptr, m->mcb->n);
+      slab_free(m->mcb);
+    } else {
+      //The buffer goes with its MCB
+      free(m->mcb);
+    }
     m->mcb=NULL;
   }
 #ifdef ENABLE_MBUFFER_CHECK
@@ -218,7 +210,7 @@ void mbuffer_free(mbuffer_t *m) {
 //Resize a memory buffer
 //Returns 0 if the operation was successful
 int mbuffer_realloc(mbuffer_t *m, size_t size) {
-  void *r;
+  mcb_t *mcb;
 
   assert(m!=NULL);
   assert(size>0);
@@ -226,41 +218,24 @@ int mbuffer_realloc(mbuffer_t *m, size_t size) {
   assert(m->check_flag==MBUFFER_CHECK_MAGIC);
 #endif
 
-#ifdef ENABLE_PTHREADS
-  PTHREAD_LOCK(&locks[lock_hash(m->mcb)]);
-#endif //ENABLE_PTHREADS
-
   //We cannot resize a buffer if more than one pointer to it is in circulation
-  if(m->mcb->i > 1) {
-#ifdef ENABLE_PTHREADS
-    PTHREAD_UNLOCK(&locks[lock_hash(m->mcb)]);
-#endif
-    return -1;
-  }
+  //NOTE: No need to lock, there is no other pointer that could add a reference
+  if(mcb_refs(m->mcb) > 1) return -1;
   //This must be the original mbuffer, otherwise we'd have to do something more complicated
-  if(m->ptr != m->mcb->ptr) {
-#ifdef ENABLE_PTHREADS
-    PTHREAD_UNLOCK(&locks[lock_hash(m->mcb)]);
-#endif
-    return -1;
-  }
+  //Views do not own their memory
+  if(m->ptr != m->mcb->ptr || m->mcb->release != NULL) return -1;
 
-  r = realloc(m->ptr, size);
-  if(r != NULL) {
-    m->ptr = r;
-    m->n = size;
-    m->mcb->ptr = r;
-  }
+  //The buffer moves along with its MCB
+  mcb = (mcb_t *)realloc(m->mcb, MCB_SIZE + size);
+  if(mcb == NULL) return -1;
 
-#ifdef ENABLE_PTHREADS
-  PTHREAD_UNLOCK(&locks[lock_hash(m->mcb)]);
-#endif
+  m->mcb = mcb;
+  m->ptr = mcb_data(mcb);
+  m->n = size;
+  m->mcb->ptr = m->ptr;
+  m->mcb->n = size;
 
-  if(r == NULL) {
-    return -1;
-  } else {
-    return 0;
-  }
+  return 0;
 }
 
 //Split a memory buffer m1 into two buffers m1 and m2 at the designated location
@@ -276,15 +251,8 @@ int mbuffer_split(mbuffer_t *m1, mbuffer_t *m2, size_t split) {
 #endif
 
   //Update reference counter
-#ifdef ENABLE_PTHREADS
-  PTHREAD_LOCK(&locks[lock_hash(m1->mcb)]);
-  assert(m1->mcb->i>=1);
-  m1->mcb->i++;
-  PTHREAD_UNLOCK(&locks[lock_hash(m1->mcb)]);
-#else
-  assert(m1->mcb->i>=1);
-  m1->mcb->i++;
-#endif //ENABLE_PTHREADS
+  assert(mcb_refs(m1->mcb)>=1);
+  mcb_ref(m1->mcb);
 
   //split buffer
   m2->ptr = (char*)m1->ptr + split;
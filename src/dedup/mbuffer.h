@@ -38,9 +38,14 @@
 //Dedup breaks memory buffers into smaller memory buffers during its operation, which means that free() cannot
 //be called until all resulting buffers are no longer used. Furthermore we need to keep track of the original
 //pointer returned by malloc & co so we know which one to pass to free().
+//Memory buffers can also be views into memory owned by someone else (e.g. a file mapping), in which case
+//release is called on the region instead of free() once the last reference is gone.
+//The memory of a buffer is allocated along with its MCB, with a single malloc.
 typedef struct {
-  unsigned int i; //reference counter
-  void *ptr; //original pointer returned by malloc that needs to be passed to free()
+  unsigned int i; //reference counter, updated atomically
+  void *ptr; //start of the region, right after the MCB unless it is a view
+  size_t n; //size of the region starting at ptr
+  void (*release)(void *, size_t); //NULL if the region was allocated with the MCB
 } mcb_t;
 
 //Definition of a memory buffer
@@ -65,6 +70,11 @@ int mbuffer_system_destroy();
 //The mbuffer system will not attempt to free argument *m
 int mbuffer_create(mbuffer_t *m, size_t size);
 
+//Initialize a memory buffer that points to size bytes at ptr without owning them
+//release(ptr, size) is called once the buffer and all its clones and splits are freed, it may be NULL
+//Views cannot be resized
+int mbuffer_create_view(mbuffer_t *m, void *ptr, size_t size, void (*release)(void *, size_t));
+
 //Make a shallow copy of a memory buffer
 mbuffer_t *mbuffer_clone(mbuffer_t *m);
 
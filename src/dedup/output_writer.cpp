@@ -0,0 +1,256 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "output_writer.h"
+#include "util.h"
+#include "debug.h"
+
+//Alignment of the offsets, sizes and buffers of O_DIRECT writes
+#define DIRECT_ALIGN 4096
+
+struct output_writer {
+  int fd;
+  int direct;                     //TRUE if the file is open with O_DIRECT
+  size_t size;                    //capacity of a buffer, 0 without buffering
+  u_char *buffers[2];
+  int current;                    //buffer being filled
+  size_t used;                    //bytes in the current buffer
+  off_t offset;                   //offset in the file of the current buffer
+  std::atomic<u_long> n_syscalls;
+
+  //Background flusher, with a second buffer
+  int has_flusher;
+  std::thread flusher;
+  std::mutex mutex;
+  std::condition_variable cond;
+  const u_char *pending;          //buffer the flusher writes, NULL when it is idle
+  size_t pending_n;
+  off_t pending_offset;
+  int stop;
+};
+
+//Write the iovecs at offset, whatever the number of system calls it takes
+static void writev_at(output_writer_t *w, struct iovec *iov, int n, off_t offset) {
+  while(n > 0) {
+    ssize_t rv = pwritev(w->fd, iov, n, offset);
+    if(rv < 0 && errno == EINTR) continue;
+    if(rv < 0) EXIT_TRACE("Writing the output file fails: %s\n", strerror(errno));
+    w->n_syscalls++;
+    offset += rv;
+
+    //Skip what was written
+    while(n > 0 && (size_t)rv >= iov->iov_len) {
+      rv -= iov->iov_len;
+      iov++;
+      n--;
+    }
+    if(n > 0) {
+      iov->iov_base = (u_char *)iov->iov_base + rv;
+      iov->iov_len -= rv;
+    }
+  }
+}
+
+static void write_at(output_writer_t *w, const void *buf, size_t n, off_t offset) {
+  struct iovec iov = { (void *)buf, n };
+
+  writev_at(w, &iov, 1, offset);
+}
+
+static void flush_loop(output_writer_t *w) {
+  std::unique_lock<std::mutex> lck(w->mutex);
+
+  while(TRUE) {
+    w->cond.wait(lck, [w]() { return w->pending != NULL || w->stop; });
+    //Stop once the last buffer is written
+    if(w->pending == NULL) return;
+
+    lck.unlock();
+    write_at(w, w->pending, w->pending_n, w->pending_offset);
+    lck.lock();
+
+    w->pending = NULL;
+    w->cond.notify_all();
+  }
+}
+
+//Wait until the flusher is done with its buffer
+static void wait_idle(output_writer_t *w) {
+  if(!w->has_flusher) return;
+
+  std::unique_lock<std::mutex> lck(w->mutex);
+  w->cond.wait(lck, [w]() { return w->pending == NULL; });
+}
+
+//Write the first n bytes of the current buffer, and start filling the other one
+static void submit(output_writer_t *w, size_t n) {
+  if(w->has_flusher) {
+    std::unique_lock<std::mutex> lck(w->mutex);
+    w->cond.wait(lck, [w]() { return w->pending == NULL; });
+    w->pending = w->buffers[w->current];
+    w->pending_n = n;
+    w->pending_offset = w->offset;
+    w->cond.notify_all();
+    w->current = 1 - w->current;
+  } else {
+    write_at(w, w->buffers[w->current], n, w->offset);
+  }
+
+  w->offset += n;
+  w->used = 0;
+}
+
+static void append(output_writer_t *w, const void *data, size_t n) {
+  const u_char *p = (const u_char *)data;
+
+  while(n > 0) {
+    size_t count = MIN(n, w->size - w->used);
+    memcpy(w->buffers[w->current] + w->used, p, count);
+    w->used += count;
+    p += count;
+    n -= count;
+    if(w->used == w->size) submit(w, w->size);
+  }
+}
+
+/*****************************************************************************/
+output_writer_t *output_writer_create(int fd, size_t buffer_size, int flags) {
+  output_writer_t *w = new output_writer_t;
+  int i;
+
+  w->fd = fd;
+  w->offset = lseek(fd, 0, SEEK_CUR);
+  if(w->offset < 0) EXIT_TRACE("Cannot get the offset of the output file: %s\n", strerror(errno));
+  w->used = 0;
+  w->current = 0;
+  w->n_syscalls = 0;
+  w->pending = NULL;
+  w->stop = FALSE;
+  w->buffers[0] = w->buffers[1] = NULL;
+
+  w->direct = (flags & OUTPUT_DIRECT) && buffer_size > 0;
+  if(w->direct) {
+    buffer_size = (buffer_size + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+  }
+  w->size = buffer_size;
+  w->has_flusher = (flags & OUTPUT_FLUSHER) && buffer_size > 0;
+
+  for(i=0; i<(w->has_flusher ? 2 : 1) && buffer_size > 0; i++) {
+    //Aligned for O_DIRECT, and on pages anyway
+    if(posix_memalign((void **)&w->buffers[i], DIRECT_ALIGN, buffer_size) != 0) {
+      EXIT_TRACE("Memory allocation failed.\n");
+    }
+  }
+
+  if(w->direct) {
+    //O_DIRECT writes start at an aligned offset, so the bytes before the first
+    //record, the header of the file, are written again. They are read before
+    //O_DIRECT is set, it would apply to this unaligned read as well.
+    off_t start = w->offset & ~(off_t)(DIRECT_ALIGN - 1);
+    size_t prefix = w->offset - start;
+    int fl = fcntl(fd, F_GETFL);
+
+    if(prefix > 0 && xpread(fd, w->buffers[0], prefix, start) <= 0) {
+      EXIT_TRACE("Cannot read the beginning of the output file: %s\n", strerror(errno));
+    }
+    if(fl < 0 || fcntl(fd, F_SETFL, fl | O_DIRECT) < 0) {
+      fprintf(stderr, "O_DIRECT is not supported for the output file, using buffered writes\n");
+      w->direct = FALSE;
+    } else {
+      w->used = prefix;
+      w->offset = start;
+    }
+  }
+
+  if(w->has_flusher) {
+    w->flusher = std::thread(flush_loop, w);
+  }
+  return w;
+}
+
+/*****************************************************************************/
+void output_writer_destroy(output_writer_t *w) {
+  off_t end = w->offset + w->used;
+
+  if(w->used > 0) {
+    if(w->direct) {
+      //The last block is padded, and the padding cut off below
+      size_t padded = (w->used + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+      memset(w->buffers[w->current] + w->used, 0, padded - w->used);
+      submit(w, padded);
+    } else {
+      submit(w, w->used);
+    }
+  }
+
+  if(w->has_flusher) {
+    {
+      std::unique_lock<std::mutex> lck(w->mutex);
+      w->stop = TRUE;
+      w->cond.notify_all();
+    }
+    w->flusher.join();
+  }
+
+  if(w->direct) {
+    if(ftruncate(w->fd, end) < 0) EXIT_TRACE("Cannot truncate the output file: %s\n", strerror(errno));
+    int fl = fcntl(w->fd, F_GETFL);
+    if(fl < 0 || fcntl(w->fd, F_SETFL, fl & ~O_DIRECT) < 0) {
+      EXIT_TRACE("Cannot clear O_DIRECT on the output file: %s\n", strerror(errno));
+    }
+  }
+  //The records were written with pwrite, the file offset has not moved
+  if(lseek(w->fd, end, SEEK_SET) < 0) EXIT_TRACE("Cannot seek in the output file: %s\n", strerror(errno));
+
+  free(w->buffers[0]);
+  free(w->buffers[1]);
+  delete w;
+}
+
+/*****************************************************************************/
+void output_writer_record(output_writer_t *w, u_char type, u_long len, const void *content) {
+  u_char header[sizeof(type) + sizeof(len)];
+
+  header[0] = type;
+  memcpy(header + sizeof(type), &len, sizeof(len));
+
+  if(w->size == 0) {
+    //One system call per record instead of one per field
+    struct iovec iov[2] = { { header, sizeof(header) }, { (void *)content, len } };
+    writev_at(w, iov, 2, w->offset);
+    w->offset += sizeof(header) + len;
+    return;
+  }
+
+  append(w, header, sizeof(header));
+  if(!w->direct && len >= w->size) {
+    //Written along with the buffer, without copying it
+    wait_idle(w);
+    struct iovec iov[2] = { { w->buffers[w->current], w->used }, { (void *)content, len } };
+    writev_at(w, iov, 2, w->offset);
+    w->offset += w->used + len;
+    w->used = 0;
+    return;
+  }
+  append(w, content, len);
+}
+
+/*****************************************************************************/
+u_long output_writer_offset(output_writer_t *w) {
+  return w->offset + w->used;
+}
+
+/*****************************************************************************/
+u_long output_writer_syscalls(output_writer_t *w) {
+  return w->n_syscalls;
+}
@@ -0,0 +1,53 @@
+/* Buffered writer of the records of a .ddp archive.
+ *
+ * Records are copied in a large buffer, written with a single pwrite once it
+ * is full. A record larger than the buffer is written with the buffer in a
+ * single pwritev, without being copied. Without a buffer, every record is
+ * written with a single writev instead of one write per field.
+ *
+ * Options:
+ *  - OUTPUT_FLUSHER: a background thread writes a full buffer while the
+ *    caller fills a second one
+ *  - OUTPUT_DIRECT: the file is written with O_DIRECT, bypassing the page
+ *    cache. The buffer size is rounded to the alignment O_DIRECT needs, and
+ *    the writer falls back to buffered writes if the file system refuses it.
+ *
+ * The writer starts at the current offset of the file, and leaves it at the
+ * end of the records when destroyed, so that the file can be written directly
+ * again. The file must be open for reading as well with OUTPUT_DIRECT.
+ */
+
+#ifndef _OUTPUT_WRITER_H_
+#define _OUTPUT_WRITER_H_
+
+#include <stddef.h>
+
+#include "dedupdef.h"
+
+#define OUTPUT_FLUSHER 1
+#define OUTPUT_DIRECT 2
+
+typedef struct output_writer output_writer_t;
+
+/*
+ * output_writer_create
+ *
+ * @param   fd            file to write, at the offset of the first record
+ * @param   buffer_size   bytes of the buffer, 0 for no buffering
+ * @param   flags         OUTPUT_FLUSHER and OUTPUT_DIRECT, or 0
+ */
+output_writer_t *output_writer_create(int fd, size_t buffer_size, int flags);
+
+//Write what is left in the buffers, and free the writer
+void output_writer_destroy(output_writer_t *w);
+
+//Append a record to the archive
+void output_writer_record(output_writer_t *w, u_char type, u_long len, const void *content);
+
+//Offset in the file of the next record
+u_long output_writer_offset(output_writer_t *w);
+
+//Number of write system calls made so far
+u_long output_writer_syscalls(output_writer_t *w);
+
+#endif //_OUTPUT_WRITER_H_
@@ -99,3 +99,99 @@ int rabinseg(uchar *p, int n, int winlen, u32int * rabintab, u32int * rabinwinta
   return n;
 }
 
+
+/* The fingerprint only depends on the last NWINDOW bytes, so the hash at any
+ * position can be rebuilt from scratch by hashing the NWINDOW bytes that
+ * precede it. rabinseg_lanes uses this to run RabinLanes independent rolling
+ * hashes over consecutive sub-windows of a strip, each lane being warmed up on
+ * the NWINDOW bytes that precede its sub-window (the seam fix-up). The lanes
+ * are advanced in lock-step so the CPU overlaps their lookup chains. The first
+ * lane holding a match gives the cut point, which is therefore the one rabinseg
+ * would have returned.
+ *
+ * This only holds if rabinwintab was built for a window of NWINDOW bytes.
+ * With any other window length, removing the oldest byte does not cancel its
+ * contribution, the hash depends on everything since the start of the scan and
+ * the serial scan is the only exact one. */
+int rabinseg_lanes(uchar *p, int n, int winlen, u32int * rabintab, u32int * rabinwintab) {
+  int i, k, l, pos;
+  int start[RabinLanes];
+  int hit[RabinLanes];
+  u32int h[RabinLanes];
+  u32int x, found;
+
+  if(winlen != NWINDOW)
+    return rabinseg(p, n, winlen, rabintab, rabinwintab);
+  if(n < NWINDOW)
+    return n;
+
+  h[0] = 0;
+  for(i=0; i<NWINDOW; i++){
+    x = h[0] >> 24;
+    h[0] = (h[0]<<8)|p[i];
+    h[0] ^= rabintab[x];
+  }
+  if((h[0] & RabinMask) == 0)
+    return NWINDOW;
+
+  /* h[0] is the hash of the window ending at pos */
+  pos = NWINDOW;
+  while(n - pos >= RabinLanes * RabinLaneSpan){
+    for(l=0; l<RabinLanes; l++){
+      start[l] = pos + l * RabinLaneSpan;
+      hit[l] = -1;
+    }
+
+    /* Lane 0 carries the running hash, the others rebuild theirs */
+    for(l=1; l<RabinLanes; l++)
+      h[l] = 0;
+    for(k=0; k<NWINDOW; k++){
+      for(l=1; l<RabinLanes; l++){
+        x = h[l] >> 24;
+        h[l] = (h[l]<<8)|p[start[l]-NWINDOW+k];
+        h[l] ^= rabintab[x];
+      }
+    }
+
+    for(k=0; k<RabinLaneSpan; k++){
+      found = 0;
+      for(l=0; l<RabinLanes; l++){
+        i = start[l] + k;
+        h[l] ^= rabinwintab[p[i-NWINDOW]];
+        x = h[l] >> 24;
+        h[l] = (h[l]<<8)|p[i];
+        h[l] ^= rabintab[x];
+        found |= ((h[l] & RabinMask) == 0) << l;
+      }
+      if(found){
+        /* Nothing can precede a match of the first lane */
+        if(found & 1)
+          return start[0] + k + 1;
+        for(l=1; l<RabinLanes; l++)
+          if(((found >> l) & 1) && hit[l] < 0)
+            hit[l] = start[l] + k + 1;
+      }
+    }
+
+    for(l=1; l<RabinLanes; l++)
+      if(hit[l] >= 0)
+        return hit[l];
+
+    /* The last lane ends where the next strip starts */
+    h[0] = h[RabinLanes-1];
+    pos += RabinLanes * RabinLaneSpan;
+  }
+
+  i = pos;
+  while(i<n){
+    x = p[i-NWINDOW];
+    h[0] ^= rabinwintab[x];
+    x = h[0] >> 24;
+    h[0] <<= 8;
+    h[0] |= p[i++];
+    h[0] ^= rabintab[x];
+    if((h[0] & RabinMask) == 0)
+      return i;
+  }
+  return n;
+}
@@ -10,9 +10,21 @@ enum {
   RabinMask = 0xfff,  // must be less than <= 0x7fff 
 };
 
+/* Parameters of rabinseg_lanes: the buffer is scanned in strips of
+ * RabinLanes * RabinLaneSpan bytes, each lane hashing RabinLaneSpan bytes of
+ * the strip. */
+enum {
+  RabinLanes    = 4,
+  RabinLaneSpan = 512,
+};
+
 void rabininit(int, u32int*, u32int*);
 
 int rabinseg(uchar*, int, int, u32int*, u32int*);
 
+/* Same contract and same result as rabinseg, computed on several interleaved
+ * hash streams to hide the latency of the table lookups. */
+int rabinseg_lanes(uchar*, int, int, u32int*, u32int*);
+
 #endif //_RABIN_H_
 
@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "reorder_window.h"
+#include "util.h"
+#include "debug.h"
+
+#ifdef ENABLE_PTHREADS
+
+//Initial number of anchors of the ring, a power of 2
+#define INITIAL_ANCHORS 64
+
+struct reorder_anchor {
+  chunk_t **chunks;               //chunks by l2num, NULL until received
+  sequence_number_t size;         //number of slots, 0 until the first chunk
+  sequence_number_t n_chunks;     //chunks of the anchor, 0 until the last one is received
+};
+
+struct reorder_window {
+  struct reorder_anchor *anchors; //anchor l1num is at l1num % n_anchors
+  sequence_number_t n_anchors;    //power of 2
+  sequence_number_t slots;
+  sequence_t next;
+  u_long n_pending;
+  u_long max_pending;
+};
+
+static struct reorder_anchor *new_ring(sequence_number_t n) {
+  struct reorder_anchor *anchors = (struct reorder_anchor *)calloc(n, sizeof(struct reorder_anchor));
+
+  if(anchors == NULL) EXIT_TRACE("Memory allocation failed.\n");
+  return anchors;
+}
+
+//Double the ring, anchors keep their slot arrays
+static void grow_ring(reorder_window_t *w) {
+  sequence_number_t n = 2 * w->n_anchors;
+  struct reorder_anchor *anchors = new_ring(n);
+  sequence_number_t i;
+
+  for(i=0; i<w->n_anchors; i++) {
+    sequence_number_t l1num = w->next.l1num + i;
+    anchors[l1num & (n - 1)] = w->anchors[l1num & (w->n_anchors - 1)];
+  }
+  free(w->anchors);
+  w->anchors = anchors;
+  w->n_anchors = n;
+}
+
+static inline struct reorder_anchor *anchor_of(reorder_window_t *w, sequence_number_t l1num) {
+  return &w->anchors[l1num & (w->n_anchors - 1)];
+}
+
+/*****************************************************************************/
+reorder_window_t *reorder_window_create(sequence_number_t slots) {
+  reorder_window_t *w = (reorder_window_t *)malloc(sizeof(reorder_window_t));
+
+  if(w == NULL) EXIT_TRACE("Memory allocation failed.\n");
+  w->n_anchors = INITIAL_ANCHORS;
+  w->anchors = new_ring(w->n_anchors);
+  w->slots = MAX(slots, 1);
+  sequence_reset(&w->next);
+  w->n_pending = 0;
+  w->max_pending = 0;
+  return w;
+}
+
+/*****************************************************************************/
+void reorder_window_destroy(reorder_window_t *w) {
+  sequence_number_t i;
+
+  for(i=0; i<w->n_anchors; i++) {
+    free(w->anchors[i].chunks);
+  }
+  free(w->anchors);
+  free(w);
+}
+
+/*****************************************************************************/
+void reorder_window_insert(reorder_window_t *w, chunk_t *chunk) {
+  sequence_number_t l1num = chunk->sequence.l1num;
+  sequence_number_t l2num = chunk->sequence.l2num;
+  struct reorder_anchor *a;
+
+  if(sequence_lt(chunk->sequence, w->next)) EXIT_TRACE("Chunk received after its sequence number was written.\n");
+  while(l1num - w->next.l1num >= w->n_anchors) grow_ring(w);
+
+  a = anchor_of(w, l1num);
+  if(l2num >= a->size) {
+    sequence_number_t size = MAX(2 * a->size, w->slots);
+    while(size <= l2num) size *= 2;
+
+    a->chunks = (chunk_t **)realloc(a->chunks, size * sizeof(chunk_t *));
+    if(a->chunks == NULL) EXIT_TRACE("Memory allocation failed.\n");
+    memset(&a->chunks[a->size], 0, (size - a->size) * sizeof(chunk_t *));
+    a->size = size;
+  }
+
+  assert(a->chunks[l2num] == NULL);
+  a->chunks[l2num] = chunk;
+  if(chunk->isLastL2Chunk) {
+    assert(a->n_chunks == 0);
+    a->n_chunks = l2num + 1;
+  }
+
+  w->n_pending++;
+  w->max_pending = MAX(w->max_pending, w->n_pending);
+}
+
+/*****************************************************************************/
+chunk_t *reorder_window_next(reorder_window_t *w) {
+  struct reorder_anchor *a = anchor_of(w, w->next.l1num);
+  chunk_t *chunk;
+
+  if(w->next.l2num >= a->size || a->chunks[w->next.l2num] == NULL) return NULL;
+
+  chunk = a->chunks[w->next.l2num];
+  a->chunks[w->next.l2num] = NULL;
+  w->n_pending--;
+
+  sequence_inc_l2(&w->next);
+  if(a->n_chunks != 0 && w->next.l2num == a->n_chunks) {
+    //All slots are empty again, the array is kept for a later anchor
+    a->n_chunks = 0;
+    sequence_inc_l1(&w->next);
+  }
+  return chunk;
+}
+
+/*****************************************************************************/
+chunk_t *reorder_window_peek(reorder_window_t *w) {
+  struct reorder_anchor *a = anchor_of(w, w->next.l1num);
+
+  if(w->next.l2num >= a->size) return NULL;
+  return a->chunks[w->next.l2num];
+}
+
+/*****************************************************************************/
+u_long reorder_window_pending(reorder_window_t *w) {
+  return w->n_pending;
+}
+
+/*****************************************************************************/
+u_long reorder_window_max_pending(reorder_window_t *w) {
+  return w->max_pending;
+}
+
+#endif //ENABLE_PTHREADS
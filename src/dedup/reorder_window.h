@@ -0,0 +1,47 @@
+/* Reorder buffer of the chunks of the pipeline.
+ *
+ * Chunks are stored at their sequence number: every anchor in flight has an
+ * array of slots indexed by l2num, and the anchors are kept in a ring indexed
+ * by l1num. Inserting a chunk and taking the next one in sequence are O(1).
+ * The ring grows to the number of anchors in flight between the first one not
+ * written yet and the last one received, and the slot arrays of written anchors
+ * are reused, so the memory is bounded by the in-flight window.
+ */
+
+#ifndef _REORDER_WINDOW_H_
+#define _REORDER_WINDOW_H_
+
+#include "dedupdef.h"
+
+#ifdef ENABLE_PTHREADS
+
+typedef struct reorder_window reorder_window_t;
+
+/*
+ * reorder_window_create
+ *
+ * @param   slots   initial number of slots of an anchor, the expected number
+ *                  of chunks the Refine stage cuts an anchor into
+ */
+reorder_window_t *reorder_window_create(sequence_number_t slots);
+
+void reorder_window_destroy(reorder_window_t *w);
+
+//Store a chunk until it is next in sequence
+void reorder_window_insert(reorder_window_t *w, chunk_t *chunk);
+
+//Remove and return the next chunk in sequence, NULL if it was not received yet
+chunk_t *reorder_window_next(reorder_window_t *w);
+
+//Next chunk in sequence, left in the window, NULL if it was not received yet
+chunk_t *reorder_window_peek(reorder_window_t *w);
+
+//Number of chunks waiting in the window
+u_long reorder_window_pending(reorder_window_t *w);
+
+//Largest number of chunks that waited in the window at the same time
+u_long reorder_window_max_pending(reorder_window_t *w);
+
+#endif //ENABLE_PTHREADS
+
+#endif //_REORDER_WINDOW_H_
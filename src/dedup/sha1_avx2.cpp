@@ -0,0 +1,166 @@
+/* Multi-buffer SHA-1 with AVX2.
+ *
+ * Each of the FINGERPRINT_LANES 32-bit lanes of the vectors hashes its own
+ * buffer, all lanes running the same round at the same time. A lane that is
+ * done with its buffer is refilled with the next one of the batch so lanes
+ * stay busy when the buffers have different sizes.
+ *
+ * Compiled for the generic target, the function attributes enable the
+ * instructions. Only call sha1_avx2_batch when fingerprint_supported(FINGERPRINT_AVX2).
+ */
+
+#include <string.h>
+
+#include "fingerprint.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#define ROTL(x, n) _mm256_or_si256(_mm256_slli_epi32((x), (n)), _mm256_srli_epi32((x), 32 - (n)))
+
+//Big endian word w of the block of every lane
+#define LOAD_WORD(w) _mm256_set_epi32(load_be32(block[7] + 4 * (w)), load_be32(block[6] + 4 * (w)), \
+                                      load_be32(block[5] + 4 * (w)), load_be32(block[4] + 4 * (w)), \
+                                      load_be32(block[3] + 4 * (w)), load_be32(block[2] + 4 * (w)), \
+                                      load_be32(block[1] + 4 * (w)), load_be32(block[0] + 4 * (w)))
+
+static inline int load_be32(const uint8_t *p) {
+  uint32_t v;
+
+  memcpy(&v, p, sizeof(v));
+  return (int)__builtin_bswap32(v);
+}
+
+//Compress one block per lane, state is stored lane-major: state[word][lane]
+__attribute__((target("avx2")))
+static void sha1_avx2_block(uint32_t state[5][FINGERPRINT_LANES], const uint8_t * const block[FINGERPRINT_LANES]) {
+  __m256i w[16];
+  __m256i a, b, c, d, e, f, k, t;
+  __m256i a0, b0, c0, d0, e0;
+  int i;
+
+  a0 = a = _mm256_loadu_si256((const __m256i *)state[0]);
+  b0 = b = _mm256_loadu_si256((const __m256i *)state[1]);
+  c0 = c = _mm256_loadu_si256((const __m256i *)state[2]);
+  d0 = d = _mm256_loadu_si256((const __m256i *)state[3]);
+  e0 = e = _mm256_loadu_si256((const __m256i *)state[4]);
+
+  for(i=0; i<80; i++) {
+    if(i < 16) {
+      w[i] = LOAD_WORD(i);
+    } else {
+      t = _mm256_xor_si256(_mm256_xor_si256(w[(i - 3) & 15], w[(i - 8) & 15]),
+                           _mm256_xor_si256(w[(i - 14) & 15], w[i & 15]));
+      w[i & 15] = ROTL(t, 1);
+    }
+
+    if(i < 20) {
+      f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+      k = _mm256_set1_epi32(0x5A827999);
+    } else if(i < 40) {
+      f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+      k = _mm256_set1_epi32(0x6ED9EBA1);
+    } else if(i < 60) {
+      f = _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)));
+      k = _mm256_set1_epi32((int)0x8F1BBCDC);
+    } else {
+      f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+      k = _mm256_set1_epi32((int)0xCA62C1D6);
+    }
+
+    t = _mm256_add_epi32(_mm256_add_epi32(ROTL(a, 5), f), _mm256_add_epi32(_mm256_add_epi32(e, k), w[i & 15]));
+    e = d;
+    d = c;
+    c = ROTL(b, 30);
+    b = a;
+    a = t;
+  }
+
+  _mm256_storeu_si256((__m256i *)state[0], _mm256_add_epi32(a, a0));
+  _mm256_storeu_si256((__m256i *)state[1], _mm256_add_epi32(b, b0));
+  _mm256_storeu_si256((__m256i *)state[2], _mm256_add_epi32(c, c0));
+  _mm256_storeu_si256((__m256i *)state[3], _mm256_add_epi32(d, d0));
+  _mm256_storeu_si256((__m256i *)state[4], _mm256_add_epi32(e, e0));
+}
+
+typedef struct {
+  int job;            //index of the buffer in the batch, -1 if the lane is idle
+  const uint8_t *data;
+  size_t n_full;      //number of full blocks read from data
+  size_t n_blocks;    //n_full plus the blocks of the tail
+  size_t next;        //next block to compress
+  sha1_tail_t tail;
+} sha1_lane_t;
+
+void sha1_avx2_batch(const void * const *data, const size_t *len, unsigned char * const *digest, int n) {
+  static const uint8_t idle_block[SHA1_BLOCK] = { 0 };
+  uint32_t state[5][FINGERPRINT_LANES];
+  const uint8_t *block[FINGERPRINT_LANES];
+  sha1_lane_t lanes[FINGERPRINT_LANES];
+  int next_job = 0;
+  int active = 0;
+  int l, i;
+
+  for(l=0; l<FINGERPRINT_LANES; l++)
+    lanes[l].job = -1;
+
+  for(;;) {
+    //Give a buffer to every idle lane
+    for(l=0; l<FINGERPRINT_LANES && next_job<n; l++) {
+      sha1_lane_t *lane = &lanes[l];
+      if(lane->job >= 0)
+        continue;
+
+      lane->job = next_job;
+      lane->data = (const uint8_t *)data[next_job];
+      lane->n_full = len[next_job] / SHA1_BLOCK;
+      sha1_make_tail(data[next_job], len[next_job], &lane->tail);
+      lane->n_blocks = lane->n_full + lane->tail.n_blocks;
+      lane->next = 0;
+      for(i=0; i<5; i++)
+        state[i][l] = sha1_initial_state[i];
+      next_job++;
+      active++;
+    }
+
+    if(active == 0)
+      break;
+
+    for(l=0; l<FINGERPRINT_LANES; l++) {
+      sha1_lane_t *lane = &lanes[l];
+      if(lane->job < 0)
+        block[l] = idle_block;
+      else if(lane->next < lane->n_full)
+        block[l] = lane->data + lane->next * SHA1_BLOCK;
+      else
+        block[l] = lane->tail.data + (lane->next - lane->n_full) * SHA1_BLOCK;
+    }
+
+    sha1_avx2_block(state, block);
+
+    for(l=0; l<FINGERPRINT_LANES; l++) {
+      sha1_lane_t *lane = &lanes[l];
+      if(lane->job < 0 || ++lane->next < lane->n_blocks)
+        continue;
+
+      uint32_t lane_state[5];
+      for(i=0; i<5; i++)
+        lane_state[i] = state[i][l];
+      sha1_store_digest(lane_state, digest[lane->job]);
+      lane->job = -1;
+      active--;
+    }
+  }
+}
+
+#else
+
+void sha1_avx2_batch(const void * const *data, const size_t *len, unsigned char * const *digest, int n) {
+  int i;
+
+  for(i=0; i<n; i++)
+    SHA1_Digest(data[i], len[i], digest[i]);
+}
+
+#endif
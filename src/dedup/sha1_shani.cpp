@@ -0,0 +1,85 @@
+/* SHA-1 with the x86 SHA extensions.
+ *
+ * Compiled for the generic target, the function attributes enable the
+ * instructions. Only call sha1_shani when fingerprint_supported(FINGERPRINT_SHANI).
+ */
+
+#include "fingerprint.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+//One group of four rounds: consume message words G_i, then derive G_{i+4} from
+//G_i .. G_{i+3} in the register G_i lived in
+#define SHA1_ROUNDS4(i)                                                          \
+  {                                                                              \
+    if((i) == 0) {                                                               \
+      e = _mm_add_epi32(e, msg[0]);                                              \
+    } else {                                                                     \
+      e = _mm_sha1nexte_epu32(abcd_prev, msg[(i) % 4]);                          \
+    }                                                                            \
+    abcd_prev = abcd;                                                            \
+    abcd = _mm_sha1rnds4_epu32(abcd, e, (i) / 5);                                \
+    if((i) + 4 < 20) {                                                           \
+      msg[(i) % 4] = _mm_sha1msg2_epu32(                                         \
+          _mm_xor_si128(_mm_sha1msg1_epu32(msg[(i) % 4], msg[((i) + 1) % 4]),    \
+                        msg[((i) + 2) % 4]),                                     \
+          msg[((i) + 3) % 4]);                                                   \
+    }                                                                            \
+  }
+
+__attribute__((target("sha,sse4.1")))
+static void sha1_shani_blocks(uint32_t *state, const uint8_t *data, size_t n_blocks) {
+  const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+  __m128i abcd, abcd_save, abcd_prev, e, e_save;
+  __m128i msg[4];
+  int j;
+
+  abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+  e = _mm_set_epi32(state[4], 0, 0, 0);
+  abcd_prev = abcd;
+
+  while(n_blocks--) {
+    abcd_save = abcd;
+    e_save = e;
+
+    for(j=0; j<4; j++)
+      msg[j] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * j)), bswap);
+
+    SHA1_ROUNDS4(0);  SHA1_ROUNDS4(1);  SHA1_ROUNDS4(2);  SHA1_ROUNDS4(3);
+    SHA1_ROUNDS4(4);  SHA1_ROUNDS4(5);  SHA1_ROUNDS4(6);  SHA1_ROUNDS4(7);
+    SHA1_ROUNDS4(8);  SHA1_ROUNDS4(9);  SHA1_ROUNDS4(10); SHA1_ROUNDS4(11);
+    SHA1_ROUNDS4(12); SHA1_ROUNDS4(13); SHA1_ROUNDS4(14); SHA1_ROUNDS4(15);
+    SHA1_ROUNDS4(16); SHA1_ROUNDS4(17); SHA1_ROUNDS4(18); SHA1_ROUNDS4(19);
+
+    e = _mm_sha1nexte_epu32(abcd_prev, e_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+    data += SHA1_BLOCK;
+  }
+
+  _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+  state[4] = _mm_extract_epi32(e, 3);
+}
+
+void sha1_shani(const void *data, size_t len, unsigned char *digest) {
+  uint32_t state[5];
+  sha1_tail_t tail;
+  int i;
+
+  for(i=0; i<5; i++)
+    state[i] = sha1_initial_state[i];
+
+  sha1_shani_blocks(state, (const uint8_t *)data, len / SHA1_BLOCK);
+  sha1_make_tail(data, len, &tail);
+  sha1_shani_blocks(state, tail.data, tail.n_blocks);
+  sha1_store_digest(state, digest);
+}
+
+#else
+
+void sha1_shani(const void *data, size_t len, unsigned char *digest) {
+  SHA1_Digest(data, len, digest);
+}
+
+#endif
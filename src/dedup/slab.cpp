@@ -0,0 +1,268 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <set>
+
+#include "slab.h"
+#include "debug.h"
+
+//Alignment of the objects
+#define SLAB_ALIGN 16
+
+//Number of caches a thread can allocate from at the same time
+#define SLAB_THREAD_CACHES 8
+
+struct slab_object {
+  struct slab_object *next;
+};
+
+//A slab in SLAB_OWNED state is the current slab of a thread, a SLAB_RETIRED
+//one is full and waits for an object to be freed in it, a SLAB_QUEUED one has
+//free objects and waits for a thread to take it
+enum {
+  SLAB_OWNED,
+  SLAB_RETIRED,
+  SLAB_QUEUED,
+};
+
+typedef struct slab {
+  slab_cache_t *cache;
+  std::atomic<const void *> owner;               //thread allocating from the slab
+  std::atomic<int> state;
+  struct slab_object *local;                     //objects freed by the owner
+  std::atomic<struct slab_object *> remote;      //objects freed by other threads
+  char *bump;                                    //objects never allocated start here
+  char *end;
+  struct slab *next;                             //all slabs of the cache
+  struct slab *next_queued;
+} slab_t;
+
+struct slab_cache {
+  size_t object_size;
+  unsigned long id;                              //never reused, unlike the address
+  std::mutex mutex;
+  slab_t *slabs;
+  slab_t *queued;
+  size_t n_slabs;
+};
+
+//Caches which are not destroyed yet, by id
+static std::mutex caches_mutex;
+static std::set<unsigned long> live_caches;
+static unsigned long next_id = 1;
+
+static void abandon(slab_t *s);
+
+//Current slab of the thread for every cache it allocates from. The slabs of the
+//caches that still exist are given to other threads when the thread exits.
+struct slab_thread {
+  struct {
+    slab_cache_t *cache;
+    unsigned long id;
+    slab_t *slab;
+  } entries[SLAB_THREAD_CACHES];
+
+  ~slab_thread() {
+    std::unique_lock<std::mutex> lck(caches_mutex);
+    for(auto& entry: entries) {
+      if(entry.slab != NULL && live_caches.count(entry.id)) abandon(entry.slab);
+    }
+  }
+};
+
+static thread_local slab_thread thread_slabs;
+
+//Identifies the calling thread as the owner of a slab
+static inline const void *self() {
+  return &thread_slabs;
+}
+
+static inline slab_t *slab_of(void *p) {
+  return (slab_t *)((uintptr_t)p & ~(uintptr_t)(SLAB_SIZE - 1));
+}
+
+static void enqueue(slab_t *s) {
+  std::unique_lock<std::mutex> lck(s->cache->mutex);
+  s->next_queued = s->cache->queued;
+  s->cache->queued = s;
+}
+
+/*
+ * Stop allocating from a slab with no free object left. Returns 1 if objects
+ * were freed in the meantime and the slab can be allocated from again.
+ *
+ * The state is written before the remote list is read, while slab_free pushes
+ * on the remote list before it reads the state: one of them sees the other, so
+ * that a slab with free objects never stays retired.
+ */
+static int retire(slab_t *s) {
+  int expected = SLAB_RETIRED;
+
+  s->owner.store(NULL, std::memory_order_relaxed);
+  s->state.store(SLAB_RETIRED);
+  if(s->remote.load() != NULL && s->state.compare_exchange_strong(expected, SLAB_OWNED)) {
+    s->owner.store(self(), std::memory_order_relaxed);
+    return 1;
+  }
+  //Queued by slab_free otherwise
+  return 0;
+}
+
+//Give the slab of an exiting thread, and its free objects, to another thread
+static void abandon(slab_t *s) {
+  s->owner.store(NULL, std::memory_order_relaxed);
+  s->state.store(SLAB_QUEUED);
+  enqueue(s);
+}
+
+//Take the objects freed by the other threads
+static inline struct slab_object *take_remote(slab_t *s) {
+  return s->remote.exchange(NULL, std::memory_order_acquire);
+}
+
+//A queued slab, or a new one
+static slab_t *next_slab(slab_cache_t *c) {
+  slab_t *s;
+
+  {
+    std::unique_lock<std::mutex> lck(c->mutex);
+    s = c->queued;
+    if(s != NULL) {
+      c->queued = s->next_queued;
+      //Its free objects are taken by slab_alloc
+      s->state.store(SLAB_OWNED);
+      s->owner.store(self(), std::memory_order_relaxed);
+      return s;
+    }
+  }
+
+  s = (slab_t *)aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+  if(s == NULL) return NULL;
+  s->cache = c;
+  new (&s->owner) std::atomic<const void *>(self());
+  new (&s->state) std::atomic<int>(SLAB_OWNED);
+  new (&s->remote) std::atomic<struct slab_object *>(nullptr);
+  s->local = NULL;
+  s->bump = (char *)s + (sizeof(slab_t) + SLAB_ALIGN - 1) / SLAB_ALIGN * SLAB_ALIGN;
+  s->end = (char *)s + SLAB_SIZE;
+
+  std::unique_lock<std::mutex> lck(c->mutex);
+  s->next = c->slabs;
+  c->slabs = s;
+  c->n_slabs++;
+  return s;
+}
+
+//Entry of the thread for the cache
+static slab_t **thread_slab(slab_cache_t *c) {
+  for(auto& entry: thread_slabs.entries) {
+    if(entry.cache == c && entry.id == c->id) return &entry.slab;
+  }
+
+  //First allocation of the thread from this cache, take an unused entry or
+  //one of a destroyed cache
+  std::unique_lock<std::mutex> lck(caches_mutex);
+  for(auto& entry: thread_slabs.entries) {
+    if(entry.cache == NULL || !live_caches.count(entry.id)) {
+      entry.cache = c;
+      entry.id = c->id;
+      entry.slab = NULL;
+      return &entry.slab;
+    }
+  }
+  EXIT_TRACE("A thread allocates from more than %d slab caches.\n", SLAB_THREAD_CACHES);
+}
+
+/*****************************************************************************/
+slab_cache_t *slab_cache_create(size_t object_size) {
+  slab_cache_t *c = new slab_cache_t;
+
+  //Freed objects hold the link of the free lists
+  c->object_size = (std::max(object_size, sizeof(struct slab_object)) + SLAB_ALIGN - 1) / SLAB_ALIGN * SLAB_ALIGN;
+  assert(c->object_size <= SLAB_SIZE / 2);
+  c->slabs = NULL;
+  c->queued = NULL;
+  c->n_slabs = 0;
+
+  std::unique_lock<std::mutex> lck(caches_mutex);
+  c->id = next_id++;
+  live_caches.insert(c->id);
+  return c;
+}
+
+/*****************************************************************************/
+void slab_cache_destroy(slab_cache_t *c) {
+  {
+    std::unique_lock<std::mutex> lck(caches_mutex);
+    live_caches.erase(c->id);
+  }
+
+  while(c->slabs != NULL) {
+    slab_t *s = c->slabs;
+    c->slabs = s->next;
+    free(s);
+  }
+  delete c;
+}
+
+/*****************************************************************************/
+void *slab_alloc(slab_cache_t *c) {
+  slab_t **current = thread_slab(c);
+  slab_t *s = *current;
+
+  while(1) {
+    if(s != NULL) {
+      struct slab_object *object = s->local;
+      if(object == NULL && s->bump + c->object_size <= s->end) {
+        void *p = s->bump;
+        s->bump += c->object_size;
+        return p;
+      }
+      if(object == NULL) object = take_remote(s);
+      if(object != NULL) {
+        s->local = object->next;
+        return object;
+      }
+
+      if(retire(s)) continue;
+    }
+
+    s = *current = next_slab(c);
+    if(s == NULL) return NULL;
+  }
+}
+
+/*****************************************************************************/
+void slab_free(void *p) {
+  slab_t *s = slab_of(p);
+  struct slab_object *object = (struct slab_object *)p;
+  struct slab_object *head;
+
+  if(s->owner.load(std::memory_order_relaxed) == self()) {
+    object->next = s->local;
+    s->local = object;
+    return;
+  }
+
+  head = s->remote.load(std::memory_order_relaxed);
+  do {
+    object->next = head;
+  } while(!s->remote.compare_exchange_weak(head, object));
+
+  //First object freed in a retired slab, it can be allocated from again
+  int expected = SLAB_RETIRED;
+  if(head == NULL && s->state.compare_exchange_strong(expected, SLAB_QUEUED)) {
+    enqueue(s);
+  }
+}
+
+/*****************************************************************************/
+size_t slab_cache_slabs(slab_cache_t *c) {
+  std::unique_lock<std::mutex> lck(c->mutex);
+  return c->n_slabs;
+}
@@ -0,0 +1,40 @@
+/* Slab allocator of objects of a fixed size.
+ *
+ * Every thread allocates from a slab of its own, a block of SLAB_SIZE bytes cut
+ * in objects, without any synchronization. An object can be freed by any
+ * thread: the thread which allocates from the slab puts it back on the free
+ * list of the slab, the other threads push it on a lock-free list of the slab
+ * that the allocating thread takes over once its own list is empty.
+ *
+ * A thread whose slab is full moves to another one. The full slab is retired,
+ * and given to the next thread which needs a slab as soon as objects are freed
+ * in it. Slabs are only returned to the system when the cache is destroyed,
+ * along with the objects still allocated in them.
+ */
+
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#include <stddef.h>
+
+//Size and alignment of a slab, a power of 2
+#define SLAB_SIZE (64 * 1024)
+
+typedef struct slab_cache slab_cache_t;
+
+//Create a cache of objects of object_size bytes
+slab_cache_t *slab_cache_create(size_t object_size);
+
+//Free every slab of the cache, the objects still allocated included
+void slab_cache_destroy(slab_cache_t *c);
+
+//Allocate an object, aligned on 16 bytes, NULL if the system is out of memory
+void *slab_alloc(slab_cache_t *c);
+
+//Free an object, from any thread
+void slab_free(void *p);
+
+//Number of slabs of the cache
+size_t slab_cache_slabs(slab_cache_t *c);
+
+#endif //_SLAB_H_
@@ -0,0 +1,188 @@
+#include <assert.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "task_pool.h"
+#include "debug.h"
+
+struct task_worker {
+  //The owner works at the back, the thieves at the front. The deque is only
+  //locked to take or add a task, never while one runs.
+  std::mutex mutex;
+  std::deque<task_t> tasks;
+  std::thread thread;
+  u_long n_tasks;
+  u_long n_steals;
+  u_long n_sleeps;
+};
+
+struct task_pool {
+  std::vector<std::unique_ptr<task_worker>> workers;
+  std::atomic<long> queued;           //tasks in the deques, may be off by the submissions in progress
+  std::atomic<u_long> unfinished;     //tasks submitted and not run yet
+  std::atomic<int> sleepers;
+  std::atomic<unsigned int> next;     //deque of the next task submitted from outside the pool
+  std::mutex mutex;                   //only for the sleeping workers and the waiting threads
+  std::condition_variable wakeup;
+  std::condition_variable done;
+  int stop;
+};
+
+//Pool and worker of the calling thread, if it is a worker
+static thread_local task_pool_t *current_pool = NULL;
+static thread_local unsigned int current_worker;
+
+//Take a task of the deque of worker i, its back if it is the caller's deque
+static int take(task_pool_t *p, unsigned int i, int own, task_t *task) {
+  task_worker *w = p->workers[i].get();
+  std::unique_lock<std::mutex> lck(w->mutex);
+
+  if(w->tasks.empty()) return FALSE;
+  if(own) {
+    *task = std::move(w->tasks.back());
+    w->tasks.pop_back();
+  } else {
+    *task = std::move(w->tasks.front());
+    w->tasks.pop_front();
+  }
+  p->queued--;
+  return TRUE;
+}
+
+static void work_loop(task_pool_t *p, unsigned int self) {
+  task_worker *w = p->workers[self].get();
+  unsigned int n = p->workers.size();
+  task_t task;
+
+  current_pool = p;
+  current_worker = self;
+  while(TRUE) {
+    int found = take(p, self, TRUE, &task);
+    //Steal from the next workers, so that the thieves do not all try the same one
+    for(unsigned int k = 1; !found && k < n; k++) {
+      found = take(p, (self + k) % n, FALSE, &task);
+      if(found) w->n_steals++;
+    }
+
+    if(found) {
+      task();
+      task = nullptr;
+      w->n_tasks++;
+      if(--p->unfinished == 0) {
+        std::unique_lock<std::mutex> lck(p->mutex);
+        p->done.notify_all();
+      }
+      continue;
+    }
+
+    //A submitter increments queued then reads sleepers, a worker increments
+    //sleepers then reads queued: one of them sees the other
+    std::unique_lock<std::mutex> lck(p->mutex);
+    p->sleepers++;
+    if(p->queued <= 0 && !p->stop) {
+      w->n_sleeps++;
+      p->wakeup.wait(lck, [p]() { return p->queued > 0 || p->stop; });
+    }
+    p->sleepers--;
+    if(p->stop && p->queued <= 0) return;
+  }
+}
+
+/*****************************************************************************/
+task_pool_t *task_pool_create(unsigned int n_workers) {
+  task_pool_t *p = new task_pool_t;
+  unsigned int i;
+
+  p->queued = 0;
+  p->unfinished = 0;
+  p->sleepers = 0;
+  p->next = 0;
+  p->stop = FALSE;
+  n_workers = MAX(n_workers, 1);
+  for(i=0; i<n_workers; i++) {
+    p->workers.emplace_back(new task_worker);
+    p->workers[i]->n_tasks = 0;
+    p->workers[i]->n_steals = 0;
+    p->workers[i]->n_sleeps = 0;
+  }
+  //The deques are all there before a worker tries to steal
+  for(i=0; i<n_workers; i++) {
+    p->workers[i]->thread = std::thread(work_loop, p, i);
+  }
+  return p;
+}
+
+/*****************************************************************************/
+void task_pool_destroy(task_pool_t *p) {
+  task_pool_wait(p);
+  {
+    std::unique_lock<std::mutex> lck(p->mutex);
+    p->stop = TRUE;
+    p->wakeup.notify_all();
+  }
+  for(auto& w: p->workers) {
+    w->thread.join();
+  }
+  delete p;
+}
+
+/*****************************************************************************/
+void task_pool_submit(task_pool_t *p, task_t task) {
+  unsigned int i = current_pool == p ? current_worker : p->next++ % p->workers.size();
+  task_worker *w = p->workers[i].get();
+
+  p->unfinished++;
+  {
+    std::unique_lock<std::mutex> lck(w->mutex);
+    w->tasks.push_back(std::move(task));
+  }
+  p->queued++;
+  if(p->sleepers > 0) {
+    std::unique_lock<std::mutex> lck(p->mutex);
+    p->wakeup.notify_one();
+  }
+}
+
+/*****************************************************************************/
+void task_pool_wait(task_pool_t *p) {
+  std::unique_lock<std::mutex> lck(p->mutex);
+
+  //A worker waiting for the tasks would wait for itself
+  assert(current_pool != p);
+  p->done.wait(lck, [p]() { return p->unfinished == 0; });
+}
+
+/*****************************************************************************/
+unsigned int task_pool_workers(task_pool_t *p) {
+  return p->workers.size();
+}
+
+/*****************************************************************************/
+u_long task_pool_tasks(task_pool_t *p) {
+  u_long n = 0;
+
+  for(auto& w: p->workers) n += w->n_tasks;
+  return n;
+}
+
+/*****************************************************************************/
+u_long task_pool_steals(task_pool_t *p) {
+  u_long n = 0;
+
+  for(auto& w: p->workers) n += w->n_steals;
+  return n;
+}
+
+/*****************************************************************************/
+u_long task_pool_sleeps(task_pool_t *p) {
+  u_long n = 0;
+
+  for(auto& w: p->workers) n += w->n_sleeps;
+  return n;
+}
@@ -0,0 +1,47 @@
+/* Work-stealing pool of threads running tasks.
+ *
+ * Every worker has a deque of tasks. A task submitted by a worker goes to the
+ * back of its own deque, and a worker takes its next task from the back of its
+ * deque: the task runs soon after the one which submitted it, on data still in
+ * the cache. A worker whose deque is empty steals the oldest task of another
+ * worker, from the front of its deque. Tasks submitted by other threads go to
+ * the deques of the workers in turn. Workers without any task to take sleep
+ * until a task is submitted.
+ *
+ * Tasks run in any order, on any worker: tasks which must not run at the same
+ * time, or must run in some order, have to be serialized by their submitters.
+ */
+
+#ifndef _TASK_POOL_H_
+#define _TASK_POOL_H_
+
+#include <functional>
+
+#include "dedupdef.h"
+
+typedef struct task_pool task_pool_t;
+
+typedef std::function<void()> task_t;
+
+//Start n_workers workers, at least 1
+task_pool_t *task_pool_create(unsigned int n_workers);
+
+//Wait for the tasks, then stop the workers
+void task_pool_destroy(task_pool_t *p);
+
+//Run task on a worker, from any thread or task
+void task_pool_submit(task_pool_t *p, task_t task);
+
+//Wait until every task submitted, and every task they submitted, has run. Not
+//from a task of the pool.
+void task_pool_wait(task_pool_t *p);
+
+unsigned int task_pool_workers(task_pool_t *p);
+
+//Number of tasks run, of tasks stolen, and of times a worker went to sleep,
+//once task_pool_wait returned
+u_long task_pool_tasks(task_pool_t *p);
+u_long task_pool_steals(task_pool_t *p);
+u_long task_pool_sleeps(task_pool_t *p);
+
+#endif //_TASK_POOL_H_
@@ -25,6 +25,25 @@ int xread(int sd, void *buf, size_t len) {
   return nrecv;
 }
 
+int xpread(int sd, void *buf, size_t len, off_t offset) {
+  char *p = (char *)buf;
+  size_t nrecv = 0;
+  ssize_t rv;
+
+  while (nrecv < len) {
+    rv = pread(sd, p, len - nrecv, offset + nrecv);
+    if (0 > rv && errno == EINTR)
+      continue;
+    if (0 > rv)
+      return -1;
+    if (0 == rv)
+      return 0;
+    nrecv += rv;
+    p += rv;
+  }
+  return nrecv;
+}
+
 int xwrite(int sd, const void *buf, size_t len) {
   char *p = (char *)buf;
   size_t nsent = 0;
@@ -42,15 +61,16 @@ int xwrite(int sd, const void *buf, size_t len) {
   return nsent;
 }
 
-int read_header(int fd, byte *compress_type) {
+int read_header(int fd, byte *compress_type, chunking_t *chunking) {
   int checkbit;
+  chunking_t c = { CHUNKING_RABIN, 0, 0, 0 };
 
   assert(compress_type != NULL);
 
   if (xread(fd, &checkbit, sizeof(int)) < 0){
     return -1;
   }
-  if (checkbit != CHECKBIT) {
+  if (checkbit != CHECKBIT && checkbit != CHECKBIT_CHUNKING) {
     printf("format error!\n");
     return -1;
   }
@@ -59,11 +79,22 @@ int read_header(int fd, byte *compress_type) {
     return -1;
   }
 
+  if (checkbit == CHECKBIT_CHUNKING) {
+    byte engine;
+    if (xread(fd, &engine, sizeof(byte)) < 0 || xread(fd, &c.min_size, sizeof(u32int)) < 0 ||
+        xread(fd, &c.avg_size, sizeof(u32int)) < 0 || xread(fd, &c.max_size, sizeof(u32int)) < 0){
+      return -1;
+    }
+    c.engine = (chunking_engine_t)engine;
+  }
+
+  if (chunking != NULL) *chunking = c;
   return 0;
 }
 
-int write_header(int fd, byte compress_type) {
-  int checkbit = CHECKBIT;
+int write_header(int fd, byte compress_type, const chunking_t *chunking) {
+  int extended = chunking != NULL && chunking->engine != CHUNKING_RABIN;
+  int checkbit = extended ? CHECKBIT_CHUNKING : CHECKBIT;
   if (xwrite(fd, &checkbit, sizeof(int)) < 0){
     return -1;
   }
@@ -71,6 +102,14 @@ int write_header(int fd, byte compress_type) {
   if (xwrite(fd, &compress_type, sizeof(byte)) < 0){
     return -1;
   }
+
+  if (extended) {
+    byte engine = chunking->engine;
+    if (xwrite(fd, &engine, sizeof(byte)) < 0 || xwrite(fd, &chunking->min_size, sizeof(u32int)) < 0 ||
+        xwrite(fd, &chunking->avg_size, sizeof(u32int)) < 0 || xwrite(fd, &chunking->max_size, sizeof(u32int)) < 0){
+      return -1;
+    }
+  }
   return 0;
 }
 
@@ -10,14 +10,22 @@
 #include <pthread.h>
 
 #include "dedupdef.h"
+#include "chunking.h"
 
 /* File I/O with error checking */
 int xread(int sd, void *buf, size_t len);
 int xwrite(int sd, const void *buf, size_t len);
+//Read at offset, without moving the file offset
+int xpread(int sd, void *buf, size_t len, off_t offset);
 
-/* Process file header */
-int read_header(int fd, byte *compress_type);
-int write_header(int fd, byte compress_type);
+/* Process file header
+ *
+ * The header is CHECKBIT and the compression type. If the chunks were cut by
+ * another engine than Rabin, it is CHECKBIT_CHUNKING, the compression type,
+ * then the engine and its min, avg and max sizes, so that the archives of the
+ * Rabin engine are the same as before. chunking can be NULL in both. */
+int read_header(int fd, byte *compress_type, chunking_t *chunking = NULL);
+int write_header(int fd, byte compress_type, const chunking_t *chunking = NULL);
 
 template<typename T>
 class TSLogger {
@@ -33,8 +33,10 @@
 #include "heat_cpu/matrix_core.h"
 #include "naive_promise.h"
 #include "promise_plus.h"
+#include "promises/dynamic_step_promise.h"
 #include "promises/naive_promise.h"
 #include "promises/static_step_promise.h"
+#include "promises/wait_policy.h"
 #include "utils.h"
 
 using json = nlohmann::json;
@@ -207,7 +209,7 @@ private:
 
 typedef std::array<std::vector<uint64>, g::HeatCPU::ITERATIONS> IterationTimeByThreadStore;
 
-template<typename T>
+template<typename T, typename Promise = ActiveStaticStepPromise<T>>
 class PromisePlusSynchronizer : public Synchronizer<HeatCPUMatrix> {
 public:
     PromisePlusSynchronizer(HeatCPUMatrix const& m, Matrix4D& matrix, int n_threads, const PromisePlusBuilder<T>& builder) : Synchronizer(m, matrix) {
@@ -288,27 +290,30 @@ private:
 
 #ifdef PROMISE_PLUS_DEBUG_COUNTERS
     void gather_promise_plus_datas() {
-        for (int i = 0; i < g::HeatCPU::ITERATIONS; ++i) {
-            for (int j = 0; j < _promises_store[i].size(); ++j) {
-                ActiveStaticStepPromise<T>* promise = static_cast<ActiveStaticStepPromise<T>*>(_promises_store[i][j]);
-                auto [wait, strong, weak] = promise->get_debug_data();
-
-                json debug_data_struct = json::object();
-                debug_data_struct["iteration"] = i;
-                debug_data_struct["thread"] = j;
-
-                json debug_data = json::object();
-                debug_data["wait"] = wait;
-                debug_data["strong"] = strong;
-                debug_data["weak"] = weak;
+        // Only static step promises keep debug counters
+        if constexpr (requires(Promise const& p) { p.get_debug_data(); }) {
+            for (int i = 0; i < g::HeatCPU::ITERATIONS; ++i) {
+                for (int j = 0; j < _promises_store[i].size(); ++j) {
+                    Promise* promise = static_cast<Promise*>(_promises_store[i][j]);
+                    auto [wait, strong, weak] = promise->get_debug_data();
+
+                    json debug_data_struct = json::object();
+                    debug_data_struct["iteration"] = i;
+                    debug_data_struct["thread"] = j;
+
+                    json debug_data = json::object();
+                    debug_data["wait"] = wait;
+                    debug_data["strong"] = strong;
+                    debug_data["weak"] = weak;
 #ifdef PROMISE_PLUS_ITERATION_TIMER
-                debug_data["iteration_time"] = _times_by_thread[i][j];
+                    debug_data["iteration_time"] = _times_by_thread[i][j];
 #endif
 
-                // debug_data["set_times"] = promise->get_set_times();
+                    // debug_data["set_times"] = promise->get_set_times();
 
-                debug_data_struct["data"] = debug_data;
-                _promise_plus_debug_data.push_back(debug_data_struct);
+                    debug_data_struct["data"] = debug_data;
+                    _promise_plus_debug_data.push_back(debug_data_struct);
+                }
             }
         }
     }
@@ -452,21 +457,62 @@ public:
         _times.push_back(log);
     }
 
-    void run_static_step_promise_plus(unsigned int nb_iterations, unsigned int step) {
+    void run_static_step_promise_plus(unsigned int nb_iterations, unsigned int step, WaitPolicyKind wait) {
+        WaitPolicy::dispatch(wait, [&](auto tag) {
+            run_static_step_promise_plus<typename decltype(tag)::type>(nb_iterations, step, wait);
+        });
+    }
+
+    template<typename Wait>
+    void run_static_step_promise_plus(unsigned int nb_iterations, unsigned int step, WaitPolicyKind wait) {
         unsigned int nb_threads = omp_nb_threads();
-        uint64 time = 0;
         TimeLog log("StaticStep+", "promise_plus");
         TimeLog iterations_log("StaticStep+", "promise_plus");
 
         log.add_extra_arg("step", step);
+        log.add_extra_arg("wait", WaitPolicy::to_string(wait));
         iterations_log.add_extra_arg("step", step);
-        Matrix4D matrix(boost::extents[g::HeatCPU::DIM_W][g::HeatCPU::DIM_X][g::HeatCPU::DIM_Y][g::HeatCPU::DIM_Z]);
+        iterations_log.add_extra_arg("wait", WaitPolicy::to_string(wait));
          
-        VoidStaticStepPromiseBuilder builder(Globals::HeatCPU::DIM_Y, step, nb_threads);
+        VoidStaticStepPromiseBuilder<Wait> builder(Globals::HeatCPU::DIM_Y, step, nb_threads);
+        run_promise_plus<ActiveStaticStepPromise<void, Wait>>(nb_iterations, builder, log, iterations_log, "StaticStep");
+    }
+
+    template<DynamicStepPromiseMode mode>
+    void run_dynamic_step_promise_plus(unsigned int nb_iterations, unsigned int step, WaitPolicyKind wait,
+                                       uint64 max_wait_ns, std::string const& name) {
+        WaitPolicy::dispatch(wait, [&](auto tag) {
+            run_dynamic_step_promise_plus<mode, typename decltype(tag)::type>(nb_iterations, step, wait, max_wait_ns, name);
+        });
+    }
+
+    template<DynamicStepPromiseMode mode, typename Wait>
+    void run_dynamic_step_promise_plus(unsigned int nb_iterations, unsigned int step, WaitPolicyKind wait,
+                                       uint64 max_wait_ns, std::string const& name) {
+        unsigned int nb_threads = omp_nb_threads();
+        TimeLog log(name, "promise_plus");
+        TimeLog iterations_log(name, "promise_plus");
+
+        for (TimeLog* l: { &log, &iterations_log }) {
+            l->add_extra_arg("step", step);
+            l->add_extra_arg("wait", WaitPolicy::to_string(wait));
+            l->add_extra_arg("max_wait", max_wait_ns);
+        }
+
+        DynamicStepPromiseBuilder<void, mode, Wait> builder(Globals::HeatCPU::DIM_Y, step, nb_threads, max_wait_ns);
+        run_promise_plus<DynamicStepPromise<void, mode, Wait>>(nb_iterations, builder, log, iterations_log, name.c_str());
+    }
+
+    template<typename Promise>
+    void run_promise_plus(unsigned int nb_iterations, PromisePlusBuilder<void> const& builder,
+                          TimeLog& log, TimeLog& iterations_log, const char* name) {
+        unsigned int nb_threads = omp_nb_threads();
+        uint64 time = 0;
+        Matrix4D matrix(boost::extents[g::HeatCPU::DIM_W][g::HeatCPU::DIM_X][g::HeatCPU::DIM_Y][g::HeatCPU::DIM_Z]);
 
         for (unsigned int i = 0; i < nb_iterations; ++i) {
-            printf("StaticStep: iteration %d\n", i);
-            PromisePlusSynchronizer<void> promisePlusSynchronizer(sHeatCPU, matrix, nb_threads, builder);
+            printf("%s: iteration %d\n", name, i);
+            PromisePlusSynchronizer<void, Promise> promisePlusSynchronizer(sHeatCPU, matrix, nb_threads, builder);
 
             time = measure_synchronizer_time(promisePlusSynchronizer, [](auto&& matrix, auto&& m, auto&& dst, auto&& src) {
                 heat_cpu_promise_plus(matrix, m, dst, src);
@@ -561,6 +607,9 @@ namespace JSON {
             Synchronizers::alt_bit,
             Synchronizers::counter,
             Synchronizers::static_step_promise_plus,
+            Synchronizers::dsp_prod_timer,
+            Synchronizers::dsp_prod_timer_unblocks,
+            Synchronizers::dsp_timer_unblocks,
             Synchronizers::array_of_promises,
             Synchronizers::promise_of_array
         };
@@ -591,6 +640,30 @@ public:
         }
     }
 
+    template<typename T>
+    static T get_extra(json const& run, std::string const& key, T const& default_value) {
+        if (run.contains(JSON::Run::extras)) {
+            const json& extras = run[JSON::Run::extras];
+            if (extras.contains(key)) {
+                return extras[key].get<T>();
+            }
+        }
+
+        return default_value;
+    }
+
+    static unsigned int get_step(json const& run) {
+        return get_extra<unsigned int>(run, JSON::Run::Extras::step, 1);
+    }
+
+    static WaitPolicyKind get_wait(json const& run) {
+        return WaitPolicy::from_string(get_extra<std::string>(run, JSON::Run::Extras::wait, WaitPolicy::spin));
+    }
+
+    static uint64 get_max_wait(json const& run) {
+        return get_extra<uint64>(run, JSON::Run::Extras::max_wait, DSP_DEFAULT_MAX_WAIT_NS);
+    }
+
     void process_run(unsigned int iterations, json run) {
         std::string const& synchronizer = run[JSON::Run::synchronizer];
 
@@ -601,15 +674,13 @@ public:
         } else if (synchronizer == Sync::counter) {
             _collector.run_atomic_counter(iterations);
         } else if (synchronizer == Sync::static_step_promise_plus) {
-            unsigned int step = 1;
-            if (run.contains(JSON::Run::extras)) {
-                const json& extras = run[JSON::Run::extras];
-                if (extras.contains(JSON::Run::Extras::step)) {
-                    step = extras[JSON::Run::Extras::step].get<unsigned int>();
-                }
-            }
-
-            _collector.run_static_step_promise_plus(iterations, step);
+            _collector.run_static_step_promise_plus(iterations, get_step(run), get_wait(run));
+        } else if (synchronizer == Sync::dsp_prod_timer) {
+            _collector.run_dynamic_step_promise_plus<DynamicStepPromiseMode::SET_STEP_PRODUCER_TIMER>(iterations, get_step(run), get_wait(run), get_max_wait(run), "DSPProdTimer");
+        } else if (synchronizer == Sync::dsp_prod_timer_unblocks) {
+            _collector.run_dynamic_step_promise_plus<DynamicStepPromiseMode::SET_STEP_PRODUCER_TIMER_UNBLOCK>(iterations, get_step(run), get_wait(run), get_max_wait(run), "DSPProdTimerUnblocks");
+        } else if (synchronizer == Sync::dsp_timer_unblocks) {
+            _collector.run_dynamic_step_promise_plus<DynamicStepPromiseMode::SET_STEP_TIMER_UNBLOCK>(iterations, get_step(run), get_wait(run), get_max_wait(run), "DSPTimerUnblocks");
         } else if (synchronizer == Sync::array_of_promises) {
             _collector.run_array_of_promises(iterations);
         } else if (synchronizer == Sync::promise_of_array) {
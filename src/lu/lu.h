@@ -28,9 +28,9 @@ void kernel_lu_omp(Matrix2D const& matrix, Matrix2D& out);
  *
  * Result is stored in the promises in @a promises.
  */
-template<DynamicStepPromiseMode mode>
+template<DynamicStepPromiseMode mode, typename Wait = SpinWait>
 void kernel_lu_omp_pp(Matrix2D const& matrix, Matrix2D& out,
-                   std::vector<DynamicStepPromise<Matrix2DValue, mode>*>& promises);
+                   std::vector<DynamicStepPromise<Matrix2DValue, mode, Wait>*>& promises);
 
 // ----------------------------------------------------------------------------
 // Solvers
@@ -58,8 +58,8 @@ void kernel_lu_solve_n(Matrix2D const& lu, std::vector<Vector1D> const& b,
  * This solver assumes the PromisePlus in @a lu contain the factorization of
  * the A matrix.
  */
-template<DynamicStepPromiseMode mode>
-void kernel_lu_solve_pp(std::vector<DynamicStepPromise<Matrix2DValue, mode>*>& lu,
+template<DynamicStepPromiseMode mode, typename Wait = SpinWait>
+void kernel_lu_solve_pp(std::vector<DynamicStepPromise<Matrix2DValue, mode, Wait>*>& lu,
                         Vector1D const& b, Vector1D& x);
 
 /**
@@ -68,8 +68,8 @@ void kernel_lu_solve_pp(std::vector<DynamicStepPromise<Matrix2DValue, mode>*>& l
  * This solver assumes the PromisePlus in @a lu contain the factorization of
  * the A matrix.
  */
-template<DynamicStepPromiseMode mode>
-void kernel_lu_solve_n_pp(std::vector<DynamicStepPromise<Matrix2DValue, mode>*>& lu,
+template<DynamicStepPromiseMode mode, typename Wait = SpinWait>
+void kernel_lu_solve_n_pp(std::vector<DynamicStepPromise<Matrix2DValue, mode, Wait>*>& lu,
                           std::vector<Vector1D> const& b,
                           std::vector<Vector1D>& x);
 
@@ -93,9 +93,9 @@ void kernel_lu_combine_n_omp(Matrix2D const& a, Matrix2D& out, std::vector<Vecto
  * This solver computes the LU factorization of A and streams it into a
  * triangular solver.
  */
-template<DynamicStepPromiseMode mode>
+template<DynamicStepPromiseMode mode, typename Wait = SpinWait>
 void kernel_lu_combine_pp(Matrix2D const& a, Matrix2D& out, Vector1D const& b, Vector1D& x,
-                          DynamicStepPromiseBuilder<Matrix2DValue, mode> const& builder);
+                          DynamicStepPromiseBuilder<Matrix2DValue, mode, Wait> const& builder);
 
 /**
  * @brief Compute the solution of Ax = b for N different b through LU 
@@ -104,11 +104,11 @@ void kernel_lu_combine_pp(Matrix2D const& a, Matrix2D& out, Vector1D const& b, V
  * This solver compute the LU factorization of A and streams it into N
  * different triangular solvers.
  */
-template<DynamicStepPromiseMode mode>
+template<DynamicStepPromiseMode mode, typename Wait = SpinWait>
 void kernel_lu_combine_n_pp(Matrix2D const& a, Matrix2D& out, 
                                          std::vector<Vector1D> const& b, 
                                          std::vector<Vector1D>& x,
-                                         DynamicStepPromiseBuilder<Matrix2DValue, mode> const& builder);
+                                         DynamicStepPromiseBuilder<Matrix2DValue, mode, Wait> const& builder);
 
 #include "lu/lu.tpp"
 
@@ -3,15 +3,15 @@
 
 void validate_diagonal(Matrix2D const&);
 
-template<DynamicStepPromiseMode mode>
+template<DynamicStepPromiseMode mode, typename Wait>
 static void init_promise_plus_vector(Matrix2D const& matrix,
-    std::vector<DynamicStepPromise<Matrix2DValue, mode>*>& promises,
-    DynamicStepPromiseBuilder<Matrix2DValue, mode> const& builder);
+    std::vector<DynamicStepPromise<Matrix2DValue, mode, Wait>*>& promises,
+    DynamicStepPromiseBuilder<Matrix2DValue, mode, Wait> const& builder);
 
-template<DynamicStepPromiseMode mode>
+template<DynamicStepPromiseMode mode, typename Wait>
 void kernel_lu_omp_pp(Matrix2D const& matrix,
                       Matrix2D& work,
-                      std::vector<DynamicStepPromise<Matrix2DValue, mode>*>& promises) {
+                      std::vector<DynamicStepPromise<Matrix2DValue, mode, Wait>*>& promises) {
     namespace g = Globals;
 /*    std::vector<std::unique_ptr<DynamicStepPromise<int>>> inner_promises(matrix.size());
     for (int i = 0; i < inner_promises.size(); ++i)
@@ -21,11 +21,19 @@ void kernel_lu_omp_pp(Matrix2D const& matrix,
 
     constexpr const size_t n = g::LU::DIM;
     memcpy(work.data(), matrix.data(), sizeof(Matrix2DValue) * n * n);
-    std::vector<ActiveStaticStepPromise<void>*> indices;
+    // Per-rank hand-off chain. In TIMER modes the step of the chain is tuned
+    // at runtime from the time ranks spend waiting on their left neighbour.
+    std::vector<PromisePlus<void>*> indices;
     constexpr const int step = 150;
-    VoidStaticStepPromiseBuilder builder(n, step, omp_nb_threads());
-    for (int i = 0; i < omp_nb_threads(); ++i)
-        indices.push_back(static_cast<ActiveStaticStepPromise<void>*>(builder.new_promise()));
+    if constexpr (IsTimerV<mode>) {
+        DynamicStepPromiseBuilder<void, mode, Wait> builder(n, step, omp_nb_threads(), promises.empty() ? DSP_DEFAULT_MAX_WAIT_NS : promises.front()->max_wait_ns());
+        for (int i = 0; i < omp_nb_threads(); ++i)
+            indices.push_back(builder.new_promise());
+    } else {
+        VoidStaticStepPromiseBuilder<Wait> builder(n, step, omp_nb_threads());
+        for (int i = 0; i < omp_nb_threads(); ++i)
+            indices.push_back(builder.new_promise());
+    }
 
 #pragma omp parallel
 {
@@ -133,10 +141,13 @@ void kernel_lu_omp_pp(Matrix2D const& matrix,
         }
     }
 }
+
+    for (PromisePlus<void>* index: indices)
+        delete index;
 }
 
-template<DynamicStepPromiseMode mode>
-void kernel_lu_solve_pp(std::vector<DynamicStepPromise<Matrix2DValue, mode>*>& lu,
+template<DynamicStepPromiseMode mode, typename Wait>
+void kernel_lu_solve_pp(std::vector<DynamicStepPromise<Matrix2DValue, mode, Wait>*>& lu,
                         Vector1D const& b, Vector1D& x) {
     Vector1D y;
     for (int i = 0; i < lu.size(); ++i) {
@@ -161,49 +172,49 @@ void kernel_lu_solve_pp(std::vector<DynamicStepPromise<Matrix2DValue, mode>*>& l
     }
 }
 
-template<DynamicStepPromiseMode mode>
-void kernel_lu_solve_n_pp(std::vector<DynamicStepPromise<Matrix2DValue, mode>*>& lu,
+template<DynamicStepPromiseMode mode, typename Wait>
+void kernel_lu_solve_n_pp(std::vector<DynamicStepPromise<Matrix2DValue, mode, Wait>*>& lu,
                           std::vector<Vector1D> const& b,
                           std::vector<Vector1D>& x) {
     std::vector<std::thread> threads;
     for (int i = 0; i < b.size(); ++i)
-        threads.push_back(std::thread(kernel_lu_solve_pp<mode>, std::ref(lu), std::cref(b[i]), std::ref(x[i])));
+        threads.push_back(std::thread(kernel_lu_solve_pp<mode, Wait>, std::ref(lu), std::cref(b[i]), std::ref(x[i])));
 
     for (auto& th: threads)
         th.join(); 
 
 }
-template<DynamicStepPromiseMode mode>
+template<DynamicStepPromiseMode mode, typename Wait>
 void kernel_lu_combine_pp(Matrix2D const& a, Matrix2D& out, Vector1D const& b, Vector1D& x,
-                          DynamicStepPromiseBuilder<Matrix2DValue, mode> const& builder) {
-    std::vector<DynamicStepPromise<Matrix2DValue, mode>*> promises;
+                          DynamicStepPromiseBuilder<Matrix2DValue, mode, Wait> const& builder) {
+    std::vector<DynamicStepPromise<Matrix2DValue, mode, Wait>*> promises;
     init_promise_plus_vector(a, promises, builder);
 
-    std::thread lu(kernel_lu_omp_pp<mode>, std::cref(a), std::ref(out), std::ref(promises));
+    std::thread lu(kernel_lu_omp_pp<mode, Wait>, std::cref(a), std::ref(out), std::ref(promises));
     kernel_lu_solve_pp(promises, b, x);
 
     lu.join();
 }
 
-template<DynamicStepPromiseMode mode>
+template<DynamicStepPromiseMode mode, typename Wait>
 void kernel_lu_combine_n_pp(Matrix2D const& a, Matrix2D& out, 
                                          std::vector<Vector1D> const& b, 
                                          std::vector<Vector1D>& x,
-                                         DynamicStepPromiseBuilder<Matrix2DValue, mode> const& builder
+                                         DynamicStepPromiseBuilder<Matrix2DValue, mode, Wait> const& builder
                                          ) {
-    std::vector<DynamicStepPromise<Matrix2DValue, mode>*> promises; 
+    std::vector<DynamicStepPromise<Matrix2DValue, mode, Wait>*> promises; 
     init_promise_plus_vector(a, promises, builder);
 
-    std::thread lu(kernel_lu_omp_pp<mode>, std::cref(a), std::ref(out), std::ref(promises));
+    std::thread lu(kernel_lu_omp_pp<mode, Wait>, std::cref(a), std::ref(out), std::ref(promises));
     kernel_lu_solve_n_pp(promises, b, x);
 
     lu.join();
 }
 
-template<DynamicStepPromiseMode mode>
+template<DynamicStepPromiseMode mode, typename Wait>
 void init_promise_plus_vector(Matrix2D const& matrix,
-    std::vector<DynamicStepPromise<Matrix2DValue, mode>*>& promises,
-    DynamicStepPromiseBuilder<Matrix2DValue, mode> const& builder) {
+    std::vector<DynamicStepPromise<Matrix2DValue, mode, Wait>*>& promises,
+    DynamicStepPromiseBuilder<Matrix2DValue, mode, Wait> const& builder) {
     for (int i = 0; i < matrix.size(); ++i)
-        promises.push_back(static_cast<DynamicStepPromise<Matrix2DValue, mode>*>(builder.new_promise()));
+        promises.push_back(static_cast<DynamicStepPromise<Matrix2DValue, mode, Wait>*>(builder.new_promise()));
 }
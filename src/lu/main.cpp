@@ -10,6 +10,7 @@
 #include <dynamic_config.h>
 #include <nlohmann/json.hpp>
 #include <promises/dynamic_step_promise.h>
+#include <promises/wait_policy.h>
 
 #include "dynamic_defines.h"
 #include "lu.h"
@@ -17,10 +18,10 @@
 
 namespace g = Globals;
 
-template<typename MatrixValue, DynamicStepPromiseMode mode>
+template<typename MatrixValue, DynamicStepPromiseMode mode, typename Wait = SpinWait>
 class PromisePlusLUSynchronizer : public Synchronizer<LUSolver> {
 public:
-    PromisePlusLUSynchronizer(LUSolver const& m, Matrix2D& matrix, int nb_threads, DynamicStepPromiseBuilder<MatrixValue, mode> const& builder) : Synchronizer(m, matrix), _n_threads(nb_threads), _builder(builder),
+    PromisePlusLUSynchronizer(LUSolver const& m, Matrix2D& matrix, int nb_threads, DynamicStepPromiseBuilder<MatrixValue, mode, Wait> const& builder) : Synchronizer(m, matrix), _n_threads(nb_threads), _builder(builder),
         _result(boost::extents[g::LU::DIM][g::LU::DIM]) {
 
     }
@@ -38,7 +39,7 @@ public:
 
 private:
     int _n_threads;
-    DynamicStepPromiseBuilder<MatrixValue, mode> const& _builder;
+    DynamicStepPromiseBuilder<MatrixValue, mode, Wait> const& _builder;
     std::vector<Vector1D> _xs;
     std::vector<Vector1D> _bs;
     Matrix2D _result;
@@ -62,10 +63,10 @@ private:
     Matrix2D _result;
 };
 
-template<typename MatrixValue, DynamicStepPromiseMode mode>
+template<typename MatrixValue, DynamicStepPromiseMode mode, typename Wait = SpinWait>
 class PromisePlusLU : public Synchronizer<LUSolver> {
 public:
-    PromisePlusLU(LUSolver const& m, Matrix2D& matrix, DynamicStepPromiseBuilder<MatrixValue, mode> const& builder) :
+    PromisePlusLU(LUSolver const& m, Matrix2D& matrix, DynamicStepPromiseBuilder<MatrixValue, mode, Wait> const& builder) :
         Synchronizer(m, matrix), _builder(builder), _result(boost::extents[g::LU::DIM][g::LU::DIM]) { }
 
     virtual void assert_okay() {
@@ -74,17 +75,17 @@ public:
 
     template<typename F, typename... Args>
     void run(F&& f, Args&&... args) {
-        std::vector<DynamicStepPromise<MatrixValue, mode>*> promises;
+        std::vector<DynamicStepPromise<MatrixValue, mode, Wait>*> promises;
         auto create_time = measure_time([&]() {
             for (int i = 0; i < _matrix.size(); ++i)
-                promises.push_back(static_cast<DynamicStepPromise<Matrix2DValue, mode>*>(_builder.new_promise()));
+                promises.push_back(static_cast<DynamicStepPromise<Matrix2DValue, mode, Wait>*>(_builder.new_promise()));
         });
         std::cout << "Creation time: " << (double)create_time / BILLION << std::endl;
         kernel_lu_omp_pp(_matrix, _result, promises);
     }
 
 private:
-    DynamicStepPromiseBuilder<MatrixValue, mode> const& _builder;
+    DynamicStepPromiseBuilder<MatrixValue, mode, Wait> const& _builder;
     Matrix2D _result;
 };
 
@@ -174,7 +175,16 @@ public:
     }
 
     template<DynamicStepPromiseMode mode>
-    void run_dsp(unsigned int iterations, unsigned int step, 
+    void run_dsp(unsigned int iterations, unsigned int step, WaitPolicyKind wait, uint64 max_wait_ns,
+                 const std::string& synchronizer_name,
+                 const std::string& function) {
+        WaitPolicy::dispatch(wait, [&](auto tag) {
+            run_dsp<mode, typename decltype(tag)::type>(iterations, step, wait, max_wait_ns, synchronizer_name, function);
+        });
+    }
+
+    template<DynamicStepPromiseMode mode, typename Wait>
+    void run_dsp(unsigned int iterations, unsigned int step, WaitPolicyKind wait, uint64 max_wait_ns,
                  const std::string& synchronizer_name,
                  const std::string& function) {
         std::cout << "Running DSP" << std::endl;
@@ -184,14 +194,17 @@ public:
         TimeLog omp(synchronizer_name + "OMP", function);
 
         log.add_extra_arg("step", step);
+        log.add_extra_arg("wait", WaitPolicy::to_string(wait));
+        if constexpr (IsTimerV<mode>)
+            log.add_extra_arg("max_wait", max_wait_ns);
 
         Matrix2D matrix(boost::extents[g::LU::DIM][g::LU::DIM]);
-        DynamicStepPromiseBuilder<Matrix2D::element, mode> builder(g::LU::DIM, step, nb_threads);
+        DynamicStepPromiseBuilder<Matrix2D::element, mode, Wait> builder(g::LU::DIM, step, nb_threads, max_wait_ns);
 
         for (unsigned int i = 0; i < iterations; ++i) {
             // PromisePlusLUSynchronizer<Matrix2D::element, mode> sync(sLU, matrix, nb_threads, builder);
             OMPLU omp_sync(sLU, matrix);
-            PromisePlusLU pp_sync(sLU, matrix, builder);
+            PromisePlusLU<Matrix2D::element, mode, Wait> pp_sync(sLU, matrix, builder);
 
             auto omp_time = measure_synchronizer_time(omp_sync, []{});
             add_time(omp, i, omp_time);
@@ -292,6 +305,28 @@ public:
             return 1;
         };
 
+        auto get_wait = [&]() -> WaitPolicyKind {
+            if (run.contains(JSON::Run::extras)) {
+                const json& extras = run[JSON::Run::extras];
+                if (extras.contains(JSON::Run::Extras::wait)) {
+                    return WaitPolicy::from_string(extras[JSON::Run::Extras::wait].get<std::string>());
+                }
+            }
+
+            return WaitPolicyKind::SPIN;
+        };
+
+        auto get_max_wait = [&]() -> uint64 {
+            if (run.contains(JSON::Run::extras)) {
+                const json& extras = run[JSON::Run::extras];
+                if (extras.contains(JSON::Run::Extras::max_wait)) {
+                    return extras[JSON::Run::Extras::max_wait].get<uint64>();
+                }
+            }
+
+            return DSP_DEFAULT_MAX_WAIT_NS;
+        };
+
         namespace Sync = JSON::Run::Synchronizers;
 
         std::map<std::string, std::function<void()>> synchronizer_action;
@@ -316,7 +351,7 @@ public:
 #undef ACTION_DSP
 */
 
-#define ACTION_DSP(NAME, MODE, SYNC_NAME, FN) synchronizer_action[Sync::NAME] = [&] { _collector.run_dsp<MODE>(iterations, get_step(), std::string(SYNC_NAME), std::string(FN)); }
+#define ACTION_DSP(NAME, MODE, SYNC_NAME, FN) synchronizer_action[Sync::NAME] = [&] { _collector.run_dsp<MODE>(iterations, get_step(), get_wait(), get_max_wait(), std::string(SYNC_NAME), std::string(FN)); }
 
         using dspm = DynamicStepPromiseMode;
 
@@ -328,6 +363,7 @@ public:
         ACTION_DSP(dsp_both_unblocks, dspm::SET_STEP_BOTH_UNBLOCK, "DSPBothUnblocks", "lu");
         ACTION_DSP(dsp_prod_timer, dspm::SET_STEP_PRODUCER_TIMER, "DSPProdTimer", "lu");
         ACTION_DSP(dsp_prod_timer_unblocks, dspm::SET_STEP_PRODUCER_TIMER_UNBLOCK, "DSPProdTimerUnblocks", "lu");
+        ACTION_DSP(dsp_timer_unblocks, dspm::SET_STEP_TIMER_UNBLOCK, "DSPTimerUnblocks", "lu");
         ACTION_DSP(dsp_monitor, dspm::SET_STEP_MONITOR, "DSPMonitor", "lu");
         ACTION_DSP(dsp_never, dspm::SET_STEP_NEVER, "DSPNever", "lu");
 
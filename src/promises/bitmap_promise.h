@@ -0,0 +1,96 @@
+#ifndef BITMAP_PROMISE_H
+#define BITMAP_PROMISE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "promise_plus.h"
+#include "promises/wait_policy.h"
+#include "utils.h"
+
+/**
+ * Readiness of every index is stored as a single bit, 64 indices per atomic
+ * word. set() is a fetch_or on the word, so no per-index mutex is needed to
+ * serialize producers. Consumers wait on the word with the Wait policy; the
+ * default one spins for a while, then sleeps on the word (futex on Linux)
+ * until a producer flips a bit in it.
+ *
+ * Compared to the NaivePromise implementations this costs one bit per index
+ * instead of a mutex + condition variable (passive) or an atomic bool + mutex
+ * (active).
+ */
+struct BitmapPromiseBase : public PromisePlusAbstractReadyCheck {
+    BitmapPromiseBase(int nb_values);
+
+    std::unique_ptr<std::atomic<uint64_t>[]> _words;
+    int _nb_words;
+
+    bool ready_index_strong(int index) final;
+    bool ready_index_weak(int index) final;
+
+    int index_strong() final { return -1; }
+    int index_weak() final { return -1; }
+
+    static inline int word_of(int index) { return index >> 6; }
+    static inline uint64_t mask_of(int index) { return uint64_t(1) << (index & 63); }
+
+    static size_t footprint(int nb_values) { return ((nb_values + 63) / 64) * sizeof(std::atomic<uint64_t>); }
+};
+
+template<typename T, typename Wait = SpinFutexWait>
+class BitmapPromise : public PromisePlus<T> {
+public:
+    BitmapPromise(int nb_values);
+
+    NO_COPY_T2(BitmapPromise, T, Wait);
+
+    T& get(int index);
+    void set(int index, const T& value);
+    void set(int index, T&& value);
+    void set_immediate(int index, const T& value);
+    void set_immediate(int index, T&& value);
+
+private:
+    void wait(int index);
+    void mark(int index);
+
+    BitmapPromiseBase _base;
+    Wait _wait;
+};
+
+template<typename Wait>
+class BitmapPromise<void, Wait> : public PromisePlus<void> {
+public:
+    BitmapPromise(int nb_values);
+
+    NO_COPY_T2(BitmapPromise, void, Wait);
+
+    void get(int index);
+    void set(int index);
+    void set_immediate(int index);
+
+private:
+    void wait(int index);
+    void mark(int index);
+
+    BitmapPromiseBase _base;
+    Wait _wait;
+};
+
+template<typename T, typename Wait = SpinFutexWait>
+class BitmapPromiseBuilder : public PromisePlusBuilder<T> {
+public:
+    BitmapPromiseBuilder(int nb_values) : _nb_values(nb_values) { }
+
+    PromisePlus<T>* new_promise() const {
+        return new BitmapPromise<T, Wait>(_nb_values);
+    }
+
+private:
+    int _nb_values;
+};
+
+#include "bitmap_promise/bitmap_promise.tpp"
+
+#endif // BITMAP_PROMISE_H
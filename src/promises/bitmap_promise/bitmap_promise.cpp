@@ -0,0 +1,19 @@
+#include "promises/bitmap_promise.h"
+
+// -----------------------------------------------------------------------------
+// Base
+
+BitmapPromiseBase::BitmapPromiseBase(int nb_values) {
+    _nb_words = (nb_values + 63) / 64;
+    _words = std::make_unique<std::atomic<uint64_t>[]>(_nb_words);
+    for (int i = 0; i < _nb_words; ++i)
+        _words[i].store(0, std::memory_order_relaxed);
+}
+
+bool BitmapPromiseBase::ready_index_strong(int index) {
+    return _words[word_of(index)].load(std::memory_order_acquire) & mask_of(index);
+}
+
+bool BitmapPromiseBase::ready_index_weak(int index) {
+    return _words[word_of(index)].load(std::memory_order_relaxed) & mask_of(index);
+}
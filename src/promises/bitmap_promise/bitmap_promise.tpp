@@ -0,0 +1,92 @@
+#include <utility>
+
+template<typename T, typename Wait>
+BitmapPromise<T, Wait>::BitmapPromise(int nb_values) :
+    PromisePlus<T>(nb_values, nb_values), _base(nb_values) {
+
+}
+
+template<typename T, typename Wait>
+T& BitmapPromise<T, Wait>::get(int index) {
+    if (!_base.ready_index_strong(index))
+        wait(index);
+
+    return this->_values[index];
+}
+
+template<typename T, typename Wait>
+void BitmapPromise<T, Wait>::set(int index, const T& value) {
+    _base.assert_free_index_strong(index);
+    this->_values[index] = value;
+    mark(index);
+}
+
+template<typename T, typename Wait>
+void BitmapPromise<T, Wait>::set(int index, T&& value) {
+    _base.assert_free_index_strong(index);
+    this->_values[index] = std::move(value);
+    mark(index);
+}
+
+template<typename T, typename Wait>
+void BitmapPromise<T, Wait>::set_immediate(int index, const T& value) {
+    this->_values[index] = value;
+    mark(index);
+}
+
+template<typename T, typename Wait>
+void BitmapPromise<T, Wait>::set_immediate(int index, T&& value) {
+    this->_values[index] = std::move(value);
+    mark(index);
+}
+
+template<typename T, typename Wait>
+void BitmapPromise<T, Wait>::wait(int index) {
+    uint64_t const mask = BitmapPromiseBase::mask_of(index);
+    _wait.wait(_base._words[BitmapPromiseBase::word_of(index)], [mask](uint64_t word) { return (word & mask) != 0; });
+}
+
+template<typename T, typename Wait>
+void BitmapPromise<T, Wait>::mark(int index) {
+    std::atomic<uint64_t>& word = _base._words[BitmapPromiseBase::word_of(index)];
+    word.fetch_or(BitmapPromiseBase::mask_of(index), std::memory_order_release);
+    _wait.notify(word);
+}
+
+// -----------------------------------------------------------------------------
+// BitmapPromise<void>
+
+template<typename Wait>
+BitmapPromise<void, Wait>::BitmapPromise(int nb_values) : PromisePlus<void>(nb_values), _base(nb_values) {
+
+}
+
+template<typename Wait>
+void BitmapPromise<void, Wait>::get(int index) {
+    if (!_base.ready_index_strong(index))
+        wait(index);
+}
+
+template<typename Wait>
+void BitmapPromise<void, Wait>::set(int index) {
+    _base.assert_free_index_strong(index);
+    mark(index);
+}
+
+template<typename Wait>
+void BitmapPromise<void, Wait>::set_immediate(int index) {
+    mark(index);
+}
+
+template<typename Wait>
+void BitmapPromise<void, Wait>::wait(int index) {
+    uint64_t const mask = BitmapPromiseBase::mask_of(index);
+    _wait.wait(_base._words[BitmapPromiseBase::word_of(index)], [mask](uint64_t word) { return (word & mask) != 0; });
+}
+
+template<typename Wait>
+void BitmapPromise<void, Wait>::mark(int index) {
+    std::atomic<uint64_t>& word = _base._words[BitmapPromiseBase::word_of(index)];
+    word.fetch_or(BitmapPromiseBase::mask_of(index), std::memory_order_release);
+    _wait.notify(word);
+}
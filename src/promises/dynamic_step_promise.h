@@ -7,7 +7,9 @@
 #include <shared_mutex>
 #include <vector>
 
+#include "defines.h"
 #include "promise_plus.h"
+#include "promises/wait_policy.h"
 
 enum class DynamicStepPromiseMode {
     SET_STEP_PRODUCER_ONLY = 1 << 0, // Only the producer will call set_step. 
@@ -78,46 +80,64 @@ constexpr bool RequiresLockV = UnblocksV<mode> && RequiresStrongSyncV<mode>;
 template<DynamicStepPromiseMode mode>
 constexpr bool SetStepNeverV = mode == DynamicStepPromiseMode::SET_STEP_NEVER;
 
-template<typename T, DynamicStepPromiseMode mode>
+/**
+ * Parameters of the step controller used in TIMER modes.
+ *
+ * The producer re-evaluates the step every DSP_TUNE_PERIOD sets. Over that
+ * window, consumers report how far behind the producer they were when get()
+ * returned: the number of sets between the value they asked for being
+ * produced (or them asking for it, if later) and its publication. Consumers
+ * still waiting when the step is re-evaluated are counted with their lag so
+ * far, and a get() that did not wait counts as no lag. The lag is turned into
+ * a time with the rate of the sets over the window. If the average exceeds
+ * the latency bound the step shrinks, to at most the step at which the bound
+ * holds; while it stays well under the bound the step grows slowly, up to that
+ * step, so that consumers which are behind and catch up do not wait for a step
+ * grown meanwhile. Without any report the step is kept.
+ */
+constexpr unsigned int DSP_TUNE_PERIOD = 256;
+constexpr uint64 DSP_DEFAULT_MAX_WAIT_NS = 20000;
+
+template<typename T, DynamicStepPromiseMode mode, typename Wait = SpinWait>
 class DynamicStepPromiseBuilder : public PromisePlusBuilder<T> {
 public:
-    DynamicStepPromiseBuilder(int, unsigned int, unsigned int);
+    DynamicStepPromiseBuilder(int, unsigned int, unsigned int, uint64 max_wait_ns = DSP_DEFAULT_MAX_WAIT_NS);
     PromisePlus<T>* new_promise() const;
 
 private:
     int _nb_values;
     unsigned int _start_step;
     unsigned int _n_threads;
+    uint64 _max_wait_ns;
 };
 
-template<typename T, DynamicStepPromiseMode mode>
-class DynamicStepPromise : public PromisePlus<T> {
+/**
+ * Synchronization state of a DynamicStepPromise, shared by the value and void
+ * flavours.
+ */
+template<DynamicStepPromiseMode mode, typename Wait>
+class DynamicStepPromiseBase {
     static_assert(mode != DynamicStepPromiseMode::SET_STEP_UNBLOCK);
     static_assert(mode != DynamicStepPromiseMode::SET_STEP_TIMER);
-    static_assert(mode != DynamicStepPromiseMode::SET_STEP_TIMER_UNBLOCK);
 public:
-    DynamicStepPromise(int nb_values, unsigned int start_step);
+    DynamicStepPromiseBase(unsigned int start_step, unsigned int max_step, uint64 max_wait_ns);
 
-    NO_COPY_T2(DynamicStepPromise, T, mode);
+    NO_COPY_T2(DynamicStepPromiseBase, mode, Wait);
 
-    T& get(int index);
-
-    void set(int index, const T& value);
-    void set(int index, T&& value);
-
-    void set_no_timer(int index, const T& value);
-    void set_no_timer(int index, T&& value);
-
-    void set_immediate(int index, const T& value);
-    void set_immediate(int index, T&& value);
-
-    void set_immediate_no_timer(int index, const T& value);
-    void set_immediate_no_timer(int index, T&& value);
-
-    friend PromisePlus<T>* DynamicStepPromiseBuilder<T, mode>::new_promise() const;
+    // Consumer: wait until index is published
+    void wait_for(int index);
+    // Producer: index has been written, publish it if the step allows
+    void publish(int index);
+    // Producer: index has been written, publish it now
+    void publish_immediate(int index);
+    // Producer: account for one set and let the controller retune the step
+    void tick();
 
     void set_step(unsigned int new_step);
 
+    // Size the per-thread slots for n_threads consumers
+    void set_threads(unsigned int n_threads);
+
     inline unsigned int get_step() const {
         if constexpr (RequiresLockV<mode>) {
             return _step.load(std::memory_order_acquire);
@@ -126,16 +146,15 @@ public:
         }
     }
 
-private:
     // Producer writes, consumers read
     std::atomic<int> _last_unblock_index_strong;
-    // Consumers read and write
-    std::vector<int> _last_unblock_index_weak;
-    // Only used if (UnblocksV<mode>)
+    // Consumers read and write, one slot per thread, each on its own cache line
+    std::vector<notstd::padded<int>> _last_unblock_index_weak;
+    // Only used if (UnblocksV<mode> || IsTimerV<mode>)
     // Stores the last index passed to set / set_immediate
     // 
     // Producer writes and may read (IsProducerV<mode> || IsBothV<mode>) 
-    // Consumers may read (IsConsumerV<mode> || IsBothV<mode>)
+    // Consumers may read (IsConsumerV<mode> || IsBothV<mode> || IsTimerV<mode>)
     std::atomic<int> _current_index;
     // Only used if (RequiresLockV<mode>): changing the step unblocks consumers, and
     // consumers are allowed to change the step
@@ -144,11 +163,31 @@ private:
     std::mutex _step_m;
     // Producer reads and may write (IsProducerV<mode> || IsBothV<mode>), consumers may read or write
     std::atomic<unsigned int> _step;
-    // Producer may read and may write (IsTimerV<mode>)
-    std::vector<std::chrono::time_point<std::chrono::steady_clock>> _sets_times;
+    // Upper bound of the step (number of values of the promise)
+    unsigned int _max_step;
+    // Consumers wait on _last_unblock_index_strong through this
+    Wait _wait;
+
+    // Only used if (IsTimerV<mode>)
+    // Consumers add, producer reads and resets every DSP_TUNE_PERIOD sets
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64> _lag_sets;
+    std::atomic<uint64> _lag_samples;
+    // Index each consumer waits for in get(), -1 if it doesn't wait. One slot per
+    // thread, sized with _last_unblock_index_weak
+    std::vector<notstd::padded<std::atomic<int>>> _waiting_index;
+    // Producer only
+    alignas(CACHE_LINE_SIZE) unsigned int _sets_since_tune;
+    std::chrono::steady_clock::time_point _last_tune;
+    uint64 _max_wait_ns;
+
+private:
+    inline void unblock(int index, std::memory_order order) {
+        _last_unblock_index_strong.store(index, order);
+        _wait.notify(_last_unblock_index_strong);
+    }
 
     inline void set_current_index(int index) {
-        if constexpr (UnblocksV<mode>) {
+        if constexpr (UnblocksV<mode> || IsTimerV<mode>) {
             if constexpr (IsProducerV<mode>) {
                 _current_index.store(index, std::memory_order_relaxed);
             } else {
@@ -159,32 +198,69 @@ private:
         }
     }
 
-    inline void add_time_and_change_step_if_necessary() {
-        if constexpr (!IsTimerV<mode>)
-            return;
+    void retune();
+};
 
-        auto now = std::chrono::steady_clock::now();
-        _sets_times.push_back(now);
-        auto const& origin = _sets_times.front();
+/**
+ * Wait is the policy used by get() to wait on the producer (see wait_policy.h).
+ *
+ * In TIMER modes the step is driven by the controller described above
+ * DSP_TUNE_PERIOD; the _no_timer flavours of set skip the controller.
+ */
+template<typename T, DynamicStepPromiseMode mode, typename Wait = SpinWait>
+class DynamicStepPromise : public PromisePlus<T> {
+public:
+    DynamicStepPromise(int nb_values, unsigned int start_step, uint64 max_wait_ns = DSP_DEFAULT_MAX_WAIT_NS);
 
-        auto diff = std::chrono::duration<double>(now - origin);
-        if (diff.count() >= 1.0) {
-            size_t n = _sets_times.size();
+    DynamicStepPromise(DynamicStepPromise<T, mode, Wait> const&) = delete;
+    DynamicStepPromise<T, mode, Wait>& operator=(DynamicStepPromise<T, mode, Wait> const&) = delete;
 
-            size_t nb_values_max = this->_values.size();
-            (void)nb_values_max;
+    T& get(int index);
 
-            // For now, use 1000 because we need to move on
-            // But we should definitely use the max amount of values to attempt
-            // to deduce the lower bound
-            if (n > 100)
-                set_step(get_step() * 2);
-            else
-                set_step(get_step() / 1.5);
+    void set(int index, const T& value);
+    void set(int index, T&& value);
 
-            _sets_times.clear();
-        }
-    }
+    void set_no_timer(int index, const T& value);
+    void set_no_timer(int index, T&& value);
+
+    void set_immediate(int index, const T& value);
+    void set_immediate(int index, T&& value);
+
+    void set_immediate_no_timer(int index, const T& value);
+    void set_immediate_no_timer(int index, T&& value);
+
+    friend PromisePlus<T>* DynamicStepPromiseBuilder<T, mode, Wait>::new_promise() const;
+
+    void set_step(unsigned int new_step) { _base.set_step(new_step); }
+    inline unsigned int get_step() const { return _base.get_step(); }
+    inline uint64 max_wait_ns() const { return _base._max_wait_ns; }
+
+private:
+    DynamicStepPromiseBase<mode, Wait> _base;
+};
+
+template<DynamicStepPromiseMode mode, typename Wait>
+class DynamicStepPromise<void, mode, Wait> : public PromisePlus<void> {
+public:
+    DynamicStepPromise(int nb_values, unsigned int start_step, uint64 max_wait_ns = DSP_DEFAULT_MAX_WAIT_NS);
+
+    DynamicStepPromise(DynamicStepPromise<void, mode, Wait> const&) = delete;
+    DynamicStepPromise<void, mode, Wait>& operator=(DynamicStepPromise<void, mode, Wait> const&) = delete;
+
+    void get(int index);
+    void set(int index);
+    void set_no_timer(int index);
+    void set_immediate(int index);
+    void set_immediate_no_timer(int index);
+
+    friend PromisePlus<void>* DynamicStepPromiseBuilder<void, mode, Wait>::new_promise() const;
+
+    void set_step(unsigned int new_step) { _base.set_step(new_step); }
+    inline unsigned int get_step() const { return _base.get_step(); }
+    inline uint64 max_wait_ns() const { return _base._max_wait_ns; }
+
+private:
+    DynamicStepPromiseBase<mode, Wait> _base;
 };
 
 #include "dynamic_step_promise/dynamic_step_promise.tpp"
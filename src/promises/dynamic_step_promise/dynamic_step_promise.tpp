@@ -1,129 +1,153 @@
+#include <algorithm>
 #include <utility>
 
 #include <omp.h>
 
-template<typename T, DynamicStepPromiseMode mode>
-DynamicStepPromiseBuilder<T, mode>::DynamicStepPromiseBuilder(int nb_values,
-    unsigned int start_step, unsigned int nb_threads) : _nb_values(nb_values),
-    _start_step(start_step), _n_threads(nb_threads) {
+template<typename T, DynamicStepPromiseMode mode, typename Wait>
+DynamicStepPromiseBuilder<T, mode, Wait>::DynamicStepPromiseBuilder(int nb_values,
+    unsigned int start_step, unsigned int nb_threads, uint64 max_wait_ns) : _nb_values(nb_values),
+    _start_step(start_step), _n_threads(nb_threads), _max_wait_ns(max_wait_ns) {
 
 }
 
-template<typename T, DynamicStepPromiseMode mode>
-PromisePlus<T>* DynamicStepPromiseBuilder<T, mode>::new_promise() const {
-    DynamicStepPromise<T, mode>* ptr = new DynamicStepPromise<T, mode>(_nb_values, _start_step);
-    ptr->_last_unblock_index_weak.resize(_n_threads, -1);
+template<typename T, DynamicStepPromiseMode mode, typename Wait>
+PromisePlus<T>* DynamicStepPromiseBuilder<T, mode, Wait>::new_promise() const {
+    DynamicStepPromise<T, mode, Wait>* ptr = new DynamicStepPromise<T, mode, Wait>(_nb_values, _start_step, _max_wait_ns);
+    ptr->_base.set_threads(_n_threads);
     return ptr;
 }
 
-template<typename T, DynamicStepPromiseMode mode>
-DynamicStepPromise<T, mode>::DynamicStepPromise(int nb_values, unsigned int start_step) : 
-    PromisePlus<T>(nb_values, -1),
+// -----------------------------------------------------------------------------
+// Base
+
+template<DynamicStepPromiseMode mode, typename Wait>
+DynamicStepPromiseBase<mode, Wait>::DynamicStepPromiseBase(unsigned int start_step, unsigned int max_step, uint64 max_wait_ns) :
     _last_unblock_index_strong(),
-    _last_unblock_index_weak() {
+    _last_unblock_index_weak(),
+    _max_step(max_step),
+    _sets_since_tune(0),
+    _max_wait_ns(max_wait_ns) {
     _step.store(start_step, std::memory_order_relaxed);
     _last_unblock_index_strong.store(-1, std::memory_order_relaxed);
-    if constexpr (UnblocksV<mode>) 
+    if constexpr (UnblocksV<mode> || IsTimerV<mode>) 
         _current_index.store(-1, std::memory_order_relaxed);
+    _lag_sets.store(0, std::memory_order_relaxed);
+    _lag_samples.store(0, std::memory_order_relaxed);
 }
 
-template<typename T, DynamicStepPromiseMode mode>
-T& DynamicStepPromise<T, mode>::get(int index) {
-    if (_last_unblock_index_weak[omp_get_thread_num()] < index) {
-        while ((_last_unblock_index_weak[omp_get_thread_num()] = _last_unblock_index_strong.load(std::memory_order_acquire)) < index)
-            ;
+template<DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromiseBase<mode, Wait>::set_threads(unsigned int n_threads) {
+    _last_unblock_index_weak.resize(n_threads, -1);
+    if constexpr (IsTimerV<mode>) {
+        _waiting_index = std::vector<notstd::padded<std::atomic<int>>>(n_threads);
+        for (auto& slot: _waiting_index)
+            slot.value.store(-1, std::memory_order_relaxed);
     }
-
-    return this->_values[index];
 }
 
-template<typename T, DynamicStepPromiseMode mode>
-void DynamicStepPromise<T, mode>::set(int index, const T& value) {
-    add_time_and_change_step_if_necessary();
-    set_no_timer(index, value);
-}
+template<DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromiseBase<mode, Wait>::wait_for(int index) {
+    int& weak = _last_unblock_index_weak[omp_get_thread_num()].value;
+    if (weak >= index)
+        return;
 
-template<typename T, DynamicStepPromiseMode mode>
-void DynamicStepPromise<T, mode>::set_no_timer(int index, const T& value) {
-    this->_values[index] = value;
+    auto ready = [index](int unblocked) { return unblocked >= index; };
 
-    set_current_index(index);
-    
-    {
-        std::unique_lock<std::mutex> lck;
-        if constexpr (RequiresLockV<mode>)
-            lck = std::move(std::unique_lock<std::mutex>(_step_m));
-
-        if (index - _last_unblock_index_strong.load(std::memory_order_acquire) >= get_step())
-            _last_unblock_index_strong.store(index, std::memory_order_release);
-    }
-}
+    if constexpr (IsTimerV<mode>) {
+        int unblocked = _last_unblock_index_strong.load(std::memory_order_acquire);
+        if (ready(unblocked)) {
+            weak = unblocked;
+            _lag_samples.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
 
-template<typename T, DynamicStepPromiseMode mode>
-void DynamicStepPromise<T, mode>::set(int index, T&& value) {
-    add_time_and_change_step_if_necessary();
-    set_no_timer(index, std::move(value));
-}
+        // The lag counts from the production of index, or from now if it was
+        // already produced
+        int from = std::max(index, _current_index.load(std::memory_order_relaxed));
+        std::atomic<int>& waiting = _waiting_index[omp_get_thread_num()].value;
+        waiting.store(index, std::memory_order_relaxed);
+        weak = _wait.wait(_last_unblock_index_strong, ready);
+        waiting.store(-1, std::memory_order_relaxed);
 
-template<typename T, DynamicStepPromiseMode mode>
-void DynamicStepPromise<T, mode>::set_no_timer(int index, T&& value) {
-    this->_values[index] = std::move(value);
+        _lag_sets.fetch_add(std::max(weak - from, 0), std::memory_order_relaxed);
+        _lag_samples.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        weak = _wait.wait(_last_unblock_index_strong, ready);
+    }
+}
 
+template<DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromiseBase<mode, Wait>::publish(int index) {
     set_current_index(index);
 
-    {
-        std::unique_lock<std::mutex> lck;
-        if constexpr (RequiresLockV<mode>)
-            lck = std::move(std::unique_lock<std::mutex>(_step_m));
-
-        if (index - _last_unblock_index_strong.load(std::memory_order_acquire) >= get_step())
-            _last_unblock_index_strong.store(index, std::memory_order_release);
-    }
+    std::unique_lock<std::mutex> lck;
+    if constexpr (RequiresLockV<mode>)
+        lck = std::unique_lock<std::mutex>(_step_m);
 
+    if (index - _last_unblock_index_strong.load(std::memory_order_acquire) >= get_step())
+        unblock(index, std::memory_order_release);
 }
 
-template<typename T, DynamicStepPromiseMode mode>
-void DynamicStepPromise<T, mode>::set_immediate(int index, const T& value) {
-    add_time_and_change_step_if_necessary();
-    set_immediate_no_timer(index, value);
-}
-
-template<typename T, DynamicStepPromiseMode mode>
-void DynamicStepPromise<T, mode>::set_immediate_no_timer(int index, const T& value) {
-    this->_values[index] = value;
+template<DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromiseBase<mode, Wait>::publish_immediate(int index) {
+    std::unique_lock<std::mutex> lck;
+    if constexpr (RequiresLockV<mode>)
+        lck = std::unique_lock<std::mutex>(_step_m);
 
-    {
-        std::unique_lock<std::mutex> lck;
-        if constexpr (RequiresLockV<mode>)
-            lck = std::move(std::unique_lock<std::mutex>(_step_m));
+    set_current_index(index);
+    unblock(index, std::memory_order_release);
+}
 
-        set_current_index(index);
-        _last_unblock_index_strong.store(index, std::memory_order_release);
+template<DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromiseBase<mode, Wait>::tick() {
+    if constexpr (IsTimerV<mode>) {
+        if (++_sets_since_tune >= DSP_TUNE_PERIOD) {
+            _sets_since_tune = 0;
+            retune();
+        }
     }
 }
 
-template<typename T, DynamicStepPromiseMode mode>
-void DynamicStepPromise<T, mode>::set_immediate(int index, T&& value) {
-    add_time_and_change_step_if_necessary();
-    set_immediate_no_timer(index, std::move(value));
-}
+template<DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromiseBase<mode, Wait>::retune() {
+    auto now = std::chrono::steady_clock::now();
+    auto last = _last_tune;
+    _last_tune = now;
+    uint64 lag = _lag_sets.exchange(0, std::memory_order_relaxed);
+    uint64 samples = _lag_samples.exchange(0, std::memory_order_relaxed);
+    // The first window only measures the rate of the sets
+    if (last == std::chrono::steady_clock::time_point())
+        return;
 
-template<typename T, DynamicStepPromiseMode mode>
-void DynamicStepPromise<T, mode>::set_immediate_no_timer(int index, T&& value) {
-    this->_values[index] = std::move(value);
+    // Consumers still waiting lag behind since they started
+    int current = _current_index.load(std::memory_order_relaxed);
+    for (auto& slot: _waiting_index) {
+        int waiting = slot.value.load(std::memory_order_relaxed);
+        if (waiting >= 0 && waiting <= current) {
+            lag += current - waiting;
+            samples++;
+        }
+    }
 
-    {
-        std::unique_lock<std::mutex> lck;
-        if constexpr (RequiresLockV<mode>)
-            lck = std::move(std::unique_lock<std::mutex>(_step_m));
+    // Nobody asked for a value: nothing says whether the step is right
+    if (samples == 0)
+        return;
 
-        set_current_index(index);
-        _last_unblock_index_strong.store(index, std::memory_order_release);
+    double ns_per_set = std::chrono::duration<double, std::nano>(now - last).count() / DSP_TUNE_PERIOD;
+    double average = lag * ns_per_set / samples;
+    // A consumer waiting for the next publish lags half a step on average: past
+    // this step, one that catches up waits longer than the bound
+    double bounded = 2.0 * _max_wait_ns / ns_per_set;
+    unsigned int step = get_step();
+    if (average > _max_wait_ns) {
+        set_step(std::min<double>(step / 2, bounded));
+    } else if (average < _max_wait_ns / 4 && step < bounded) {
+        set_step(std::min<double>(step + step / 4 + 1, bounded));
     }
 }
 
-template<typename T, DynamicStepPromiseMode mode>
-void DynamicStepPromise<T, mode>::set_step(unsigned int new_step) {
+template<DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromiseBase<mode, Wait>::set_step(unsigned int new_step) {
     /* if constexpr (!CanSetStepV<mode>) {
         return;
     } */
@@ -134,31 +158,31 @@ void DynamicStepPromise<T, mode>::set_step(unsigned int new_step) {
     if (new_step == 0)
         new_step = 1;
 
-    if (new_step >= this->_values.size())
-        new_step = this->_values.size();
+    if (new_step >= _max_step)
+        new_step = _max_step;
 
     if (new_step == get_step()) {
         return;
     }
 
-
-
     if constexpr (UnblocksV<mode>) {
         if constexpr (RequiresLockV<mode>) {
             std::unique_lock<std::mutex> lck(_step_m);
 
             if (new_step < _step.load(std::memory_order_relaxed)) {
                 if (_current_index.load(std::memory_order_acquire) - _last_unblock_index_strong.load(std::memory_order_acquire) >= new_step) {
-                    _last_unblock_index_strong.store(_current_index.load(std::memory_order_acquire), std::memory_order_release);
+                    unblock(_current_index.load(std::memory_order_acquire), std::memory_order_release);
                 }
             }
 
             _step.store(new_step, std::memory_order_relaxed); // Mutex unblock at end of CS voids the need of release
         } else {
             if (new_step < _step.load(std::memory_order_relaxed)) {
-                int current_index = _current_index.load(std::memory_order_relaxed);
+                // Acquire / release so that consumers unblocked here see the
+                // values written by the producer up to current_index
+                int current_index = _current_index.load(std::memory_order_acquire);
                 if (current_index - _last_unblock_index_strong.load(std::memory_order_relaxed) >= new_step) {
-                    _last_unblock_index_strong.store(current_index, std::memory_order_relaxed);
+                    unblock(current_index, std::memory_order_release);
                 }
             }
 
@@ -172,3 +196,104 @@ void DynamicStepPromise<T, mode>::set_step(unsigned int new_step) {
         }
     }
 }
+
+// -----------------------------------------------------------------------------
+// DynamicStepPromise<T>
+
+template<typename T, DynamicStepPromiseMode mode, typename Wait>
+DynamicStepPromise<T, mode, Wait>::DynamicStepPromise(int nb_values, unsigned int start_step, uint64 max_wait_ns) : 
+    PromisePlus<T>(nb_values, -1),
+    _base(start_step, nb_values, max_wait_ns) {
+
+}
+
+template<typename T, DynamicStepPromiseMode mode, typename Wait>
+T& DynamicStepPromise<T, mode, Wait>::get(int index) {
+    _base.wait_for(index);
+    return this->_values[index];
+}
+
+template<typename T, DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromise<T, mode, Wait>::set(int index, const T& value) {
+    _base.tick();
+    set_no_timer(index, value);
+}
+
+template<typename T, DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromise<T, mode, Wait>::set_no_timer(int index, const T& value) {
+    this->_values[index] = value;
+    _base.publish(index);
+}
+
+template<typename T, DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromise<T, mode, Wait>::set(int index, T&& value) {
+    _base.tick();
+    set_no_timer(index, std::move(value));
+}
+
+template<typename T, DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromise<T, mode, Wait>::set_no_timer(int index, T&& value) {
+    this->_values[index] = std::move(value);
+    _base.publish(index);
+}
+
+template<typename T, DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromise<T, mode, Wait>::set_immediate(int index, const T& value) {
+    _base.tick();
+    set_immediate_no_timer(index, value);
+}
+
+template<typename T, DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromise<T, mode, Wait>::set_immediate_no_timer(int index, const T& value) {
+    this->_values[index] = value;
+    _base.publish_immediate(index);
+}
+
+template<typename T, DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromise<T, mode, Wait>::set_immediate(int index, T&& value) {
+    _base.tick();
+    set_immediate_no_timer(index, std::move(value));
+}
+
+template<typename T, DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromise<T, mode, Wait>::set_immediate_no_timer(int index, T&& value) {
+    this->_values[index] = std::move(value);
+    _base.publish_immediate(index);
+}
+
+// -----------------------------------------------------------------------------
+// DynamicStepPromise<void>
+
+template<DynamicStepPromiseMode mode, typename Wait>
+DynamicStepPromise<void, mode, Wait>::DynamicStepPromise(int nb_values, unsigned int start_step, uint64 max_wait_ns) :
+    PromisePlus<void>(-1),
+    _base(start_step, nb_values, max_wait_ns) {
+
+}
+
+template<DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromise<void, mode, Wait>::get(int index) {
+    _base.wait_for(index);
+}
+
+template<DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromise<void, mode, Wait>::set(int index) {
+    _base.tick();
+    set_no_timer(index);
+}
+
+template<DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromise<void, mode, Wait>::set_no_timer(int index) {
+    _base.publish(index);
+}
+
+template<DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromise<void, mode, Wait>::set_immediate(int index) {
+    _base.tick();
+    set_immediate_no_timer(index);
+}
+
+template<DynamicStepPromiseMode mode, typename Wait>
+void DynamicStepPromise<void, mode, Wait>::set_immediate_no_timer(int index) {
+    _base.publish_immediate(index);
+}
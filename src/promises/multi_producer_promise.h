@@ -0,0 +1,137 @@
+#ifndef MULTI_PRODUCER_PROMISE_H
+#define MULTI_PRODUCER_PROMISE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "promise_plus.h"
+#include "promises/wait_policy.h"
+#include "utils.h"
+
+/**
+ * State of a promise that several producers fill concurrently, each index being
+ * set exactly once but in any order.
+ *
+ * Completed indices are recorded in a bitmap (64 indices per atomic word).
+ * The watermark is the last index of the longest completed prefix: every
+ * index <= watermark has been set. After marking its bits, a producer scans the
+ * bitmap from the watermark and pushes it forward with a CAS. All bitmap
+ * accesses are sequentially consistent, so when two producers fill adjacent
+ * holes concurrently at least one of them sees both and advances the watermark.
+ *
+ * Consumers only ever look at the watermark, like with the single producer
+ * promises. A consumer that waits for index i is released once all of
+ * [0, i] has been produced.
+ */
+struct MultiProducerPromiseBase : public PromisePlusAbstractReadyCheck {
+    MultiProducerPromiseBase(int nb_values);
+
+    std::unique_ptr<std::atomic<uint64_t>[]> _words;
+    int _nb_words;
+    int _nb_values;
+
+    // Last index of the completed prefix, -1 if index 0 is not set yet
+    std::atomic<int> _watermark;
+    // Consumers read and write, one slot per thread, each on its own cache line
+    std::vector<notstd::padded<int>> _watermark_weak;
+
+    // Strong: has index been set, even if the watermark hasn't reached it
+    // yet (used to detect double sets). Weak: has the watermark, as last seen
+    // by this thread, reached index.
+    bool ready_index_strong(int index) final;
+    bool ready_index_weak(int index) final;
+
+    int index_strong() final { return _watermark.load(std::memory_order_acquire); }
+    int index_weak() final;
+
+    // Record [begin, end) as set
+    void mark(int begin, int end);
+    // Move the watermark as far as the bitmap allows. Returns true if it moved.
+    bool advance();
+
+private:
+    // First index >= from that has not been set, _nb_values if none
+    int first_missing(int from) const;
+};
+
+/**
+ * Promise with several producers completing disjoint indices (or ranges of
+ * indices, see MultiProducerPromise<void>::set_range) out of order. get(i)
+ * returns once every index up to i has been set.
+ *
+ * Unlike the step promises there is no notion of step: publication happens
+ * as soon as the ready prefix grows. Wait is the policy used by get() to wait
+ * on the watermark (see wait_policy.h).
+ */
+template<typename T, typename Wait = SpinWait>
+class MultiProducerPromise : public PromisePlus<T> {
+public:
+    MultiProducerPromise(int nb_values);
+
+    NO_COPY_T2(MultiProducerPromise, T, Wait);
+
+    T& get(int index);
+    void set(int index, const T& value);
+    void set(int index, T&& value);
+    void set_immediate(int index, const T& value);
+    void set_immediate(int index, T&& value);
+
+    inline int ready_prefix() const { return _base._watermark.load(std::memory_order_acquire); }
+
+    template<typename, typename>
+    friend class MultiProducerPromiseBuilder;
+
+private:
+    void publish(int begin, int end);
+
+    MultiProducerPromiseBase _base;
+    Wait _wait;
+};
+
+template<typename Wait>
+class MultiProducerPromise<void, Wait> : public PromisePlus<void> {
+public:
+    MultiProducerPromise(int nb_values);
+
+    NO_COPY_T2(MultiProducerPromise, void, Wait);
+
+    void get(int index);
+    void set(int index);
+    void set_immediate(int index);
+    // Mark every index of [begin, end) as set at once. Ranges given by
+    // different producers must be disjoint.
+    void set_range(int begin, int end);
+
+    inline int ready_prefix() const { return _base._watermark.load(std::memory_order_acquire); }
+
+    template<typename, typename>
+    friend class MultiProducerPromiseBuilder;
+
+private:
+    void publish(int begin, int end);
+
+    MultiProducerPromiseBase _base;
+    Wait _wait;
+};
+
+template<typename T, typename Wait = SpinWait>
+class MultiProducerPromiseBuilder : public PromisePlusBuilder<T> {
+public:
+    MultiProducerPromiseBuilder(int nb_values, unsigned int n_threads) : _nb_values(nb_values), _n_threads(n_threads) { }
+
+    PromisePlus<T>* new_promise() const {
+        MultiProducerPromise<T, Wait>* ptr = new MultiProducerPromise<T, Wait>(_nb_values);
+        ptr->_base._watermark_weak.resize(_n_threads, -1);
+        return ptr;
+    }
+
+private:
+    int _nb_values;
+    unsigned int _n_threads;
+};
+
+#include "multi_producer_promise/multi_producer_promise.tpp"
+
+#endif // MULTI_PRODUCER_PROMISE_H
@@ -0,0 +1,73 @@
+#include <algorithm>
+
+#include <omp.h>
+
+#include "promises/multi_producer_promise.h"
+
+static inline int word_of(int index) { return index >> 6; }
+static inline uint64_t mask_of(int index) { return uint64_t(1) << (index & 63); }
+
+// -----------------------------------------------------------------------------
+// Base
+
+MultiProducerPromiseBase::MultiProducerPromiseBase(int nb_values) : _nb_values(nb_values) {
+    _nb_words = (nb_values + 63) / 64;
+    _words = std::make_unique<std::atomic<uint64_t>[]>(_nb_words);
+    for (int i = 0; i < _nb_words; ++i)
+        _words[i].store(0, std::memory_order_relaxed);
+    _watermark.store(-1, std::memory_order_relaxed);
+}
+
+bool MultiProducerPromiseBase::ready_index_strong(int index) {
+    return _words[word_of(index)].load(std::memory_order_acquire) & mask_of(index);
+}
+
+bool MultiProducerPromiseBase::ready_index_weak(int index) {
+    return _watermark_weak[omp_get_thread_num()].value >= index;
+}
+
+int MultiProducerPromiseBase::index_weak() {
+    return _watermark_weak[omp_get_thread_num()].value;
+}
+
+void MultiProducerPromiseBase::mark(int begin, int end) {
+    while (begin < end) {
+        int word = word_of(begin);
+        int last = std::min(end, (word + 1) * 64);
+        // Bits [begin % 64, last - begin + begin % 64) of the word
+        int width = last - begin;
+        uint64_t bits = width == 64 ? ~uint64_t(0) : ((uint64_t(1) << width) - 1) << (begin & 63);
+        _words[word].fetch_or(bits, std::memory_order_seq_cst);
+        begin = last;
+    }
+}
+
+int MultiProducerPromiseBase::first_missing(int from) const {
+    if (from >= _nb_values)
+        return _nb_values;
+
+    int word = word_of(from);
+    // Indices below from are known to be set
+    uint64_t bits = _words[word].load(std::memory_order_seq_cst) | (mask_of(from) - 1);
+    while (bits == ~uint64_t(0)) {
+        if (++word >= _nb_words)
+            return _nb_values;
+        bits = _words[word].load(std::memory_order_seq_cst);
+    }
+
+    return std::min(_nb_values, word * 64 + __builtin_ctzll(~bits));
+}
+
+bool MultiProducerPromiseBase::advance() {
+    int current = _watermark.load(std::memory_order_seq_cst);
+    for (;;) {
+        int next = first_missing(current + 1) - 1;
+        if (next <= current)
+            return false;
+
+        // On failure current is reloaded: someone else moved the watermark,
+        // rescan from there in case our indices extend it further.
+        if (_watermark.compare_exchange_weak(current, next, std::memory_order_seq_cst))
+            return true;
+    }
+}
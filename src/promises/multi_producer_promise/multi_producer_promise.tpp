@@ -0,0 +1,92 @@
+#include <utility>
+
+#include <omp.h>
+
+template<typename T, typename Wait>
+MultiProducerPromise<T, Wait>::MultiProducerPromise(int nb_values) :
+    PromisePlus<T>(nb_values, nb_values), _base(nb_values) {
+
+}
+
+template<typename T, typename Wait>
+T& MultiProducerPromise<T, Wait>::get(int index) {
+    if (!_base.ready_index_weak(index)) {
+        _base._watermark_weak[omp_get_thread_num()].value =
+            _wait.wait(_base._watermark, [index](int watermark) { return watermark >= index; });
+    }
+
+    return this->_values[index];
+}
+
+template<typename T, typename Wait>
+void MultiProducerPromise<T, Wait>::set(int index, const T& value) {
+    _base.assert_free_index_strong(index);
+    this->_values[index] = value;
+    publish(index, index + 1);
+}
+
+template<typename T, typename Wait>
+void MultiProducerPromise<T, Wait>::set(int index, T&& value) {
+    _base.assert_free_index_strong(index);
+    this->_values[index] = std::move(value);
+    publish(index, index + 1);
+}
+
+template<typename T, typename Wait>
+void MultiProducerPromise<T, Wait>::set_immediate(int index, const T& value) {
+    this->_values[index] = value;
+    publish(index, index + 1);
+}
+
+template<typename T, typename Wait>
+void MultiProducerPromise<T, Wait>::set_immediate(int index, T&& value) {
+    this->_values[index] = std::move(value);
+    publish(index, index + 1);
+}
+
+template<typename T, typename Wait>
+void MultiProducerPromise<T, Wait>::publish(int begin, int end) {
+    _base.mark(begin, end);
+    if (_base.advance())
+        _wait.notify(_base._watermark);
+}
+
+// -----------------------------------------------------------------------------
+// MultiProducerPromise<void>
+
+template<typename Wait>
+MultiProducerPromise<void, Wait>::MultiProducerPromise(int nb_values) :
+    PromisePlus<void>(nb_values), _base(nb_values) {
+
+}
+
+template<typename Wait>
+void MultiProducerPromise<void, Wait>::get(int index) {
+    if (!_base.ready_index_weak(index)) {
+        _base._watermark_weak[omp_get_thread_num()].value =
+            _wait.wait(_base._watermark, [index](int watermark) { return watermark >= index; });
+    }
+}
+
+template<typename Wait>
+void MultiProducerPromise<void, Wait>::set(int index) {
+    _base.assert_free_index_strong(index);
+    publish(index, index + 1);
+}
+
+template<typename Wait>
+void MultiProducerPromise<void, Wait>::set_immediate(int index) {
+    publish(index, index + 1);
+}
+
+template<typename Wait>
+void MultiProducerPromise<void, Wait>::set_range(int begin, int end) {
+    publish(begin, end);
+}
+
+template<typename Wait>
+void MultiProducerPromise<void, Wait>::publish(int begin, int end) {
+    _base.mark(begin, end);
+    if (_base.advance())
+        _wait.notify(_base._watermark);
+}
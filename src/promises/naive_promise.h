@@ -7,6 +7,7 @@
 #include <mutex>
 
 #include "promise_plus.h"
+#include "promises/wait_policy.h"
 #include "utils.h"
 
 #ifndef NDEBUG
@@ -47,12 +48,15 @@ struct PassiveNaivePromiseBase : public PromisePlusAbstractReadyCheck {
     int index_weak() final { return -1; }
 };
 
-template<typename T>
+/**
+ * Wait is the policy used by get() to wait on the producer (see wait_policy.h).
+ */
+template<typename T, typename Wait = SpinWait>
 class ActiveNaivePromise : public PromisePlus<T> {
 public:
     ActiveNaivePromise(int nb_values);
 
-    NO_COPY_T(ActiveNaivePromise, T);
+    NO_COPY_T2(ActiveNaivePromise, T, Wait);
 
     T& get(int index);
     void set(int index, const T& value);
@@ -65,6 +69,7 @@ private:
     void set_maybe_check(int index, T&& value, bool check);
 
     ActiveNaivePromiseBase _base;
+    Wait _wait;
 };
 
 template<typename T>
@@ -87,12 +92,12 @@ private:
     PassiveNaivePromiseBase _base;
 };
 
-template<>
-class ActiveNaivePromise<void> : public PromisePlus<void> {
+template<typename Wait>
+class ActiveNaivePromise<void, Wait> : public PromisePlus<void> {
 public:
     ActiveNaivePromise(int nb_values);
 
-    NO_COPY_T(ActiveNaivePromise, void);
+    NO_COPY_T2(ActiveNaivePromise, void, Wait);
 
     void get(int index);
     void set(int index);
@@ -102,6 +107,7 @@ private:
     void set_maybe_check(int index, bool check);
 
     ActiveNaivePromiseBase _base;
+    Wait _wait;
 };
 
 template<>
@@ -121,21 +127,21 @@ private:
     PassiveNaivePromiseBase _base;
 };
 
-template<typename T>
+template<typename T, typename Wait = SpinWait>
 class NaivePromiseBuilder : public PromisePlusBuilder<T> {
 public:
     NaivePromiseBuilder(int nb_values);
 
     PromisePlus<T>* new_promise() const {
-        return new ActiveNaivePromise<T>(_nb_values);
+        return new ActiveNaivePromise<T, Wait>(_nb_values);
     }
 
 private:
     int _nb_values;
 };
 
-template<typename T>
-NaivePromiseBuilder<T>::NaivePromiseBuilder(int nb_values) : 
+template<typename T, typename Wait>
+NaivePromiseBuilder<T, Wait>::NaivePromiseBuilder(int nb_values) : 
 _nb_values(nb_values) {
 
 }
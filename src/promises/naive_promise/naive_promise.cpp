@@ -40,10 +40,6 @@ PassiveNaivePromise<void>::PassiveNaivePromise(int nb_values) : PromisePlus<void
 
 }
 
-ActiveNaivePromise<void>::ActiveNaivePromise(int nb_values) : PromisePlus<void>(nb_values), _base(nb_values) {
-
-}
-
 void PassiveNaivePromise<void>::get(int index) {
     if (!_base.ready_index_strong(index)) {
         std::unique_lock<std::mutex> lck(_base._wait[index].first);
@@ -52,13 +48,6 @@ void PassiveNaivePromise<void>::get(int index) {
     }
 }
 
-void ActiveNaivePromise<void>::get(int index) {
-    if (!_base.ready_index_strong(index)) {
-        while (!_base._ready[index].load(std::memory_order_acquire))
-            ;
-    }
-}
-
 void PassiveNaivePromise<void>::set(int index) {
     set_maybe_check(index, true);
 }
@@ -67,14 +56,6 @@ void PassiveNaivePromise<void>::set_immediate(int index) {
     set_maybe_check(index, false);
 }
 
-void ActiveNaivePromise<void>::set(int index) {
-    set_maybe_check(index, true);
-}
-
-void ActiveNaivePromise<void>::set_immediate(int index) {
-    set_maybe_check(index, false);
-}
-
 void PassiveNaivePromise<void>::set_maybe_check(int index, bool check) {
     std::unique_lock<NaiveSetMutex> lock_s(_base._common._set_m[index]);
 
@@ -85,12 +66,3 @@ void PassiveNaivePromise<void>::set_maybe_check(int index, bool check) {
     _base._ready[index] = true;
     _base._wait[index].second.notify_all();
 }
-
-void ActiveNaivePromise<void>::set_maybe_check(int index, bool check) {
-    std::unique_lock<NaiveSetMutex> lock_s(_base._common._set_m[index]);
-
-    if (check)
-        _base.assert_free_index_strong(index);
-
-    _base._ready[index].store(true, std::memory_order_release);
-}
\ No newline at end of file
@@ -8,8 +8,8 @@ PassiveNaivePromise<T>::PassiveNaivePromise(int nb_values) :
     
 }
 
-template<typename T>
-ActiveNaivePromise<T>::ActiveNaivePromise(int nb_values) :
+template<typename T, typename Wait>
+ActiveNaivePromise<T, Wait>::ActiveNaivePromise(int nb_values) :
     PromisePlus<T>(nb_values), _base(nb_values) {
     
 }
@@ -25,12 +25,10 @@ T& PassiveNaivePromise<T>::get(int index) {
     return this->_values[index];
 }
 
-template<typename T>
-T& ActiveNaivePromise<T>::get(int index) {
-    if (!_base.ready_index_strong(index)) {
-        while (!_base._ready[index].load(std::memory_order_acquire))
-            ;
-    }
+template<typename T, typename Wait>
+T& ActiveNaivePromise<T, Wait>::get(int index) {
+    if (!_base.ready_index_strong(index))
+        _wait.wait(_base._ready[index], [](bool ready) { return ready; });
 
     return this->_values[index];
 }
@@ -55,23 +53,23 @@ void PassiveNaivePromise<T>::set_immediate(int index, T&& value) {
     set_maybe_check(index, std::move(value), false);
 }
 
-template<typename T>
-void ActiveNaivePromise<T>::set(int index, const T& value) {
+template<typename T, typename Wait>
+void ActiveNaivePromise<T, Wait>::set(int index, const T& value) {
     set_maybe_check(index, value, true);
 }
 
-template<typename T>
-void ActiveNaivePromise<T>::set(int index, T&& value) {
+template<typename T, typename Wait>
+void ActiveNaivePromise<T, Wait>::set(int index, T&& value) {
     set_maybe_check(index, std::move(value), true);
 }
 
-template<typename T>
-void ActiveNaivePromise<T>::set_immediate(int index, const T& value) {
+template<typename T, typename Wait>
+void ActiveNaivePromise<T, Wait>::set_immediate(int index, const T& value) {
     set_maybe_check(index, value, false);
 }
 
-template<typename T>
-void ActiveNaivePromise<T>::set_immediate(int index, T&& value) {
+template<typename T, typename Wait>
+void ActiveNaivePromise<T, Wait>::set_immediate(int index, T&& value) {
     set_maybe_check(index, std::move(value), false);
 }
 
@@ -101,8 +99,8 @@ void PassiveNaivePromise<T>::set_maybe_check(int index, T&& value, bool check) {
     _base._wait[index].second.notify_all();
 }
 
-template<typename T>
-void ActiveNaivePromise<T>::set_maybe_check(int index, T const& value, bool check) {
+template<typename T, typename Wait>
+void ActiveNaivePromise<T, Wait>::set_maybe_check(int index, T const& value, bool check) {
     std::unique_lock<NaiveSetMutex> lock_s(_base._common._set_m[index]);
 
     if (check)
@@ -110,10 +108,11 @@ void ActiveNaivePromise<T>::set_maybe_check(int index, T const& value, bool chec
 
     this->_values[index] = value;
     _base._ready[index].store(true, std::memory_order_release);
+    _wait.notify(_base._ready[index]);
 }
 
-template<typename T>
-void ActiveNaivePromise<T>::set_maybe_check(int index, T&& value, bool check) {
+template<typename T, typename Wait>
+void ActiveNaivePromise<T, Wait>::set_maybe_check(int index, T&& value, bool check) {
     std::unique_lock<NaiveSetMutex> lock_s(_base._common._set_m[index]);
 
     if (check)
@@ -121,4 +120,40 @@ void ActiveNaivePromise<T>::set_maybe_check(int index, T&& value, bool check) {
 
     this->_values[index] = std::move(value);
     _base._ready[index].store(true, std::memory_order_release);
-}
\ No newline at end of file
+    _wait.notify(_base._ready[index]);
+}
+
+// -----------------------------------------------------------------------------
+// NaivePromise<void>
+
+template<typename Wait>
+ActiveNaivePromise<void, Wait>::ActiveNaivePromise(int nb_values) : PromisePlus<void>(nb_values), _base(nb_values) {
+
+}
+
+template<typename Wait>
+void ActiveNaivePromise<void, Wait>::get(int index) {
+    if (!_base.ready_index_strong(index))
+        _wait.wait(_base._ready[index], [](bool ready) { return ready; });
+}
+
+template<typename Wait>
+void ActiveNaivePromise<void, Wait>::set(int index) {
+    set_maybe_check(index, true);
+}
+
+template<typename Wait>
+void ActiveNaivePromise<void, Wait>::set_immediate(int index) {
+    set_maybe_check(index, false);
+}
+
+template<typename Wait>
+void ActiveNaivePromise<void, Wait>::set_maybe_check(int index, bool check) {
+    std::unique_lock<NaiveSetMutex> lock_s(_base._common._set_m[index]);
+
+    if (check)
+        _base.assert_free_index_strong(index);
+
+    _base._ready[index].store(true, std::memory_order_release);
+    _wait.notify(_base._ready[index]);
+}
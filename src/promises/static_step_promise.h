@@ -11,6 +11,7 @@
 #include <vector>
 
 #include "promise_plus.h"
+#include "promises/wait_policy.h"
 #include "utils.h"
 
 #ifndef NDEBUG
@@ -19,7 +20,7 @@
     using StaticStepSetMutex = std::mutex;
 #endif
 
-template<typename T>
+template<typename T, typename Wait = SpinWait>
 class StaticStepPromiseBuilder : public PromisePlusBuilder<T> {
 public:
     StaticStepPromiseBuilder(int, unsigned int, unsigned int, unsigned int);
@@ -32,6 +33,7 @@ private:
     unsigned int _n_threads;
 };
 
+template<typename Wait = SpinWait>
 class VoidStaticStepPromiseBuilder : public PromisePlusBuilder<void> {
 public:
     VoidStaticStepPromiseBuilder(unsigned int, unsigned int, unsigned int);
@@ -49,7 +51,8 @@ struct StaticStepPromiseCommonBase {
     StaticStepSetMutex  _set_m;
     const unsigned int  _step;
 
-    std::vector<int>    _current_index_weak;
+    // One slot per thread, each on its own cache line
+    std::vector<notstd::padded<int>> _current_index_weak;
 
 #ifdef PROMISE_PLUS_DEBUG_COUNTERS
     uint64              _nb_wait_loops = 0;
@@ -70,7 +73,7 @@ struct ActiveStaticStepPromiseBase : public PromisePlusAbstractReadyCheck {
     bool ready_index_weak(int index) final;
 
     int index_strong() final { return _current_index_strong.load(std::memory_order_acquire); }
-    int index_weak() final { return _common._current_index_weak[omp_get_thread_num()]; }
+    int index_weak() final { return _common._current_index_weak[omp_get_thread_num()].value; }
 };
 
 struct PassiveStaticStepPromiseBase : public PromisePlusAbstractReadyCheck {
@@ -85,7 +88,7 @@ struct PassiveStaticStepPromiseBase : public PromisePlusAbstractReadyCheck {
     bool ready_index_weak(int index) final;
 
     int index_strong() final { std::unique_lock<std::mutex> lck(_index_m); return _current_index_strong; }
-    int index_weak() final { return _common._current_index_weak[omp_get_thread_num()]; }
+    int index_weak() final { return _common._current_index_weak[omp_get_thread_num()].value; }
 };
 
 /**
@@ -95,13 +98,15 @@ struct PassiveStaticStepPromiseBase : public PromisePlusAbstractReadyCheck {
  * 
  * Debug mode ensures that index are indeed received in increasing order. In release
  * mode not performing set()s in the right order will result in undefined behaviour.
+ *
+ * Wait is the policy used by get() to wait on the producer (see wait_policy.h).
  */
-template<typename T>
+template<typename T, typename Wait = SpinWait>
 class ActiveStaticStepPromise : public PromisePlus<T> {
 public:
     ActiveStaticStepPromise(int nb_values, unsigned int max_index, unsigned int step);
     
-    NO_COPY_T(ActiveStaticStepPromise, T);
+    NO_COPY_T2(ActiveStaticStepPromise, T, Wait);
 
     T& get(int index);
     void set(int index, const T& value);
@@ -109,18 +114,19 @@ public:
     void set_immediate(int index, const T& value);
     void set_immediate(int index, T&& value);
 
-    friend PromisePlus<T>* StaticStepPromiseBuilder<T>::new_promise() const;
+    friend PromisePlus<T>* StaticStepPromiseBuilder<T, Wait>::new_promise() const;
 
 private:
     ActiveStaticStepPromiseBase _base;
+    Wait _wait;
 };
 
-template<>
-class ActiveStaticStepPromise<void> : public PromisePlus<void> {
+template<typename Wait>
+class ActiveStaticStepPromise<void, Wait> : public PromisePlus<void> {
 public:
     ActiveStaticStepPromise(unsigned int max_index, unsigned int step);
     
-    NO_COPY_T(ActiveStaticStepPromise, void);
+    NO_COPY_T2(ActiveStaticStepPromise, void, Wait);
 
     void get(int index);
     void set(int index);
@@ -137,12 +143,18 @@ public:
     } */
 #endif
 
-    friend PromisePlus<void>* VoidStaticStepPromiseBuilder::new_promise() const;
+    friend PromisePlus<void>* VoidStaticStepPromiseBuilder<Wait>::new_promise() const;
 
 private:
     ActiveStaticStepPromiseBase _base;
+    Wait _wait;
 };
 
+/**
+ * Same as ActiveStaticStepPromise, but consumers always sleep on a condition
+ * variable. Does not take a waiting policy: use ActiveStaticStepPromise with
+ * SpinFutexWait to get a promise that spins before sleeping.
+ */
 template<typename T>
 class PassiveStaticStepPromise : public PromisePlus<T> {
 public:
@@ -156,7 +168,8 @@ public:
     void set_immediate(int index, const T& value);
     void set_immediate(int index, T&& value);
 
-    friend PromisePlus<T>* StaticStepPromiseBuilder<T>::new_promise() const;
+    template<typename, typename>
+    friend class StaticStepPromiseBuilder;
 
 private:
     PassiveStaticStepPromiseBase _base;
@@ -173,7 +186,8 @@ public:
     void set(int index);
     void set_immediate(int index);
 
-    friend PromisePlus<void>* VoidStaticStepPromiseBuilder::new_promise() const;
+    template<typename>
+    friend class VoidStaticStepPromiseBuilder;
 
 private:
     PassiveStaticStepPromiseBase _base;
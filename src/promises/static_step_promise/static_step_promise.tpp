@@ -1,7 +1,9 @@
 #include <utility>
 
-template<typename T>
-ActiveStaticStepPromise<T>::ActiveStaticStepPromise(int nb_values, unsigned int max_index, unsigned int step) : 
+#include <omp.h>
+
+template<typename T, typename Wait>
+ActiveStaticStepPromise<T, Wait>::ActiveStaticStepPromise(int nb_values, unsigned int max_index, unsigned int step) : 
     PromisePlus<T>(nb_values, max_index), _base(step) {
 }
 
@@ -11,15 +13,13 @@ PassiveStaticStepPromise<T>::PassiveStaticStepPromise(int nb_values, unsigned in
 
 }
 
-template<typename T>
-T& ActiveStaticStepPromise<T>::get(int index) {
+template<typename T, typename Wait>
+T& ActiveStaticStepPromise<T, Wait>::get(int index) {
     if (!_base.ready_index_weak(index)) {
-        int ready_index = _base._current_index_strong.load(std::memory_order_acquire);
-        while (ready_index < index)
-            ready_index = _base._current_index_strong.load(std::memory_order_acquire);
+        _wait.wait(_base._current_index_strong, [index](int ready_index) { return ready_index >= index; });
 
         // Not sure...
-        _base._common._current_index_weak[omp_get_thread_num()] = _base._current_index_strong.load(std::memory_order_acquire);
+        _base._common._current_index_weak[omp_get_thread_num()].value = _base._current_index_strong.load(std::memory_order_acquire);
     }
 
     return this->_values[index];
@@ -32,14 +32,14 @@ T& PassiveStaticStepPromise<T>::get(int index) {
         while (_base._current_index_strong > index)
             _base._index_c.wait(lck);
 
-        _base._common._current_index_weak[omp_get_thread_num()] = _base._current_index_strong;
+        _base._common._current_index_weak[omp_get_thread_num()].value = _base._current_index_strong;
     }
 
     return this->_values[index];
 }
 
-template<typename T>
-void ActiveStaticStepPromise<T>::set(int index, const T& value) {
+template<typename T, typename Wait>
+void ActiveStaticStepPromise<T, Wait>::set(int index, const T& value) {
     // std::unique_lock<StaticStepSetMutex> lck(_base._common._set_m);
 
     _base.assert_free_index_weak(index);
@@ -49,6 +49,7 @@ void ActiveStaticStepPromise<T>::set(int index, const T& value) {
     if (_base._common._step == 1 || (index - _base._current_index >= _base._common._step)) {
         _base._current_index = index;
         _base._current_index_strong.store(index, std::memory_order_release);
+        _wait.notify(_base._current_index_strong);
     }
 }
 
@@ -67,8 +68,8 @@ void PassiveStaticStepPromise<T>::set(int index, const T& value) {
     }
 }
 
-template<typename T>
-void ActiveStaticStepPromise<T>::set(int index, T&& value) {
+template<typename T, typename Wait>
+void ActiveStaticStepPromise<T, Wait>::set(int index, T&& value) {
     // std::unique_lock<StaticStepSetMutex> lck(_base._common._set_m);
 
     _base.assert_free_index_weak(index);
@@ -78,6 +79,7 @@ void ActiveStaticStepPromise<T>::set(int index, T&& value) {
     if (_base._common._step == 1 || (index - _base._current_index >= _base._common._step)) {
         _base._current_index = index;
         _base._current_index_strong.store(index, std::memory_order_release);
+        _wait.notify(_base._current_index_strong);
     }
 }
 
@@ -96,8 +98,8 @@ void PassiveStaticStepPromise<T>::set(int index, T&& value) {
     }
 }
 
-template<typename T>
-void ActiveStaticStepPromise<T>::set_immediate(int index, const T& value) {
+template<typename T, typename Wait>
+void ActiveStaticStepPromise<T, Wait>::set_immediate(int index, const T& value) {
     // std::unique_lock<StaticStepSetMutex> lck(_base._common._set_m);
 
     _base.assert_free_index_weak(index);
@@ -106,6 +108,7 @@ void ActiveStaticStepPromise<T>::set_immediate(int index, const T& value) {
     
     _base._current_index = index;
     _base._current_index_strong.store(index, std::memory_order_release);
+    _wait.notify(_base._current_index_strong);
 }
 
 template<typename T>
@@ -121,8 +124,8 @@ void PassiveStaticStepPromise<T>::set_immediate(int index, const T& value) {
     _base._index_c.notify_all();
 }
 
-template<typename T>
-void ActiveStaticStepPromise<T>::set_immediate(int index, T&& value) {
+template<typename T, typename Wait>
+void ActiveStaticStepPromise<T, Wait>::set_immediate(int index, T&& value) {
     // std::unique_lock<StaticStepSetMutex> lck(_base._common._set_m);
 
     _base.assert_free_index_weak(index);
@@ -130,6 +133,7 @@ void ActiveStaticStepPromise<T>::set_immediate(int index, T&& value) {
     this->_values[index] = std::move(value);
     
     _base._current_index_strong.store(index, std::memory_order_release);
+    _wait.notify(_base._current_index_strong);
 }
 
 template<typename T>
@@ -145,19 +149,104 @@ void PassiveStaticStepPromise<T>::set_immediate(int index, T&& value) {
     _base._index_c.notify_all();
 }
 
-template<typename T>
-StaticStepPromiseBuilder<T>::StaticStepPromiseBuilder(int nb_values, unsigned int max_index, unsigned int step, unsigned int n_threads) {
+template<typename T, typename Wait>
+StaticStepPromiseBuilder<T, Wait>::StaticStepPromiseBuilder(int nb_values, unsigned int max_index, unsigned int step, unsigned int n_threads) {
     _nb_values = nb_values;
     _max_index = max_index;
     _step = step;
     _n_threads = n_threads;
 }
 
-template<typename T>
-PromisePlus<T>* StaticStepPromiseBuilder<T>::new_promise() const {
-    ActiveStaticStepPromise<T>* ptr = new ActiveStaticStepPromise<T>(_nb_values, _max_index, _step);
+template<typename T, typename Wait>
+PromisePlus<T>* StaticStepPromiseBuilder<T, Wait>::new_promise() const {
+    ActiveStaticStepPromise<T, Wait>* ptr = new ActiveStaticStepPromise<T, Wait>(_nb_values, _max_index, _step);
     ptr->_base._common._current_index_weak.resize(_n_threads, -1);
     return ptr;
 }
 
 
+
+// -----------------------------------------------------------------------------
+// StaticStepPromise<void>
+
+template<typename Wait>
+ActiveStaticStepPromise<void, Wait>::ActiveStaticStepPromise(unsigned int max_index, unsigned int step) : 
+    PromisePlus<void>(max_index), _base(step) {
+#ifdef PROMISE_PLUS_DEBUG_COUNTERS
+    auto& times = _base._common._set_times;
+    times.resize(max_index, 0);
+#endif
+}
+
+template<typename Wait>
+void ActiveStaticStepPromise<void, Wait>::get(int index) {
+    if (!_base.ready_index_weak(index)) {
+#ifdef PROMISE_PLUS_DEBUG_COUNTERS
+        ++_base._common._nb_get_strong;
+#endif
+        _wait.wait(_base._current_index_strong, [this, index](int ready_index) {
+#ifdef PROMISE_PLUS_DEBUG_COUNTERS
+            if (ready_index < index)
+                ++_base._common._nb_wait_loops;
+#else
+            (void)this;
+#endif
+            return ready_index >= index;
+        });
+
+        _base._common._current_index_weak[omp_get_thread_num()].value = _base._current_index_strong.load(std::memory_order_acquire);
+    } 
+#ifdef PROMISE_PLUS_DEBUG_COUNTERS
+    else {
+        ++_base._common._nb_get_weak;
+    }
+#endif
+}
+
+template<typename Wait>
+void ActiveStaticStepPromise<void, Wait>::set(int index) {
+    // std::unique_lock<StaticStepSetMutex> lck(_base._common._set_m);
+#ifdef PROMISE_PLUS_DEBUG_COUNTERS
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+#endif
+
+    _base.assert_free_index_weak(index);
+
+    if (_base._common._step == 1 || (index - _base._current_index >= _base._common._step)) {
+        _base._current_index = index;
+        _base._current_index_strong.store(index, std::memory_order_release);
+        _wait.notify(_base._current_index_strong);
+    }
+
+#ifdef PROMISE_PLUS_DEBUG_COUNTERS
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    _base._common._set_times[index] = clock_diff(&end, &begin);
+#endif
+}
+
+template<typename Wait>
+void ActiveStaticStepPromise<void, Wait>::set_immediate(int index) {
+    // std::unique_lock<StaticStepSetMutex> lck(_base._common._set_m);
+
+    _base.assert_free_index_weak(index);
+
+    _base._current_index = index;
+    _base._current_index_strong.store(index, std::memory_order_release);
+    _wait.notify(_base._current_index_strong);
+    // _base._common._current_index_weak[omp_get_thread_num()].value = index;
+}
+
+template<typename Wait>
+VoidStaticStepPromiseBuilder<Wait>::VoidStaticStepPromiseBuilder(unsigned int max_index, unsigned int step, unsigned int n_threads) {
+    _max_index = max_index;
+    _step = step;
+    _n_threads = n_threads;
+}
+
+template<typename Wait>
+PromisePlus<void>* VoidStaticStepPromiseBuilder<Wait>::new_promise() const {
+    ActiveStaticStepPromise<void, Wait>* ptr = new ActiveStaticStepPromise<void, Wait>(_max_index, _step);
+    ptr->_base._common._current_index_weak.resize(_n_threads, -1);
+    return ptr;
+}
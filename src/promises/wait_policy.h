@@ -0,0 +1,232 @@
+#ifndef WAIT_POLICY_H
+#define WAIT_POLICY_H
+
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "utils.h"
+
+/**
+ * Waiting policies used by the PromisePlus implementations that publish their
+ * progress through an atomic (ActiveStaticStepPromise, DynamicStepPromise,
+ * ActiveNaivePromise, BitmapPromise).
+ *
+ * A policy exposes two operations:
+ *  - wait(atom, ready): block until ready(atom.load()) holds, return the value
+ *    that satisfied the predicate. Loads are acquire.
+ *  - notify(atom): called by producers right after they stored to atom. Only
+ *    policies that park threads do anything here.
+ *
+ * Policies may hold state (the adaptive spin budget), so promises store one
+ * instance per promise.
+ */
+
+namespace WaitPolicy {
+    inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        asm volatile("yield" ::: "memory");
+#endif
+    }
+
+    // Number of polls before SpinYield starts yielding the core.
+    constexpr unsigned int YIELD_AFTER = 128;
+
+    // Bounds of SpinFutex's adaptive spin budget, in polls.
+    constexpr unsigned int FUTEX_MIN_SPIN = 16;
+    constexpr unsigned int FUTEX_MAX_SPIN = 16384;
+    constexpr unsigned int FUTEX_START_SPIN = 1024;
+}
+
+/**
+ * Busy-wait on the atomic forever. Historical behaviour of the active promises.
+ */
+struct SpinWait {
+    template<typename U, typename Ready>
+    inline U wait(std::atomic<U>& atom, Ready&& ready) {
+        U value = atom.load(std::memory_order_acquire);
+        while (!ready(value))
+            value = atom.load(std::memory_order_acquire);
+        return value;
+    }
+
+    template<typename U>
+    inline void notify(std::atomic<U>&) { }
+};
+
+/**
+ * Busy-wait, issuing a pause instruction between polls. Lowers power usage and
+ * lets the sibling hyperthread progress.
+ */
+struct SpinPauseWait {
+    template<typename U, typename Ready>
+    inline U wait(std::atomic<U>& atom, Ready&& ready) {
+        U value = atom.load(std::memory_order_acquire);
+        while (!ready(value)) {
+            WaitPolicy::cpu_relax();
+            value = atom.load(std::memory_order_acquire);
+        }
+        return value;
+    }
+
+    template<typename U>
+    inline void notify(std::atomic<U>&) { }
+};
+
+/**
+ * Spin for a while, then yield the core between polls. Survives mild
+ * oversubscription without requiring anything from producers.
+ */
+struct SpinYieldWait {
+    template<typename U, typename Ready>
+    inline U wait(std::atomic<U>& atom, Ready&& ready) {
+        U value = atom.load(std::memory_order_acquire);
+        for (unsigned int i = 0; !ready(value); ++i) {
+            if (i < WaitPolicy::YIELD_AFTER)
+                WaitPolicy::cpu_relax();
+            else
+                std::this_thread::yield();
+            value = atom.load(std::memory_order_acquire);
+        }
+        return value;
+    }
+
+    template<typename U>
+    inline void notify(std::atomic<U>&) { }
+};
+
+/**
+ * Spin up to an adaptive budget, then sleep on the atomic (futex on Linux).
+ *
+ * The budget grows when waits complete while spinning and shrinks when threads
+ * end up sleeping, so it converges towards the typical wait length of the
+ * promise. Producers only pay for a wake-up syscall when someone is asleep.
+ */
+struct alignas(CACHE_LINE_SIZE) SpinFutexWait {
+    SpinFutexWait() : _budget(WaitPolicy::FUTEX_START_SPIN), _sleepers(0) { }
+    SpinFutexWait(SpinFutexWait const&) = delete;
+    SpinFutexWait& operator=(SpinFutexWait const&) = delete;
+
+    template<typename U, typename Ready>
+    inline U wait(std::atomic<U>& atom, Ready&& ready) {
+        U value = atom.load(std::memory_order_acquire);
+        if (ready(value))
+            return value;
+
+        unsigned int budget = _budget.load(std::memory_order_relaxed);
+        for (unsigned int i = 0; i < budget; ++i) {
+            WaitPolicy::cpu_relax();
+            value = atom.load(std::memory_order_acquire);
+            if (ready(value)) {
+                // Got it while spinning: allow a bit more spinning next time
+                _budget.store(std::min(WaitPolicy::FUTEX_MAX_SPIN, budget + budget / 8 + 1), std::memory_order_relaxed);
+                return value;
+            }
+        }
+
+        _budget.store(std::max(WaitPolicy::FUTEX_MIN_SPIN, budget / 2), std::memory_order_relaxed);
+
+        _sleepers.fetch_add(1, std::memory_order_seq_cst);
+        // Pairs with the fence in notify(): either the producer sees us as a
+        // sleeper, or we see its store before going to sleep.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        value = atom.load(std::memory_order_acquire);
+        while (!ready(value)) {
+            atom.wait(value, std::memory_order_acquire);
+            value = atom.load(std::memory_order_acquire);
+        }
+        _sleepers.fetch_sub(1, std::memory_order_relaxed);
+
+        return value;
+    }
+
+    template<typename U>
+    inline void notify(std::atomic<U>& atom) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_sleepers.load(std::memory_order_relaxed) != 0)
+            atom.notify_all();
+    }
+
+private:
+    std::atomic<unsigned int> _budget;
+    std::atomic<int> _sleepers;
+};
+
+enum class WaitPolicyKind {
+    SPIN,
+    SPIN_PAUSE,
+    SPIN_YIELD,
+    SPIN_FUTEX,
+};
+
+namespace WaitPolicy {
+    static const std::string spin("spin");
+    static const std::string spin_pause("spin_pause");
+    static const std::string spin_yield("spin_yield");
+    static const std::string spin_futex("spin_futex");
+
+    inline WaitPolicyKind from_string(std::string const& name) {
+        if (name == spin)
+            return WaitPolicyKind::SPIN;
+        else if (name == spin_pause)
+            return WaitPolicyKind::SPIN_PAUSE;
+        else if (name == spin_yield)
+            return WaitPolicyKind::SPIN_YIELD;
+        else if (name == spin_futex)
+            return WaitPolicyKind::SPIN_FUTEX;
+
+        std::ostringstream stream;
+        stream << "Waiting policy " << name << " is not valid" << std::endl;
+        stream << "Authorized waiting policies are: " << spin << ", " << spin_pause << ", " << spin_yield << ", " << spin_futex << std::endl;
+        throw std::runtime_error(stream.str());
+    }
+
+    inline const char* to_string(WaitPolicyKind kind) {
+        switch (kind) {
+        case WaitPolicyKind::SPIN:
+            return spin.c_str();
+        case WaitPolicyKind::SPIN_PAUSE:
+            return spin_pause.c_str();
+        case WaitPolicyKind::SPIN_YIELD:
+            return spin_yield.c_str();
+        case WaitPolicyKind::SPIN_FUTEX:
+            return spin_futex.c_str();
+        }
+
+        return "unknown";
+    }
+
+    template<typename W>
+    struct Tag { using type = W; };
+
+    /**
+     * Call f with a Tag<Policy> matching kind. Used to turn a policy read from
+     * a run configuration into a template argument:
+     *
+     *     WaitPolicy::dispatch(kind, [&](auto tag) {
+     *         using Wait = typename decltype(tag)::type;
+     *         ...
+     *     });
+     */
+    template<typename F>
+    inline auto dispatch(WaitPolicyKind kind, F&& f) {
+        switch (kind) {
+        case WaitPolicyKind::SPIN_PAUSE:
+            return f(Tag<SpinPauseWait>());
+        case WaitPolicyKind::SPIN_YIELD:
+            return f(Tag<SpinYieldWait>());
+        case WaitPolicyKind::SPIN_FUTEX:
+            return f(Tag<SpinFutexWait>());
+        case WaitPolicyKind::SPIN:
+        default:
+            return f(Tag<SpinWait>());
+        }
+    }
+}
+
+#endif // WAIT_POLICY_H
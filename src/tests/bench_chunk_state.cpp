@@ -0,0 +1,118 @@
+/* Cost of handing the chunks over from the Compress to the Reorder stage.
+ *
+ * A compress thread changes the state of chunks to CHUNK_STATE_COMPRESSED, in
+ * sequence, while a reorder thread waits for every chunk to be compressed and
+ * flushes it, the way write_chunk_to_file does. This is done with a mutex and a
+ * condition variable per chunk, the former synchronization of chunk_t, then
+ * with the atomic state of chunk_t. Either the compress thread starts first and
+ * the reorder thread seldom waits, or the reorder thread starts first and waits
+ * for most chunks.
+ *
+ * Reported are millions of chunks per second, best of several passes.
+ */
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "dedupdef.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct locked_state {
+    pthread_mutex_t lock;
+    pthread_cond_t update;
+};
+
+static double run(std::vector<chunk_t>& chunks, std::vector<locked_state>* locks, bool reorder_first) {
+    for (chunk_t& chunk: chunks) {
+        chunk.header.state = CHUNK_STATE_UNCOMPRESSED;
+    }
+
+    auto compress = [&]() {
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            if (locks != NULL) {
+                pthread_mutex_lock(&(*locks)[i].lock);
+                chunks[i].header.state = CHUNK_STATE_COMPRESSED;
+                pthread_cond_broadcast(&(*locks)[i].update);
+                pthread_mutex_unlock(&(*locks)[i].lock);
+            } else {
+                chunk_state_publish(&chunks[i], CHUNK_STATE_COMPRESSED);
+            }
+        }
+    };
+
+    auto reorder = [&]() {
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            if (locks != NULL) {
+                pthread_mutex_lock(&(*locks)[i].lock);
+                while (chunks[i].header.state == CHUNK_STATE_UNCOMPRESSED) {
+                    pthread_cond_wait(&(*locks)[i].update, &(*locks)[i].lock);
+                }
+                chunks[i].header.state = CHUNK_STATE_FLUSHED;
+                pthread_mutex_unlock(&(*locks)[i].lock);
+            } else {
+                if (chunk_state_load(&chunks[i]) == CHUNK_STATE_UNCOMPRESSED) {
+                    chunk_state_wait(&chunks[i], CHUNK_STATE_UNCOMPRESSED);
+                }
+                chunks[i].header.state = CHUNK_STATE_FLUSHED;
+            }
+        }
+    };
+
+    auto begin = Clock::now();
+    std::thread first = reorder_first ? std::thread(reorder) : std::thread(compress);
+    std::thread second = reorder_first ? std::thread(compress) : std::thread(reorder);
+    first.join();
+    second.join();
+    double mcs = chunks.size() / std::chrono::duration<double>(Clock::now() - begin).count() / 1e6;
+
+    for (chunk_t& chunk: chunks) {
+        if (chunk.header.state != CHUNK_STATE_FLUSHED) {
+            fprintf(stderr, "A chunk was not flushed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return mcs;
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? atol(argv[1]) : 1 << 20;
+    int passes = argc > 2 ? atoi(argv[2]) : 3;
+
+    if (n == 0 || passes <= 0) {
+        fprintf(stderr, "Usage: %s [n_chunks] [n_passes]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<chunk_t> chunks(n);
+    std::vector<locked_state> locks(n);
+    for (locked_state& state: locks) {
+        pthread_mutex_init(&state.lock, NULL);
+        pthread_cond_init(&state.update, NULL);
+    }
+
+    printf("%zu chunks, chunk_t is %zu bytes, %zu without the mutex and condition variable\n",
+           n, sizeof(chunk_t) + sizeof(locked_state), sizeof(chunk_t));
+    printf("%-16s %14s %14s\n", "first thread", "mutex Mc/s", "atomic Mc/s");
+    for (bool reorder_first: { false, true }) {
+        double best[2] = { 0, 0 };
+        for (int pass = 0; pass < passes; ++pass) {
+            best[0] = std::max(best[0], run(chunks, &locks, reorder_first));
+            best[1] = std::max(best[1], run(chunks, NULL, reorder_first));
+        }
+        printf("%-16s %14.1f %14.1f\n", reorder_first ? "reorder" : "compress", best[0], best[1]);
+    }
+
+    for (locked_state& state: locks) {
+        pthread_mutex_destroy(&state.lock);
+        pthread_cond_destroy(&state.update);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+/* Chunking engines of the Refine stage.
+ *
+ * A random buffer is cut the way Refine does it, with the Rabin engine and the
+ * window of the encoders (0), with the Rabin engine and a window of NWINDOW
+ * bytes, and with the gear engine. Then a copy of the buffer where a few bytes
+ * were inserted at random places is cut too: reported are the bytes of the
+ * copy that fall in chunks of the original, what the Deduplicate stage would
+ * find.
+ *
+ * Reported are GB/s, best of several passes, and the sizes of the chunks. The
+ * header of the archives is also checked to keep the engine and its sizes.
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "dedupdef.h"
+#include "rabin.h"
+#include "chunking.h"
+#include "util.h"
+
+using Clock = std::chrono::steady_clock;
+
+typedef std::function<int(uchar*, int)> Engine;
+
+static void cut(Engine const& engine, uchar* buffer, int n, std::vector<int>& sizes) {
+    sizes.clear();
+    int offset = 0;
+    while (offset < n) {
+        int size = engine(buffer + offset, n - offset);
+        sizes.push_back(size);
+        offset += size;
+    }
+}
+
+static double bench(Engine const& engine, uchar* buffer, int n, int passes, std::vector<int>& sizes) {
+    double best = 0;
+    for (int pass = 0; pass < passes; ++pass) {
+        auto begin = Clock::now();
+        cut(engine, buffer, n, sizes);
+        double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+        best = std::max(best, n / seconds / 1e9);
+    }
+    return best;
+}
+
+// Bytes of the copy in chunks of the original
+static double duplicates(Engine const& engine, std::vector<uchar>& original, std::vector<uchar>& copy) {
+    std::vector<int> sizes;
+    std::unordered_set<std::string_view> seen;
+
+    cut(engine, original.data(), original.size(), sizes);
+    size_t offset = 0;
+    for (int size: sizes) {
+        seen.emplace((const char*)original.data() + offset, size);
+        offset += size;
+    }
+
+    size_t found = 0;
+    cut(engine, copy.data(), copy.size(), sizes);
+    offset = 0;
+    for (int size: sizes) {
+        if (seen.count(std::string_view((const char*)copy.data() + offset, size)))
+            found += size;
+        offset += size;
+    }
+    return (double)found / copy.size();
+}
+
+static bool check_header(const chunking_t* chunking) {
+    char path[] = "/tmp/bench_chunking_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return false;
+    unlink(path);
+
+    byte compress_type;
+    chunking_t read = { CHUNKING_RABIN, 0, 0, 0 };
+    bool ok = write_header(fd, COMPRESS_NONE, chunking) == 0 && lseek(fd, 0, SEEK_SET) == 0 &&
+              read_header(fd, &compress_type, &read) == 0 && compress_type == COMPRESS_NONE &&
+              read.engine == chunking->engine;
+    if (ok && chunking->engine != CHUNKING_RABIN)
+        ok = read.min_size == chunking->min_size && read.avg_size == chunking->avg_size && read.max_size == chunking->max_size;
+    // Archives of the Rabin engine keep the header they always had
+    if (ok && chunking->engine == CHUNKING_RABIN)
+        ok = lseek(fd, 0, SEEK_CUR) == sizeof(int) + sizeof(byte);
+    close(fd);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 1 << 27;
+    int passes = argc > 2 ? atoi(argv[2]) : 5;
+    int insertions = argc > 3 ? atoi(argv[3]) : 1000;
+
+    if (n <= 0 || passes <= 0 || insertions < 0) {
+        fprintf(stderr, "Usage: %s [n_bytes] [n_passes] [n_insertions]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::mt19937_64 gen(42);
+    std::vector<uchar> buffer(n);
+    for (auto& byte: buffer)
+        byte = gen() & 0xff;
+
+    // A few bytes inserted at sorted random places
+    std::vector<size_t> places(insertions);
+    for (auto& place: places)
+        place = gen() % n;
+    std::sort(places.begin(), places.end());
+    std::vector<uchar> copy;
+    copy.reserve(n + 8 * insertions);
+    size_t from = 0;
+    for (size_t place: places) {
+        copy.insert(copy.end(), buffer.begin() + from, buffer.begin() + place);
+        for (int i = 0, k = 1 + gen() % 8; i < k; ++i)
+            copy.push_back(gen() & 0xff);
+        from = place;
+    }
+    copy.insert(copy.end(), buffer.begin() + from, buffer.end());
+
+    u32int encoder_tab[256], encoder_wintab[256], window_tab[256], window_wintab[256];
+    rabininit(0, encoder_tab, encoder_wintab);
+    rabininit(NWINDOW, window_tab, window_wintab);
+    chunking_t rabin = { CHUNKING_RABIN, 0, 0, 0 };
+    chunking_t gear = { CHUNKING_GEAR, 2048, 8192, 65536 };
+
+    if (!check_header(&rabin) || !check_header(&gear)) {
+        fprintf(stderr, "The header does not keep the chunking\n");
+        return EXIT_FAILURE;
+    }
+    if (chunking_init(&gear) != 0) {
+        fprintf(stderr, "Invalid gear sizes\n");
+        return EXIT_FAILURE;
+    }
+
+    struct {
+        const char* name;
+        Engine engine;
+    } engines[] = {
+        { "rabin", [&](uchar* p, int len) { return rabinseg_lanes(p, len, 0, encoder_tab, encoder_wintab); } },
+        { "rabin window", [&](uchar* p, int len) { return rabinseg_lanes(p, len, NWINDOW, window_tab, window_wintab); } },
+        { "gear", [&](uchar* p, int len) { return gearseg(p, len, &gear); } },
+    };
+
+    printf("%d bytes, %d insertions, gear sizes %u/%u/%u\n", n, insertions, gear.min_size, gear.avg_size, gear.max_size);
+    printf("%-14s %8s %10s %10s %10s %8s %8s %11s\n", "engine", "GB/s", "chunks", "mean", "stddev", "min", "max", "duplicates");
+    for (auto& e: engines) {
+        std::vector<int> sizes;
+        double gbs = bench(e.engine, buffer.data(), n, passes, sizes);
+
+        double mean = (double)n / sizes.size();
+        double variance = 0;
+        for (int size: sizes)
+            variance += (size - mean) * (size - mean);
+        // The last chunk is whatever is left
+        int smallest = sizes.size() > 1 ? *std::min_element(sizes.begin(), sizes.end() - 1) : sizes[0];
+        int largest = *std::max_element(sizes.begin(), sizes.end());
+
+        printf("%-14s %8.3f %10zu %10.0f %10.0f %8d %8d %10.1f%%\n", e.name, gbs, sizes.size(), mean,
+               std::sqrt(variance / sizes.size()), smallest, largest, 100 * duplicates(e.engine, buffer, copy));
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+/* Throughput of the compression backends of dedup.
+ *
+ * The input (a file given on the command line, or generated text-like data) is
+ * cut in chunks of the average size of refined chunks, which are compressed
+ * and decompressed one by one with a single compressor_t, as a Compress thread
+ * and the decoder do. Every chunk must come back unchanged, the benchmark
+ * aborts otherwise. For gzip, the one-shot compress() of the original dedup,
+ * which sets up a new zlib state for every chunk, is measured as well.
+ *
+ * Reported throughput is in MB/s of uncompressed data, best of several passes.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "dedupdef.h"
+#include "compressor.h"
+
+#ifdef ENABLE_GZIP_COMPRESSION
+#include <zlib.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+static const size_t chunk_size = 4096;
+
+static std::vector<char> generate(size_t size) {
+    static const char* words[] = { "dedup", "chunk", "anchor", "rabin", "fingerprint", "compress",
+                                   "reorder", "fifo", "thread", "layer", "the", "of", "and", "a" };
+    std::mt19937 gen(42);
+    std::vector<char> data;
+    while (data.size() < size) {
+        const char* word = words[gen() % (sizeof(words) / sizeof(words[0]))];
+        data.insert(data.end(), word, word + strlen(word));
+        data.push_back(gen() % 8 == 0 ? '\n' : ' ');
+    }
+    data.resize(size);
+    return data;
+}
+
+template<typename F>
+static double best_of(int passes, size_t bytes, F&& f) {
+    double best = 0;
+    for (int pass = 0; pass < passes; ++pass) {
+        auto begin = Clock::now();
+        f();
+        double mbs = bytes / std::chrono::duration<double>(Clock::now() - begin).count() / 1e6;
+        if (mbs > best) {
+            best = mbs;
+        }
+    }
+    return best;
+}
+
+static void bench(std::vector<char> const& data, int type, int level, int passes) {
+    compressor_t* c = compressor_create(type, level);
+    compressor_t* d = compressor_create(type, 0);
+    if (c == NULL || d == NULL) {
+        printf("%-6s %6d %12s\n", compressor_name(type), level, "-");
+        return;
+    }
+
+    size_t n_chunks = (data.size() + chunk_size - 1) / chunk_size;
+    std::vector<std::vector<char>> compressed(n_chunks);
+    size_t total = 0;
+
+    double compress_mbs = best_of(passes, data.size(), [&]() {
+        total = 0;
+        for (size_t i = 0; i < n_chunks; ++i) {
+            size_t len = std::min(chunk_size, data.size() - i * chunk_size);
+            size_t n;
+            const char* out = (const char*)compressor_compress(c, data.data() + i * chunk_size, len, &n);
+            if (out == NULL) {
+                fprintf(stderr, "%s: compression failed\n", compressor_name(type));
+                exit(EXIT_FAILURE);
+            }
+            compressed[i].assign(out, out + n);
+            total += n;
+        }
+    });
+
+    double decompress_mbs = best_of(passes, data.size(), [&]() {
+        for (size_t i = 0; i < n_chunks; ++i) {
+            size_t len = std::min(chunk_size, data.size() - i * chunk_size);
+            size_t n;
+            const char* out = (const char*)compressor_decompress(d, compressed[i].data(), compressed[i].size(), &n);
+            if (out == NULL || n != len || memcmp(out, data.data() + i * chunk_size, len) != 0) {
+                fprintf(stderr, "%s: chunk %zu does not round-trip\n", compressor_name(type), i);
+                exit(EXIT_FAILURE);
+            }
+        }
+    });
+
+    printf("%-6s %6d %12.1f %12.1f %8.2fx\n", compressor_name(type), level != 0 ? level : compressor_default_level(type),
+           compress_mbs, decompress_mbs, (double)data.size() / total);
+
+    compressor_destroy(c);
+    compressor_destroy(d);
+}
+
+#ifdef ENABLE_GZIP_COMPRESSION
+static void bench_oneshot_gzip(std::vector<char> const& data, int passes) {
+    std::vector<unsigned char> out(compressBound(chunk_size));
+    double mbs = best_of(passes, data.size(), [&]() {
+        for (size_t i = 0; i * chunk_size < data.size(); ++i) {
+            size_t len = std::min(chunk_size, data.size() - i * chunk_size);
+            uLongf n = out.size();
+            if (compress(out.data(), &n, (const Bytef*)data.data() + i * chunk_size, len) != Z_OK) {
+                fprintf(stderr, "compress() failed\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    });
+    printf("%-6s %6s %12.1f\n", "gzip", "1-shot", mbs);
+}
+#endif
+
+int main(int argc, char** argv) {
+    int passes = argc > 2 ? atoi(argv[2]) : 3;
+    std::vector<char> data;
+
+    if (argc > 1 && strcmp(argv[1], "-") != 0) {
+        std::ifstream stream(argv[1], std::ios::binary);
+        if (!stream) {
+            fprintf(stderr, "Cannot open %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+        data.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    } else {
+        data = generate(32 << 20);
+    }
+
+    if (data.empty() || passes <= 0) {
+        fprintf(stderr, "Usage: %s [input_file|-] [n_passes]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%zu bytes in chunks of %zu bytes\n", data.size(), chunk_size);
+    printf("%-6s %6s %12s %12s %9s\n", "type", "level", "comp MB/s", "decomp MB/s", "ratio");
+
+    struct { int type; int levels[3]; } runs[] = {
+        { COMPRESS_NONE, { 0 } },
+        { COMPRESS_GZIP, { 1, 6, 9 } },
+        { COMPRESS_BZIP2, { 9 } },
+        { COMPRESS_ZSTD, { -1, 3, 19 } },
+        { COMPRESS_LZ4, { -4, 1, 9 } },
+    };
+
+    for (auto const& run: runs) {
+        if (!compressor_supported(run.type)) {
+            printf("%-6s %6s %12s\n", compressor_name(run.type), "-", "not built");
+            continue;
+        }
+
+        // Unused levels are 0, which stands for the default level
+        for (int i = 0; i < 3 && (i == 0 || run.levels[i] != 0); ++i) {
+            bench(data, run.type, run.levels[i], passes);
+        }
+
+#ifdef ENABLE_GZIP_COMPRESSION
+        if (run.type == COMPRESS_GZIP) {
+            bench_oneshot_gzip(data, passes);
+        }
+#endif
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,251 @@
+/* Skipping the compression of incompressible chunks.
+ *
+ * The input (a file given on the command line, or generated data) is cut in
+ * chunks of the average size of refined chunks. The generated data has pieces
+ * of text, of gzip-compressed text, as media files are, and of random bytes.
+ * Every chunk is estimated with compressor_entropy and compressed with gzip.
+ * For a few thresholds of the entropy, reported are the chunks skipped, the
+ * seconds the Compress stage would spend, and the size of the archive: skipped
+ * chunks and chunks which do not get smaller are stored as they are.
+ *
+ * The chunks are then written as a gzip .ddp file the way the Reorder stage
+ * does with a compress_skip of 7.8, with TYPE_ORIGINAL records for the chunks
+ * stored as they are and a few duplicates, and decoded with and without an
+ * index, and with a memory budget of a few chunks. The output must be the
+ * input, the benchmark aborts otherwise.
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dedupdef.h"
+#include "compressor.h"
+#include "ddpindex.h"
+#include "decoder.h"
+#include "fingerprint.h"
+#include "util.h"
+
+using Clock = std::chrono::steady_clock;
+
+//Defined by the main program of dedup
+config_t* conf;
+struct hashtable* cache;
+
+static const size_t chunk_size = 8192;
+// compress_skip suggested in lua_core.h
+static const double dedup_threshold = 7.8;
+
+struct Chunk {
+    size_t offset;
+    size_t size;
+    double entropy;
+    size_t compressed;
+    double seconds;             // to compress it
+};
+
+static std::vector<char> text(std::mt19937& gen, size_t size) {
+    static const char* words[] = { "dedup", "chunk", "anchor", "rabin", "fingerprint", "compress",
+                                   "reorder", "fifo", "thread", "layer", "the", "of", "and", "a" };
+    std::vector<char> data;
+    while (data.size() < size) {
+        const char* word = words[gen() % (sizeof(words) / sizeof(words[0]))];
+        data.insert(data.end(), word, word + strlen(word));
+        data.push_back(gen() % 8 == 0 ? '\n' : ' ');
+    }
+    data.resize(size);
+    return data;
+}
+
+// Pieces of 256 KB: half text, a third compressed text, the rest random
+static std::vector<char> generate(size_t size) {
+    static const size_t piece = 256 << 10;
+    std::mt19937 gen(42);
+    compressor_t* compressor = compressor_create(COMPRESS_GZIP, 9);
+    std::vector<char> data;
+    while (data.size() < size) {
+        int kind = gen() % 6;
+        if (kind < 3) {
+            std::vector<char> t = text(gen, piece);
+            data.insert(data.end(), t.begin(), t.end());
+        } else if (kind < 5) {
+            std::vector<char> t = text(gen, 4 * piece);
+            size_t n;
+            const char* compressed = (const char*)compressor_compress(compressor, t.data(), t.size(), &n);
+            data.insert(data.end(), compressed, compressed + std::min(n, piece));
+        } else {
+            for (size_t i = 0; i < piece; ++i) {
+                data.push_back(gen());
+            }
+        }
+    }
+    compressor_destroy(compressor);
+    data.resize(size);
+    return data;
+}
+
+static bool stored_as_is(Chunk const& c, double threshold) {
+    return c.entropy >= threshold || c.compressed >= c.size;
+}
+
+static void write_record(int fd, u_char type, u_long len, const void* content) {
+    if (xwrite(fd, &type, sizeof(type)) < 0 || xwrite(fd, &len, sizeof(len)) < 0 || xwrite(fd, content, len) < 0) {
+        fprintf(stderr, "Cannot write the archive\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Write the chunks, every eighth record a duplicate of an earlier one. Returns
+// the data the decoder must produce.
+static std::vector<char> encode(std::vector<char> const& input, std::vector<Chunk> const& chunks, std::string const& path, bool with_index) {
+    std::mt19937 gen(42);
+    int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0 || write_header(fd, COMPRESS_GZIP) != 0) {
+        fprintf(stderr, "Cannot create %s\n", path.c_str());
+        exit(EXIT_FAILURE);
+    }
+
+    compressor_t* compressor = compressor_create(COMPRESS_GZIP, 0);
+    ddp_index_t* index = with_index ? ddp_index_create(lseek(fd, 0, SEEK_CUR)) : NULL;
+    std::vector<u_long> records;
+    std::vector<char> output;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        Chunk const& c = chunks[i];
+        if (i > 0 && gen() % 8 == 0) {
+            size_t k = gen() % i;
+            unsigned char sha1[SHA1_LEN];
+            fingerprint(input.data() + chunks[k].offset, chunks[k].size, sha1);
+            write_record(fd, TYPE_FINGERPRINT, SHA1_LEN, sha1);
+            if (index != NULL) {
+                ddp_index_add(index, TYPE_FINGERPRINT, SHA1_LEN, chunks[k].size, records[k]);
+            }
+            output.insert(output.end(), input.begin() + chunks[k].offset, input.begin() + chunks[k].offset + chunks[k].size);
+        }
+
+        u_char type = TYPE_ORIGINAL;
+        const void* data = input.data() + c.offset;
+        size_t n = c.size;
+        if (!stored_as_is(c, dedup_threshold)) {
+            type = TYPE_COMPRESS;
+            data = compressor_compress(compressor, input.data() + c.offset, c.size, &n);
+        }
+        write_record(fd, type, n, data);
+        records.push_back(index != NULL ? ddp_index_add(index, type, n, c.size, 0) : 0);
+        output.insert(output.end(), input.begin() + c.offset, input.begin() + c.offset + c.size);
+    }
+
+    if (index != NULL) {
+        if (ddp_index_write(index, fd) != 0) {
+            fprintf(stderr, "Cannot write the index\n");
+            exit(EXIT_FAILURE);
+        }
+        ddp_index_destroy(index);
+    }
+    compressor_destroy(compressor);
+    close(fd);
+    return output;
+}
+
+static void check_decode(std::vector<char> const& expected, std::string const& archive, size_t memory_budget, const char* what) {
+    std::string decoded = "bench_compress_skip.out";
+    config_t decode_conf;
+    strcpy(decode_conf.infile, archive.c_str());
+    strcpy(decode_conf.outfile, decoded.c_str());
+    decode_conf.store[0] = '\0';
+    decode_conf.compress_type = COMPRESS_GZIP;
+    decode_conf.preloading = 0;
+    decode_conf.nthreads = 2;
+    decode_conf.verbose = 0;
+    decode_conf.verify = 1;
+    decode_conf.memory_budget = memory_budget;
+    Decode(&decode_conf);
+
+    std::ifstream stream(decoded, std::ios::binary);
+    std::vector<char> data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    if (data != expected) {
+        fprintf(stderr, "%s: decoded file differs from the input\n", what);
+        exit(EXIT_FAILURE);
+    }
+    unlink(decoded.c_str());
+}
+
+int main(int argc, char** argv) {
+    std::vector<char> input;
+
+    if (argc > 1 && strcmp(argv[1], "-") != 0) {
+        std::ifstream stream(argv[1], std::ios::binary);
+        if (!stream) {
+            fprintf(stderr, "Cannot open %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+        input.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    } else {
+        input = generate(64 << 20);
+    }
+    if (input.empty()) {
+        fprintf(stderr, "Usage: %s [input_file|-]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    fingerprint_init(FINGERPRINT_AUTO);
+    compressor_t* compressor = compressor_create(COMPRESS_GZIP, 0);
+    std::vector<Chunk> chunks;
+    double estimate_seconds = 0, compress_seconds = 0;
+    for (size_t offset = 0; offset < input.size(); offset += chunk_size) {
+        Chunk c = { offset, std::min(chunk_size, input.size() - offset), 0, 0, 0 };
+        auto begin = Clock::now();
+        c.entropy = compressor_entropy(input.data() + offset, c.size);
+        auto estimated = Clock::now();
+        compressor_compress(compressor, input.data() + offset, c.size, &c.compressed);
+        c.seconds = std::chrono::duration<double>(Clock::now() - estimated).count();
+        estimate_seconds += std::chrono::duration<double>(estimated - begin).count();
+        compress_seconds += c.seconds;
+        chunks.push_back(c);
+    }
+    compressor_destroy(compressor);
+
+    printf("%zu bytes in %zu chunks of %zu bytes\n", input.size(), chunks.size(), chunk_size);
+    printf("estimate %.2f GB/s, gzip %.1f MB/s\n", input.size() / estimate_seconds / 1e9, input.size() / compress_seconds / 1e6);
+    printf("%10s %10s %10s %12s %12s\n", "threshold", "skipped", "seconds", "archive MB", "vs gzip");
+    size_t all_compressed = 0;
+    for (auto const& c: chunks) {
+        all_compressed += std::min(c.compressed, c.size);
+    }
+    for (double threshold: { 7.0, 7.5, 7.8, 7.9, 8.1 }) {
+        size_t skipped = 0, archive = 0;
+        double seconds = threshold <= 8 ? estimate_seconds : 0;
+        for (auto const& c: chunks) {
+            if (c.entropy >= threshold) {
+                skipped++;
+                archive += c.size;
+            } else {
+                seconds += c.seconds;
+                archive += std::min(c.compressed, c.size);
+            }
+        }
+        printf("%10.1f %9.1f%% %10.3f %12.2f %+11.2f%%\n", threshold, 100.0 * skipped / chunks.size(), seconds, archive / 1e6,
+               100.0 * ((double)archive / all_compressed - 1));
+    }
+
+    std::string archive = "bench_compress_skip.ddp", indexed = "bench_compress_skip_index.ddp";
+    std::vector<char> expected = encode(input, chunks, archive, false);
+    encode(input, chunks, indexed, true);
+    check_decode(expected, archive, 0, "SHA1");
+    check_decode(expected, indexed, 0, "index");
+    check_decode(expected, indexed, 4 * chunk_size, "memory budget");
+    printf("TYPE_ORIGINAL records decoded\n");
+    unlink(archive.c_str());
+    unlink(indexed.c_str());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+/* Scaling of the dedup decoder.
+ *
+ * The input (a file given on the command line, or generated text-like data) is
+ * cut in chunks of the average size of refined chunks, a third of which repeat
+ * an earlier chunk, and written as a gzip .ddp file the way the Reorder stage
+ * does, once without and once with an index. Both files are then decoded with
+ * an increasing number of workers: without the index, duplicates are resolved
+ * by the SHA1 sums of the unique chunks, with the index by record number and
+ * without computing any sum. Both are also decoded with a memory budget of a
+ * few chunks, which makes the decoder read most unique chunks again, and random
+ * byte ranges are decoded with the index. The output must be the input, the
+ * benchmark aborts otherwise.
+ *
+ * Reported throughput is in MB/s of decoded data, best of several passes.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dedupdef.h"
+#include "compressor.h"
+#include "ddpindex.h"
+#include "decoder.h"
+#include "fingerprint.h"
+#include "util.h"
+
+//Defined by the main program of dedup
+config_t* conf;
+struct hashtable* cache;
+
+static const size_t chunk_size = 4096;
+
+static std::vector<char> generate(size_t size) {
+    static const char* words[] = { "dedup", "chunk", "anchor", "rabin", "fingerprint", "compress",
+                                   "reorder", "fifo", "thread", "layer", "the", "of", "and", "a" };
+    std::mt19937 gen(42);
+    std::vector<char> data;
+    while (data.size() < size) {
+        const char* word = words[gen() % (sizeof(words) / sizeof(words[0]))];
+        data.insert(data.end(), word, word + strlen(word));
+        data.push_back(gen() % 8 == 0 ? '\n' : ' ');
+    }
+    data.resize(size);
+    return data;
+}
+
+static void write_record(int fd, u_char type, u_long len, const void* content) {
+    if (xwrite(fd, &type, sizeof(type)) < 0 || xwrite(fd, &len, sizeof(len)) < 0 || xwrite(fd, content, len) < 0) {
+        fprintf(stderr, "Cannot write the archive\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Replace a third of the chunks by copies of earlier ones, and write the .ddp
+// file of the result. Returns the data the decoder must produce.
+static std::vector<char> encode(std::vector<char> const& input, std::string const& path, bool with_index) {
+    std::mt19937 gen(42);
+    size_t n_chunks = (input.size() + chunk_size - 1) / chunk_size;
+    std::vector<std::pair<size_t, size_t>> chunks; // offset and size in input of every chunk of the output
+    for (size_t i = 0; i < n_chunks; ++i) {
+        if (i > 0 && gen() % 3 == 0) {
+            chunks.push_back(chunks[gen() % i]);
+        } else {
+            chunks.emplace_back(i * chunk_size, std::min(chunk_size, input.size() - i * chunk_size));
+        }
+    }
+
+    int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0 || write_header(fd, COMPRESS_GZIP) != 0) {
+        fprintf(stderr, "Cannot create %s\n", path.c_str());
+        exit(EXIT_FAILURE);
+    }
+
+    compressor_t* compressor = compressor_create(COMPRESS_GZIP, 0);
+    ddp_index_t* index = with_index ? ddp_index_create(lseek(fd, 0, SEEK_CUR)) : NULL;
+    std::map<std::string, u_long> written; // record of every unique chunk
+    std::vector<char> output;
+    for (auto const& [offset, size]: chunks) {
+        unsigned char sha1[SHA1_LEN];
+        fingerprint(input.data() + offset, size, sha1);
+        std::string key((char*)sha1, SHA1_LEN);
+        if (written.count(key)) {
+            write_record(fd, TYPE_FINGERPRINT, SHA1_LEN, sha1);
+            if (index != NULL) {
+                ddp_index_add(index, TYPE_FINGERPRINT, SHA1_LEN, size, written[key]);
+            }
+        } else {
+            size_t n;
+            const void* compressed = compressor_compress(compressor, input.data() + offset, size, &n);
+            write_record(fd, TYPE_COMPRESS, n, compressed);
+            written[key] = index != NULL ? ddp_index_add(index, TYPE_COMPRESS, n, size, 0) : 0;
+        }
+        output.insert(output.end(), input.begin() + offset, input.begin() + offset + size);
+    }
+
+    if (index != NULL) {
+        if (ddp_index_write(index, fd) != 0) {
+            fprintf(stderr, "Cannot write the index\n");
+            exit(EXIT_FAILURE);
+        }
+        ddp_index_destroy(index);
+    }
+
+    compressor_destroy(compressor);
+    close(fd);
+    return output;
+}
+
+static void check(std::vector<char>::const_iterator begin, std::vector<char>::const_iterator end, std::string const& path, char const* what) {
+    std::ifstream stream(path, std::ios::binary);
+    std::vector<char> decoded((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    if (!std::equal(begin, end, decoded.begin(), decoded.end())) {
+        fprintf(stderr, "%s: decoded file differs from the input\n", what);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static config_t make_config(std::string const& archive, std::string const& decoded, int n_threads) {
+    config_t decode_conf;
+    strcpy(decode_conf.infile, archive.c_str());
+    strcpy(decode_conf.outfile, decoded.c_str());
+    decode_conf.compress_type = COMPRESS_GZIP;
+    decode_conf.preloading = 0;
+    decode_conf.nthreads = n_threads;
+    decode_conf.verbose = 0;
+    decode_conf.verify = 0;
+    decode_conf.memory_budget = 0;
+    decode_conf.store[0] = '\0';
+    return decode_conf;
+}
+
+int main(int argc, char** argv) {
+    int max_threads = argc > 2 ? atoi(argv[2]) : std::max(1U, std::thread::hardware_concurrency());
+    int passes = argc > 3 ? atoi(argv[3]) : 3;
+    std::vector<char> input;
+
+    if (argc > 1 && strcmp(argv[1], "-") != 0) {
+        std::ifstream stream(argv[1], std::ios::binary);
+        if (!stream) {
+            fprintf(stderr, "Cannot open %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+        input.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    } else {
+        input = generate(32 << 20);
+    }
+
+    if (input.empty() || max_threads <= 0 || passes <= 0) {
+        fprintf(stderr, "Usage: %s [input_file|-] [max_threads] [n_passes]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    fingerprint_init(FINGERPRINT_AUTO);
+
+    std::string archive = "bench_decode.ddp", indexed = "bench_decode_index.ddp", decoded = "bench_decode.out";
+    std::vector<char> expected = encode(input, archive, false);
+    encode(input, indexed, true);
+
+    printf("%zu bytes in chunks of %zu bytes, %u hardware threads\n", expected.size(), chunk_size, std::thread::hardware_concurrency());
+    printf("%8s %12s %12s\n", "threads", "SHA1 MB/s", "index MB/s");
+    for (int n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+        double best[2] = { 0, 0 };
+        for (int pass = 0; pass < passes; ++pass) {
+            for (int with_index = 0; with_index < 2; ++with_index) {
+                config_t decode_conf = make_config(with_index ? indexed : archive, decoded, n_threads);
+                double mbs = expected.size() / (Decode(&decode_conf) / 1e9) / 1e6;
+                check(expected.begin(), expected.end(), decoded, with_index ? "index" : "SHA1");
+                best[with_index] = std::max(best[with_index], mbs);
+            }
+        }
+        printf("%8d %12.1f %12.1f\n", n_threads, best[0], best[1]);
+    }
+
+    printf("%8s %12s %12s\n", "budget", "SHA1 MB/s", "index MB/s");
+    for (size_t budget: { 64 * chunk_size, 1024 * chunk_size }) {
+        double mbs[2];
+        for (int with_index = 0; with_index < 2; ++with_index) {
+            config_t decode_conf = make_config(with_index ? indexed : archive, decoded, max_threads);
+            decode_conf.memory_budget = budget;
+            mbs[with_index] = expected.size() / (Decode(&decode_conf) / 1e9) / 1e6;
+            check(expected.begin(), expected.end(), decoded, "budget");
+        }
+        printf("%7zuK %12.1f %12.1f\n", budget >> 10, mbs[0], mbs[1]);
+    }
+
+    // Ranges of up to 1 MB anywhere in the file, and the empty range
+    std::mt19937 gen(42);
+    for (int i = 0; i <= 100; ++i) {
+        size_t begin = gen() % expected.size();
+        size_t end = i < 100 ? std::min(expected.size(), begin + gen() % (1 << 20)) : begin;
+        config_t decode_conf = make_config(indexed, decoded, 1);
+        decode_conf.verify = i % 2;
+        decode_conf.memory_budget = i % 4 < 2 ? 0 : 16 * chunk_size;
+        DecodeRange(&decode_conf, begin, end);
+        check(expected.begin() + begin, expected.begin() + end, decoded, "range");
+    }
+    printf("101 ranges decoded\n");
+
+    unlink(archive.c_str());
+    unlink(indexed.c_str());
+    unlink(decoded.c_str());
+    return EXIT_SUCCESS;
+}
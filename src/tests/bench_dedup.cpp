@@ -0,0 +1,584 @@
+/* Throughput of dedup on synthetic inputs, stage by stage and end to end.
+ *
+ * The input is generated from a seed: regions of random or text-like bytes,
+ * some of them copies of earlier regions. The duplicate ratio, the size and
+ * the distribution of the sizes of the regions, and the share of text-like
+ * bytes (the compressibility) are set on the command line. The share of
+ * duplicate bytes dedup finds depends on the chunker as well: with the window
+ * length of the pipeline, 0, the Rabin hash does not forget the bytes before
+ * its window, so the chunks of a copy only line up with those of the original
+ * by chance. --window NWINDOW (32) gives a sliding window, in the stages and
+ * in the pipeline runs, whose scripts then set rabin_window. No other window
+ * is accepted: dedup has none.
+ *
+ * Every stage runs alone on the whole input, in one thread, the way the
+ * pipeline runs it: rabin (Fragment then Refine), sha1, index (insert in the
+ * lock-free index), compress (unique chunks only) and write (the records of
+ * the archive, through an output_writer_t). Then the pipeline runs on the same
+ * input with each backend, run_orig, run_auto and run_tasks, if a dedup binary
+ * is given. The pool of run_tasks has as many workers as the Refine,
+ * Deduplicate and Compress layers of the other two have threads. The busy and idle time of the layers of run_auto come from the logs
+ * of its --observers: busy is the work of the items they sampled, idle the
+ * time the pushes of these items waited for the lock of a queue and moved them
+ * through it. The observers only sample the items before the steps of their
+ * queue are set, so these are not totals over the run. run_orig and run_tasks
+ * have no observers.
+ *
+ * Reported is a JSON object on the standard output, or in the --json file:
+ * the parameters, then MB of input per second, seconds and RSS for every stage
+ * and pipeline run. The peak RSS of a stage is the one during the stage, reset
+ * through /proc/self/clear_refs before it starts; it is left out where the
+ * kernel cannot reset it. A pipeline run that fails only reports its error.
+ */
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "dedupdef.h"
+#include "rabin.h"
+#include "fingerprint.h"
+#include "fpindex.h"
+#include "compressor.h"
+#include "output_writer.h"
+
+using Clock = std::chrono::steady_clock;
+using json = nlohmann::json;
+
+struct Options {
+    size_t size = 64 << 20;
+    double duplicates = 0.5;
+    size_t region = 64 << 10;
+    bool exponential = true;
+    double compressibility = 0.5;
+    unsigned long seed = 42;
+    int compression = COMPRESS_GZIP;
+    int threads = 1;
+    int window = 0;
+    std::string dedup;
+    std::string json_file;
+};
+
+struct Chunk {
+    size_t offset;
+    size_t n;
+    unsigned char sha1[SHA1_LEN];
+    bool duplicate;
+};
+
+static const void* chunk_key(void* v) {
+    return ((Chunk*)v)->sha1;
+}
+
+// A field of /proc/self/status, such as VmRSS (now) or VmHWM (peak), in kB
+static long status_kb(const char* field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    size_t n = strlen(field);
+    while (std::getline(status, line)) {
+        if (line.compare(0, n, field) == 0 && line[n] == ':') {
+            return atol(line.c_str() + n + 1);
+        }
+    }
+    return -1;
+}
+
+// Sets VmHWM back to VmRSS, Linux 4.0 and later
+static bool reset_peak_rss() {
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, "5", 1) == 1;
+    close(fd);
+    return ok;
+}
+
+static std::vector<u_char> generate(Options const& opts) {
+    static const char* words[] = { "chunk", "anchor", "fingerprint", "the", "of", "deduplicate", "compress",
+                                   "a", "stream", "index", "and", "buffer", "record", "to", "queue", "in" };
+    std::mt19937_64 gen(opts.seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::exponential_distribution<double> exponential(1.0 / opts.region);
+    std::vector<u_char> data(opts.size);
+
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t n = opts.exponential ? (size_t)exponential(gen) : opts.region;
+        n = std::min(std::clamp<size_t>(n, 64, 16 * opts.region), data.size() - pos);
+
+        if (pos > n && uniform(gen) < opts.duplicates) {
+            size_t from = gen() % (pos - n);
+            std::copy(data.begin() + from, data.begin() + from + n, data.begin() + pos);
+        } else {
+            // Pieces of 256 bytes, text or random
+            for (size_t i = pos; i < pos + n; i += 256) {
+                size_t end = std::min(i + 256, pos + n);
+                if (uniform(gen) < opts.compressibility) {
+                    for (size_t j = i; j < end;) {
+                        const char* word = words[gen() % 16];
+                        for (; *word != 0 && j < end; ++word) {
+                            data[j++] = *word;
+                        }
+                        if (j < end) {
+                            data[j++] = ' ';
+                        }
+                    }
+                } else {
+                    for (size_t j = i; j < end; ++j) {
+                        data[j] = gen();
+                    }
+                }
+            }
+        }
+        pos += n;
+    }
+    return data;
+}
+
+// Anchors the way Fragment cuts them, then chunks the way Refine cuts anchors
+static std::vector<Chunk> stage_rabin(std::vector<u_char>& data, int window) {
+    u32int rabintab[256], rabinwintab[256];
+    std::vector<Chunk> chunks;
+
+    rabininit(window, rabintab, rabinwintab);
+    size_t start = 0;
+    while (start < data.size()) {
+        size_t anchor = data.size() - start;
+        if (anchor > ANCHOR_JUMP) {
+            int offset = rabinseg_lanes(data.data() + start + ANCHOR_JUMP, anchor - ANCHOR_JUMP, window, rabintab, rabinwintab);
+            anchor = std::min(anchor, (size_t)offset + ANCHOR_JUMP);
+        }
+
+        size_t end = start + anchor;
+        while (start < end) {
+            size_t n = rabinseg_lanes(data.data() + start, end - start, window, rabintab, rabinwintab);
+            chunks.push_back({ start, n, {}, false });
+            start += n;
+        }
+    }
+    return chunks;
+}
+
+static void stage_sha1(std::vector<u_char>& data, std::vector<Chunk>& chunks) {
+    const void* ptrs[FINGERPRINT_MAX_BATCH];
+    size_t lens[FINGERPRINT_MAX_BATCH];
+    unsigned char* digests[FINGERPRINT_MAX_BATCH];
+
+    for (size_t i = 0; i < chunks.size(); i += FINGERPRINT_MAX_BATCH) {
+        int n = std::min<size_t>(FINGERPRINT_MAX_BATCH, chunks.size() - i);
+        for (int j = 0; j < n; ++j) {
+            ptrs[j] = data.data() + chunks[i + j].offset;
+            lens[j] = chunks[i + j].n;
+            digests[j] = chunks[i + j].sha1;
+        }
+        fingerprint_batch(ptrs, lens, digests, n);
+    }
+}
+
+static size_t stage_index(std::vector<Chunk>& chunks) {
+    struct fpindex* index = fpindex_create(65536, chunk_key);
+    size_t unique_bytes = 0;
+
+    for (Chunk& chunk: chunks) {
+        chunk.duplicate = fpindex_insert(index, &chunk) != &chunk;
+        if (!chunk.duplicate) {
+            unique_bytes += chunk.n;
+        }
+    }
+    fpindex_destroy(index, FALSE);
+    return unique_bytes;
+}
+
+// Compressed unique chunks, one after the other, and the size of each
+static void stage_compress(std::vector<u_char>& data, std::vector<Chunk>& chunks, int type,
+                           std::vector<u_char>& compressed, std::vector<size_t>& sizes) {
+    compressor_t* c = compressor_create(type, 0);
+    if (c == NULL) {
+        fprintf(stderr, "Compression %s is not supported\n", compressor_name(type));
+        exit(EXIT_FAILURE);
+    }
+
+    for (Chunk& chunk: chunks) {
+        if (chunk.duplicate) {
+            continue;
+        }
+        size_t n;
+        const u_char* p = (const u_char*)compressor_compress(c, data.data() + chunk.offset, chunk.n, &n);
+        if (p == NULL) {
+            fprintf(stderr, "Compression fails\n");
+            exit(EXIT_FAILURE);
+        }
+        compressed.insert(compressed.end(), p, p + n);
+        sizes.push_back(n);
+    }
+    compressor_destroy(c);
+}
+
+static void stage_write(std::vector<Chunk>& chunks, std::vector<u_char>& compressed, std::vector<size_t>& sizes) {
+    const char* path = "bench_dedup.ddp";
+    int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot create %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    // The default buffer of DedupData
+    output_writer_t* out = output_writer_create(fd, 1 << 20, 0);
+    size_t offset = 0, unique = 0;
+    for (Chunk& chunk: chunks) {
+        if (chunk.duplicate) {
+            output_writer_record(out, TYPE_FINGERPRINT, SHA1_LEN, chunk.sha1);
+        } else {
+            output_writer_record(out, TYPE_COMPRESS, sizes[unique], compressed.data() + offset);
+            offset += sizes[unique++];
+        }
+    }
+    output_writer_destroy(out);
+    close(fd);
+    unlink(path);
+}
+
+static const char* lua_script = R"(
+local data = DedupData.new()
+data.input_filename = "%s"
+data.output_filename = "%s"
+data.compression = Compressions.%s
+data.rabin_window = %s
+data.task_threads = %d
+
+local function fifo()
+    local f = FIFOData.new()
+    f.n = 20
+    return f
+end
+
+local q = {}
+for i = 1, 4 do
+    q[i] = data:new_fifo()
+end
+
+local function layer(n, setup)
+    local l = LayerData.new()
+    for t = 1, n do
+        local thread = ThreadData.new()
+        setup(thread)
+        l:push(thread)
+    end
+    return l
+end
+
+data:push_layer(Layers.FRAGMENT, layer(1, function(t) t:push_output(q[1], fifo()) end))
+data:push_layer(Layers.REFINE, layer(%d, function(t) t:push_input(q[1], fifo()) t:push_output(q[2], fifo()) end))
+data:push_layer(Layers.DEDUPLICATE, layer(%d, function(t) t:push_input(q[2], fifo()) t:push_output(q[3], fifo()) t:push_extra(q[4], fifo()) end))
+data:push_layer(Layers.COMPRESS, layer(%d, function(t) t:push_input(q[3], fifo()) t:push_output(q[4], fifo()) end))
+data:push_layer(Layers.REORDER, layer(1, function(t) t:push_input(q[4], fifo()) end))
+if observers_path then
+    data:set_observers(observers_path)
+end
+data:%s()
+)";
+
+static const char* observers_base = "bench_dedup.obs";
+
+// Queues as dump_observers in encode_naive_queue.cpp names them, after the
+// layer that pushes into them, and the layer that pops from them
+static const char* queues[][2] = {
+    { "fragment", "refine" },
+    { "refine", "deduplicate" },
+    { "deduplicate", "compress" },
+    { "compress", "reorder" },
+};
+
+// Busy and idle seconds of the layers of a run_auto, from its observers, whose
+// logs are removed. The work of a layer is the one its threads logged for the
+// items they popped, or pushed if they log none, so that no item counts twice.
+static json read_observers() {
+    struct Layer {
+        size_t popped = 0, pushed = 0;
+        uint64_t pop_work = 0, push_work = 0, sync = 0;
+    };
+    std::map<std::string, Layer> layers;
+
+    for (auto [producer, consumer]: queues) {
+        for (int i = 0;; ++i) {
+            std::string path = std::string(observers_base) + "_" + producer + "_" + std::to_string(i) + ".txt";
+            std::ifstream stream(path);
+            if (!stream) {
+                break;
+            }
+            json observer = json::parse(stream, nullptr, false);
+            unlink(path.c_str());
+            if (observer.is_discarded()) {
+                continue;
+            }
+
+            for (json const& fifo: observer["fifos"]) {
+                if (fifo["type"] == "producer") {
+                    Layer& layer = layers[producer];
+                    for (uint64_t t: fifo["work"]) {
+                        layer.push_work += t;
+                        ++layer.pushed;
+                    }
+                    for (const char* key: { "lock", "transfer", "unlock" }) {
+                        for (uint64_t t: fifo[key]) {
+                            layer.sync += t;
+                        }
+                    }
+                } else {
+                    Layer& layer = layers[consumer];
+                    for (uint64_t t: fifo["work"]) {
+                        layer.pop_work += t;
+                        ++layer.popped;
+                    }
+                }
+            }
+            // Synchronizations of the second reconfiguration
+            for (json const& fifo: observer["p2"]) {
+                if (fifo["type"] == "producer") {
+                    for (const char* key: { "lock", "transfer", "unlock" }) {
+                        for (uint64_t t: fifo[key]) {
+                            layers[producer].sync += t;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    json stages = json::object();
+    for (auto const& [name, layer]: layers) {
+        json stage = json::object();
+        size_t samples = layer.popped > 0 ? layer.popped : layer.pushed;
+        if (samples > 0) {
+            stage["samples"] = samples;
+            stage["busy_seconds"] = (layer.popped > 0 ? layer.pop_work : layer.push_work) / 1e9;
+        }
+        if (layer.sync > 0) {
+            stage["idle_seconds"] = layer.sync / 1e9;
+        }
+        if (!stage.empty()) {
+            stages[name] = stage;
+        }
+    }
+    return stages;
+}
+
+// Run the pipeline in a child dedup process, whose output is discarded
+static json run_pipeline(Options const& opts, const char* input, const char* backend) {
+    const char* script = "bench_dedup.lua";
+    const char* output = "bench_dedup.out.ddp";
+    std::string name = compressor_name(opts.compression);
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+
+    FILE* f = fopen(script, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Cannot write %s\n", script);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(f, lua_script, input, output, name.c_str(), opts.window == NWINDOW ? "true" : "false", 3 * opts.threads,
+            opts.threads, opts.threads, opts.threads, backend);
+    fclose(f);
+
+    // NOTE: fork rather than vfork or posix_spawn: the peak RSS of the child
+    //       starts from the RSS of the memory it was created with, which must
+    //       not be the one of this process
+    json result;
+    auto begin = Clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int fd = open("/dev/null", O_WRONLY);
+        dup2(fd, 1);
+        dup2(fd, 2);
+        execl(opts.dedup.c_str(), opts.dedup.c_str(), "-f", script, "--observers", observers_base, (char*)NULL);
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) < 0) {
+        result["error"] = "cannot run " + opts.dedup;
+        return result;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    json stages = read_observers();
+    struct stat st;
+    bool written = stat(output, &st) == 0;
+    unlink(script);
+    unlink(output);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        result["error"] = "dedup fails";
+        return result;
+    }
+
+    if (written) {
+        result["output_bytes"] = st.st_size;
+    }
+    result["seconds"] = seconds;
+    result["mb_per_s"] = opts.size / seconds / 1e6;
+    result["cpu_seconds"] = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    result["peak_rss_kb"] = usage.ru_maxrss;
+    if (!stages.empty()) {
+        result["stages"] = stages;
+    }
+    return result;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [--size MB] [--duplicates 0..1] [--region bytes] [--distribution fixed|exp]\n"
+                    "       [--compressibility 0..1] [--seed n] [--compression gzip|bzip2|none|zstd|lz4]\n"
+                    "       [--threads n] [--window 0|32] [--dedup path] [--json file]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+static Options parse(int argc, char** argv) {
+    Options opts;
+#ifdef DEDUP_BINARY
+    opts.dedup = DEDUP_BINARY;
+#endif
+
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+        std::string key = argv[i];
+        const char* value = argv[i + 1];
+        if (key == "--size") {
+            opts.size = (size_t)atol(value) << 20;
+        } else if (key == "--duplicates") {
+            opts.duplicates = atof(value);
+        } else if (key == "--region") {
+            opts.region = atol(value);
+        } else if (key == "--distribution") {
+            opts.exponential = strcmp(value, "fixed") != 0;
+        } else if (key == "--compressibility") {
+            opts.compressibility = atof(value);
+        } else if (key == "--seed") {
+            opts.seed = atol(value);
+        } else if (key == "--compression") {
+            int type;
+            for (type = COMPRESS_GZIP; type <= COMPRESS_LZ4 && strcmp(compressor_name(type), value) != 0; ++type);
+            opts.compression = type;
+        } else if (key == "--threads") {
+            opts.threads = atoi(value);
+        } else if (key == "--window") {
+            opts.window = atoi(value);
+        } else if (key == "--dedup") {
+            opts.dedup = value;
+        } else if (key == "--json") {
+            opts.json_file = value;
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (opts.size == 0 || opts.region == 0 || opts.threads <= 0 || (opts.window != 0 && opts.window != NWINDOW) || opts.compression > COMPRESS_LZ4 ||
+        opts.duplicates < 0 || opts.duplicates > 1 || opts.compressibility < 0 || opts.compressibility > 1) {
+        usage(argv[0]);
+    }
+    return opts;
+}
+
+int main(int argc, char** argv) {
+    Options opts = parse(argc, argv);
+    json report;
+
+    report["parameters"] = {
+        { "size", opts.size },
+        { "duplicates", opts.duplicates },
+        { "region", opts.region },
+        { "distribution", opts.exponential ? "exp" : "fixed" },
+        { "compressibility", opts.compressibility },
+        { "seed", opts.seed },
+        { "compression", compressor_name(opts.compression) },
+        { "threads", opts.threads },
+        { "window", opts.window },
+    };
+
+    if (fingerprint_init(FINGERPRINT_AUTO) != 0) {
+        fprintf(stderr, "No fingerprint backend\n");
+        return EXIT_FAILURE;
+    }
+    report["parameters"]["fingerprint"] = fingerprint_backend_name(fingerprint_backend());
+
+    std::vector<u_char> data = generate(opts);
+    std::vector<Chunk> chunks;
+    std::vector<u_char> compressed;
+    std::vector<size_t> sizes;
+    size_t unique_bytes = 0;
+
+    json stages = json::object();
+    auto stage = [&](const char* name, auto&& fn) {
+        long rss = status_kb("VmRSS");
+        bool peak = reset_peak_rss();
+        auto begin = Clock::now();
+        fn();
+        double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+        stages[name] = {
+            { "seconds", seconds },
+            { "mb_per_s", opts.size / seconds / 1e6 },
+            { "rss_before_kb", rss },
+            { "rss_after_kb", status_kb("VmRSS") },
+        };
+        if (peak) {
+            stages[name]["peak_rss_kb"] = status_kb("VmHWM");
+        }
+    };
+
+    stage("rabin", [&]() { chunks = stage_rabin(data, opts.window); });
+    stage("sha1", [&]() { stage_sha1(data, chunks); });
+    stage("index", [&]() { unique_bytes = stage_index(chunks); });
+    stage("compress", [&]() { stage_compress(data, chunks, opts.compression, compressed, sizes); });
+    stage("write", [&]() { stage_write(chunks, compressed, sizes); });
+    report["stages"] = stages;
+
+    report["input"] = {
+        { "chunks", chunks.size() },
+        { "unique_chunks", sizes.size() },
+        { "duplicate_ratio", 1 - (double)unique_bytes / opts.size },
+        { "compression_ratio", unique_bytes > 0 ? (double)compressed.size() / unique_bytes : 0 },
+    };
+
+    if (!opts.dedup.empty()) {
+        const char* input = "bench_dedup.in";
+        FILE* f = fopen(input, "wb");
+        if (f == NULL || fwrite(data.data(), 1, data.size(), f) != data.size()) {
+            fprintf(stderr, "Cannot write %s\n", input);
+            return EXIT_FAILURE;
+        }
+        fclose(f);
+        // Given back to the system, see run_pipeline
+        std::vector<u_char>().swap(data);
+        std::vector<u_char>().swap(compressed);
+
+        json pipelines = json::object();
+        for (const char* backend: { "run_orig", "run_auto", "run_tasks" }) {
+            pipelines[backend] = run_pipeline(opts, input, backend);
+        }
+        report["pipelines"] = pipelines;
+        unlink(input);
+    }
+
+    if (opts.json_file.empty()) {
+        std::cout << report.dump(4) << std::endl;
+    } else {
+        std::ofstream(opts.json_file) << report.dump(4) << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
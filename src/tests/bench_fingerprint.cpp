@@ -0,0 +1,112 @@
+/* Throughput of the fingerprint backends of dedup.
+ *
+ * Buffers of random sizes (around the average size of refined chunks) are
+ * hashed one at a time and in batches of FINGERPRINT_MAX_BATCH, as the
+ * Deduplicate stage does. Every backend must produce the digests of the
+ * bundled OpenSSL code, the benchmark aborts otherwise.
+ *
+ * Reported throughput is in GB/s of input, best of several passes.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "dedupdef.h"
+#include "fingerprint.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Buffers {
+    std::vector<unsigned char> storage;
+    std::vector<const void*> data;
+    std::vector<size_t> len;
+    std::vector<unsigned char> digests;
+    std::vector<unsigned char*> digest;
+    size_t total = 0;
+};
+
+static double bench(Buffers& buffers, bool batch, int passes) {
+    double best = 0;
+    int n = buffers.data.size();
+    for (int pass = 0; pass < passes; ++pass) {
+        auto begin = Clock::now();
+        if (batch) {
+            for (int i = 0; i < n; i += FINGERPRINT_MAX_BATCH) {
+                int count = n - i < FINGERPRINT_MAX_BATCH ? n - i : FINGERPRINT_MAX_BATCH;
+                fingerprint_batch(&buffers.data[i], &buffers.len[i], &buffers.digest[i], count);
+            }
+        } else {
+            for (int i = 0; i < n; ++i) {
+                fingerprint(buffers.data[i], buffers.len[i], buffers.digest[i]);
+            }
+        }
+        auto end = Clock::now();
+        double gbs = buffers.total / std::chrono::duration<double>(end - begin).count() / 1e9;
+        if (gbs > best)
+            best = gbs;
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 1 << 16;
+    int passes = argc > 2 ? atoi(argv[2]) : 5;
+    int max_size = argc > 3 ? atoi(argv[3]) : 8192;
+
+    if (n <= 0 || passes <= 0 || max_size <= 0) {
+        fprintf(stderr, "Usage: %s [n_buffers] [n_passes] [max_buffer_size]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Buffers buffers;
+    srand(42);
+    for (int i = 0; i < n; ++i) {
+        // Include the sizes around the padding boundary
+        buffers.len.push_back(i < 256 ? i : rand() % max_size + 1);
+        buffers.total += buffers.len.back();
+    }
+
+    buffers.storage.resize(buffers.total);
+    for (unsigned char& c: buffers.storage)
+        c = rand() & 0xff;
+
+    buffers.digests.resize(n * SHA1_LEN);
+    size_t offset = 0;
+    for (int i = 0; i < n; ++i) {
+        buffers.data.push_back(buffers.storage.data() + offset);
+        buffers.digest.push_back(buffers.digests.data() + i * SHA1_LEN);
+        offset += buffers.len[i];
+    }
+
+    std::vector<unsigned char> reference(n * SHA1_LEN);
+    for (int i = 0; i < n; ++i)
+        SHA1_Digest(buffers.data[i], buffers.len[i], reference.data() + i * SHA1_LEN);
+
+    printf("%d buffers, %zu bytes\n", n, buffers.total);
+    printf("%-10s %12s %12s\n", "backend", "single GB/s", "batch GB/s");
+
+    fingerprint_backend_t backends[] = { FINGERPRINT_OPENSSL, FINGERPRINT_SHANI, FINGERPRINT_AVX2, FINGERPRINT_AUTO };
+    for (fingerprint_backend_t backend: backends) {
+        if (fingerprint_init(backend) != 0) {
+            printf("%-10s %12s %12s\n", fingerprint_backend_name(backend), "-", "-");
+            continue;
+        }
+
+        double results[2];
+        for (int batch = 0; batch < 2; ++batch) {
+            memset(buffers.digests.data(), 0, buffers.digests.size());
+            results[batch] = bench(buffers, batch, passes);
+            if (buffers.digests != reference) {
+                fprintf(stderr, "%s (%s) computed wrong digests\n", fingerprint_backend_name(backend), batch ? "batch" : "single");
+                return EXIT_FAILURE;
+            }
+        }
+
+        printf("%-10s %12.3f %12.3f\n", fingerprint_backend_name(backend), results[0], results[1]);
+    }
+
+    return EXIT_SUCCESS;
+}
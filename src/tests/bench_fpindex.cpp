@@ -0,0 +1,166 @@
+/* Scaling of the fingerprint indexes of dedup.
+ *
+ * Every thread deduplicates its share of a stream of random SHA1 sums, half of
+ * them being duplicates: the lock-free index does one insert-if-absent per
+ * sum, the PARSEC hashtable a search and an insert under the bucket lock, as
+ * sub_Deduplicate does. Both start from 65536 slots / buckets like the
+ * encoder, so the lock-free index has to grow while it is used. Every sum must
+ * resolve to the same entry in all threads, the benchmark aborts otherwise.
+ *
+ * Reported throughput is in millions of lookups per second.
+ */
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "sha.h"
+#include "fpindex.h"
+#include "hashtable.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Item {
+    unsigned int sha1[SHA1_LEN / sizeof(unsigned int)];
+    unsigned int id; // index of the distinct sum
+};
+
+static const void* item_key(void* v) {
+    return ((Item*)v)->sha1;
+}
+
+static unsigned int hash_from_key(void* k) {
+    return ((unsigned int*)k)[0];
+}
+
+static int keys_equal(void* key1, void* key2) {
+    return memcmp(key1, key2, SHA1_LEN) == 0;
+}
+
+static void* lockfree_lookup(void* index, Item* item) {
+    return fpindex_insert((struct fpindex*)index, item);
+}
+
+static void* locked_lookup(void* index, Item* item) {
+    struct hashtable* h = (struct hashtable*)index;
+    auto [lock, idx] = hashtable_getlock(h, item->sha1);
+    (void)idx;
+    pthread_mutex_lock(lock);
+    void* entry = hashtable_search(h, item->sha1);
+    if (entry == NULL) {
+        if (hashtable_insert(h, item->sha1, item) == 0) {
+            fprintf(stderr, "hashtable_insert failed\n");
+            exit(EXIT_FAILURE);
+        }
+        entry = item;
+    }
+    pthread_mutex_unlock(lock);
+    return entry;
+}
+
+static double run(std::vector<Item>& items, std::vector<void*>& results, int n_threads, bool lockfree) {
+    void* index;
+    if (lockfree) {
+        index = fpindex_create(65536, item_key);
+    } else {
+        index = hashtable_create(65536, hash_from_key, keys_equal, 0);
+    }
+
+    if (index == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    auto lookup = lockfree ? lockfree_lookup : locked_lookup;
+    size_t n = items.size();
+    std::vector<std::thread> threads;
+
+    auto begin = Clock::now();
+    for (int t = 0; t < n_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            // Interleave the shares so that the threads race on the same sums
+            for (size_t i = t; i < n; i += n_threads) {
+                results[i] = lookup(index, &items[i]);
+            }
+        });
+    }
+
+    for (std::thread& thread: threads) {
+        thread.join();
+    }
+    auto end = Clock::now();
+
+    if (lockfree) {
+        fpindex_destroy((struct fpindex*)index, 0);
+    } else {
+        hashtable_destroy((struct hashtable*)index, 0);
+    }
+
+    return n / std::chrono::duration<double>(end - begin).count() / 1e6;
+}
+
+static void check(std::vector<Item> const& items, std::vector<void*> const& results, unsigned int n_distinct, char const* name, int n_threads) {
+    std::vector<void*> winners(n_distinct, nullptr);
+    for (size_t i = 0; i < items.size(); ++i) {
+        Item* entry = (Item*)results[i];
+        if (entry->id != items[i].id || memcmp(entry->sha1, items[i].sha1, SHA1_LEN) != 0) {
+            fprintf(stderr, "%s, %d threads: lookup %zu returned another sum\n", name, n_threads, i);
+            exit(EXIT_FAILURE);
+        }
+
+        if (winners[entry->id] == nullptr) {
+            winners[entry->id] = entry;
+        } else if (winners[entry->id] != entry) {
+            fprintf(stderr, "%s, %d threads: sum %u inserted twice\n", name, n_threads, entry->id);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? atol(argv[1]) : 1 << 22;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 64;
+
+    if (n == 0 || max_threads <= 0) {
+        fprintf(stderr, "Usage: %s [n_lookups] [max_threads]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Half of the lookups find a sum that is already there
+    unsigned int n_distinct = n / 2 > 0 ? n / 2 : 1;
+    std::mt19937 gen(42);
+    std::vector<Item> distinct(n_distinct);
+    for (unsigned int i = 0; i < n_distinct; ++i) {
+        for (unsigned int& word: distinct[i].sha1) {
+            word = gen();
+        }
+        distinct[i].id = i;
+    }
+
+    std::vector<Item> items(n);
+    for (size_t i = 0; i < n; ++i) {
+        items[i] = distinct[i < n_distinct ? i : gen() % n_distinct];
+    }
+    std::shuffle(items.begin(), items.end(), gen);
+
+    std::vector<void*> results(n);
+
+    printf("%zu lookups, %u distinct sums, %u hardware threads\n", n, n_distinct, std::thread::hardware_concurrency());
+    printf("%8s %16s %16s\n", "threads", "lock-free Ml/s", "locked Ml/s");
+    for (int n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+        double lockfree = run(items, results, n_threads, true);
+        check(items, results, n_distinct, "lock-free", n_threads);
+        double locked = run(items, results, n_threads, false);
+        check(items, results, n_distinct, "locked", n_threads);
+        printf("%8d %16.2f %16.2f\n", n_threads, lockfree, locked);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,324 @@
+/* Incremental archives with a fingerprint store.
+ *
+ * A series of nightly backups is simulated: the data of each night is the data
+ * of the night before with a few chunks changed. Each night is written as a
+ * gzip .ddp file the way the Reorder stage does, once with a fingerprint store,
+ * whose chunks become TYPE_REFERENCE records, and once without it. Every
+ * archive of the store is then decoded, with and without an index, and must
+ * give the data of its night back, the benchmark aborts otherwise. So must a
+ * store whose log has entries of an archive that was never added, and whose
+ * index is stale, once opened again, and two archives written at the same
+ * time by two processes with the same store, and one which refers to both.
+ *
+ * Reported are the bytes compressed and the time spent per night, and the
+ * rate of searches in the store.
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dedupdef.h"
+#include "compressor.h"
+#include "ddpindex.h"
+#include "decoder.h"
+#include "fingerprint.h"
+#include "fpstore.h"
+#include "util.h"
+
+using Clock = std::chrono::steady_clock;
+
+//Defined by the main program of dedup
+config_t* conf;
+struct hashtable* cache;
+
+static const size_t chunk_size = 4096;
+
+struct Night {
+    std::string archive;
+    u_long compressed;         // bytes given to the compressor
+    u_long size;               // bytes of the archive
+    double seconds;
+};
+
+static void write_record(int fd, u_char type, u_long len, const void* content) {
+    if (xwrite(fd, &type, sizeof(type)) < 0 || xwrite(fd, &len, sizeof(len)) < 0 || xwrite(fd, content, len) < 0) {
+        fprintf(stderr, "Cannot write the archive\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Write the .ddp file of data, with the store if it is not NULL
+static Night encode(std::vector<char> const& data, std::string const& path, fpstore_t* store, bool with_index) {
+    Night night = { path, 0, 0, 0 };
+    auto begin = Clock::now();
+
+    int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0 || write_header(fd, COMPRESS_GZIP) != 0) {
+        fprintf(stderr, "Cannot create %s\n", path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    if (store != NULL) {
+        fpstore_begin(store, path.c_str(), COMPRESS_GZIP);
+    }
+
+    compressor_t* compressor = compressor_create(COMPRESS_GZIP, 0);
+    ddp_index_t* index = with_index ? ddp_index_create(lseek(fd, 0, SEEK_CUR)) : NULL;
+    std::map<std::string, u_long> written; // record of every unique chunk of the night
+    for (size_t offset = 0; offset < data.size(); offset += chunk_size) {
+        size_t size = std::min(chunk_size, data.size() - offset);
+        unsigned char sha1[SHA1_LEN];
+        fingerprint(data.data() + offset, size, sha1);
+        std::string key((char*)sha1, SHA1_LEN);
+        const fpstore_entry_t* stored;
+        u_long record = 0;
+
+        if (written.count(key)) {
+            write_record(fd, TYPE_FINGERPRINT, SHA1_LEN, sha1);
+            if (index != NULL) {
+                ddp_index_add(index, TYPE_FINGERPRINT, SHA1_LEN, size, written[key]);
+            }
+            continue;
+        }
+        if (store != NULL && (stored = fpstore_search(store, sha1)) != NULL) {
+            write_record(fd, TYPE_REFERENCE, sizeof(*stored), stored);
+            if (index != NULL) {
+                record = ddp_index_add(index, TYPE_REFERENCE, sizeof(*stored), size, 0);
+            }
+        } else {
+            size_t n;
+            const void* compressed = compressor_compress(compressor, data.data() + offset, size, &n);
+            if (store != NULL) {
+                fpstore_add(store, sha1, lseek(fd, 0, SEEK_CUR));
+            }
+            write_record(fd, TYPE_COMPRESS, n, compressed);
+            if (index != NULL) {
+                record = ddp_index_add(index, TYPE_COMPRESS, n, size, 0);
+            }
+            night.compressed += size;
+        }
+        written[key] = record;
+    }
+
+    if (index != NULL) {
+        if (ddp_index_write(index, fd) != 0) {
+            fprintf(stderr, "Cannot write the index\n");
+            exit(EXIT_FAILURE);
+        }
+        ddp_index_destroy(index);
+    }
+    compressor_destroy(compressor);
+    night.size = lseek(fd, 0, SEEK_END);
+    close(fd);
+    if (store != NULL) {
+        fpstore_commit(store);
+    }
+
+    night.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    return night;
+}
+
+static void check_decode(std::vector<char> const& expected, std::string const& archive, const char* store) {
+    std::string decoded = "bench_fpstore.out";
+    config_t decode_conf;
+    strcpy(decode_conf.infile, archive.c_str());
+    strcpy(decode_conf.outfile, decoded.c_str());
+    strcpy(decode_conf.store, store);
+    decode_conf.compress_type = COMPRESS_GZIP;
+    decode_conf.preloading = 0;
+    decode_conf.nthreads = 2;
+    decode_conf.verbose = 0;
+    decode_conf.verify = 1;
+    // Small enough that referenced chunks are read again
+    decode_conf.memory_budget = 16 * chunk_size;
+    Decode(&decode_conf);
+
+    std::ifstream stream(decoded, std::ios::binary);
+    std::vector<char> data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    if (data != expected) {
+        fprintf(stderr, "%s: decoded file differs from the input\n", archive.c_str());
+        exit(EXIT_FAILURE);
+    }
+    unlink(decoded.c_str());
+}
+
+int main(int argc, char** argv) {
+    size_t size = (argc > 1 ? atol(argv[1]) : 32) << 20;
+    int nights = argc > 2 ? atoi(argv[2]) : 5;
+    int changed = argc > 3 ? atoi(argv[3]) : 5;
+    const char* dir = "bench_fpstore.store";
+
+    if (size == 0 || nights <= 0 || changed < 0 || changed > 100) {
+        fprintf(stderr, "Usage: %s [size_MB] [n_nights] [percent_changed]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    fingerprint_init(FINGERPRINT_AUTO);
+    std::mt19937_64 gen(42);
+    // Compressible, so that the compression costs what it does on real data,
+    // and a third of the chunks repeat an earlier one
+    std::vector<char> data(size);
+    for (auto& c: data) {
+        c = 'a' + gen() % 16;
+    }
+    for (size_t offset = chunk_size; offset + chunk_size <= size; offset += chunk_size) {
+        if (gen() % 3 == 0) {
+            size_t from = (gen() % (offset / chunk_size)) * chunk_size;
+            std::copy(data.begin() + from, data.begin() + from + chunk_size, data.begin() + offset);
+        }
+    }
+
+    std::vector<std::vector<char>> history;
+    fpstore_t* store = fpstore_open(dir);
+    printf("%zu MB a night, %d%% of the chunks of %zu bytes change every night\n", size >> 20, changed, chunk_size);
+    printf("%6s %14s %12s %10s %14s %12s %10s\n", "night", "store MB in", "archive MB", "seconds", "plain MB in", "archive MB", "seconds");
+    for (int night = 0; night < nights; ++night) {
+        if (night > 0) {
+            for (size_t offset = 0; offset < size; offset += chunk_size) {
+                if ((int)(gen() % 100) < changed) {
+                    for (size_t i = offset; i < std::min(size, offset + chunk_size); ++i) {
+                        data[i] = 'a' + gen() % 16;
+                    }
+                }
+            }
+        }
+        history.push_back(data);
+
+        Night incremental = encode(data, "bench_fpstore_" + std::to_string(night) + ".ddp", store, night % 2);
+        Night plain = encode(data, "bench_fpstore_plain.ddp", NULL, false);
+        printf("%6d %14.1f %12.1f %10.3f %14.1f %12.1f %10.3f\n", night, incremental.compressed / 1e6, incremental.size / 1e6,
+               incremental.seconds, plain.compressed / 1e6, plain.size / 1e6, plain.seconds);
+    }
+    unlink("bench_fpstore_plain.ddp");
+
+    // Searches of chunks of the store and of chunks it does not have
+    u_long n = fpstore_count(store);
+    std::vector<std::array<unsigned char, SHA1_LEN>> keys(1 << 20);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        const std::vector<char>& night = history[i % nights];
+        size_t offset = (gen() % (size / chunk_size)) * chunk_size;
+        if (i % 2) {
+            fingerprint(night.data() + offset, std::min(chunk_size, size - offset), keys[i].data());
+        } else {
+            for (auto& b: keys[i]) {
+                b = gen();
+            }
+        }
+    }
+    fpstore_begin(store, "bench_fpstore_next.ddp", COMPRESS_GZIP);
+    auto begin = Clock::now();
+    size_t found = 0;
+    for (auto const& key: keys) {
+        found += fpstore_search(store, key.data()) != NULL;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    if (found != keys.size() / 2) {
+        fprintf(stderr, "%zu chunks of the store found out of %zu\n", found, keys.size() / 2);
+        return EXIT_FAILURE;
+    }
+    printf("%lu chunks in the store, %.1f M searches/s\n", n, keys.size() / seconds / 1e6);
+
+    // A run that died before its archive was added, and an index it left stale
+    fpstore_add(store, keys[1].data(), 0);
+    fpstore_close(store);
+    std::string log = std::string(dir) + "/log", index = std::string(dir) + "/index";
+    fpstore_entry_t orphan = { {}, (u32int)nights, 0 };
+    int fd = open(log.c_str(), O_WRONLY | O_APPEND);
+    if (fd < 0 || xwrite(fd, &orphan, sizeof(orphan)) < 0 || close(fd) < 0 || truncate(index.c_str(), 16) < 0) {
+        fprintf(stderr, "Cannot damage the store\n");
+        return EXIT_FAILURE;
+    }
+    store = fpstore_open(dir);
+    if (fpstore_count(store) != n) {
+        fprintf(stderr, "%lu entries in the store after a failed run instead of %lu\n", fpstore_count(store), n);
+        return EXIT_FAILURE;
+    }
+    fpstore_close(store);
+
+    // Two runs of another night, each with its own changes, in two processes
+    std::vector<std::vector<char>> concurrent(2, data);
+    for (int run = 0; run < 2; ++run) {
+        for (size_t offset = 0; offset < size; offset += chunk_size) {
+            if ((int)(gen() % 100) < changed) {
+                for (size_t i = offset; i < std::min(size, offset + chunk_size); ++i) {
+                    concurrent[run][i] = 'a' + gen() % 16;
+                }
+            }
+        }
+    }
+    // The store is open when the other process opens it
+    store = fpstore_open(dir);
+    pid_t child = fork();
+    if (child < 0) {
+        fprintf(stderr, "Cannot fork\n");
+        return EXIT_FAILURE;
+    }
+    int run = child == 0 ? 1 : 0;
+    if (child == 0) {
+        // Only the copy of the parent's store, which stays open in the parent
+        fpstore_close(store);
+        store = fpstore_open(dir);
+    }
+    encode(concurrent[run], "bench_fpstore_run" + std::to_string(run) + ".ddp", store, false);
+    fpstore_close(store);
+    if (child == 0) {
+        _exit(EXIT_SUCCESS);
+    }
+    int status;
+    if (waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        fprintf(stderr, "The run of the other process failed\n");
+        return EXIT_FAILURE;
+    }
+    std::vector<fpstore_archive_t> archives;
+    if (fpstore_read_archives(dir, &archives) != 0 || archives.size() != (size_t)nights + 2) {
+        fprintf(stderr, "%zu archives in the store instead of %d\n", archives.size(), nights + 2);
+        return EXIT_FAILURE;
+    }
+    // Its chunks are all in the archives of the two runs
+    std::vector<char> both(concurrent[0]);
+    both.insert(both.end(), concurrent[1].begin(), concurrent[1].end());
+    store = fpstore_open(dir);
+    Night after = encode(both, "bench_fpstore_both.ddp", store, false);
+    fpstore_close(store);
+    if (after.compressed != 0) {
+        fprintf(stderr, "%lu bytes of the chunks of the two runs not found in the store\n", after.compressed);
+        return EXIT_FAILURE;
+    }
+
+    for (int night = 0; night < nights; ++night) {
+        check_decode(history[night], "bench_fpstore_" + std::to_string(night) + ".ddp", dir);
+    }
+    for (int run = 0; run < 2; ++run) {
+        check_decode(concurrent[run], "bench_fpstore_run" + std::to_string(run) + ".ddp", dir);
+    }
+    check_decode(both, "bench_fpstore_both.ddp", dir);
+    printf("%d archives decoded, 2 of them written at the same time\n", nights + 3);
+
+    // The archives of the later nights refer to the earlier ones
+    for (int night = 0; night < nights; ++night) {
+        unlink(("bench_fpstore_" + std::to_string(night) + ".ddp").c_str());
+    }
+    for (int run = 0; run < 2; ++run) {
+        unlink(("bench_fpstore_run" + std::to_string(run) + ".ddp").c_str());
+    }
+    unlink("bench_fpstore_both.ddp");
+    for (const char* file: { "archives", "log", "index" }) {
+        unlink((std::string(dir) + "/" + file).c_str());
+    }
+    rmdir(dir);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,196 @@
+/* Cost of reading the input of the Fragment stage and cutting it into anchors.
+ *
+ * A file with repeated regions is cut into anchors, first the way the Fragment
+ * stage did: read a MAXBUF buffer, cut it, copy the bytes after the last
+ * anchor at the beginning of the next buffer. Then with an input_stream_t,
+ * whose reader thread reads the next blocks while the current one is cut, for
+ * several block sizes. Last, the mapped file is cut in memory with
+ * input_stream_next_anchor, the way the parallel Fragment of a preloaded or
+ * mapped input does. All must give the same anchors, the benchmark aborts
+ * otherwise. This is done with the window of the default Rabin tables, 0, and
+ * with the one of rabin_window, NWINDOW.
+ *
+ * Reported are MB per second, best of several passes, and the bytes of the
+ * buffers the input is read in. The file is read from the page cache after
+ * the first pass.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "dedupdef.h"
+#include "rabin.h"
+#include "input_stream.h"
+
+using Clock = std::chrono::steady_clock;
+
+static u32int rabintab[256];
+static u32int rabinwintab[256];
+
+static void generate(const char* path, size_t size) {
+    std::mt19937_64 gen(42);
+    std::vector<uint64_t> data(size / sizeof(uint64_t));
+    for (size_t i = 0; i < data.size();) {
+        // A random region, or a copy of an earlier one
+        size_t n = std::min<size_t>(data.size() - i, 1 + gen() % 65536);
+        if (i > n && gen() % 2) {
+            size_t from = gen() % (i - n);
+            std::copy(data.begin() + from, data.begin() + from + n, data.begin() + i);
+        } else {
+            for (size_t j = i; j < i + n; ++j) {
+                data[j] = gen();
+            }
+        }
+        i += n;
+    }
+
+    FILE* f = fopen(path, "wb");
+    if (f == NULL || fwrite(data.data(), sizeof(uint64_t), data.size(), f) != data.size()) {
+        fprintf(stderr, "Cannot write %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fclose(f);
+}
+
+// The loop of the Fragment stage before the input_stream_t
+static void split_maxbuf(int fd, int winlen, std::vector<size_t>& anchors) {
+    std::vector<u_char> left;
+    size_t allocated = MAXBUF + ANCHOR_JUMP;
+    u_char* buffer = (u_char*)malloc(allocated);
+
+    while (true) {
+        size_t capacity = MAXBUF + left.size();
+        if (capacity > allocated) {
+            allocated = capacity;
+            buffer = (u_char*)realloc(buffer, allocated);
+        }
+        std::copy(left.begin(), left.end(), buffer);
+        size_t n = left.size();
+        ssize_t rv;
+        while (n < capacity && (rv = read(fd, buffer + n, capacity - n)) > 0) {
+            n += rv;
+        }
+        if (n == left.size()) {
+            break;
+        }
+
+        size_t start = 0;
+        while (n - start > ANCHOR_JUMP) {
+            int offset = rabinseg_lanes(buffer + start + ANCHOR_JUMP, n - start - ANCHOR_JUMP, winlen, rabintab, rabinwintab);
+            if ((size_t)offset + ANCHOR_JUMP >= n - start) {
+                break;
+            }
+            anchors.push_back(offset + ANCHOR_JUMP);
+            start += offset + ANCHOR_JUMP;
+        }
+        left.assign(buffer + start, buffer + n);
+    }
+    if (!left.empty()) {
+        anchors.push_back(left.size());
+    }
+    free(buffer);
+}
+
+static void split_stream(int fd, size_t block_size, int read_ahead, int winlen, std::vector<size_t>& anchors) {
+    input_stream_t* in = input_stream_create(fd, block_size, read_ahead, 2 * ANCHOR_JUMP);
+    input_stream_split(in, winlen, rabintab, rabinwintab, [&](const u_char*, size_t n) { anchors.push_back(n); });
+    input_stream_destroy(in);
+}
+
+// The anchor chain of ParallelFragmentNaiveQueue over the mapped file
+static void split_mapped(int fd, int winlen, std::vector<size_t>& anchors) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        return;
+    }
+    size_t size = st.st_size;
+    uchar* buffer = (uchar*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (buffer == MAP_FAILED) {
+        fprintf(stderr, "Cannot map the input\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t anchor = 0; anchor < size;) {
+        size_t next = input_stream_next_anchor(buffer, size, anchor, winlen, rabintab, rabinwintab);
+        anchors.push_back(next - anchor);
+        anchor = next;
+    }
+    munmap(buffer, size);
+}
+
+int main(int argc, char** argv) {
+    size_t size = (argc > 1 ? atol(argv[1]) : 256) << 20;
+    int read_ahead = argc > 2 ? atoi(argv[2]) : 4;
+    int passes = argc > 3 ? atoi(argv[3]) : 3;
+    const char* path = "bench_fragment.dat";
+
+    if (size == 0 || read_ahead < 2 || passes <= 0) {
+        fprintf(stderr, "Usage: %s [size_MB] [read_ahead >= 2] [n_passes]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    generate(path, size);
+
+    printf("%zu MB, %d blocks read ahead\n", size >> 20, read_ahead);
+    for (int winlen: { 0, (int)NWINDOW }) {
+        rabininit(winlen, rabintab, rabinwintab);
+
+        std::vector<size_t> expected;
+        printf("\nWindow %d\n", winlen);
+        printf("%-12s %10s %12s %10s\n", "block", "MB/s", "buffers MB", "anchors");
+        // 0 for the MAXBUF buffers, SIZE_MAX for the mapped file
+        for (size_t block_size: { (size_t)0, (size_t)1 << 20, (size_t)4 << 20, (size_t)16 << 20, (size_t)64 << 20, SIZE_MAX }) {
+            double best = 0;
+            std::vector<size_t> anchors;
+            for (int pass = 0; pass < passes; ++pass) {
+                int fd = open(path, O_RDONLY);
+                if (fd < 0) {
+                    fprintf(stderr, "Cannot open %s\n", path);
+                    return EXIT_FAILURE;
+                }
+                anchors.clear();
+                auto begin = Clock::now();
+                if (block_size == 0) {
+                    split_maxbuf(fd, winlen, anchors);
+                } else if (block_size == SIZE_MAX) {
+                    split_mapped(fd, winlen, anchors);
+                } else {
+                    split_stream(fd, block_size, read_ahead, winlen, anchors);
+                }
+                best = std::max(best, size / std::chrono::duration<double>(Clock::now() - begin).count() / 1e6);
+                close(fd);
+            }
+
+            char name[32];
+            if (block_size == 0) {
+                snprintf(name, sizeof(name), "MAXBUF");
+            } else if (block_size == SIZE_MAX) {
+                snprintf(name, sizeof(name), "mapped");
+            } else {
+                snprintf(name, sizeof(name), "%zu MB", block_size >> 20);
+            }
+            if (block_size == 0) {
+                expected = anchors;
+            } else if (anchors != expected) {
+                fprintf(stderr, "Window %d, %s: the anchors differ\n", winlen, name);
+                return EXIT_FAILURE;
+            }
+            size_t buffers = block_size == 0 ? MAXBUF : block_size == SIZE_MAX ? size : read_ahead * (block_size + 2 * ANCHOR_JUMP);
+            printf("%-12s %10.1f %12zu %10zu\n", name, best, buffers >> 20, anchors.size());
+        }
+    }
+
+    unlink(path);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,95 @@
+/* Microbenchmark comparing the NaivePromise implementations with the bitmap
+ * based one.
+ *
+ * Footprint: bytes of synchronization objects allocated per promise (the
+ * _values vector is identical for all of them and is not counted).
+ *
+ * Latency:
+ *  - set/get: one thread sets every index then gets it back, no contention.
+ *  - ping-pong: a producer sets index i, the consumer gets it then the
+ *    producer waits for the consumer's acknowledgement on a second promise
+ *    before moving on. Reported time is per round trip.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "promises/bitmap_promise.h"
+#include "promises/naive_promise.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double ns_per_op(Clock::time_point const& begin, Clock::time_point const& end, int n) {
+    return double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()) / n;
+}
+
+template<typename P>
+static double bench_set_get(int n) {
+    std::unique_ptr<P> promise = std::make_unique<P>(n);
+    auto begin = Clock::now();
+    for (int i = 0; i < n; ++i) {
+        promise->set(i);
+        promise->get(i);
+    }
+    auto end = Clock::now();
+    return ns_per_op(begin, end, n);
+}
+
+template<typename P>
+static double bench_ping_pong(int n) {
+    std::unique_ptr<P> ping = std::make_unique<P>(n);
+    std::unique_ptr<P> pong = std::make_unique<P>(n);
+
+    auto begin = Clock::now();
+    std::thread consumer([&]() {
+        for (int i = 0; i < n; ++i) {
+            ping->get(i);
+            pong->set(i);
+        }
+    });
+
+    for (int i = 0; i < n; ++i) {
+        ping->set(i);
+        pong->get(i);
+    }
+
+    consumer.join();
+    auto end = Clock::now();
+    return ns_per_op(begin, end, n);
+}
+
+template<typename P>
+static void run(const char* name, size_t footprint, int n_set_get, int n_ping_pong) {
+    double set_get = bench_set_get<P>(n_set_get);
+    double ping_pong = bench_ping_pong<P>(n_ping_pong);
+    printf("%-20s %14zu %12.2f %14.2f\n", name, footprint, set_get, ping_pong);
+}
+
+int main(int argc, char** argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 1 << 20;
+    int n_ping_pong = argc > 2 ? atoi(argv[2]) : 1 << 16;
+
+    if (n <= 0 || n_ping_pong <= 0) {
+        fprintf(stderr, "Usage: %s [n_indices] [n_round_trips]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    size_t active = size_t(n) * (sizeof(std::atomic<bool>) + sizeof(NaiveSetMutex));
+    size_t passive = size_t(n) * (sizeof(bool) + sizeof(std::pair<std::mutex, std::condition_variable>) + sizeof(NaiveSetMutex));
+    size_t bitmap = BitmapPromiseBase::footprint(n);
+
+    printf("%d indices, %d round trips\n", n, n_ping_pong);
+    printf("%-20s %14s %12s %14s\n", "promise", "footprint (B)", "set/get (ns)", "ping-pong (ns)");
+    run<ActiveNaivePromise<void>>("ActiveNaivePromise", active, n, n_ping_pong);
+    run<PassiveNaivePromise<void>>("PassiveNaivePromise", passive, n, n_ping_pong);
+    run<ActiveNaivePromise<void, SpinFutexWait>>("ActiveNaive/futex", active, n, n_ping_pong);
+    run<BitmapPromise<void, SpinWait>>("Bitmap/spin", bitmap, n, n_ping_pong);
+    run<BitmapPromise<void>>("Bitmap/futex", bitmap, n, n_ping_pong);
+
+    return EXIT_SUCCESS;
+}
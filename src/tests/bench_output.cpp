@@ -0,0 +1,133 @@
+/* Cost of writing the records of a .ddp archive.
+ *
+ * A stream of records like the Reorder stage writes, two thirds of them
+ * duplicates (a SHA1 sum) and the others compressed chunks of 1 to 4 KB, is
+ * written with the three xwrite calls per record of write_file, then with the
+ * output_writer_t in its different modes. All files must be identical, the
+ * benchmark aborts otherwise.
+ *
+ * Reported are the throughput in thousands of records per second, best of
+ * several passes, and the number of write system calls.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dedupdef.h"
+#include "output_writer.h"
+#include "util.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Record {
+    u_char type;
+    std::vector<char> content;
+};
+
+static std::vector<Record> generate(size_t n) {
+    std::mt19937 gen(42);
+    std::vector<Record> records(n);
+    for (Record& record: records) {
+        record.type = gen() % 3 == 0 ? TYPE_COMPRESS : TYPE_FINGERPRINT;
+        record.content.resize(record.type == TYPE_COMPRESS ? 1024 + gen() % 3072 : SHA1_LEN);
+        for (char& c: record.content) {
+            c = gen();
+        }
+    }
+    return records;
+}
+
+static int create(std::string const& path) {
+    int fd = open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd < 0 || write_header(fd, COMPRESS_GZIP) != 0) {
+        fprintf(stderr, "Cannot create %s\n", path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+// Same as write_file of the encoder
+static void write_file(int fd, u_char type, u_long len, const void* content) {
+    if (xwrite(fd, &type, sizeof(type)) < 0 || xwrite(fd, &len, sizeof(len)) < 0 || xwrite(fd, content, len) < 0) {
+        fprintf(stderr, "xwrite fails\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static std::vector<char> contents(std::string const& path) {
+    std::ifstream stream(path, std::ios::binary);
+    return std::vector<char>((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? atol(argv[1]) : 1 << 20;
+    int passes = argc > 2 ? atoi(argv[2]) : 3;
+    std::string path = argc > 3 ? argv[3] : "bench_output.ddp";
+
+    if (n == 0 || passes <= 0) {
+        fprintf(stderr, "Usage: %s [n_records] [n_passes] [output_file]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Record> records = generate(n);
+
+    struct { const char* name; int buffered; size_t size; int flags; } modes[] = {
+        { "write_file", FALSE, 0, 0 },
+        { "writev", TRUE, 0, 0 },
+        { "buffer 64K", TRUE, 64 << 10, 0 },
+        { "buffer 1M", TRUE, 1 << 20, 0 },
+        { "flusher 1M", TRUE, 1 << 20, OUTPUT_FLUSHER },
+        { "direct 1M", TRUE, 1 << 20, OUTPUT_DIRECT },
+        { "direct+flusher 1M", TRUE, 1 << 20, OUTPUT_DIRECT | OUTPUT_FLUSHER },
+    };
+
+    std::vector<char> expected;
+    printf("%zu records\n", n);
+    printf("%-18s %12s %12s\n", "mode", "Krecords/s", "syscalls");
+    for (auto const& mode: modes) {
+        double best = 0;
+        u_long syscalls = 0;
+        for (int pass = 0; pass < passes; ++pass) {
+            int fd = create(path);
+            auto begin = Clock::now();
+            if (mode.buffered) {
+                output_writer_t* out = output_writer_create(fd, mode.size, mode.flags);
+                for (Record const& record: records) {
+                    output_writer_record(out, record.type, record.content.size(), record.content.data());
+                }
+                syscalls = output_writer_syscalls(out);
+                output_writer_destroy(out);
+            } else {
+                for (Record const& record: records) {
+                    write_file(fd, record.type, record.content.size(), record.content.data());
+                }
+                syscalls = 3 * n;
+            }
+            double krs = n / std::chrono::duration<double>(Clock::now() - begin).count() / 1e3;
+            close(fd);
+            best = std::max(best, krs);
+        }
+
+        std::vector<char> written = contents(path);
+        if (expected.empty()) {
+            expected = written;
+        } else if (written != expected) {
+            fprintf(stderr, "%s: the file differs from the one of write_file\n", mode.name);
+            return EXIT_FAILURE;
+        }
+        printf("%-18s %12.1f %12lu\n", mode.name, best, syscalls);
+    }
+
+    unlink(path.c_str());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,104 @@
+/* Throughput of the Rabin boundary finders used by Fragment and Refine.
+ *
+ * A random buffer is cut the way Refine does it: call the finder, split at the
+ * returned offset, repeat on the remainder. The multi-lane finder must produce
+ * exactly the same cut points as rabinseg, the benchmark aborts otherwise.
+ *
+ * Both windows of the encoders are measured: the tables built for a window of
+ * 0 byte, the default, with which rabinseg_lanes is rabinseg, and the tables
+ * built for NWINDOW bytes of the rabin_window option, which cut elsewhere.
+ *
+ * Reported throughput is in GB/s of input, best of several passes.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "dedupdef.h"
+#include "rabin.h"
+
+using Clock = std::chrono::steady_clock;
+
+typedef int (*Finder)(uchar*, int, int, u32int*, u32int*);
+
+struct Window {
+    int winlen;
+    u32int rabintab[256];
+    u32int rabinwintab[256];
+};
+
+static void cut(Finder finder, Window& w, uchar* buffer, int n, std::vector<int>& cuts) {
+    cuts.clear();
+    int offset = 0;
+    while (offset < n) {
+        offset += finder(buffer + offset, n - offset, w.winlen, w.rabintab, w.rabinwintab);
+        cuts.push_back(offset);
+    }
+}
+
+static double bench(Finder finder, Window& w, uchar* buffer, int n, int passes, std::vector<int>& cuts) {
+    double best = 0;
+    for (int pass = 0; pass < passes; ++pass) {
+        auto begin = Clock::now();
+        cut(finder, w, buffer, n, cuts);
+        auto end = Clock::now();
+        double seconds = std::chrono::duration<double>(end - begin).count();
+        double gbs = n / seconds / 1e9;
+        if (gbs > best)
+            best = gbs;
+    }
+    return best;
+}
+
+/* Edge cases around the lane seams and the serial tail */
+static bool check_small_buffers(uchar* buffer, Window& w) {
+    for (int n = 0; n < 4 * RabinLanes * RabinLaneSpan; ++n) {
+        for (int shift = 0; shift < 64; shift += 7) {
+            int expected = rabinseg(buffer + shift, n, w.winlen, w.rabintab, w.rabinwintab);
+            int got = rabinseg_lanes(buffer + shift, n, w.winlen, w.rabintab, w.rabinwintab);
+            if (expected != got) {
+                fprintf(stderr, "Mismatch on %d bytes at shift %d with a window of %d: %d vs %d\n", n, shift, w.winlen, expected, got);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 1 << 28;
+    int passes = argc > 2 ? atoi(argv[2]) : 5;
+
+    if (n <= 0 || passes <= 0) {
+        fprintf(stderr, "Usage: %s [n_bytes] [n_passes]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uchar> buffer(n);
+    srand(42);
+    for (int i = 0; i < n; ++i)
+        buffer[i] = rand() & 0xff;
+
+    printf("%d bytes, %d lanes of %d bytes\n", n, (int)RabinLanes, (int)RabinLaneSpan);
+    printf("%-8s %10s %14s %14s\n", "window", "cuts", "rabinseg GB/s", "lanes GB/s");
+    for (int winlen: { 0, (int)NWINDOW }) {
+        Window w;
+        w.winlen = winlen;
+        rabininit(winlen, w.rabintab, w.rabinwintab);
+        if (!check_small_buffers(buffer.data(), w))
+            return EXIT_FAILURE;
+
+        std::vector<int> serial_cuts, lanes_cuts;
+        double serial = bench(rabinseg, w, buffer.data(), n, passes, serial_cuts);
+        double lanes = bench(rabinseg_lanes, w, buffer.data(), n, passes, lanes_cuts);
+        if (serial_cuts != lanes_cuts) {
+            fprintf(stderr, "Cut points differ with a window of %d (%zu vs %zu cuts)\n", winlen, serial_cuts.size(), lanes_cuts.size());
+            return EXIT_FAILURE;
+        }
+        printf("%-8d %10zu %14.3f %14.3f\n", winlen, serial_cuts.size(), serial, lanes);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,172 @@
+/* Cost of putting the chunks back in sequence in the Reorder stage.
+ *
+ * Chunks of anchors cut into a random number of chunks are delivered out of
+ * order, every chunk up to a given distance from its place, the way several
+ * Refine and Compress threads deliver them. They are put back in sequence with
+ * the search tree of binary heaps the Reorder stage used, then with the
+ * reorder window. Both must give the sequence back, the benchmark aborts
+ * otherwise.
+ *
+ * Reported are millions of chunks per second, best of several passes, for
+ * increasing distances.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "dedupdef.h"
+#include "binheap.h"
+#include "tree.h"
+#include "reorder_window.h"
+
+using Clock = std::chrono::steady_clock;
+
+static std::vector<chunk_t> generate(size_t n_anchors) {
+    std::mt19937 gen(42);
+    std::vector<chunk_t> chunks;
+    for (sequence_number_t l1num = 0; l1num < n_anchors; ++l1num) {
+        sequence_number_t n_chunks = 1 + gen() % 1024;
+        for (sequence_number_t l2num = 0; l2num < n_chunks; ++l2num) {
+            chunk_t chunk;
+            memset(&chunk, 0, sizeof(chunk));
+            chunk.sequence.l1num = l1num;
+            chunk.sequence.l2num = l2num;
+            chunk.isLastL2Chunk = l2num == n_chunks - 1;
+            chunks.push_back(chunk);
+        }
+    }
+    return chunks;
+}
+
+// Every chunk moves forward or backward by at most distance places
+static std::vector<chunk_t*> shuffle(std::vector<chunk_t>& chunks, size_t distance) {
+    std::mt19937 gen(42);
+    std::vector<std::pair<size_t, chunk_t*>> keys;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        keys.emplace_back(i + gen() % (distance + 1), &chunks[i]);
+    }
+    std::stable_sort(keys.begin(), keys.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+
+    std::vector<chunk_t*> order;
+    for (auto const& key: keys) {
+        order.push_back(key.second);
+    }
+    return order;
+}
+
+static void check(std::vector<chunk_t*> const& written, std::vector<chunk_t>& chunks, const char* what) {
+    bool ok = written.size() == chunks.size();
+    for (size_t i = 0; ok && i < written.size(); ++i) {
+        ok = written[i] == &chunks[i];
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: chunks are not back in sequence\n", what);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// The loop of the Reorder stage before the reorder window
+static void reorder_tree(std::vector<chunk_t*> const& order, std::vector<chunk_t*>& written) {
+    SearchTree T = TreeMakeEmpty(NULL);
+    Position pos = NULL;
+    struct tree_element tele;
+    std::vector<sequence_number_t> chunks_per_anchor;
+    sequence_t next;
+    sequence_reset(&next);
+
+    for (chunk_t* chunk: order) {
+        if (chunk->sequence.l1num >= chunks_per_anchor.size()) {
+            chunks_per_anchor.resize(2 * (chunk->sequence.l1num + 1), 0);
+        }
+        if (chunk->isLastL2Chunk) {
+            chunks_per_anchor[chunk->sequence.l1num] = chunk->sequence.l2num + 1;
+        }
+
+        if (!sequence_eq(chunk->sequence, next)) {
+            pos = TreeFind(chunk->sequence.l1num, T);
+            if (pos == NULL) {
+                tele.l1num = chunk->sequence.l1num;
+                tele.queue = Initialize(4096);
+                Insert(chunk, tele.queue);
+                T = TreeInsert(tele, T);
+            } else {
+                Insert(chunk, pos->Element.queue);
+            }
+            continue;
+        }
+
+        pos = TreeFindMin(T);
+        do {
+            written.push_back(chunk);
+            sequence_inc_l2(&next);
+            if (chunks_per_anchor[next.l1num] != 0 && next.l2num == chunks_per_anchor[next.l1num]) sequence_inc_l1(&next);
+
+            chunk = NULL;
+            if (pos != NULL && pos->Element.l1num == next.l1num) {
+                chunk = FindMin(pos->Element.queue);
+                if (sequence_eq(chunk->sequence, next)) {
+                    DeleteMin(pos->Element.queue);
+                    if (IsEmpty(pos->Element.queue)) {
+                        Destroy(pos->Element.queue);
+                        T = TreeDelete(pos->Element, T);
+                        pos = TreeFindMin(T);
+                    }
+                } else {
+                    chunk = NULL;
+                }
+            }
+        } while (chunk != NULL);
+    }
+}
+
+static void reorder_window(std::vector<chunk_t*> const& order, std::vector<chunk_t*>& written) {
+    reorder_window_t* window = reorder_window_create(512);
+    for (chunk_t* chunk: order) {
+        reorder_window_insert(window, chunk);
+        while ((chunk = reorder_window_next(window)) != NULL) {
+            written.push_back(chunk);
+        }
+    }
+    reorder_window_destroy(window);
+}
+
+int main(int argc, char** argv) {
+    size_t n_anchors = argc > 1 ? atol(argv[1]) : 2048;
+    int passes = argc > 2 ? atoi(argv[2]) : 3;
+
+    if (n_anchors == 0 || passes <= 0) {
+        fprintf(stderr, "Usage: %s [n_anchors] [n_passes]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<chunk_t> chunks = generate(n_anchors);
+    printf("%zu chunks in %zu anchors\n", chunks.size(), n_anchors);
+    printf("%10s %12s %12s\n", "distance", "tree Mc/s", "window Mc/s");
+    for (size_t distance: { 0, 16, 256, 4096, 65536 }) {
+        std::vector<chunk_t*> order = shuffle(chunks, distance);
+        double best[2] = { 0, 0 };
+        for (int pass = 0; pass < passes; ++pass) {
+            for (int with_window = 0; with_window < 2; ++with_window) {
+                std::vector<chunk_t*> written;
+                written.reserve(chunks.size());
+                auto begin = Clock::now();
+                if (with_window) {
+                    reorder_window(order, written);
+                } else {
+                    reorder_tree(order, written);
+                }
+                double mcs = chunks.size() / std::chrono::duration<double>(Clock::now() - begin).count() / 1e6;
+                check(written, chunks, with_window ? "window" : "tree");
+                best[with_window] = std::max(best[with_window], mcs);
+            }
+        }
+        printf("%10zu %12.1f %12.1f\n", distance, best[0], best[1]);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+/* Cost of allocating the chunks of the pipeline.
+ *
+ * Producer threads allocate objects of the size of a chunk_t and hand them in
+ * batches to a consumer thread, which frees them, the way Refine allocates the
+ * chunks that Reorder frees. The objects are allocated with malloc, then from
+ * the slab cache. Every object is filled with the number of its producer and
+ * checked when freed, the benchmark aborts if two live objects overlap. The
+ * mbuffer_create and mbuffer_free pair, a single allocation with its MCB now,
+ * is timed as well.
+ *
+ * Reported are millions of objects per second, best of several passes.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "dedupdef.h"
+#include "mbuffer.h"
+#include "slab.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const size_t batch_size = 64;
+
+static double run(slab_cache_t* slabs, int n_producers, size_t n) {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::vector<chunk_t*>> batches;
+    int producing = n_producers;
+
+    auto produce = [&](int id) {
+        std::vector<chunk_t*> batch;
+        for (size_t i = 0; i < n; ++i) {
+            chunk_t* chunk = (chunk_t*)(slabs != NULL ? slab_alloc(slabs) : malloc(sizeof(chunk_t)));
+            memset(chunk, id, sizeof(chunk_t));
+            batch.push_back(chunk);
+            if (batch.size() == batch_size || i == n - 1) {
+                std::unique_lock<std::mutex> lck(mutex);
+                batches.push_back(std::move(batch));
+                batch.clear();
+                cond.notify_one();
+            }
+        }
+        std::unique_lock<std::mutex> lck(mutex);
+        --producing;
+        cond.notify_one();
+    };
+
+    auto consume = [&]() {
+        while (true) {
+            std::vector<chunk_t*> batch;
+            {
+                std::unique_lock<std::mutex> lck(mutex);
+                cond.wait(lck, [&]() { return !batches.empty() || producing == 0; });
+                if (batches.empty()) {
+                    return;
+                }
+                batch = std::move(batches.front());
+                batches.pop_front();
+            }
+            for (chunk_t* chunk: batch) {
+                unsigned char id = *(unsigned char*)chunk;
+                for (size_t i = 0; i < sizeof(chunk_t); ++i) {
+                    if (((unsigned char*)chunk)[i] != id) {
+                        fprintf(stderr, "Two live objects overlap\n");
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                if (slabs != NULL) {
+                    slab_free(chunk);
+                } else {
+                    free(chunk);
+                }
+            }
+        }
+    };
+
+    auto begin = Clock::now();
+    std::thread consumer(consume);
+    std::vector<std::thread> producers;
+    for (int id = 0; id < n_producers; ++id) {
+        producers.emplace_back(produce, id + 1);
+    }
+    for (std::thread& producer: producers) {
+        producer.join();
+    }
+    consumer.join();
+    return n_producers * n / std::chrono::duration<double>(Clock::now() - begin).count() / 1e6;
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? atol(argv[1]) : 1 << 20;
+    int max_producers = argc > 2 ? atoi(argv[2]) : 4;
+    int passes = argc > 3 ? atoi(argv[3]) : 3;
+
+    if (n == 0 || max_producers <= 0 || max_producers > 255 || passes <= 0) {
+        fprintf(stderr, "Usage: %s [n_objects] [max_producers] [n_passes]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%zu objects of %zu bytes per producer\n", n, sizeof(chunk_t));
+    printf("%10s %12s %12s %8s\n", "producers", "malloc Mo/s", "slab Mo/s", "slabs");
+    for (int n_producers = 1; n_producers <= max_producers; n_producers *= 2) {
+        double best[2] = { 0, 0 };
+        size_t n_slabs = 0;
+        for (int pass = 0; pass < passes; ++pass) {
+            best[0] = std::max(best[0], run(NULL, n_producers, n));
+            slab_cache_t* slabs = slab_cache_create(sizeof(chunk_t));
+            best[1] = std::max(best[1], run(slabs, n_producers, n));
+            n_slabs = slab_cache_slabs(slabs);
+            slab_cache_destroy(slabs);
+        }
+        printf("%10d %12.1f %12.1f %8zu\n", n_producers, best[0], best[1], n_slabs);
+    }
+
+    mbuffer_system_init();
+    double best = 0;
+    for (int pass = 0; pass < passes; ++pass) {
+        auto begin = Clock::now();
+        for (size_t i = 0; i < n; ++i) {
+            mbuffer_t m;
+            if (mbuffer_create(&m, 4096) != 0) {
+                fprintf(stderr, "mbuffer_create fails\n");
+                return EXIT_FAILURE;
+            }
+            ((char*)m.ptr)[4095] = 1;
+            mbuffer_free(&m);
+        }
+        best = std::max(best, n / std::chrono::duration<double>(Clock::now() - begin).count() / 1e6);
+    }
+    mbuffer_system_destroy();
+    printf("mbuffer_create and mbuffer_free of 4 KB: %.1f Mo/s\n", best);
+
+    return EXIT_SUCCESS;
+}
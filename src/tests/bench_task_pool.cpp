@@ -0,0 +1,220 @@
+/* Stages as tasks of the work-stealing pool of run_tasks.
+ *
+ * Generated text-like data is cut in chunks of the average size of refined
+ * chunks, which go through two stages as unbalanced as Deduplicate and
+ * Compress: a hash of the chunk, then its gzip compression. The stages run
+ * once with a fixed number of threads each, half of the threads for each
+ * stage with a queue between them, as a configuration of the layers without
+ * tuning does, and once as tasks of a task_pool_t with as many workers: a
+ * hash task per batch of chunks, which submits the compress task of its batch.
+ * Both must give the same results for every chunk, each computed once, the
+ * benchmark aborts otherwise. So must a tree of tasks submitting tasks.
+ *
+ * Reported are the seconds and MB/s of uncompressed data of both, and the
+ * tasks stolen from another worker.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "dedupdef.h"
+#include "compressor.h"
+#include "task_pool.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const size_t chunk_size = 8192;
+static const size_t batch_size = 32;
+
+struct Result {
+    uint64_t hash;
+    size_t compressed;
+    std::atomic<int> runs;
+};
+
+static std::vector<char> generate(size_t size) {
+    static const char* words[] = { "dedup", "chunk", "anchor", "rabin", "fingerprint", "compress",
+                                   "reorder", "fifo", "thread", "layer", "the", "of", "and", "a" };
+    std::mt19937 gen(42);
+    std::vector<char> data;
+    while (data.size() < size) {
+        const char* word = words[gen() % (sizeof(words) / sizeof(words[0]))];
+        data.insert(data.end(), word, word + strlen(word));
+        data.push_back(gen() % 8 == 0 ? '\n' : ' ');
+    }
+    data.resize(size);
+    return data;
+}
+
+// FNV-1a, about as cheap per byte as a SHA1 sum is next to gzip
+static uint64_t hash(const char* p, size_t n) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < n; ++i) {
+        h = (h ^ (unsigned char)p[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+struct Bench {
+    std::vector<char> const& data;
+    size_t n_chunks;
+    std::vector<Result> results;
+
+    Bench(std::vector<char> const& d) : data(d), n_chunks((d.size() + chunk_size - 1) / chunk_size), results(n_chunks) {
+        for (auto& r: results) {
+            r.runs = 0;
+        }
+    }
+
+    size_t batches() const {
+        return (n_chunks + batch_size - 1) / batch_size;
+    }
+
+    void hash_batch(size_t batch) {
+        for (size_t i = batch * batch_size; i < std::min(n_chunks, (batch + 1) * batch_size); ++i) {
+            results[i].hash = hash(data.data() + i * chunk_size, std::min(chunk_size, data.size() - i * chunk_size));
+        }
+    }
+
+    void compress_batch(compressor_t* compressor, size_t batch) {
+        for (size_t i = batch * batch_size; i < std::min(n_chunks, (batch + 1) * batch_size); ++i) {
+            if (compressor_compress(compressor, data.data() + i * chunk_size, std::min(chunk_size, data.size() - i * chunk_size),
+                                    &results[i].compressed) == NULL) {
+                fprintf(stderr, "Compression failed\n");
+                exit(EXIT_FAILURE);
+            }
+            results[i].runs++;
+        }
+    }
+};
+
+static compressor_t* thread_compressor() {
+    static thread_local std::unique_ptr<compressor_t, decltype(&compressor_destroy)> compressor(nullptr, compressor_destroy);
+    if (!compressor) {
+        compressor.reset(compressor_create(COMPRESS_GZIP, 0));
+    }
+    return compressor.get();
+}
+
+// Half of the threads hash, the other half compress
+static double run_fixed(Bench& bench, unsigned int threads) {
+    unsigned int hashers = std::max(1U, threads / 2), compressors = std::max(1U, threads - hashers);
+    std::atomic<size_t> next(0);
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<size_t> queue;
+    unsigned int hashing = hashers;
+    std::vector<std::thread> pool;
+
+    auto begin = Clock::now();
+    for (unsigned int i = 0; i < hashers; ++i) {
+        pool.emplace_back([&]() {
+            size_t batch;
+            while ((batch = next++) < bench.batches()) {
+                bench.hash_batch(batch);
+                std::unique_lock<std::mutex> lck(mutex);
+                queue.push_back(batch);
+                cond.notify_one();
+            }
+            std::unique_lock<std::mutex> lck(mutex);
+            if (--hashing == 0) {
+                cond.notify_all();
+            }
+        });
+    }
+    for (unsigned int i = 0; i < compressors; ++i) {
+        pool.emplace_back([&]() {
+            while (true) {
+                std::unique_lock<std::mutex> lck(mutex);
+                cond.wait(lck, [&]() { return !queue.empty() || hashing == 0; });
+                if (queue.empty()) {
+                    return;
+                }
+                size_t batch = queue.front();
+                queue.pop_front();
+                lck.unlock();
+                bench.compress_batch(thread_compressor(), batch);
+            }
+        });
+    }
+    for (auto& t: pool) {
+        t.join();
+    }
+    return std::chrono::duration<double>(Clock::now() - begin).count();
+}
+
+static double run_tasks(Bench& bench, task_pool_t* pool) {
+    auto begin = Clock::now();
+    for (size_t batch = 0; batch < bench.batches(); ++batch) {
+        task_pool_submit(pool, [&bench, pool, batch]() {
+            bench.hash_batch(batch);
+            task_pool_submit(pool, [&bench, batch]() { bench.compress_batch(thread_compressor(), batch); });
+        });
+    }
+    task_pool_wait(pool);
+    return std::chrono::duration<double>(Clock::now() - begin).count();
+}
+
+// Every task of a binary tree of the given depth counts itself
+static void tree(task_pool_t* pool, std::atomic<u_long>* count, int depth) {
+    (*count)++;
+    if (depth > 0) {
+        task_pool_submit(pool, [=]() { tree(pool, count, depth - 1); });
+        task_pool_submit(pool, [=]() { tree(pool, count, depth - 1); });
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t size = (argc > 1 ? atol(argv[1]) : 64) << 20;
+    unsigned int threads = argc > 2 ? atoi(argv[2]) : std::max(2U, std::thread::hardware_concurrency());
+
+    if (size == 0 || threads < 2) {
+        fprintf(stderr, "Usage: %s [size_MB] [n_threads >= 2]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<char> data = generate(size);
+    Bench fixed(data), tasks(data);
+    task_pool_t* pool = task_pool_create(threads);
+
+    double fixed_seconds = run_fixed(fixed, threads);
+    double tasks_seconds = run_tasks(tasks, pool);
+    for (size_t i = 0; i < fixed.n_chunks; ++i) {
+        if (fixed.results[i].runs != 1 || tasks.results[i].runs != 1 || fixed.results[i].hash != tasks.results[i].hash ||
+            fixed.results[i].compressed != tasks.results[i].compressed) {
+            fprintf(stderr, "Chunk %zu: different results\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+    u_long steals = task_pool_steals(pool);
+
+    // The pool is used again once it waited
+    for (int depth: { 10, 14 }) {
+        std::atomic<u_long> count(0);
+        task_pool_submit(pool, [&count, pool, depth]() { tree(pool, &count, depth); });
+        task_pool_wait(pool);
+        if (count != (2UL << depth) - 1) {
+            fprintf(stderr, "%lu tasks of a tree of depth %d run\n", count.load(), depth);
+            return EXIT_FAILURE;
+        }
+    }
+    task_pool_destroy(pool);
+
+    printf("%zu MB in %zu chunks of %zu bytes, %u threads\n", size >> 20, fixed.n_chunks, chunk_size, threads);
+    printf("%-24s %10s %10s\n", "", "seconds", "MB/s");
+    printf("%-24s %10.3f %10.1f\n", "threads per stage", fixed_seconds, size / fixed_seconds / 1e6);
+    printf("%-24s %10.3f %10.1f\n", "work-stealing tasks", tasks_seconds, size / tasks_seconds / 1e6);
+    printf("%lu tasks stolen\n", steals);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,104 @@
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <omp.h>
+
+#include "promises/dynamic_step_promise.h"
+
+/* A producer sets a value every few microseconds while a consumer reads them
+ * as soon as they are published. The step controller of the TIMER modes must
+ * keep the time between the set of a value and the return of its get under the
+ * latency bound of the promise, on average once it had a few windows to tune
+ * the step. The consumer may also start late: the step must not grow meanwhile
+ * past the step at which the bound holds once it caught up.
+ *
+ * The latencies are only checked with at least two hardware threads: on a
+ * single one, they are the time slices of the scheduler.
+ */
+
+using Clock = std::chrono::steady_clock;
+using D = DynamicStepPromiseMode;
+
+static const uint64 max_wait_ns = DSP_DEFAULT_MAX_WAIT_NS;
+
+static void spin_for(std::chrono::nanoseconds duration) {
+    auto end = Clock::now() + duration;
+    while (Clock::now() < end)
+        ;
+}
+
+template<DynamicStepPromiseMode mode>
+static bool test_latency(const char* name, int nb_values, std::chrono::nanoseconds period, std::chrono::milliseconds consumer_delay) {
+    DynamicStepPromiseBuilder<int, mode> builder(nb_values, 1, 2, max_wait_ns);
+    DynamicStepPromise<int, mode>* promise = static_cast<DynamicStepPromise<int, mode>*>(builder.new_promise());
+    std::vector<Clock::time_point> set_times(nb_values);
+    std::vector<double> latencies(nb_values);
+    unsigned int max_step = 0;
+    bool ok = true;
+
+    #pragma omp parallel num_threads(2)
+    {
+        if (omp_get_thread_num() == 0) {
+            for (int i = 0; i < nb_values; ++i) {
+                spin_for(period);
+                set_times[i] = Clock::now();
+                if (i == nb_values - 1)
+                    promise->set_immediate(i, i);
+                else
+                    promise->set(i, i);
+                max_step = std::max(max_step, promise->get_step());
+            }
+        } else {
+            std::this_thread::sleep_for(consumer_delay);
+            for (int i = 0; i < nb_values; ++i) {
+                if (promise->get(i) != i) {
+                    std::cerr << name << ": index " << i << " has a wrong value" << std::endl;
+                    ok = false;
+                }
+                latencies[i] = std::chrono::duration<double, std::nano>(Clock::now() - set_times[i]).count();
+            }
+        }
+    }
+
+    // The last quarter: after the first windows, and after a late consumer caught up
+    double average = 0, worst = 0;
+    int from = nb_values - nb_values / 4;
+    for (int i = from; i < nb_values; ++i) {
+        average += latencies[i];
+        worst = std::max(worst, latencies[i]);
+    }
+    average /= nb_values - from;
+
+    std::cout << name << ": average latency " << average / 1000 << " us, max " << worst / 1000 << " us, step "
+              << promise->get_step() << " (max " << max_step << ")" << std::endl;
+    if (max_step > 2 * max_wait_ns / period.count()) {
+        std::cerr << name << ": step grew past the step at which the bound holds" << std::endl;
+        ok = false;
+    }
+    if (std::thread::hardware_concurrency() >= 2 && average > max_wait_ns) {
+        std::cerr << name << ": average latency over the bound of " << max_wait_ns / 1000 << " us" << std::endl;
+        ok = false;
+    }
+
+    delete promise;
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    for (auto delay: { std::chrono::milliseconds(0), std::chrono::milliseconds(100) }) {
+        ok &= test_latency<D::SET_STEP_PRODUCER_TIMER>("PRODUCER_TIMER", 200000, std::chrono::microseconds(2), delay);
+        ok &= test_latency<D::SET_STEP_PRODUCER_TIMER_UNBLOCK>("PRODUCER_TIMER_UNBLOCK", 200000, std::chrono::microseconds(2), delay);
+        ok &= test_latency<D::SET_STEP_TIMER_UNBLOCK>("TIMER_UNBLOCK", 200000, std::chrono::microseconds(2), delay);
+    }
+    // Sets much faster than the bound: the step has room to grow
+    ok &= test_latency<D::SET_STEP_PRODUCER_TIMER>("PRODUCER_TIMER fast", 2000000, std::chrono::nanoseconds(100), std::chrono::milliseconds(0));
+
+    std::cout << (ok ? "OK" : "FAILED") << std::endl;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,83 @@
+#include <cstdlib>
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <omp.h>
+
+#include "promises/multi_producer_promise.h"
+
+/* Several producers fill interleaved tiles of the promise in a shuffled
+ * order while one consumer reads it sequentially. The consumer must never
+ * observe an index before every index below it has been set.
+ */
+
+static bool test_values(int nb_values, int n_producers) {
+    MultiProducerPromiseBuilder<int, SpinYieldWait> builder(nb_values, n_producers + 1);
+    PromisePlus<int>* promise = builder.new_promise();
+    MultiProducerPromise<int, SpinYieldWait>* mpp = static_cast<MultiProducerPromise<int, SpinYieldWait>*>(promise);
+    bool ok = true;
+
+    #pragma omp parallel num_threads(n_producers + 1)
+    {
+        int rank = omp_get_thread_num();
+        if (rank == n_producers) {
+            for (int i = 0; i < nb_values; ++i) {
+                int value = promise->get(i);
+                if (value != i || mpp->ready_prefix() < i) {
+                    std::cerr << "Index " << i << ": got " << value << ", prefix " << mpp->ready_prefix() << std::endl;
+                    ok = false;
+                }
+            }
+        } else {
+            std::vector<int> mine;
+            for (int i = rank; i < nb_values; i += n_producers)
+                mine.push_back(i);
+            std::shuffle(mine.begin(), mine.end(), std::mt19937(rank));
+
+            for (int i: mine)
+                promise->set(i, i);
+        }
+    }
+
+    delete promise;
+    return ok;
+}
+
+static bool test_ranges(int nb_values, int tile, int n_producers) {
+    MultiProducerPromiseBuilder<void> builder(nb_values, n_producers + 1);
+    MultiProducerPromise<void>* promise = static_cast<MultiProducerPromise<void>*>(builder.new_promise());
+    bool ok = true;
+
+    #pragma omp parallel num_threads(n_producers + 1)
+    {
+        int rank = omp_get_thread_num();
+        if (rank == n_producers) {
+            promise->get(nb_values - 1);
+            ok = promise->ready_prefix() == nb_values - 1;
+        } else {
+            // Tiles handed out backwards so that the prefix only completes at the end
+            int n_tiles = (nb_values + tile - 1) / tile;
+            for (int t = n_tiles - 1 - rank; t >= 0; t -= n_producers)
+                promise->set_range(t * tile, std::min(nb_values, (t + 1) * tile));
+        }
+    }
+
+    delete promise;
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    ok &= test_values(100000, 3);
+    ok &= test_values(1000, 1);
+    ok &= test_ranges(100003, 97, 4);
+    ok &= test_ranges(64 * 40, 64, 2);
+
+    std::cout << (ok ? "OK" : "FAILED") << std::endl;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
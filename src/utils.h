@@ -28,6 +28,8 @@
 #define NO_COPY_OP_T2(CLASS, T1, T2) CLASS<T1, T2>& operator=(CLASS<T1, T2> const&) = delete
 #define NO_COPY_T2(CLASS, T1, T2) NO_COPY_CTR_T2(CLASS, T1, T2); NO_COPY_OP_T2(CLASS, T1, T2)
 
+#define CACHE_LINE_SIZE 64
+
 struct timespec;
 
 template<typename IntType>
@@ -60,6 +62,17 @@ namespace notstd {
         inline void lock() { }
         inline void unlock() { }
     };
+
+    // Value alone on its cache line. Use it for per-thread slots stored
+    // contiguously (e.g. indexed by omp_get_thread_num()) so that a write
+    // from one thread doesn't invalidate the line of its neighbours.
+    template<typename T>
+    struct alignas(CACHE_LINE_SIZE) padded {
+        padded() = default;
+        padded(T const& v) : value(v) { }
+
+        T value;
+    };
 }
 
 namespace Globals {